@@ -0,0 +1,499 @@
+//-------------------------------------------------------------------------------
+//! \file   cyBlockCompress.h
+//!
+//! \brief  CPU block compression of 8-bit RGBA images to BC1, BC3, BC4, BC5, and BC7.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_BLOCK_COMPRESS_H_INCLUDED_
+#define _CY_BLOCK_COMPRESS_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyParallel.h"
+#include <cmath>
+#include <limits>
+#include <utility>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! GPU texture formats of 4x4 texel blocks. The values are stored in cache files, so they must not change.
+enum BlockFormat : uint32_t {
+	BLOCK_NONE,	//!< Uncompressed 8-bit RGBA
+	BLOCK_BC1,	//!< RGB with 4 bits per texel (DXT1), the alpha channel is dropped
+	BLOCK_BC3,	//!< RGBA with 8 bits per texel (DXT5): BC1 colors and BC4 alpha
+	BLOCK_BC4,	//!< The red channel with 4 bits per texel (RGTC1), for height and displacement maps
+	BLOCK_BC5,	//!< The red and green channels with 8 bits per texel (RGTC2), for normal maps
+	BLOCK_BC7,	//!< RGBA with 8 bits per texel (BPTC), encoded with mode 6 only
+};
+
+//! Returns the name of the block format
+CY_NODISCARD inline char const * BlockFormatName( BlockFormat format )
+{
+	switch ( format ) {
+		case BLOCK_BC1: return "BC1";
+		case BLOCK_BC3: return "BC3";
+		case BLOCK_BC4: return "BC4";
+		case BLOCK_BC5: return "BC5";
+		case BLOCK_BC7: return "BC7";
+		default:        return "RGBA8";
+	}
+}
+
+//! Returns the number of bytes of a 4x4 block, or zero for uncompressed images
+CY_NODISCARD inline unsigned int BlockBytes( BlockFormat format ) { return format == BLOCK_NONE ? 0 : ( format == BLOCK_BC1 || format == BLOCK_BC4 ? 8 : 16 ); }
+
+//! Returns the number of RGBA channels that the block format keeps, starting from red
+CY_NODISCARD inline int BlockChannels( BlockFormat format ) { return format == BLOCK_BC4 ? 1 : format == BLOCK_BC5 ? 2 : format == BLOCK_BC1 ? 3 : 4; }
+
+//! Returns the size of an image in bytes. The blocks of compressed images cover the image, so partial blocks are counted fully.
+CY_NODISCARD inline size_t BlockImageSize( BlockFormat format, unsigned int width, unsigned int height )
+{
+	if ( format == BLOCK_NONE ) return size_t(width) * height * 4;
+	return size_t( (width+3)/4 ) * ( (height+3)/4 ) * BlockBytes(format);
+}
+
+//! Compresses an 8-bit RGBA image, top row first, to the given block format. The texels of partial blocks at the
+//! right and bottom edges are replicated. The block rows are compressed on multiple threads and, if numThreads
+//! is zero, all hardware threads are used. The result does not depend on the number of threads.
+inline void CompressBlocks( unsigned char *dst, unsigned char const *rgba, unsigned int width, unsigned int height, BlockFormat format, unsigned int numThreads=0 );
+
+//! Decompresses the blocks written by CompressBlocks to an 8-bit RGBA image. Only mode 6 of BC7 is decoded.
+//! The channels that the format does not keep are zero, except for alpha, which is 255.
+inline void DecompressBlocks( unsigned char *rgba, unsigned char const *src, unsigned int width, unsigned int height, BlockFormat format );
+
+//! Returns the peak signal-to-noise ratio in dB between two 8-bit RGBA images over the channels that the block
+//! format keeps. Returns infinity if the images are identical.
+CY_NODISCARD inline double ComputePSNR( unsigned char const *rgba0, unsigned char const *rgba1, unsigned int width, unsigned int height, BlockFormat format=BLOCK_NONE );
+
+//-------------------------------------------------------------------------------
+
+namespace bc {
+
+// Writes bits of a little-endian block, starting from the least significant bit
+struct BitWriter
+{
+	unsigned char *data;
+	unsigned int   pos = 0;
+	explicit BitWriter( unsigned char *d ) : data(d) {}
+	void Write( uint32_t value, unsigned int bits ) { for ( unsigned int i=0; i<bits; i++, pos++ ) data[pos>>3] |= (unsigned char)( ( (value>>i) & 1 ) << (pos&7) ); }
+};
+
+struct BitReader
+{
+	unsigned char const *data;
+	unsigned int         pos = 0;
+	explicit BitReader( unsigned char const *d ) : data(d) {}
+	uint32_t Read( unsigned int bits ) { uint32_t v=0; for ( unsigned int i=0; i<bits; i++, pos++ ) v |= uint32_t( ( data[pos>>3] >> (pos&7) ) & 1 ) << i; return v; }
+};
+
+// Copies the 4x4 block at the given block coordinates, replicating the edge texels
+inline void LoadBlock( unsigned char block[64], unsigned char const *rgba, unsigned int width, unsigned int height, unsigned int bx, unsigned int by )
+{
+	for ( unsigned int y=0; y<4; y++ ) {
+		unsigned char const *row = rgba + size_t( Min( by*4+y, height-1 ) ) * width * 4;
+		for ( unsigned int x=0; x<4; x++ ) memcpy( block + (y*4+x)*4, row + size_t( Min( bx*4+x, width-1 ) ) * 4, 4 );
+	}
+}
+
+// Finds the line through the given points with N channels that has the least squared distance to them. The
+// direction is the principal eigenvector of the covariance matrix, computed with power iterations. The
+// endpoints are the extreme projections of the points on the line.
+template <int N>
+inline void FitLine( float e0[N], float e1[N], float const points[16][N] )
+{
+	float mean[N] = {};
+	for ( int i=0; i<16; i++ ) for ( int c=0; c<N; c++ ) mean[c] += points[i][c];
+	for ( int c=0; c<N; c++ ) mean[c] /= 16;
+	float cov[N][N] = {};
+	for ( int i=0; i<16; i++ ) {
+		for ( int a=0; a<N; a++ ) for ( int b=a; b<N; b++ ) cov[a][b] += ( points[i][a] - mean[a] ) * ( points[i][b] - mean[b] );
+	}
+	for ( int a=0; a<N; a++ ) for ( int b=0; b<a; b++ ) cov[a][b] = cov[b][a];
+
+	// The iterations start from the covariance row of the channel with the largest variance, which cannot be
+	// orthogonal to the principal axis unless that channel is uncorrelated with it
+	int k = 0;
+	for ( int c=1; c<N; c++ ) if ( cov[c][c] > cov[k][k] ) k = c;
+	float axis[N];
+	for ( int c=0; c<N; c++ ) axis[c] = cov[k][c];
+	for ( int iter=0; iter<8; iter++ ) {
+		float next[N] = {};
+		for ( int a=0; a<N; a++ ) for ( int b=0; b<N; b++ ) next[a] += cov[a][b] * axis[b];
+		float len = 0;
+		for ( int c=0; c<N; c++ ) len = Max( len, std::abs(next[c]) );
+		if ( len < 1e-12f ) break;
+		for ( int c=0; c<N; c++ ) axis[c] = next[c] / len;
+	}
+	float len2 = 0;
+	for ( int c=0; c<N; c++ ) len2 += axis[c]*axis[c];
+	if ( len2 > 0 ) for ( int c=0; c<N; c++ ) axis[c] /= std::sqrt(len2);
+
+	float tMin = 0, tMax = 0;
+	for ( int i=0; i<16; i++ ) {
+		float t = 0;
+		for ( int c=0; c<N; c++ ) t += ( points[i][c] - mean[c] ) * axis[c];
+		tMin = Min( tMin, t );
+		tMax = Max( tMax, t );
+	}
+	for ( int c=0; c<N; c++ ) {
+		e0[c] = Clamp( mean[c] + axis[c]*tMin, 0.0f, 255.0f );
+		e1[c] = Clamp( mean[c] + axis[c]*tMax, 0.0f, 255.0f );
+	}
+}
+
+// Solves the endpoints that minimize the squared error of the given points, where point i is interpolated
+// between the endpoints with the weight w[i] of e1. Returns false if the weights do not determine the endpoints.
+template <int N>
+inline bool SolveEndpoints( float e0[N], float e1[N], float const points[16][N], float const w[16] )
+{
+	float aa=0, ab=0, bb=0, ax[N]={}, bx[N]={};
+	for ( int i=0; i<16; i++ ) {
+		float const a = 1 - w[i], b = w[i];
+		aa += a*a;
+		ab += a*b;
+		bb += b*b;
+		for ( int c=0; c<N; c++ ) { ax[c] += a*points[i][c]; bx[c] += b*points[i][c]; }
+	}
+	float const det = aa*bb - ab*ab;
+	if ( std::abs(det) < 1e-6f ) return false;
+	for ( int c=0; c<N; c++ ) {
+		e0[c] = Clamp( ( bb*ax[c] - ab*bx[c] ) / det, 0.0f, 255.0f );
+		e1[c] = Clamp( ( aa*bx[c] - ab*ax[c] ) / det, 0.0f, 255.0f );
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------
+// BC1
+
+inline uint16_t PackRGB565( float const c[3] )
+{
+	int const r = (int)( c[0] * 31 / 255 + 0.5f );
+	int const g = (int)( c[1] * 63 / 255 + 0.5f );
+	int const b = (int)( c[2] * 31 / 255 + 0.5f );
+	return (uint16_t)( (r << 11) | (g << 5) | b );
+}
+
+inline void UnpackRGB565( int c[3], uint16_t v )
+{
+	int const r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// The four colors of a BC1 block with color0 > color1; index 1 is color1 and indices 2 and 3 are in between
+inline void BC1Palette( int palette[4][3], uint16_t c0, uint16_t c1 )
+{
+	UnpackRGB565( palette[0], c0 );
+	UnpackRGB565( palette[1], c1 );
+	for ( int c=0; c<3; c++ ) {
+		palette[2][c] = ( 2*palette[0][c] +   palette[1][c] ) / 3;
+		palette[3][c] = (   palette[0][c] + 2*palette[1][c] ) / 3;
+	}
+}
+
+// Picks the nearest palette color of each texel and returns the total squared error
+inline int BC1Indices( int indices[16], float const points[16][3], uint16_t c0, uint16_t c1 )
+{
+	int palette[4][3];
+	BC1Palette( palette, c0, c1 );
+	int total = 0;
+	for ( int i=0; i<16; i++ ) {
+		int best = 0, bestErr = (std::numeric_limits<int>::max)();
+		for ( int p=0; p<4; p++ ) {
+			int err = 0;
+			for ( int c=0; c<3; c++ ) { int const d = (int)points[i][c] - palette[p][c]; err += d*d; }
+			if ( err < bestErr ) { bestErr = err; best = p; }
+		}
+		indices[i] = best;
+		total += bestErr;
+	}
+	return total;
+}
+
+// Encodes the RGB channels of a block with the four-color mode. The endpoints of the principal axis are
+// refined with least squares for the chosen indices, as long as the error decreases.
+inline void EncodeBC1( unsigned char out[8], unsigned char const block[64] )
+{
+	float points[16][3];
+	for ( int i=0; i<16; i++ ) for ( int c=0; c<3; c++ ) points[i][c] = block[i*4+c];
+	float e0[3], e1[3];
+	FitLine<3>( e0, e1, points );
+	uint16_t c0 = PackRGB565(e1), c1 = PackRGB565(e0);
+	int indices[16];
+	int err = BC1Indices( indices, points, c0, c1 );
+	static float const weights[4] = { 0, 1, 1.0f/3, 2.0f/3 };
+	for ( int iter=0; iter<2 && err>0; iter++ ) {
+		float w[16];
+		for ( int i=0; i<16; i++ ) w[i] = weights[ indices[i] ];
+		if ( !SolveEndpoints<3>( e0, e1, points, w ) ) break;
+		uint16_t const n0 = PackRGB565(e0), n1 = PackRGB565(e1);
+		int newIndices[16];
+		int const newErr = BC1Indices( newIndices, points, n0, n1 );
+		if ( newErr >= err ) break;
+		err = newErr;
+		c0 = n0;
+		c1 = n1;
+		memcpy( indices, newIndices, sizeof(indices) );
+	}
+
+	// color0 must be greater than color1 for the four-color mode; swapping them swaps indices 0-1 and 2-3
+	if ( c0 < c1 ) {
+		std::swap( c0, c1 );
+		for ( int i=0; i<16; i++ ) indices[i] ^= 1;
+	} else if ( c0 == c1 ) {
+		for ( int i=0; i<16; i++ ) indices[i] = 0;
+	}
+	uint32_t bits = 0;
+	for ( int i=0; i<16; i++ ) bits |= uint32_t( indices[i] ) << (2*i);
+	out[0] = (unsigned char)( c0 & 0xFF );
+	out[1] = (unsigned char)( c0 >> 8 );
+	out[2] = (unsigned char)( c1 & 0xFF );
+	out[3] = (unsigned char)( c1 >> 8 );
+	memcpy( out+4, &bits, 4 );
+}
+
+inline void DecodeBC1( unsigned char block[64], unsigned char const in[8] )
+{
+	uint16_t const c0 = uint16_t( in[0] | (in[1] << 8) );
+	uint16_t const c1 = uint16_t( in[2] | (in[3] << 8) );
+	int palette[4][3];
+	BC1Palette( palette, c0, c1 );
+	if ( c0 <= c1 ) for ( int c=0; c<3; c++ ) { palette[2][c] = ( palette[0][c] + palette[1][c] ) / 2; palette[3][c] = 0; }
+	uint32_t bits;
+	memcpy( &bits, in+4, 4 );
+	for ( int i=0; i<16; i++ ) {
+		int const p = ( bits >> (2*i) ) & 3;
+		for ( int c=0; c<3; c++ ) block[i*4+c] = (unsigned char) palette[p][c];
+	}
+}
+
+//-------------------------------------------------------------------------------
+// BC4
+
+inline void BC4Palette( int palette[8], int e0, int e1 )
+{
+	palette[0] = e0;
+	palette[1] = e1;
+	if ( e0 > e1 ) {
+		for ( int i=1; i<7; i++ ) palette[i+1] = ( (7-i)*e0 + i*e1 + 3 ) / 7;
+	} else {
+		for ( int i=1; i<5; i++ ) palette[i+1] = ( (5-i)*e0 + i*e1 + 2 ) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+// Encodes one channel of a block, given with a stride of 4 bytes, with the eight-value mode between the
+// minimum and the maximum
+inline void EncodeBC4( unsigned char out[8], unsigned char const *values )
+{
+	int lo = 255, hi = 0;
+	for ( int i=0; i<16; i++ ) { lo = Min( lo, (int)values[i*4] ); hi = Max( hi, (int)values[i*4] ); }
+	out[0] = (unsigned char) hi;
+	out[1] = (unsigned char) lo;
+	uint64_t bits = 0;
+	if ( hi > lo ) {
+		int palette[8];
+		BC4Palette( palette, hi, lo );
+		for ( int i=0; i<16; i++ ) {
+			int best = 0, bestErr = 256;
+			for ( int p=0; p<8; p++ ) {
+				int const err = std::abs( (int)values[i*4] - palette[p] );
+				if ( err < bestErr ) { bestErr = err; best = p; }
+			}
+			bits |= uint64_t(best) << (3*i);
+		}
+	}
+	for ( int i=0; i<6; i++ ) out[2+i] = (unsigned char)( bits >> (8*i) );
+}
+
+inline void DecodeBC4( unsigned char *values, unsigned char const in[8] )
+{
+	int palette[8];
+	BC4Palette( palette, in[0], in[1] );
+	uint64_t bits = 0;
+	for ( int i=0; i<6; i++ ) bits |= uint64_t( in[2+i] ) << (8*i);
+	for ( int i=0; i<16; i++ ) values[i*4] = (unsigned char) palette[ ( bits >> (3*i) ) & 7 ];
+}
+
+//-------------------------------------------------------------------------------
+// BC7 mode 6: one subset, 7-bit RGBA endpoints with a p-bit each, and 4-bit indices
+
+int const bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Quantizes an endpoint to 7 bits per channel and picks the shared p-bit with the smaller error
+inline void BC7QuantizeEndpoint( int q[4], int &pbit, float const e[4] )
+{
+	float bestErr = (std::numeric_limits<float>::max)();
+	for ( int p=0; p<2; p++ ) {
+		int   v  [4];
+		float err = 0;
+		for ( int c=0; c<4; c++ ) {
+			v[c] = Clamp( (int)std::floor( ( e[c] - p ) / 2 + 0.5f ), 0, 127 );
+			float const d = float( (v[c] << 1) | p ) - e[c];
+			err += d*d;
+		}
+		if ( err < bestErr ) { bestErr = err; pbit = p; memcpy( q, v, sizeof(v) ); }
+	}
+}
+
+inline void BC7Palette( int palette[16][4], int const q0[4], int p0, int const q1[4], int p1 )
+{
+	for ( int c=0; c<4; c++ ) {
+		int const a = (q0[c] << 1) | p0, b = (q1[c] << 1) | p1;
+		for ( int i=0; i<16; i++ ) palette[i][c] = ( (64-bc7Weights[i])*a + bc7Weights[i]*b + 32 ) >> 6;
+	}
+}
+
+inline int BC7Indices( int indices[16], float const points[16][4], int const q0[4], int p0, int const q1[4], int p1 )
+{
+	int palette[16][4];
+	BC7Palette( palette, q0, p0, q1, p1 );
+	int total = 0;
+	for ( int i=0; i<16; i++ ) {
+		int best = 0, bestErr = (std::numeric_limits<int>::max)();
+		for ( int p=0; p<16; p++ ) {
+			int err = 0;
+			for ( int c=0; c<4; c++ ) { int const d = (int)points[i][c] - palette[p][c]; err += d*d; }
+			if ( err < bestErr ) { bestErr = err; best = p; }
+		}
+		indices[i] = best;
+		total += bestErr;
+	}
+	return total;
+}
+
+inline void EncodeBC7( unsigned char out[16], unsigned char const block[64] )
+{
+	float points[16][4];
+	for ( int i=0; i<16; i++ ) for ( int c=0; c<4; c++ ) points[i][c] = block[i*4+c];
+	float e0[4], e1[4];
+	FitLine<4>( e0, e1, points );
+	int q0[4], q1[4], p0=0, p1=0, indices[16];
+	BC7QuantizeEndpoint( q0, p0, e0 );
+	BC7QuantizeEndpoint( q1, p1, e1 );
+	int err = BC7Indices( indices, points, q0, p0, q1, p1 );
+	for ( int iter=0; iter<2 && err>0; iter++ ) {
+		float w[16];
+		for ( int i=0; i<16; i++ ) w[i] = bc7Weights[ indices[i] ] / 64.0f;
+		if ( !SolveEndpoints<4>( e0, e1, points, w ) ) break;
+		int n0[4], n1[4], np0=0, np1=0, newIndices[16];
+		BC7QuantizeEndpoint( n0, np0, e0 );
+		BC7QuantizeEndpoint( n1, np1, e1 );
+		int const newErr = BC7Indices( newIndices, points, n0, np0, n1, np1 );
+		if ( newErr >= err ) break;
+		err = newErr;
+		memcpy( q0, n0, sizeof(q0) ); p0 = np0;
+		memcpy( q1, n1, sizeof(q1) ); p1 = np1;
+		memcpy( indices, newIndices, sizeof(indices) );
+	}
+
+	// The most significant bit of the first index is implied to be zero; swapping the endpoints inverts the indices
+	if ( indices[0] >= 8 ) {
+		for ( int c=0; c<4; c++ ) std::swap( q0[c], q1[c] );
+		std::swap( p0, p1 );
+		for ( int i=0; i<16; i++ ) indices[i] = 15 - indices[i];
+	}
+	memset( out, 0, 16 );
+	BitWriter bits( out );
+	bits.Write( 1 << 6, 7 );
+	for ( int c=0; c<4; c++ ) { bits.Write( q0[c], 7 ); bits.Write( q1[c], 7 ); }
+	bits.Write( p0, 1 );
+	bits.Write( p1, 1 );
+	bits.Write( indices[0], 3 );
+	for ( int i=1; i<16; i++ ) bits.Write( indices[i], 4 );
+}
+
+inline void DecodeBC7( unsigned char block[64], unsigned char const in[16] )
+{
+	BitReader bits( in );
+	if ( bits.Read(7) != (1 << 6) ) { memset( block, 0, 64 ); return; }
+	int q0[4], q1[4];
+	for ( int c=0; c<4; c++ ) { q0[c] = (int) bits.Read(7); q1[c] = (int) bits.Read(7); }
+	int const p0 = (int) bits.Read(1);
+	int const p1 = (int) bits.Read(1);
+	int palette[16][4];
+	BC7Palette( palette, q0, p0, q1, p1 );
+	for ( int i=0; i<16; i++ ) {
+		int const index = (int) bits.Read( i == 0 ? 3 : 4 );
+		for ( int c=0; c<4; c++ ) block[i*4+c] = (unsigned char) palette[index][c];
+	}
+}
+
+} // namespace bc
+
+//-------------------------------------------------------------------------------
+
+inline void CompressBlocks( unsigned char *dst, unsigned char const *rgba, unsigned int width, unsigned int height, BlockFormat format, unsigned int numThreads )
+{
+	if ( format == BLOCK_NONE ) { memcpy( dst, rgba, BlockImageSize( format, width, height ) ); return; }
+	unsigned int const blocksX = (width+3)/4, blocksY = (height+3)/4;
+	unsigned int const blockBytes = BlockBytes(format);
+	// Small images are not worth the threads
+	if ( size_t(width)*height < 64*64 ) numThreads = 1;
+	ParallelFor( blocksY, [&]( unsigned int by ) {
+		unsigned char block[64];
+		unsigned char *out = dst + size_t(by) * blocksX * blockBytes;
+		for ( unsigned int bx=0; bx<blocksX; bx++, out+=blockBytes ) {
+			bc::LoadBlock( block, rgba, width, height, bx, by );
+			switch ( format ) {
+				case BLOCK_BC1: bc::EncodeBC1( out, block ); break;
+				case BLOCK_BC3: bc::EncodeBC4( out, block+3 ); bc::EncodeBC1( out+8, block ); break;
+				case BLOCK_BC4: bc::EncodeBC4( out, block ); break;
+				case BLOCK_BC5: bc::EncodeBC4( out, block ); bc::EncodeBC4( out+8, block+1 ); break;
+				case BLOCK_BC7: bc::EncodeBC7( out, block ); break;
+				default: break;
+			}
+		}
+	}, numThreads );
+}
+
+inline void DecompressBlocks( unsigned char *rgba, unsigned char const *src, unsigned int width, unsigned int height, BlockFormat format )
+{
+	if ( format == BLOCK_NONE ) { memcpy( rgba, src, BlockImageSize( format, width, height ) ); return; }
+	unsigned int const blocksX = (width+3)/4, blocksY = (height+3)/4;
+	unsigned int const blockBytes = BlockBytes(format);
+	for ( unsigned int by=0; by<blocksY; by++ ) {
+		for ( unsigned int bx=0; bx<blocksX; bx++, src+=blockBytes ) {
+			unsigned char block[64];
+			for ( int i=0; i<16; i++ ) { block[i*4] = block[i*4+1] = block[i*4+2] = 0; block[i*4+3] = 255; }
+			switch ( format ) {
+				case BLOCK_BC1: bc::DecodeBC1( block, src ); break;
+				case BLOCK_BC3: bc::DecodeBC4( block+3, src ); bc::DecodeBC1( block, src+8 ); break;
+				case BLOCK_BC4: bc::DecodeBC4( block, src ); break;
+				case BLOCK_BC5: bc::DecodeBC4( block, src ); bc::DecodeBC4( block+1, src+8 ); break;
+				case BLOCK_BC7: bc::DecodeBC7( block, src ); break;
+				default: break;
+			}
+			for ( unsigned int y=0; y<4 && by*4+y<height; y++ ) {
+				unsigned int const n = Min( 4u, width - bx*4 );
+				memcpy( rgba + ( size_t(by*4+y)*width + bx*4 ) * 4, block + y*16, n*4 );
+			}
+		}
+	}
+}
+
+inline double ComputePSNR( unsigned char const *rgba0, unsigned char const *rgba1, unsigned int width, unsigned int height, BlockFormat format )
+{
+	int const channels = BlockChannels(format);
+	size_t const numTexels = size_t(width) * height;
+	uint64_t sum = 0;
+	for ( size_t i=0; i<numTexels; i++ ) {
+		for ( int c=0; c<channels; c++ ) { int const d = (int)rgba0[i*4+c] - (int)rgba1[i*4+c]; sum += uint64_t(d*d); }
+	}
+	if ( sum == 0 || numTexels == 0 ) return std::numeric_limits<double>::infinity();
+	double const mse = double(sum) / ( double(numTexels) * channels );
+	return 10 * std::log10( 255.0 * 255.0 / mse );
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+#endif
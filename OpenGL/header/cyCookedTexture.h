@@ -0,0 +1,519 @@
+//-------------------------------------------------------------------------------
+//! \file   cyCookedTexture.h
+//!
+//! \brief  GPU-ready textures with precomputed mipmaps (.cytex files), optionally block compressed.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_COOKED_TEXTURE_H_INCLUDED_
+#define _CY_COOKED_TEXTURE_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyMappedFile.h"
+#include "cyHash.h"
+#include "cyParallel.h"
+#include "cyBlockCompress.h"
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__) || ( defined(_M_IX86_FP) && _M_IX86_FP >= 2 )
+# define _CY_COOKED_TEXTURE_SSE2
+# include <emmintrin.h>
+#endif
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! A texture with its full mipmap chain, cooked on the CPU and stored in a cache file.
+//!
+//! Build() computes the mipmap levels from the original image with a box or a Kaiser-windowed sinc
+//! filter. Each level is filtered from the previous one in floating point, and the color channels of
+//! sRGB textures are filtered in linear space. The filter uses SSE2 and the rows of each level are
+//! filtered on multiple threads. A cache file holds all levels (like a KTX2 file with a single
+//! uncompressed format), so that the texture storage can be created with the right number of levels
+//! and each level can be uploaded directly from the mapped file.
+//!
+//! The levels are 8-bit RGBA, or they are block compressed after all levels are filtered. Compressed sRGB
+//! textures are compressed in sRGB space, since the GPU decodes the blocks before converting to linear.
+//! The PSNR of the first compressed level is stored with the levels, so that the quality can be reported
+//! without decoding the blocks again.
+//!
+//! The cooked data depends only on the source image and the cook settings, not on the number of
+//! threads, and the cache file is keyed on the size and the hash of the source file, not on its time.
+//! So, a cache file is byte-for-byte reproducible and it can be cached by the hash of its content.
+
+class CookedTexture
+{
+public:
+	//! Mipmap filters
+	enum Filter : uint32_t {
+		FILTER_BOX,		//!< 2x2 average (area average for odd sizes)
+		FILTER_KAISER,	//!< Kaiser-windowed sinc with a radius of 3 texels of the smaller level, which keeps more detail
+	};
+
+	CookedTexture() {}
+	CookedTexture( CookedTexture const & ) CY_CLASS_FUNCTION_DELETE
+	CookedTexture& operator = ( CookedTexture const & ) CY_CLASS_FUNCTION_DELETE
+
+	//!@name Creating and storing the cooked texture
+	bool Load ( char const *cacheFile, char const *sourceFile, bool srgb, BlockFormat format=BLOCK_NONE, Filter filter=FILTER_KAISER );	//!< Maps the cache file. Returns false if the cache file does not exist, is invalid, does not match the current source file, or it is cooked with different settings. If sourceFile is null, the source file is not checked, which is meant for loading a cache file again.
+	void Build( unsigned char const *rgba, unsigned int width, unsigned int height, bool srgb, BlockFormat format=BLOCK_NONE, Filter filter=FILTER_KAISER, unsigned int numThreads=0 );	//!< Builds all mipmap levels of the given 8-bit RGBA image, top row first, and compresses them to the given format. If numThreads is zero, all hardware threads are used.
+	bool Save ( char const *cacheFile, char const *sourceFile ) const;	//!< Writes all levels to a file, keyed on the given source file.
+	void Clear();														//!< Releases all data
+
+	//! Returns the cache file name for the given source file by replacing its extension with .cytex, prefixed with the block format (like .bc7.cytex) for compressed textures and with .srgb for sRGB textures.
+	static std::string GetCacheFileName( char const *sourceFile, bool srgb, BlockFormat format=BLOCK_NONE )
+	{
+		std::string ext = format == BLOCK_NONE ? std::string() : std::string(".") + BlockFormatName(format);
+		for ( char &c : ext ) c = (char) tolower(c);
+		return std::filesystem::path(sourceFile).replace_extension( ext + ( srgb ? ".srgb.cytex" : ".cytex" ) ).string();
+	}
+
+	//!@name Access methods
+	bool                 IsMapped () const { return file.IsOpen(); }	//!< Returns true if the data is read from a mapped cache file
+	bool                 IsSRGB   () const { return srgb; }				//!< Returns true if the color channels are sRGB encoded
+	Filter               GetFilter() const { return filter; }			//!< Returns the mipmap filter
+	BlockFormat          GetFormat() const { return format; }			//!< Returns the block format of the levels, BLOCK_NONE for 8-bit RGBA
+	double               GetPSNR  () const { return psnr; }				//!< Returns the PSNR of the first level after block compression in dB, infinity for uncompressed textures
+	unsigned int         NumLevels() const { return (unsigned int) levels.size(); }	//!< Returns the number of mipmap levels, zero if there is no texture
+	unsigned int         Width    ( int level=0 ) const { return Max( width  >> level, 1u ); }	//!< Returns the width of the given level
+	unsigned int         Height   ( int level=0 ) const { return Max( height >> level, 1u ); }	//!< Returns the height of the given level
+	unsigned char const* LevelData( int level ) const { return levels[level]; }	//!< Returns the RGBA pixels or the blocks of the given level, top row first
+	size_t               LevelSize( int level ) const { return BlockImageSize( format, Width(level), Height(level) ); }	//!< Returns the size of the given level in bytes
+	size_t               DataSize () const { size_t s=0; for ( unsigned int l=0; l<NumLevels(); l++ ) s += LevelSize(l); return s; }	//!< Returns the size of all levels in bytes
+	size_t               RGBASize () const { size_t s=0; for ( unsigned int l=0; l<NumLevels(); l++ ) s += size_t(Width(l)) * Height(l) * 4; return s; }	//!< Returns the size of all levels as uncompressed 8-bit RGBA
+	size_t               FileSize () const { return file.Size(); }		//!< Returns the size of the mapped cache file
+
+private:
+	static uint32_t const version = 2;
+	enum Flags : uint32_t { FLAG_SRGB=1 };
+	static size_t const alignment = 64;
+	static unsigned int const maxSize = 1u << 15;
+
+	struct Header
+	{
+		char     magic[8];
+		uint32_t version;
+		uint32_t flags;
+		uint32_t filter;
+		uint32_t width;
+		uint32_t height;
+		uint32_t numLevels;
+		uint32_t format;
+		float    psnr;
+		uint64_t sourceSize;
+		uint64_t sourceHash;
+	};
+	struct Level
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	MappedFile                         file;
+	unsigned int                       width  = 0;
+	unsigned int                       height = 0;
+	bool                               srgb   = false;
+	Filter                             filter = FILTER_KAISER;
+	BlockFormat                        format = BLOCK_NONE;
+	double                             psnr   = std::numeric_limits<double>::infinity();
+	std::vector<unsigned char const *> levels;
+	std::vector<unsigned char>         pixels;	// used when the data is not mapped
+
+	static unsigned int CountLevels( unsigned int w, unsigned int h ) { unsigned int n=1; while ( (w|h) > 1 ) { w>>=1; h>>=1; n++; } return n; }
+	static bool GetSourceKey( char const *sourceFile, Header &header );
+	void Compress( BlockFormat blockFormat, unsigned int numThreads );
+
+	// Filter taps for resampling one axis: dst texel i is the sum of weight[i*n+k] * src[index[i*n+k]]
+	struct Taps
+	{
+		unsigned int       n = 0;
+		std::vector<int>   index;
+		std::vector<float> weight;
+	};
+	static void MakeTaps( Taps &taps, unsigned int srcSize, unsigned int dstSize, Filter filter );
+	static void FilterRow( float *dst, float const *src, Taps const &taps, unsigned int dstWidth );
+	static void FilterColumns( float *dst, float const * const *rows, float const *weights, unsigned int n, size_t count );
+
+	// Conversion tables between 8-bit values and linear values
+	static int const srgbNumBuckets = 4096;	// fine enough that each bucket contains at most one threshold
+	struct EncodeTables
+	{
+		float         srgbToLinear[256];
+		float         srgbThresholds[256];	// the linear value at the middle of each pair of successive sRGB values, and 2 at the end
+		unsigned char srgbBuckets[srgbNumBuckets+1];	// the sRGB value of the linear values i/srgbNumBuckets
+	};
+	static EncodeTables const & GetEncodeTables();
+	static unsigned char EncodeSRGB  ( float v, EncodeTables const &tables );
+	static unsigned char EncodeLinear( float v ) { return (unsigned char)( v * 255.0f + 0.5f ); }
+};
+
+//-------------------------------------------------------------------------------
+
+// Fills in the source size and hash of the header. Returns false if the source file cannot be read.
+inline bool CookedTexture::GetSourceKey( char const *sourceFile, Header &header )
+{
+	MappedFile source;
+	if ( !source.Open(sourceFile) ) return false;
+	header.sourceSize = source.Size();
+	header.sourceHash = Hash64( source.Data(), source.Size() );
+	return true;
+}
+
+inline CookedTexture::EncodeTables const & CookedTexture::GetEncodeTables()
+{
+	static EncodeTables const tables = []() {
+		auto toLinear = []( double c ) { return c <= 0.04045 ? c / 12.92 : std::pow( (c + 0.055) / 1.055, 2.4 ); };
+		EncodeTables t;
+		for ( int i=0; i<256; i++ ) t.srgbToLinear  [i] = (float) toLinear( i / 255.0 );
+		for ( int i=0; i<255; i++ ) t.srgbThresholds[i] = (float) toLinear( (i + 0.5) / 255.0 );
+		t.srgbThresholds[255] = 2;
+		for ( int b=0, c=0; b<=srgbNumBuckets; b++ ) {
+			float const v = float(b) / srgbNumBuckets;
+			while ( v >= t.srgbThresholds[c] ) c++;
+			t.srgbBuckets[b] = (unsigned char) c;
+		}
+		return t;
+	}();
+	return tables;
+}
+
+// Returns the sRGB value that is closest to the given linear value in [0,1] in sRGB space, which is the
+// number of thresholds below the value. The bucket of the value gives the number of thresholds below the
+// start of the bucket, so at most one more threshold can be below the value.
+inline unsigned char CookedTexture::EncodeSRGB( float v, EncodeTables const &tables )
+{
+	int c = tables.srgbBuckets[ (int)( v * srgbNumBuckets ) ];
+	c += v >= tables.srgbThresholds[c];
+	return (unsigned char) c;
+}
+
+inline void CookedTexture::MakeTaps( Taps &taps, unsigned int srcSize, unsigned int dstSize, Filter filter )
+{
+	taps.index .resize( dstSize );
+	taps.weight.resize( dstSize );
+	if ( srcSize == dstSize ) {
+		taps.n = 1;
+		for ( unsigned int i=0; i<dstSize; i++ ) { taps.index[i] = (int) i; taps.weight[i] = 1.0f; }
+		return;
+	}
+
+	double const kaiserWidth = 3;
+	double const kaiserAlpha = 4;
+	auto besselI0 = []( double x ) {
+		double sum = 1, term = 1, y = x*x / 4;
+		for ( int k=1; term > sum * 1e-16; k++ ) { term *= y / (double(k)*k); sum += term; }
+		return sum;
+	};
+	double const i0Alpha = besselI0( kaiserAlpha );
+	auto kaiser = [&]( double x ) {
+		if ( std::abs(x) >= kaiserWidth ) return 0.0;
+		double const t = x / kaiserWidth;
+		double const sinc = x == 0 ? 1.0 : std::sin( Pi<double>()*x ) / ( Pi<double>()*x );
+		return sinc * besselI0( kaiserAlpha * std::sqrt( 1 - t*t ) ) / i0Alpha;
+	};
+
+	// The filter is scaled to the source texels; source texel j covers [j,j+1] and dst texel i is centered at (i+0.5)*scale
+	double const scale  = double(srcSize) / dstSize;
+	double const radius = ( filter == FILTER_BOX ? 0.5 : kaiserWidth ) * scale;
+	unsigned int const maxTaps = (unsigned int) std::ceil( 2*radius ) + 1;
+	std::vector<double> w( size_t(dstSize) * maxTaps );
+	std::vector<int>    first( dstSize );
+	unsigned int n = 1;
+	for ( unsigned int i=0; i<dstSize; i++ ) {
+		double const c = ( i + 0.5 ) * scale;
+		first[i] = (int) std::floor( c - radius );
+		double sum = 0;
+		for ( unsigned int k=0; k<maxTaps; k++ ) {
+			double const j = first[i] + double(k);
+			double &wk = w[ size_t(i)*maxTaps + k ];
+			if ( filter == FILTER_BOX ) wk = Max( 0.0, Min( j + 1, c + radius ) - Max( j, c - radius ) );
+			else                        wk = kaiser( ( j + 0.5 - c ) / scale );
+			sum += wk;
+			if ( wk != 0 ) n = Max( n, k+1 );
+		}
+		for ( unsigned int k=0; k<maxTaps; k++ ) w[ size_t(i)*maxTaps + k ] /= sum;
+	}
+	// texels outside of the source are clamped to the edge
+	taps.n = n;
+	taps.index .resize( size_t(dstSize) * n );
+	taps.weight.resize( size_t(dstSize) * n );
+	for ( unsigned int i=0; i<dstSize; i++ ) {
+		for ( unsigned int k=0; k<n; k++ ) {
+			taps.index [ size_t(i)*n + k ] = Clamp( first[i] + (int)k, 0, (int)srcSize - 1 );
+			taps.weight[ size_t(i)*n + k ] = (float) w[ size_t(i)*maxTaps + k ];
+		}
+	}
+}
+
+// Resamples a row of RGBA float texels. The SSE2 and scalar versions add the products in the same order, so they give
+// the same results. Two (SSE2) texels are filtered together, so that their additions do not wait for each other.
+inline void CookedTexture::FilterRow( float *dst, float const *src, Taps const &taps, unsigned int dstWidth )
+{
+	unsigned int x = 0;
+#ifdef _CY_COOKED_TEXTURE_SSE2
+	for ( ; x+2<=dstWidth; x+=2 ) {
+		int   const *index  = taps.index .data() + size_t(x)*taps.n;
+		float const *weight = taps.weight.data() + size_t(x)*taps.n;
+		__m128 acc0 = _mm_setzero_ps();
+		__m128 acc1 = _mm_setzero_ps();
+		for ( unsigned int k=0; k<taps.n; k++ ) {
+			acc0 = _mm_add_ps( acc0, _mm_mul_ps( _mm_loadu_ps( src + 4*index[k]          ), _mm_set1_ps( weight[k]          ) ) );
+			acc1 = _mm_add_ps( acc1, _mm_mul_ps( _mm_loadu_ps( src + 4*index[taps.n+k] ), _mm_set1_ps( weight[taps.n+k] ) ) );
+		}
+		_mm_storeu_ps( dst + 4*x,     acc0 );
+		_mm_storeu_ps( dst + 4*x + 4, acc1 );
+	}
+#endif
+	for ( ; x<dstWidth; x++ ) {
+		int   const *index  = taps.index .data() + size_t(x)*taps.n;
+		float const *weight = taps.weight.data() + size_t(x)*taps.n;
+		float acc[4] = { 0, 0, 0, 0 };
+		for ( unsigned int k=0; k<taps.n; k++ ) for ( int c=0; c<4; c++ ) acc[c] += src[ 4*index[k] + c ] * weight[k];
+		for ( int c=0; c<4; c++ ) dst[ 4*x + c ] = acc[c];
+	}
+}
+
+// Computes dst[i] as the weighted sum of rows[k][i] for the count floats of a row
+inline void CookedTexture::FilterColumns( float *dst, float const * const *rows, float const *weights, unsigned int n, size_t count )
+{
+	size_t i = 0;
+#ifdef _CY_COOKED_TEXTURE_SSE2
+	for ( ; i+16<=count; i+=16 ) {
+		__m128 acc[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+		for ( unsigned int k=0; k<n; k++ ) {
+			__m128 const w = _mm_set1_ps( weights[k] );
+			for ( int j=0; j<4; j++ ) acc[j] = _mm_add_ps( acc[j], _mm_mul_ps( _mm_loadu_ps( rows[k] + i + 4*j ), w ) );
+		}
+		for ( int j=0; j<4; j++ ) _mm_storeu_ps( dst + i + 4*j, acc[j] );
+	}
+#endif
+	for ( ; i<count; i++ ) {
+		float acc = 0;
+		for ( unsigned int k=0; k<n; k++ ) acc += rows[k][i] * weights[k];
+		dst[i] = acc;
+	}
+}
+
+inline void CookedTexture::Clear()
+{
+	file.Close();
+	width = height = 0;
+	srgb = false;
+	filter = FILTER_KAISER;
+	format = BLOCK_NONE;
+	psnr   = std::numeric_limits<double>::infinity();
+	levels.clear();
+	pixels.clear();
+	pixels.shrink_to_fit();
+}
+
+inline bool CookedTexture::Load( char const *cacheFile, char const *sourceFile, bool srgbTexture, BlockFormat blockFormat, Filter mipFilter )
+{
+	Clear();
+	if ( !file.Open(cacheFile) ) return false;
+
+	auto fail = [this]() { Clear(); return false; };
+
+	Header header;
+	if ( file.Size() < sizeof(Header) ) return fail();
+	memcpy( &header, file.Data(), sizeof(Header) );
+	if ( memcmp( header.magic, "CYTEX\0\0\0", 8 ) != 0 || header.version != version ) return fail();
+	if ( ( (header.flags & FLAG_SRGB) != 0 ) != srgbTexture || header.filter != mipFilter || header.format != blockFormat ) return fail();
+	if ( header.width == 0 || header.height == 0 || header.width > maxSize || header.height > maxSize ) return fail();
+	if ( header.numLevels != CountLevels( header.width, header.height ) ) return fail();
+	size_t tableEnd = sizeof(Header) + size_t(header.numLevels)*sizeof(Level);
+	if ( file.Size() < tableEnd ) return fail();
+
+	// Check the source file; the hash is only computed if the size matches
+	if ( sourceFile ) {
+		Header source;
+		std::error_code ec;
+		if ( header.sourceSize != (uint64_t) std::filesystem::file_size( sourceFile, ec ) || ec ) return fail();
+		if ( !GetSourceKey(sourceFile,source) || source.sourceHash != header.sourceHash ) return fail();
+	}
+
+	width  = header.width;
+	height = header.height;
+	srgb   = srgbTexture;
+	filter = mipFilter;
+	format = blockFormat;
+	psnr   = header.psnr;
+	levels.resize( header.numLevels );
+	for ( uint32_t l=0; l<header.numLevels; l++ ) {
+		Level level;
+		memcpy( &level, file.Data() + sizeof(Header) + l*sizeof(Level), sizeof(Level) );
+		if ( level.size != LevelSize(l) || level.offset > file.Size() || level.size > file.Size() - level.offset ) return fail();
+		levels[l] = (unsigned char const*)( file.Data() + level.offset );
+	}
+	return true;
+}
+
+inline void CookedTexture::Build( unsigned char const *rgba, unsigned int w, unsigned int h, bool srgbTexture, BlockFormat blockFormat, Filter mipFilter, unsigned int numThreads )
+{
+	Clear();
+	if ( w == 0 || h == 0 ) return;
+	width  = w;
+	height = h;
+	srgb   = srgbTexture;
+	filter = mipFilter;
+	unsigned int const numLevels = CountLevels( w, h );
+	levels.resize( numLevels );
+	pixels.resize( DataSize() );
+	size_t offset = 0;
+	for ( unsigned int l=0; l<numLevels; l++ ) {
+		levels[l] = pixels.data() + offset;
+		offset += LevelSize(l);
+	}
+	memcpy( pixels.data(), rgba, LevelSize(0) );
+	if ( numLevels == 1 ) { Compress( blockFormat, numThreads ); return; }
+
+	EncodeTables const &tables = GetEncodeTables();
+	float linearToFloat[256];
+	for ( int i=0; i<256; i++ ) linearToFloat[i] = i / 255.0f;
+	float const *colorToFloat = srgb ? tables.srgbToLinear : linearToFloat;
+
+	// Small levels are not worth the threads
+	auto threadsFor = [numThreads]( size_t numTexels ) { return numTexels < 64*64 ? 1u : numThreads; };
+
+	// The rows of each level are filtered in bands, so that the horizontally filtered rows of a band stay in the
+	// cache and the full-size intermediate images are not allocated. The first level is converted to floats row
+	// by row, and the other levels are filtered from the linear float texels of the previous level.
+	unsigned int const bandRows = 32;
+	std::vector<float> src, dst;
+	Taps tapsX, tapsY;
+	for ( unsigned int l=1; l<numLevels; l++ ) {
+		unsigned int const sw = Width (l-1), sh = Height(l-1);
+		unsigned int const dw = Width (l  ), dh = Height(l  );
+		MakeTaps( tapsX, sw, dw, filter );
+		MakeTaps( tapsY, sh, dh, filter );
+		if ( l+1 < numLevels ) dst.resize( size_t(dw)*dh*4 );
+		unsigned char *level = pixels.data() + ( levels[l] - levels[0] );
+		unsigned int const numBands = ( dh + bandRows - 1 ) / bandRows;
+		ParallelFor( numBands, [&]( unsigned int band ) {
+			unsigned int const y0 = band * bandRows;
+			unsigned int const y1 = Min( y0 + bandRows, dh );
+			int r0 = tapsY.index[ size_t(y0)*tapsY.n ], r1 = r0;
+			for ( size_t i=size_t(y0)*tapsY.n; i<size_t(y1)*tapsY.n; i++ ) { r0 = Min( r0, tapsY.index[i] ); r1 = Max( r1, tapsY.index[i] ); }
+			// horizontal pass of the source rows of the band
+			std::vector<float> filtered( size_t(r1-r0+1)*dw*4 ), row;
+			if ( l == 1 ) row.resize( size_t(sw)*4 );
+			for ( int r=r0; r<=r1; r++ ) {
+				float const *in = src.data() + size_t(r)*sw*4;
+				if ( l == 1 ) {
+					unsigned char const *texels = rgba + size_t(r)*sw*4;
+					for ( unsigned int x=0; x<sw; x++ ) {
+						for ( int c=0; c<3; c++ ) row[4*x+c] = colorToFloat[ texels[4*x+c] ];
+						row[4*x+3] = linearToFloat[ texels[4*x+3] ];
+					}
+					in = row.data();
+				}
+				FilterRow( filtered.data() + size_t(r-r0)*dw*4, in, tapsX, dw );
+			}
+			// vertical pass, then the texels are clamped, since the Kaiser filter can overshoot, and encoded
+			std::vector<float> out( size_t(dw)*4 );
+			for ( unsigned int y=y0; y<y1; y++ ) {
+				float const *rows[32];	// the scale is at most 3 (from 3 to 1 texel), so there are at most 19 taps
+				for ( unsigned int k=0; k<tapsY.n; k++ ) rows[k] = filtered.data() + size_t( tapsY.index[ size_t(y)*tapsY.n + k ] - r0 )*dw*4;
+				FilterColumns( out.data(), rows, tapsY.weight.data() + size_t(y)*tapsY.n, tapsY.n, size_t(dw)*4 );
+				unsigned char *texels = level + size_t(y)*dw*4;
+				for ( unsigned int x=0; x<dw; x++ ) {
+					for ( int c=0; c<4; c++ ) out[4*x+c] = Clamp( out[4*x+c], 0.0f, 1.0f );
+					for ( int c=0; c<3; c++ ) texels[4*x+c] = srgb ? EncodeSRGB( out[4*x+c], tables ) : EncodeLinear( out[4*x+c] );
+					texels[4*x+3] = EncodeLinear( out[4*x+3] );
+				}
+				if ( l+1 < numLevels ) memcpy( dst.data() + size_t(y)*dw*4, out.data(), size_t(dw)*4*sizeof(float) );
+			}
+		}, threadsFor( size_t(sw)*sh ) );
+		src.swap( dst );
+	}
+	Compress( blockFormat, numThreads );
+}
+
+// Compresses all 8-bit RGBA levels to the given block format and computes the PSNR of the first level
+inline void CookedTexture::Compress( BlockFormat blockFormat, unsigned int numThreads )
+{
+	if ( blockFormat == BLOCK_NONE ) return;
+	std::vector<unsigned char> rgba;
+	rgba.swap( pixels );
+	std::vector<unsigned char const *> rgbaLevels = levels;
+	format = blockFormat;
+	pixels.resize( DataSize() );
+	size_t offset = 0;
+	for ( unsigned int l=0; l<NumLevels(); l++ ) {
+		levels[l] = pixels.data() + offset;
+		CompressBlocks( pixels.data() + offset, rgbaLevels[l], Width(l), Height(l), format, numThreads );
+		offset += LevelSize(l);
+	}
+	std::vector<unsigned char> decoded( size_t(width)*height*4 );
+	DecompressBlocks( decoded.data(), levels[0], width, height, format );
+	psnr = ComputePSNR( rgbaLevels[0], decoded.data(), width, height, format );
+}
+
+inline bool CookedTexture::Save( char const *cacheFile, char const *sourceFile ) const
+{
+	if ( levels.empty() ) return false;
+
+	// The header is cleared with memset, so that the file does not contain uninitialized padding bytes
+	Header header;
+	memset( &header, 0, sizeof(Header) );
+	memcpy( header.magic, "CYTEX\0\0\0", 8 );
+	header.version   = version;
+	header.flags     = srgb ? uint32_t(FLAG_SRGB) : 0u;
+	header.filter    = filter;
+	header.width     = width;
+	header.height    = height;
+	header.numLevels = NumLevels();
+	header.format    = format;
+	header.psnr      = (float) psnr;
+	if ( !GetSourceKey(sourceFile,header) ) return false;
+
+	// Levels are aligned, so that the data can be accessed directly from the mapped file
+	std::vector<Level> table( levels.size() );
+	uint64_t offset = sizeof(Header) + table.size()*sizeof(Level);
+	for ( size_t l=0; l<table.size(); l++ ) {
+		offset = (offset + alignment-1) & ~uint64_t(alignment-1);
+		table[l].offset = offset;
+		table[l].size   = LevelSize( (int)l );
+		offset += table[l].size;
+	}
+
+	// Write to a temporary file first, so that an interrupted write never leaves a partial cache file
+	std::string tmpFile = std::string(cacheFile) + ".tmp";
+	FILE *fp = fopen( tmpFile.c_str(), "wb" );
+	if ( !fp ) return false;
+	bool ok = fwrite( &header, sizeof(Header), 1, fp ) == 1 && fwrite( table.data(), sizeof(Level), table.size(), fp ) == table.size();
+	uint64_t pos = sizeof(Header) + table.size()*sizeof(Level);
+	char const zeros[alignment] = {};
+	for ( size_t l=0; ok && l<table.size(); l++ ) {
+		size_t pad = size_t( table[l].offset - pos );
+		if ( pad > 0 ) ok = fwrite( zeros, 1, pad, fp ) == pad;
+		if ( ok ) ok = fwrite( levels[l], 1, table[l].size, fp ) == table[l].size;
+		pos = table[l].offset + table[l].size;
+	}
+	ok = ( fclose(fp) == 0 ) && ok;
+	std::error_code ec;
+	if ( ok ) std::filesystem::rename( tmpFile, cacheFile, ec );
+	if ( !ok || ec ) {
+		std::filesystem::remove( tmpFile, ec );
+		return false;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::CookedTexture cyCookedTexture;	//!< GPU-ready 8-bit RGBA texture with precomputed mipmaps
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,205 @@
+//-------------------------------------------------------------------------------
+//! \file   cyFrameWriter.h
+//!
+//! \brief  Asynchronous PNG encoding of frame sequences on a pool of worker threads.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_FRAME_WRITER_H_INCLUDED_
+#define _CY_FRAME_WRITER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyParallel.h"
+#include "cyPngEncoder.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Statistics of a FrameWriter sequence
+struct FrameWriterStats
+{
+	unsigned int framesWritten = 0;		//!< number of frames written to files
+	unsigned int framesDropped = 0;		//!< number of frames dropped because too many frames were pending
+	unsigned int framesFailed  = 0;		//!< number of frames that could not be encoded or written
+	size_t       rawBytes      = 0;		//!< size of the written frames as RGBA pixels
+	size_t       fileBytes     = 0;		//!< size of the written files
+	double       encodeSeconds = 0;		//!< time spent encoding and writing, summed over the workers
+	double       elapsedSeconds= 0;		//!< time from the first queued frame until the last one was written
+
+	//! Returns the number of frames written per second of elapsed time
+	double FramesPerSecond() const { return elapsedSeconds > 0 ? framesWritten / elapsedSeconds : 0; }
+};
+
+//! Writes RGBA frames to numbered PNG files, encoding them with EncodePNG on a pool of worker threads.
+//!
+//! Start() begins a sequence of files named prefix000000.png, prefix000001.png, and so on. Write() queues a
+//! frame and returns immediately, so that the render loop does not wait for the encoding. If the workers fall
+//! behind by more than the maximum number of pending frames, Write() drops the frame instead of waiting and the
+//! frame number is not used. The writer does not use OpenGL, so the worker threads do not need a GL context.
+
+class FrameWriter
+{
+public:
+	//! Starts the worker threads. If numThreads is zero, all hardware threads are used.
+	explicit FrameWriter( unsigned int numThreads=0 )
+	{
+		if ( numThreads == 0 ) numThreads = NumHardwareThreads();
+		threads.reserve( numThreads );
+		for ( unsigned int t=0; t<numThreads; t++ ) threads.emplace_back( [this]() { Worker(); } );
+	}
+	FrameWriter( FrameWriter const & ) CY_CLASS_FUNCTION_DELETE
+	FrameWriter& operator = ( FrameWriter const & ) CY_CLASS_FUNCTION_DELETE
+
+	//! Writes the queued frames and stops the worker threads.
+	~FrameWriter()
+	{
+		Wait();
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stop = true;
+		}
+		jobReady.notify_all();
+		for ( std::thread &t : threads ) t.join();
+	}
+
+	//! Waits for the frames of the current sequence, then starts a new sequence with the given file name prefix and
+	//! effort. The directory of the prefix is created if needed. If alpha is false, RGB files are written.
+	void Start( std::string const &filePrefix, PngEffort pngEffort=PNG_FAST, bool writeAlpha=false )
+	{
+		Wait();
+		std::filesystem::path dir = std::filesystem::path( filePrefix ).parent_path();
+		std::error_code ec;
+		if ( !dir.empty() ) std::filesystem::create_directories( dir, ec );
+		std::lock_guard<std::mutex> lock( mutex );
+		prefix    = filePrefix;
+		effort    = pngEffort;
+		alpha     = writeAlpha;
+		nextFrame = 0;
+		stats     = FrameWriterStats();
+	}
+
+	//! Queues a frame of width*height RGBA pixels. If bottomUp is true, the first row is the bottom row, as
+	//! glReadPixels returns it. Returns the frame number, or -1 if the frame is dropped.
+	int Write( std::vector<unsigned char> &&rgba, unsigned int width, unsigned int height, bool bottomUp=false )
+	{
+		Job job;
+		job.rgba     = std::move( rgba );
+		job.width    = width;
+		job.height   = height;
+		job.bottomUp = bottomUp;
+		unsigned int frame;
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			if ( numPending >= maxPending ) { stats.framesDropped++; return -1; }
+			if ( nextFrame == 0 ) startTime = std::chrono::steady_clock::now();
+			frame      = nextFrame++;
+			job.frame  = frame;
+			job.path   = FileName( job.frame );
+			job.effort = effort;
+			job.alpha  = alpha;
+			jobs.push_back( std::move(job) );
+			numPending++;
+		}
+		jobReady.notify_one();
+		return (int) frame;
+	}
+
+	//! Waits until all queued frames are written.
+	void Wait() { std::unique_lock<std::mutex> lock( mutex ); frameDone.wait( lock, [this]() { return numPending == 0; } ); }
+
+	//! Sets the maximum number of frames that are queued or being encoded before Write() drops frames.
+	void SetMaxPending( unsigned int n ) { std::lock_guard<std::mutex> lock( mutex ); maxPending = Max( n, 1u ); }
+
+	unsigned int     NumPending() const { std::lock_guard<std::mutex> lock( mutex ); return numPending; }	//!< Returns the number of frames that are not written yet
+	FrameWriterStats GetStats  () const { std::lock_guard<std::mutex> lock( mutex ); return stats; }		//!< Returns the statistics of the current sequence
+	PngEffort        GetEffort () const { std::lock_guard<std::mutex> lock( mutex ); return effort; }		//!< Returns the effort of the current sequence
+	unsigned int     NumThreads() const { return (unsigned int) threads.size(); }							//!< Returns the number of worker threads
+
+private:
+	struct Job
+	{
+		std::vector<unsigned char> rgba;
+		std::string  path;
+		unsigned int frame    = 0;
+		unsigned int width    = 0;
+		unsigned int height   = 0;
+		bool         bottomUp = false;
+		bool         alpha    = false;
+		PngEffort    effort   = PNG_FAST;
+	};
+
+	mutable std::mutex       mutex;
+	std::condition_variable  jobReady;		// signaled when a frame is queued or the writer stops
+	std::condition_variable  frameDone;		// signaled when a frame is written
+	std::deque<Job>          jobs;			// frames to encode
+	std::string              prefix     = "frame";
+	PngEffort                effort     = PNG_FAST;
+	bool                     alpha      = false;
+	unsigned int             nextFrame  = 0;
+	unsigned int             numPending = 0;
+	unsigned int             maxPending = 8;
+	bool                     stop       = false;
+	FrameWriterStats         stats;
+	std::chrono::steady_clock::time_point startTime;
+	std::vector<std::thread> threads;
+
+	std::string FileName( unsigned int frame ) const
+	{
+		char number[16];
+		snprintf( number, sizeof(number), "%06u", frame );
+		return prefix + number + ".png";
+	}
+
+	void Worker()
+	{
+		std::vector<unsigned char> png;
+		for (;;) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				jobReady.wait( lock, [this]() { return stop || !jobs.empty(); } );
+				if ( stop ) return;
+				job = std::move( jobs.front() );
+				jobs.pop_front();
+			}
+			auto const t0 = std::chrono::steady_clock::now();
+			bool ok = job.width > 0 && job.height > 0 && job.rgba.size() >= size_t(job.width) * job.height * 4;
+			if ( ok ) ok = EncodePNG( png, job.rgba.data(), job.width, job.height, job.effort, job.bottomUp, job.alpha ) == 0;
+			if ( ok ) ok = lodepng::save_file( png, job.path ) == 0;
+			auto const t1 = std::chrono::steady_clock::now();
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				if ( ok ) {
+					stats.framesWritten++;
+					stats.rawBytes  += size_t(job.width) * job.height * 4;
+					stats.fileBytes += png.size();
+				} else stats.framesFailed++;
+				stats.encodeSeconds += std::chrono::duration<double>( t1 - t0 ).count();
+				stats.elapsedSeconds = std::chrono::duration<double>( t1 - startTime ).count();
+				numPending--;
+			}
+			frameDone.notify_all();
+		}
+	}
+};
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::FrameWriter cyFrameWriter;	//!< Asynchronous PNG encoding of frame sequences on a pool of worker threads
+
+//-------------------------------------------------------------------------------
+
+#endif
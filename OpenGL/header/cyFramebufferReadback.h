@@ -0,0 +1,183 @@
+//-------------------------------------------------------------------------------
+//! \file   cyFramebufferReadback.h
+//!
+//! \brief  Asynchronous framebuffer readback through a ring of pixel pack buffers.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_FRAMEBUFFER_READBACK_H_INCLUDED_
+#define _CY_FRAMEBUFFER_READBACK_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyGL.h"
+#include <deque>
+#include <functional>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Reads back framebuffer pixels without stalling the pipeline, using a ring of GL_PIXEL_PACK_BUFFERs.
+//!
+//! Capture() issues glReadPixels to the next buffer of the ring and inserts a fence after it, so it returns
+//! without waiting for the GPU. Poll(), called once per frame, checks the fences in capture order and hands
+//! the pixels of the finished captures to the callback, typically a few frames later. If all buffers are still
+//! in flight, Capture() skips the frame instead of waiting. The buffers are allocated with glNamedBufferStorage
+//! and stay mapped for reading. All functions must be called from the thread of the OpenGL context.
+
+class FramebufferReadback
+{
+public:
+	//! A finished capture. The pixels are RGBA, bottom row first, and they are valid only during the callback.
+	struct Frame
+	{
+		unsigned char const *pixels = nullptr;	//!< width*height*4 bytes
+		unsigned int         width  = 0;		//!< width of the captured rectangle
+		unsigned int         height = 0;		//!< height of the captured rectangle
+		uint64_t             frame  = 0;		//!< the frame number given to Capture()
+		unsigned int         delay  = 0;		//!< number of Poll() calls between the capture and the delivery
+	};
+	typedef std::function<void( Frame const & )> Callback;
+
+	FramebufferReadback() = default;
+	FramebufferReadback( FramebufferReadback const & ) CY_CLASS_FUNCTION_DELETE
+	FramebufferReadback& operator = ( FramebufferReadback const & ) CY_CLASS_FUNCTION_DELETE
+	~FramebufferReadback() { if ( GL::CheckContext() ) Delete(); }	//!< Destructor that deletes the buffers
+
+	//! Sets the number of buffers in the ring, at least two, and the callback that receives the captured pixels.
+	//! The buffers are allocated by the first capture and reallocated when the captured size changes.
+	void Create( unsigned int numBuffers, Callback const &callback )
+	{
+		Delete();
+		slots.resize( Max( numBuffers, 2u ) );
+		onFrame = callback;
+	}
+
+	//! Discards the captures in flight and deletes the buffers.
+	void Delete()
+	{
+		for ( Slot &s : slots ) FreeSlot( s );
+		slots.clear();
+		pending.clear();
+		next = 0;
+	}
+
+	//! Reads the given rectangle of the read buffer of the given framebuffer (zero for the default framebuffer)
+	//! into the next buffer of the ring. Returns false and skips the capture if that buffer is still in flight.
+	//! The GL_READ_FRAMEBUFFER and GL_PIXEL_PACK_BUFFER bindings are restored.
+	bool Capture( GLuint framebuffer, int x, int y, unsigned int width, unsigned int height, uint64_t frame )
+	{
+		if ( slots.empty() || width == 0 || height == 0 ) return false;
+		Slot &s = slots[next];
+		if ( s.fence ) { numSkipped++; return false; }
+		size_t const size = size_t(width) * height * 4;
+		if ( s.size != size ) {
+			FreeSlot( s );
+			glCreateBuffers( 1, &s.buffer );
+			GLbitfield const flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glNamedBufferStorage( s.buffer, (GLsizeiptr)size, nullptr, flags );
+			s.mapped = (unsigned char const*) glMapNamedBufferRange( s.buffer, 0, (GLsizeiptr)size, flags );
+			if ( !s.mapped ) { FreeSlot( s ); return false; }
+			s.size = size;
+		}
+		GLint prevRead = 0, prevPack = 0;
+		glGetIntegerv( GL_READ_FRAMEBUFFER_BINDING, &prevRead );
+		glGetIntegerv( GL_PIXEL_PACK_BUFFER_BINDING, &prevPack );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, framebuffer );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, s.buffer );
+		glPixelStorei( GL_PACK_ALIGNMENT, 4 );
+		glReadPixels( x, y, (GLsizei)width, (GLsizei)height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+		glBindBuffer( GL_PIXEL_PACK_BUFFER, (GLuint)prevPack );
+		glBindFramebuffer( GL_READ_FRAMEBUFFER, (GLuint)prevRead );
+		s.fence  = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		s.width  = width;
+		s.height = height;
+		s.frame  = frame;
+		s.polls  = 0;
+		pending.push_back( next );
+		next = ( next + 1 ) % (unsigned int) slots.size();
+		numCaptured++;
+		return true;
+	}
+
+	//! Hands the finished captures to the callback, in capture order, and returns their number.
+	//! If wait is true, waits for all captures in flight, otherwise only the finished ones are delivered.
+	int Poll( bool wait=false )
+	{
+		int delivered = 0;
+		for ( unsigned int i : pending ) slots[i].polls++;
+		while ( !pending.empty() ) {
+			Slot &s = slots[ pending.front() ];
+			GLenum status = glClientWaitSync( s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0 );
+			if ( status == GL_TIMEOUT_EXPIRED ) break;
+			glDeleteSync( s.fence );
+			s.fence = nullptr;
+			pending.pop_front();
+			if ( status == GL_WAIT_FAILED ) continue;
+			if ( onFrame ) {
+				Frame f;
+				f.pixels = s.mapped;
+				f.width  = s.width;
+				f.height = s.height;
+				f.frame  = s.frame;
+				f.delay  = s.polls;
+				onFrame( f );
+			}
+			numDelivered++;
+			totalDelay += s.polls;
+			delivered++;
+		}
+		return delivered;
+	}
+
+	//!@name Statistics
+	unsigned int NumBuffers  () const { return (unsigned int) slots.size(); }	//!< Returns the number of buffers in the ring
+	unsigned int NumPending  () const { return (unsigned int) pending.size(); }	//!< Returns the number of captures in flight
+	unsigned int NumCaptured () const { return numCaptured; }					//!< Returns the number of captures issued
+	unsigned int NumDelivered() const { return numDelivered; }					//!< Returns the number of captures handed to the callback
+	unsigned int NumSkipped  () const { return numSkipped; }					//!< Returns the number of captures skipped because all buffers were in flight
+	double AverageDelay() const { return numDelivered > 0 ? (double)totalDelay / numDelivered : 0.0; }	//!< Returns the average number of frames from capture to delivery
+
+private:
+	struct Slot
+	{
+		GLuint               buffer = 0;
+		unsigned char const *mapped = nullptr;
+		size_t               size   = 0;
+		GLsync               fence  = nullptr;
+		unsigned int         width  = 0;
+		unsigned int         height = 0;
+		uint64_t             frame  = 0;
+		unsigned int         polls  = 0;	// Poll() calls since the capture
+	};
+
+	std::vector<Slot>        slots;
+	std::deque<unsigned int> pending;	// slots in flight, in capture order
+	unsigned int             next         = 0;
+	Callback                 onFrame;
+	unsigned int             numCaptured  = 0;
+	unsigned int             numDelivered = 0;
+	unsigned int             numSkipped   = 0;
+	uint64_t                 totalDelay   = 0;
+
+	void FreeSlot( Slot &s )
+	{
+		if ( s.fence ) glDeleteSync( s.fence );
+		if ( s.mapped ) glUnmapNamedBuffer( s.buffer );
+		if ( s.buffer ) glDeleteBuffers( 1, &s.buffer );
+		s = Slot();
+	}
+};
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::FramebufferReadback cyFramebufferReadback;	//!< Asynchronous framebuffer readback through a ring of pixel pack buffers
+
+//-------------------------------------------------------------------------------
+
+#endif
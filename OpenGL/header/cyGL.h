@@ -64,6 +64,12 @@
 #ifndef GL_TESS_CONTROL_SHADER
 #define GL_TESS_CONTROL_SHADER 0x8E88
 #endif
+#ifndef GL_MAX_SHADER_COMPILER_THREADS_KHR
+#define GL_MAX_SHADER_COMPILER_THREADS_KHR 0x91B0
+#endif
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 #ifdef APIENTRY
 # define _CY_APIENTRY APIENTRY
 #else
@@ -75,14 +81,18 @@
 #endif
 //-------------------------------------------------------------------------------
 
+#include "cyHash.h"
 #include <vector>
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cassert>
+#include <cstring>
+#include <cstdio>
 #include <regex>
 #include <filesystem>
+#include <memory>
 
 //-------------------------------------------------------------------------------
 
@@ -804,6 +814,16 @@ public:
 	template <bool file, bool parse>
 	bool Compile( char const *shaderSource, GLenum shaderType, int prependSourceCount, char const **prependSources, std::ostream *outStream=&std::cout );
 
+	//! Starts compiling the shader using the given file or source code, without waiting for the result.
+	//! Returns false if the source cannot be loaded. The parameters are the same as the ones of Compile().
+	//! The result is checked by CheckCompileStatus(), which waits for the driver if the compilation is not finished.
+	template <bool file, bool parse>
+	bool Submit( char const *shaderSource, GLenum shaderType, int prependSourceCount, char const **prependSources, std::ostream *outStream=&std::cout );
+
+	//! Returns true if the shader compiled by Submit() is compiled successfully and has the given type.
+	//! Writes any error or warning messages to the given output stream.
+	bool CheckCompileStatus( GLenum shaderType, std::ostream *outStream=&std::cout );
+
 	//!@name Source File Management
 
 	//! GLSL Shader Source class.
@@ -837,29 +857,140 @@ public:
 
 //-------------------------------------------------------------------------------
 
+#ifdef GL_VERSION_4_1
+
+//! Typed location of a uniform parameter of a GLSL program, returned by GLSLProgram::GetUniform().
+//!
+//! The value is set with glProgramUniform, so the program does not need to be bound and glUseProgram is not
+//! called. The type T selects the uniform function: float, int, GLuint, bool, and the vector and matrix types
+//! of cyVector.h and cyMatrix.h, if they are included before this file. Setting a uniform parameter that is not
+//! found in the program does nothing, as with the SetUniform methods of GLSLProgram.
+
+template <typename T>
+class GLSLUniform
+{
+public:
+	GLSLUniform() {}
+	GLSLUniform( GLuint program, GLint loc ) : programID(program), location(loc) {}
+
+	GLint GetLocation() const { return location; }		//!< Returns the uniform location, or -1 if the uniform parameter is not found
+	bool  IsValid    () const { return location >= 0; }	//!< Returns true if the uniform parameter is found in the program
+
+	void Set( T const &value )             const { if ( location >= 0 ) Uniform( programID, location, &value, 1 ); }		//!< Sets the value
+	void Set( T const *values, int count ) const { if ( location >= 0 ) Uniform( programID, location, values, count ); }	//!< Sets the values of an array
+
+private:
+	GLuint programID = CY_GL_INVALID_ID;
+	GLint  location  = -1;
+
+	static void Uniform( GLuint p, GLint l, float  const *v, int n ) { glProgramUniform1fv ( p, l, n, v ); }
+	static void Uniform( GLuint p, GLint l, int    const *v, int n ) { glProgramUniform1iv ( p, l, n, v ); }
+	static void Uniform( GLuint p, GLint l, GLuint const *v, int n ) { glProgramUniform1uiv( p, l, n, v ); }
+	static void Uniform( GLuint p, GLint l, bool   const *v, int n ) { for ( int i=0; i<n; i++ ) glProgramUniform1i( p, l+i, v[i] ? 1 : 0 ); }
+#ifdef _CY_VECTOR_H_INCLUDED_
+	static void Uniform( GLuint p, GLint l, Vec2<float>  const *v, int n ) { glProgramUniform2fv ( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec3<float>  const *v, int n ) { glProgramUniform3fv ( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec4<float>  const *v, int n ) { glProgramUniform4fv ( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec2<int>    const *v, int n ) { glProgramUniform2iv ( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec3<int>    const *v, int n ) { glProgramUniform3iv ( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec4<int>    const *v, int n ) { glProgramUniform4iv ( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec2<GLuint> const *v, int n ) { glProgramUniform2uiv( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec3<GLuint> const *v, int n ) { glProgramUniform3uiv( p, l, n, &v->x ); }
+	static void Uniform( GLuint p, GLint l, Vec4<GLuint> const *v, int n ) { glProgramUniform4uiv( p, l, n, &v->x ); }
+#endif
+#ifdef _CY_MATRIX_H_INCLUDED_
+	static void Uniform( GLuint p, GLint l, Matrix2 <float> const *m, int n ) { glProgramUniformMatrix2fv  ( p, l, n, GL_FALSE, m->cell ); }
+	static void Uniform( GLuint p, GLint l, Matrix3 <float> const *m, int n ) { glProgramUniformMatrix3fv  ( p, l, n, GL_FALSE, m->cell ); }
+	static void Uniform( GLuint p, GLint l, Matrix4 <float> const *m, int n ) { glProgramUniformMatrix4fv  ( p, l, n, GL_FALSE, m->cell ); }
+	static void Uniform( GLuint p, GLint l, Matrix34<float> const *m, int n ) { glProgramUniformMatrix3x4fv( p, l, n, GL_FALSE, m->cell ); }
+#endif
+};
+
+#endif
+
+//-------------------------------------------------------------------------------
+
 //! GLSL program class.
 //!
 //! This class provides basic functionality for building GLSL programs
 //! using vertex and fragment shaders, along with optionally geometry and tessellation shaders.
 //! The shader sources can be provides as GLSLShader class objects, source strings, or file names.
 //! This class also stores a vector of registered uniform parameter IDs.
+//! After the program is linked, the locations of its active uniforms are cached in a table that is searched
+//! by the hash of the uniform name, so setting a uniform by its name does not call glGetUniformLocation.
+//! If a binary cache directory is set, the programs built from shader sources or files are stored there
+//! as program binaries and loaded back without compiling the shaders.
+//! BuildAsync() submits a program without waiting for the driver, so that multiple programs can compile in parallel.
 
 class GLSLProgram
 {
 private:
-	GLuint programID;			//!< The program ID
+	mutable GLuint programID;	//!< The program ID, deleted by Finish() if the build fails
 	std::vector<GLint> params;	//!< A list of registered uniform parameter IDs
 
+	struct UniformEntry
+	{
+		unsigned int hash     = 0;
+		GLint        location = -1;
+		std::string  name;
+	};
+	mutable std::vector<UniformEntry> uniforms;	//!< Open addressing hash table of the active uniform locations, empty if they are not cached
+
+	static unsigned int HashName( char const *name ) { unsigned int h = 2166136261u; for ( ; *name; name++ ) h = ( h ^ (unsigned char)*name ) * 16777619u; return h; }	// FNV-1a
+	void CacheUniforms() const;
+	void AddUniform( std::string const &name, GLint location ) const;
+
+#ifdef GL_VERSION_4_1
+	struct BinaryCacheState
+	{
+		std::string  directory;			// empty if the cache is disabled
+		std::string  driver;			// vendor, renderer, and version strings of the driver
+		unsigned int hits     = 0;
+		unsigned int misses   = 0;
+		unsigned int rejected = 0;
+	};
+	static BinaryCacheState& BinaryCache() { static BinaryCacheState state; return state; }
+	bool loadedFromBinary = false;
+
+	template <bool files, bool parse>
+	static bool GetBinaryCacheKey( std::string &key, char const * const shaders[5], int prependSourceCount, char const **prependSource );
+	bool LoadBinary( std::string const &filename, unsigned long long hash, std::ostream *outStream );
+	void SaveBinary( std::string const &filename, unsigned long long hash, std::ostream *outStream ) const;
+#endif
+
+	struct ParallelCompileState
+	{
+		bool         enabled = false;
+		unsigned int threads = 0;		// the requested number of compiler threads
+	};
+	static ParallelCompileState& ParallelCompile() { static ParallelCompileState state; return state; }
+
+	struct PendingBuild
+	{
+		GLSLShader    shaders[5];		// vertex, fragment, geometry, tessellation control, tessellation evaluation
+		std::string   fileNames[5];		// for the error messages, empty if the shaders are not built from files
+		std::ostream *outStream = nullptr;
+		std::string        cacheFile;	// the program binary is stored there after linking, if it is not empty
+		unsigned long long cacheHash = 0;
+	};
+	mutable std::unique_ptr<PendingBuild> pending;	//!< The build started by BuildAsync(), until it is finished
+
+	static GLenum      StageType( int i ) { static GLenum      const types[5] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER }; return types[i]; }
+	static char const* StageName( int i ) { static char const* const names[5] = { "vertex shader", "fragment shader", "geometry shader", "tessellation control shader", "tessellation evaluation shader" }; return names[i]; }
+	static void PrintCompileError( std::ostream *outStream, int stage, std::string const &fileName, std::stringstream const &shaderOutput );
+	bool CheckLinkStatus( std::ostream *outStream ) const;
+	void Release() const { pending.reset(); if (programID!=CY_GL_INVALID_ID) { glDeleteProgram(programID); programID=CY_GL_INVALID_ID; } uniforms.clear(); }
+
 public:
 	GLSLProgram() : programID(CY_GL_INVALID_ID) {}					//!< Constructor
 	virtual ~GLSLProgram() { if ( GL::CheckContext() ) Delete(); }	//!< Destructor that deletes the program
 
 	//!@name General Methods
 
-	void   Delete() { if (programID!=CY_GL_INVALID_ID) { glDeleteProgram(programID); programID=CY_GL_INVALID_ID; } }	//!< Deletes the program.
+	void   Delete() { Release(); }									//!< Deletes the program.
 	GLuint GetID () const { return programID; }						//!< Returns the program ID
 	bool   IsNull() const { return programID == CY_GL_INVALID_ID; }	//!< Returns true if the OpenGL program object is not generated, i.e. the program id is invalid.
-	void   Bind  () const { glUseProgram(programID); }				//!< Binds the program for rendering
+	void   Bind  () const { if ( pending ) Finish(); glUseProgram(programID); }	//!< Binds the program for rendering, after finishing the build started by BuildAsync()
 
 	//! Attaches the given shader to the program.
 	//! This function must be called before calling Link.
@@ -877,7 +1008,7 @@ public:
 	//! The shaders must be attached before calling this function.
 	//! Returns true if the link operation is successful.
 	//! Writes any error or warning messages to the given output stream.
-	bool Link( std::ostream *outStream=&std::cout );
+	bool Link( std::ostream *outStream=&std::cout ) { glLinkProgram(programID); return CheckLinkStatus(outStream); }
 
 	//!@name Build Methods
 
@@ -1024,6 +1155,65 @@ public:
 	                   std::ostream *outStream=&std::cout )
 	{ return Build<false,false>(vertexShaderSourceCode,fragmentShaderSourceCode,geometryShaderSourceCode,tessControlShaderSourceCode,tessEvaluationShaderSourceCode,prependSourceCount,prependSource,outStream); }
 
+#ifdef GL_VERSION_4_1
+	//!@name Program Binary Cache
+
+	//! Sets the directory of the program binary cache, which is used by the Build methods that take shader sources or files.
+	//! A program is stored with glGetProgramBinary after it is linked, with a file name given by the hash of its sources
+	//! and the vendor, renderer, and version strings of the driver. Building the same program again loads the binary with
+	//! glProgramBinary instead of compiling the shaders. If the driver rejects the binary, the shaders are compiled and the
+	//! binary is replaced. An empty directory disables the cache, which is the default.
+	static void SetBinaryCacheDirectory( char const *directory ) { BinaryCache().directory = directory ? directory : ""; }
+
+	static unsigned int NumBinaryCacheHits    () { return BinaryCache().hits;     }	//!< Returns the number of programs loaded from the binary cache
+	static unsigned int NumBinaryCacheMisses  () { return BinaryCache().misses;   }	//!< Returns the number of programs not found in the binary cache, including the rejected ones
+	static unsigned int NumBinaryCacheRejected() { return BinaryCache().rejected; }	//!< Returns the number of cached binaries the driver did not accept
+
+	//! Returns true if the program was loaded from the binary cache by the last Build call.
+	bool IsLoadedFromBinary() const { return loadedFromBinary; }
+#endif
+
+	//!@name Parallel Build Methods
+
+	//! Enables parallel shader compilation with KHR_parallel_shader_compile or ARB_parallel_shader_compile,
+	//! if the driver supports one of them, and sets the maximum number of compiler threads. The default value
+	//! lets the driver choose the number of threads. The getProcAddress function is used for loading
+	//! glMaxShaderCompilerThreadsKHR, such as glfwGetProcAddress. Returns true if parallel compilation is enabled.
+	//! Programs built by BuildAsync() without parallel compilation still work, but IsReady() cannot tell
+	//! if they are finished, so it always returns true.
+	static bool EnableParallelCompile( void* (*getProcAddress)( char const *name ), unsigned int maxThreads=0xFFFFFFFF );
+
+	//! Returns true if parallel shader compilation is enabled by EnableParallelCompile().
+	static bool IsParallelCompileEnabled() { return ParallelCompile().enabled; }
+
+	//! Starts building a program like Build(), but returns without waiting for the driver to compile and link it,
+	//! so that multiple programs can be compiled in parallel and other work can be done in the meantime.
+	//! A program found in the binary cache is loaded immediately. The build is finished by Finish(), which writes
+	//! the error messages to the given output stream, or implicitly by Bind() and the SetUniform methods that take
+	//! a uniform name. Returns false only if a shader source file cannot be loaded.
+	template <bool files, bool parse>
+	bool BuildAsync( char const *vertexShader, 
+	                 char const *fragmentShader,
+	                 char const *geometryShader=nullptr,
+	                 char const *tessControlShader=nullptr,
+	                 char const *tessEvaluationShader=nullptr,
+	                 int         prependSourceCount=0,
+	                 char const **prependSource=nullptr,
+	                 std::ostream *outStream=&std::cout );
+
+	//! Returns true if the build started by BuildAsync() is not finished by Finish() yet.
+	bool IsPending() const { return pending != nullptr; }
+
+	//! Returns true if the driver has finished compiling and linking the program started by BuildAsync(),
+	//! so that Finish() will not wait. It always returns true if parallel compilation is not enabled.
+	bool IsReady() const;
+
+	//! Waits for the build started by BuildAsync(), writes any error or warning messages to the output stream
+	//! given to BuildAsync(), and caches the uniform locations. Returns true if all compilation and link
+	//! operations are successful. If the build fails, the program is deleted. If there is no pending build,
+	//! returns true if the program is not null.
+	bool Finish() const;
+
 	//!@name Uniform Parameter Methods
 
 	//! Registers a single uniform parameter.
@@ -1035,6 +1225,18 @@ public:
 	//! The names should be separated by a space character.
 	void RegisterUniforms( char const *names, unsigned int startingIndex=0, std::ostream *outStream=&std::cout );
 
+	//! Returns the location of the uniform parameter with the given name, or -1 if it is not found.
+	//! If the program is linked by Link(), the location is found in the cached table without calling OpenGL.
+	GLint GetUniformLocation( char const *name ) const;
+
+	//! Returns the number of cached uniform locations
+	unsigned int NumCachedUniforms() const { unsigned int n=0; for ( UniformEntry const &u : uniforms ) n += u.location >= 0; return n; }
+
+#ifdef GL_VERSION_4_1
+	//! Returns a typed handle of the uniform parameter with the given name, which sets its value without binding the program.
+	template <typename T> GLSLUniform<T> GetUniform( char const *name ) const { return GLSLUniform<T>( programID, GetUniformLocation(name) ); }
+#endif
+
 	//!@{
 	//! Sets the value of the uniform parameter with the given index. 
 	//! The uniform parameter must be registered before using RegisterUniform() or RegisterUniforms().
@@ -1172,138 +1374,139 @@ public:
 	//!@}
 
 
-	//!@{ glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 )
+	//!@{
 	//! Sets the value of the uniform parameter with the given name, if the uniform parameter is found. 
 	//! Since it searches for the uniform parameter first, it is not as efficient as setting the uniform parameter using
-	//! a previously registered id. There is no need to bind the program before calling this method.
-	void SetUniform (char const *name, float x)                                { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1f  (id,x); }
-	void SetUniform (char const *name, float x, float y)                       { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2f  (id,x,y); }
-	void SetUniform (char const *name, float x, float y, float z)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3f  (id,x,y,z); }
-	void SetUniform (char const *name, float x, float y, float z, float w)     { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4f  (id,x,y,z,w); }
-	void SetUniform1(char const *name, float  const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1fv (id,count,data); }
-	void SetUniform2(char const *name, float  const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2fv (id,count,data); }
-	void SetUniform3(char const *name, float  const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3fv (id,count,data); }
-	void SetUniform4(char const *name, float  const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4fv (id,count,data); }
-	void SetUniform (char const *name, int x)                                  { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1i  (id,x); }
-	void SetUniform (char const *name, int x, int y)                           { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2i  (id,x,y); }
-	void SetUniform (char const *name, int x, int y, int z)                    { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3i  (id,x,y,z); }
-	void SetUniform (char const *name, int x, int y, int z, int w)             { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4i  (id,x,y,z,w); }
-	void SetUniform1(char const *name, int    const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1iv (id,count,data); }
-	void SetUniform2(char const *name, int    const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2iv (id,count,data); }
-	void SetUniform3(char const *name, int    const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3iv (id,count,data); }
-	void SetUniform4(char const *name, int    const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4iv (id,count,data); }
+	//! a previously registered id or a GLSLUniform handle. There is no need to bind the program before calling this method,
+	//! but these methods bind it with glUseProgram on every call, which a GLSLUniform handle does not.
+	void SetUniform (char const *name, float x)                                { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1f  (id,x); }
+	void SetUniform (char const *name, float x, float y)                       { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2f  (id,x,y); }
+	void SetUniform (char const *name, float x, float y, float z)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3f  (id,x,y,z); }
+	void SetUniform (char const *name, float x, float y, float z, float w)     { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4f  (id,x,y,z,w); }
+	void SetUniform1(char const *name, float  const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1fv (id,count,data); }
+	void SetUniform2(char const *name, float  const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2fv (id,count,data); }
+	void SetUniform3(char const *name, float  const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3fv (id,count,data); }
+	void SetUniform4(char const *name, float  const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4fv (id,count,data); }
+	void SetUniform (char const *name, int x)                                  { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1i  (id,x); }
+	void SetUniform (char const *name, int x, int y)                           { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2i  (id,x,y); }
+	void SetUniform (char const *name, int x, int y, int z)                    { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3i  (id,x,y,z); }
+	void SetUniform (char const *name, int x, int y, int z, int w)             { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4i  (id,x,y,z,w); }
+	void SetUniform1(char const *name, int    const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1iv (id,count,data); }
+	void SetUniform2(char const *name, int    const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2iv (id,count,data); }
+	void SetUniform3(char const *name, int    const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3iv (id,count,data); }
+	void SetUniform4(char const *name, int    const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4iv (id,count,data); }
 #ifdef GL_VERSION_3_0
-	void SetUniform (char const *name, GLuint x)                               { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1ui (id,x); }
-	void SetUniform (char const *name, GLuint x, GLuint y)                     { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2ui (id,x,y); }
-	void SetUniform (char const *name, GLuint x, GLuint y, GLuint z)           { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3ui (id,x,y,z); }
-	void SetUniform (char const *name, GLuint x, GLuint y, GLuint z, GLuint w) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4ui (id,x,y,z,w); }
-	void SetUniform1(char const *name, GLuint const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1uiv(id,count,data); }
-	void SetUniform2(char const *name, GLuint const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2uiv(id,count,data); }
-	void SetUniform3(char const *name, GLuint const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3uiv(id,count,data); }
-	void SetUniform4(char const *name, GLuint const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4uiv(id,count,data); }
+	void SetUniform (char const *name, GLuint x)                               { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1ui (id,x); }
+	void SetUniform (char const *name, GLuint x, GLuint y)                     { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2ui (id,x,y); }
+	void SetUniform (char const *name, GLuint x, GLuint y, GLuint z)           { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3ui (id,x,y,z); }
+	void SetUniform (char const *name, GLuint x, GLuint y, GLuint z, GLuint w) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4ui (id,x,y,z,w); }
+	void SetUniform1(char const *name, GLuint const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1uiv(id,count,data); }
+	void SetUniform2(char const *name, GLuint const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2uiv(id,count,data); }
+	void SetUniform3(char const *name, GLuint const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3uiv(id,count,data); }
+	void SetUniform4(char const *name, GLuint const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4uiv(id,count,data); }
 #endif
 #ifdef GL_VERSION_4_0
-	void SetUniform (char const *name, double x)                               { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1d  (id,x); }
-	void SetUniform (char const *name, double x, double y)                     { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2d  (id,x,y); }
-	void SetUniform (char const *name, double x, double y, double z)           { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3d  (id,x,y,z); }
-	void SetUniform (char const *name, double x, double y, double z, double w) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4d  (id,x,y,z,w); }
-	void SetUniform1(char const *name, double const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform1dv (id,count,data); }
-	void SetUniform2(char const *name, double const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2dv (id,count,data); }
-	void SetUniform3(char const *name, double const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3dv (id,count,data); }
-	void SetUniform4(char const *name, double const *data, int count=1)        { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4dv (id,count,data); }
+	void SetUniform (char const *name, double x)                               { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1d  (id,x); }
+	void SetUniform (char const *name, double x, double y)                     { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2d  (id,x,y); }
+	void SetUniform (char const *name, double x, double y, double z)           { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3d  (id,x,y,z); }
+	void SetUniform (char const *name, double x, double y, double z, double w) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4d  (id,x,y,z,w); }
+	void SetUniform1(char const *name, double const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform1dv (id,count,data); }
+	void SetUniform2(char const *name, double const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2dv (id,count,data); }
+	void SetUniform3(char const *name, double const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3dv (id,count,data); }
+	void SetUniform4(char const *name, double const *data, int count=1)        { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4dv (id,count,data); }
 #endif
 
-	void SetUniformMatrix2  (char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2fv  (id,count,transpose,m); }
-	void SetUniformMatrix3  (char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3fv  (id,count,transpose,m); }
-	void SetUniformMatrix4  (char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4fv  (id,count,transpose,m); }
+	void SetUniformMatrix2  (char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2fv  (id,count,transpose,m); }
+	void SetUniformMatrix3  (char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3fv  (id,count,transpose,m); }
+	void SetUniformMatrix4  (char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4fv  (id,count,transpose,m); }
 #ifdef GL_VERSION_2_1
-	void SetUniformMatrix2x3(char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2x3fv(id,count,transpose,m); }
-	void SetUniformMatrix2x4(char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2x4fv(id,count,transpose,m); }
-	void SetUniformMatrix3x2(char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x2fv(id,count,transpose,m); }
-	void SetUniformMatrix3x4(char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x4fv(id,count,transpose,m); }
-	void SetUniformMatrix4x2(char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4x2fv(id,count,transpose,m); }
-	void SetUniformMatrix4x3(char const *name, float  const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4x3fv(id,count,transpose,m); }
+	void SetUniformMatrix2x3(char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2x3fv(id,count,transpose,m); }
+	void SetUniformMatrix2x4(char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2x4fv(id,count,transpose,m); }
+	void SetUniformMatrix3x2(char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x2fv(id,count,transpose,m); }
+	void SetUniformMatrix3x4(char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x4fv(id,count,transpose,m); }
+	void SetUniformMatrix4x2(char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4x2fv(id,count,transpose,m); }
+	void SetUniformMatrix4x3(char const *name, float  const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4x3fv(id,count,transpose,m); }
 #endif
 #ifdef GL_VERSION_4_0
-	void SetUniformMatrix2  (char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2dv  (id,count,transpose,m); }
-	void SetUniformMatrix3  (char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3dv  (id,count,transpose,m); }
-	void SetUniformMatrix4  (char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4dv  (id,count,transpose,m); }
-	void SetUniformMatrix2x3(char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2x3dv(id,count,transpose,m); }
-	void SetUniformMatrix2x4(char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2x4dv(id,count,transpose,m); }
-	void SetUniformMatrix3x2(char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x2dv(id,count,transpose,m); }	
-	void SetUniformMatrix3x4(char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x4dv(id,count,transpose,m); }	
-	void SetUniformMatrix4x2(char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4x2dv(id,count,transpose,m); }	
-	void SetUniformMatrix4x3(char const *name, double const *m, int count=1, bool transpose=false) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4x3dv(id,count,transpose,m); }	
+	void SetUniformMatrix2  (char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2dv  (id,count,transpose,m); }
+	void SetUniformMatrix3  (char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3dv  (id,count,transpose,m); }
+	void SetUniformMatrix4  (char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4dv  (id,count,transpose,m); }
+	void SetUniformMatrix2x3(char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2x3dv(id,count,transpose,m); }
+	void SetUniformMatrix2x4(char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2x4dv(id,count,transpose,m); }
+	void SetUniformMatrix3x2(char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x2dv(id,count,transpose,m); }	
+	void SetUniformMatrix3x4(char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x4dv(id,count,transpose,m); }	
+	void SetUniformMatrix4x2(char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4x2dv(id,count,transpose,m); }	
+	void SetUniformMatrix4x3(char const *name, double const *m, int count=1, bool transpose=false) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4x3dv(id,count,transpose,m); }	
 #endif
 
 #ifdef _CY_VECTOR_H_INCLUDED_
-	void SetUniform(char const *name, Vec2<float>  const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2fv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec3<float>  const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3fv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec4<float>  const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4fv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec2<int>    const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2iv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec3<int>    const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3iv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec4<int>    const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4iv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec2<float>  const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2fv (id,count,&p->x); }
-	void SetUniform(char const *name, Vec3<float>  const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3fv (id,count,&p->x); }
-	void SetUniform(char const *name, Vec4<float>  const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4fv (id,count,&p->x); }
-	void SetUniform(char const *name, Vec2<int>    const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2iv (id,count,&p->x); }
-	void SetUniform(char const *name, Vec3<int>    const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3iv (id,count,&p->x); }
-	void SetUniform(char const *name, Vec4<int>    const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4iv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec2<float>  const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2fv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec3<float>  const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3fv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec4<float>  const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4fv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec2<int>    const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2iv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec3<int>    const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3iv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec4<int>    const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4iv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec2<float>  const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2fv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec3<float>  const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3fv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec4<float>  const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4fv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec2<int>    const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2iv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec3<int>    const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3iv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec4<int>    const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4iv (id,count,&p->x); }
 # ifdef GL_VERSION_3_0
-	void SetUniform(char const *name, Vec2<GLuint> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2uiv(id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec3<GLuint> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3uiv(id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec4<GLuint> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4uiv(id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec2<GLuint> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2uiv(id,count,&p->x); }
-	void SetUniform(char const *name, Vec3<GLuint> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3uiv(id,count,&p->x); }
-	void SetUniform(char const *name, Vec4<GLuint> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4uiv(id,count,&p->x); }
+	void SetUniform(char const *name, Vec2<GLuint> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2uiv(id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec3<GLuint> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3uiv(id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec4<GLuint> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4uiv(id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec2<GLuint> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2uiv(id,count,&p->x); }
+	void SetUniform(char const *name, Vec3<GLuint> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3uiv(id,count,&p->x); }
+	void SetUniform(char const *name, Vec4<GLuint> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4uiv(id,count,&p->x); }
 # endif
 # ifdef GL_VERSION_4_0
-	void SetUniform(char const *name, Vec2<double> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2dv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec3<double> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3dv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec4<double> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4dv (id,1,    &p.x ); }
-	void SetUniform(char const *name, Vec2<double> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2dv (id,count,&p->x); }
-	void SetUniform(char const *name, Vec3<double> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3dv (id,count,&p->x); }
-	void SetUniform(char const *name, Vec4<double> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4dv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec2<double> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2dv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec3<double> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3dv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec4<double> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4dv (id,1,    &p.x ); }
+	void SetUniform(char const *name, Vec2<double> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2dv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec3<double> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3dv (id,count,&p->x); }
+	void SetUniform(char const *name, Vec4<double> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4dv (id,count,&p->x); }
 # endif
 #endif
 
 #ifdef _CY_IVECTOR_H_INCLUDED_
-	void SetUniform(char const *name, IVec2<int>    const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2iv (id,1,    &p.x ); }
-	void SetUniform(char const *name, IVec3<int>    const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3iv (id,1,    &p.x ); }
-	void SetUniform(char const *name, IVec4<int>    const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4iv (id,1,    &p.x ); }
-	void SetUniform(char const *name, IVec2<int>    const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2iv (id,count,&p->x); }
-	void SetUniform(char const *name, IVec3<int>    const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3iv (id,count,&p->x); }
-	void SetUniform(char const *name, IVec4<int>    const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4iv (id,count,&p->x); }
+	void SetUniform(char const *name, IVec2<int>    const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2iv (id,1,    &p.x ); }
+	void SetUniform(char const *name, IVec3<int>    const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3iv (id,1,    &p.x ); }
+	void SetUniform(char const *name, IVec4<int>    const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4iv (id,1,    &p.x ); }
+	void SetUniform(char const *name, IVec2<int>    const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2iv (id,count,&p->x); }
+	void SetUniform(char const *name, IVec3<int>    const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3iv (id,count,&p->x); }
+	void SetUniform(char const *name, IVec4<int>    const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4iv (id,count,&p->x); }
 # ifdef GL_VERSION_3_0
-	void SetUniform(char const *name, IVec2<GLuint> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2uiv(id,1,    &p.x ); }
-	void SetUniform(char const *name, IVec3<GLuint> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3uiv(id,1,    &p.x ); }
-	void SetUniform(char const *name, IVec4<GLuint> const &p)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4uiv(id,1,    &p.x ); }
-	void SetUniform(char const *name, IVec2<GLuint> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform2uiv(id,count,&p->x); }
-	void SetUniform(char const *name, IVec3<GLuint> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform3uiv(id,count,&p->x); }
-	void SetUniform(char const *name, IVec4<GLuint> const *p, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniform4uiv(id,count,&p->x); }
+	void SetUniform(char const *name, IVec2<GLuint> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2uiv(id,1,    &p.x ); }
+	void SetUniform(char const *name, IVec3<GLuint> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3uiv(id,1,    &p.x ); }
+	void SetUniform(char const *name, IVec4<GLuint> const &p)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4uiv(id,1,    &p.x ); }
+	void SetUniform(char const *name, IVec2<GLuint> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform2uiv(id,count,&p->x); }
+	void SetUniform(char const *name, IVec3<GLuint> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform3uiv(id,count,&p->x); }
+	void SetUniform(char const *name, IVec4<GLuint> const *p, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniform4uiv(id,count,&p->x); }
 # endif
 #endif
 
 #ifdef _CY_MATRIX_H_INCLUDED_
-	void SetUniform(char const *name, Matrix2 <float>  const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2fv  (id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix3 <float>  const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3fv  (id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix4 <float>  const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4fv  (id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix2 <float>  const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2fv  (id,count,GL_FALSE,m->cell); }
-	void SetUniform(char const *name, Matrix3 <float>  const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3fv  (id,count,GL_FALSE,m->cell); }
-	void SetUniform(char const *name, Matrix4 <float>  const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4fv  (id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix2 <float>  const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2fv  (id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix3 <float>  const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3fv  (id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix4 <float>  const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4fv  (id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix2 <float>  const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2fv  (id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix3 <float>  const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3fv  (id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix4 <float>  const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4fv  (id,count,GL_FALSE,m->cell); }
 # ifdef GL_VERSION_2_1
-	void SetUniform(char const *name, Matrix34<float>  const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x4fv(id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix34<float>  const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x4fv(id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix34<float>  const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x4fv(id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix34<float>  const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x4fv(id,count,GL_FALSE,m->cell); }
 # endif
 # ifdef GL_VERSION_4_0
-	void SetUniform(char const *name, Matrix2 <double> const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2dv  (id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix3 <double> const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3dv  (id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix4 <double> const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4dv  (id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix34<double> const &m)              { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x4dv(id,1,    GL_FALSE,m.cell ); }
-	void SetUniform(char const *name, Matrix2 <double> const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix2dv  (id,count,GL_FALSE,m->cell); }
-	void SetUniform(char const *name, Matrix3 <double> const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3dv  (id,count,GL_FALSE,m->cell); }
-	void SetUniform(char const *name, Matrix4 <double> const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix4dv  (id,count,GL_FALSE,m->cell); }
-	void SetUniform(char const *name, Matrix34<double> const *m, int count=1) { glUseProgram(programID); int id = glGetUniformLocation( programID, name ); if ( id >= 0 ) glUniformMatrix3x4dv(id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix2 <double> const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2dv  (id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix3 <double> const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3dv  (id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix4 <double> const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4dv  (id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix34<double> const &m)              { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x4dv(id,1,    GL_FALSE,m.cell ); }
+	void SetUniform(char const *name, Matrix2 <double> const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix2dv  (id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix3 <double> const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3dv  (id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix4 <double> const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix4dv  (id,count,GL_FALSE,m->cell); }
+	void SetUniform(char const *name, Matrix34<double> const *m, int count=1) { Bind(); int id = GetUniformLocation( name ); if ( id >= 0 ) glUniformMatrix3x4dv(id,count,GL_FALSE,m->cell); }
 # endif
 #endif
 	//!@}
@@ -1707,6 +1910,12 @@ inline bool GLSLShader::Source::ParseIncludes( std::vector<std::string> &sources
 
 template <bool file, bool parse>
 inline bool GLSLShader::Compile( char const *shaderSource, GLenum shaderType, int prependSourceCount, char const **prependSources, std::ostream *outStream )
+{
+	return Submit<file,parse>( shaderSource, shaderType, prependSourceCount, prependSources, outStream ) && CheckCompileStatus( shaderType, outStream );
+}
+
+template <bool file, bool parse>
+inline bool GLSLShader::Submit( char const *shaderSource, GLenum shaderType, int prependSourceCount, char const **prependSources, std::ostream *outStream )
 {
 	Source source;
 	char const *shaderSourceCode = shaderSource;
@@ -1741,7 +1950,11 @@ inline bool GLSLShader::Compile( char const *shaderSource, GLenum shaderType, in
 	shaderID = glCreateShader( shaderType );
 	glShaderSource(shaderID, sourceDataCount, sourceData, nullptr);
 	glCompileShader(shaderID);
+	return true;
+}
 
+inline bool GLSLShader::CheckCompileStatus( GLenum shaderType, std::ostream *outStream )
+{
 	GLint result = GL_FALSE;
 	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &result);
 
@@ -1775,10 +1988,8 @@ inline bool GLSLShader::Compile( char const *shaderSource, GLenum shaderType, in
 // GLSLProgram Implementation
 //-------------------------------------------------------------------------------
 
-inline bool GLSLProgram::Link( std::ostream *outStream )
+inline bool GLSLProgram::CheckLinkStatus( std::ostream *outStream ) const
 {
-	glLinkProgram(programID);
-
 	GLint result = GL_FALSE;
 	glGetProgramiv(programID, GL_LINK_STATUS, &result);
 
@@ -1790,9 +2001,59 @@ inline bool GLSLProgram::Link( std::ostream *outStream )
 		if ( outStream ) *outStream << "ERROR: " << compilerMessage.data() << std::endl;
 	}
 
+	uniforms.clear();
+	if ( result == GL_TRUE ) CacheUniforms();
 	return result == GL_TRUE;
 }
 
+inline void GLSLProgram::CacheUniforms() const
+{
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv( programID, GL_ACTIVE_UNIFORMS, &count );
+	glGetProgramiv( programID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength );
+	size_t size = 16;
+	while ( size < size_t(count) * 4 ) size *= 2;	// arrays are added twice and the table stays at most half full
+	uniforms.assign( size, UniformEntry() );
+	std::vector<char> name( maxLength > 0 ? maxLength : 1 );
+	for ( GLint i=0; i<count; i++ ) {
+		GLsizei length = 0;
+		GLint   arraySize = 0;
+		GLenum  type = 0;
+		glGetActiveUniform( programID, (GLuint)i, (GLsizei)name.size(), &length, &arraySize, &type, name.data() );
+		std::string n( name.data(), length );
+		GLint location = glGetUniformLocation( programID, n.c_str() );
+		if ( location < 0 ) continue;	// members of uniform blocks have no location
+		AddUniform( n, location );
+		// Arrays are listed as "name[0]", but they can also be set using the array name
+		if ( n.size() > 3 && n.compare( n.size()-3, 3, "[0]" ) == 0 ) AddUniform( n.substr( 0, n.size()-3 ), location );
+	}
+}
+
+inline void GLSLProgram::AddUniform( std::string const &name, GLint location ) const
+{
+	unsigned int const hash = HashName( name.c_str() );
+	size_t const mask = uniforms.size() - 1;
+	for ( size_t i = hash & mask; ; i = ( i+1 ) & mask ) {
+		UniformEntry &u = uniforms[i];
+		if ( u.location < 0 ) { u.hash = hash; u.location = location; u.name = name; return; }
+		if ( u.hash == hash && u.name == name ) return;
+	}
+}
+
+inline GLint GLSLProgram::GetUniformLocation( char const *name ) const
+{
+	if ( ! uniforms.empty() ) {
+		unsigned int const hash = HashName( name );
+		size_t const mask = uniforms.size() - 1;
+		for ( size_t i = hash & mask; uniforms[i].location >= 0; i = ( i+1 ) & mask ) {
+			if ( uniforms[i].hash == hash && uniforms[i].name == name ) return uniforms[i].location;
+		}
+		// Only the array elements after the first one are not in the table
+		if ( strchr( name, '[' ) == nullptr ) return -1;
+	}
+	return glGetUniformLocation( programID, name );
+}
+
 inline bool GLSLProgram::Build( GLSLShader const *vertexShader, 
                                 GLSLShader const *fragmentShader,
 	                            GLSLShader const *geometryShader,
@@ -1820,41 +2081,239 @@ inline bool GLSLProgram::Build( char const *vertexShader,
 	                            char const **prependSource,
 	                            std::ostream *outStream )
 {
-	auto compile = [&]( GLSLShader &s, char const *source, GLenum type, char const *typeStr )
-	{
+	return BuildAsync<files,parse>( vertexShader, fragmentShader, geometryShader, tessControlShader, tessEvaluationShader, prependSourceCount, prependSource, outStream ) && Finish();
+}
+
+template <bool files, bool parse>
+inline bool GLSLProgram::BuildAsync( char const *vertexShader, 
+                                     char const *fragmentShader,
+	                                 char const *geometryShader,
+	                                 char const *tessControlShader,
+	                                 char const *tessEvaluationShader,
+	                                 int         prependSourceCount,
+	                                 char const **prependSource,
+	                                 std::ostream *outStream )
+{
+	char const * const shaders[5] = { vertexShader, fragmentShader, geometryShader, tessControlShader, tessEvaluationShader };
+
+	std::string cacheFile;
+	unsigned long long cacheHash = 0;
+#ifdef GL_VERSION_4_1
+	loadedFromBinary = false;
+	if ( ! BinaryCache().directory.empty() ) {
+		std::string key;
+		if ( GetBinaryCacheKey<files,parse>( key, shaders, prependSourceCount, prependSource ) ) {
+			cacheHash = Hash64( key.data(), key.size() );
+			char name[24];
+			snprintf( name, sizeof(name), "%016llx.bin", cacheHash );
+			cacheFile = ( std::filesystem::path( BinaryCache().directory ) / name ).string();
+			if ( LoadBinary( cacheFile, cacheHash, outStream ) ) return true;
+		}
+	}
+#endif
+
+	CreateProgram();
+	std::unique_ptr<PendingBuild> build( new PendingBuild );
+	for ( int i=0; i<5; i++ ) {
+		if ( ! shaders[i] ) continue;
+		if ( files ) build->fileNames[i] = shaders[i];
 		std::stringstream shaderOutput;
-		if ( s.Compile<files,parse>( source, type, prependSourceCount, prependSource, &shaderOutput ) ) return true;
-		if ( outStream ) {
-			*outStream << "ERROR: Failed compiling " << typeStr;
-			if ( files ) *outStream << " \"" << source << "\"";
-			*outStream << std::endl << shaderOutput.str();
+		if ( ! build->shaders[i].Submit<files,parse>( shaders[i], StageType(i), prependSourceCount, prependSource, &shaderOutput ) ) {
+			PrintCompileError( outStream, i, build->fileNames[i], shaderOutput );
+			Delete();
+			return false;
 		}
+		AttachShader( build->shaders[i] );
+	}
+#ifdef GL_VERSION_4_1
+	if ( ! cacheFile.empty() ) glProgramParameteri( programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+#endif
+	glLinkProgram( programID );
+	build->outStream = outStream;
+	build->cacheFile = cacheFile;
+	build->cacheHash = cacheHash;
+	pending = std::move( build );
+	return true;
+}
+
+inline bool GLSLProgram::EnableParallelCompile( void* (*getProcAddress)( char const *name ), unsigned int maxThreads )
+{
+	ParallelCompileState &state = ParallelCompile();
+	state.enabled = false;
+#ifdef GL_VERSION_3_0
+	char const *procName = nullptr;
+	GLint numExtensions = 0;
+	glGetIntegerv( GL_NUM_EXTENSIONS, &numExtensions );
+	for ( GLint i=0; i<numExtensions && ! procName; i++ ) {
+		char const *ext = (char const*) glGetStringi( GL_EXTENSIONS, (GLuint)i );
+		if ( ! ext ) continue;
+		if      ( strcmp( ext, "GL_KHR_parallel_shader_compile" ) == 0 ) procName = "glMaxShaderCompilerThreadsKHR";
+		else if ( strcmp( ext, "GL_ARB_parallel_shader_compile" ) == 0 ) procName = "glMaxShaderCompilerThreadsARB";
+	}
+	if ( ! procName || ! getProcAddress ) return false;
+	typedef void (_CY_APIENTRY *MaxShaderCompilerThreadsProc)( GLuint count );
+	MaxShaderCompilerThreadsProc maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc) getProcAddress( procName );
+	if ( ! maxShaderCompilerThreads ) return false;
+	maxShaderCompilerThreads( maxThreads );
+	state.enabled = true;
+	state.threads = maxThreads;
+#endif
+	return state.enabled;
+}
+
+inline void GLSLProgram::PrintCompileError( std::ostream *outStream, int stage, std::string const &fileName, std::stringstream const &shaderOutput )
+{
+	if ( ! outStream ) return;
+	*outStream << "ERROR: Failed compiling " << StageName(stage);
+	if ( ! fileName.empty() ) *outStream << " \"" << fileName << "\"";
+	*outStream << std::endl << shaderOutput.str();
+}
+
+inline bool GLSLProgram::IsReady() const
+{
+	if ( ! pending || ! ParallelCompile().enabled ) return true;
+	GLint done = GL_TRUE;
+	glGetProgramiv( programID, GL_COMPLETION_STATUS_KHR, &done );
+	return done == GL_TRUE;
+}
+
+inline bool GLSLProgram::Finish() const
+{
+	if ( ! pending ) return ! IsNull();
+	std::unique_ptr<PendingBuild> build = std::move( pending );
+	std::ostream *outStream = build->outStream;
+	for ( int i=0; i<5; i++ ) {
+		if ( build->shaders[i].IsNull() ) continue;
+		std::stringstream shaderOutput;
+		if ( build->shaders[i].CheckCompileStatus( StageType(i), &shaderOutput ) ) continue;
+		PrintCompileError( outStream, i, build->fileNames[i], shaderOutput );
+		Release();
 		return false;
-	};
+	}
+	if ( ! CheckLinkStatus( outStream ) ) { Release(); return false; }
+#ifdef GL_VERSION_4_1
+	if ( ! build->cacheFile.empty() ) SaveBinary( build->cacheFile, build->cacheHash, outStream );
+#endif
+	return true;
+}
 
-	CreateProgram();
-	GLSLShader vs, fs, gs, tcs, tes;
-	if ( ! compile( vs, vertexShader, GL_VERTEX_SHADER, "vertex shader" ) ) return false;
-	AttachShader(vs);
-	if ( ! compile( fs, fragmentShader, GL_FRAGMENT_SHADER, "fragment shader" ) ) return false;
-	AttachShader(fs);
-	if ( geometryShader ) {
-		if ( ! compile( gs, geometryShader, GL_GEOMETRY_SHADER, "geometry shader" ) ) return false;
-		AttachShader(gs);
+#ifdef GL_VERSION_4_1
+
+template <bool files, bool parse>
+inline bool GLSLProgram::GetBinaryCacheKey( std::string &key, char const * const shaders[5], int prependSourceCount, char const **prependSource )
+{
+	BinaryCacheState &cache = BinaryCache();
+	if ( cache.driver.empty() ) {
+		GLint numFormats = 0;
+		glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats );
+		if ( numFormats <= 0 ) return false;	// the driver cannot store program binaries
+		for ( GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION } ) {
+			char const *str = (char const*) glGetString( name );
+			cache.driver += str ? str : "";
+			cache.driver += '\n';
+		}
 	}
-	if ( tessControlShader ) {
-		if ( ! compile( tcs, tessControlShader, GL_TESS_CONTROL_SHADER, "tessellation control shader" ) ) return false;
-		AttachShader(tcs);
+	key = cache.driver;
+	for ( int i=0; i<5; i++ ) {
+		key += '\0';
+		if ( ! shaders[i] ) continue;
+		key += char( '0' + i );
+		for ( int j=0; j<prependSourceCount; j++ ) key += prependSource[j];
+		GLSLShader::Source source;
+		char const *code = shaders[i];
+		std::string includePath;
+		if ( files ) {
+			if ( ! source.LoadFile( shaders[i], nullptr ) ) return false;
+			code = source.data();
+			includePath = shaders[i];
+			includePath.erase( includePath.find_last_of("/\\") + 1 );
+		}
+		if ( parse ) {
+			std::vector<std::string> sources;
+			if ( ! GLSLShader::Source::ParseIncludes( sources, code, includePath, nullptr ) ) return false;
+			for ( std::string const &s : sources ) key += s;
+		} else key += code;
 	}
-	if ( tessEvaluationShader ) {
-		if ( ! compile( tes, tessEvaluationShader, GL_TESS_EVALUATION_SHADER, "tessellation evaluation shader" ) ) return false;
-		AttachShader(tes);
+	return true;
+}
+
+inline bool GLSLProgram::LoadBinary( std::string const &filename, unsigned long long hash, std::ostream *outStream )
+{
+	BinaryCacheState &cache = BinaryCache();
+	std::ifstream file( filename, std::ios::binary );
+	char magic[4] = {};
+	unsigned long long fileHash = 0;
+	GLenum format = 0;
+	unsigned int size = 0;
+	std::vector<char> binary;
+	if ( file ) {
+		file.read( magic, 4 );
+		file.read( (char*)&fileHash, sizeof(fileHash) );
+		file.read( (char*)&format, sizeof(format) );
+		file.read( (char*)&size, sizeof(size) );
+		if ( file && memcmp( magic, "CYPB", 4 ) == 0 && fileHash == hash && size > 0 ) {
+			binary.resize( size );
+			file.read( binary.data(), size );
+			if ( ! file ) binary.clear();
+		}
+	}
+	if ( binary.empty() ) {
+		cache.misses++;
+		if ( outStream ) *outStream << "Program binary cache miss: " << filename << std::endl;
+		return false;
+	}
+	CreateProgram();
+	glProgramBinary( programID, format, binary.data(), (GLsizei)size );
+	GLint result = GL_FALSE;
+	glGetProgramiv( programID, GL_LINK_STATUS, &result );
+	if ( result != GL_TRUE ) {
+		cache.misses++;
+		cache.rejected++;
+		if ( outStream ) *outStream << "Program binary cache rejected: " << filename << std::endl;
+		return false;
+	}
+	cache.hits++;
+	loadedFromBinary = true;
+	uniforms.clear();
+	CacheUniforms();
+	if ( outStream ) *outStream << "Program binary cache hit: " << filename << std::endl;
+	return true;
+}
+
+inline void GLSLProgram::SaveBinary( std::string const &filename, unsigned long long hash, std::ostream *outStream ) const
+{
+	GLint length = 0;
+	glGetProgramiv( programID, GL_PROGRAM_BINARY_LENGTH, &length );
+	if ( length <= 0 ) return;
+	std::vector<char> binary( length );
+	GLenum format = 0;
+	glGetProgramBinary( programID, length, &length, &format, binary.data() );
+	if ( length <= 0 ) return;
+	std::error_code ec;
+	std::filesystem::create_directories( std::filesystem::path( filename ).parent_path(), ec );
+	// Write to a temporary file first, so that an interrupted write never leaves a partial binary in the cache
+	std::string const tmpFile = filename + ".tmp";
+	std::ofstream file( tmpFile, std::ios::binary | std::ios::trunc );
+	unsigned int const size = (unsigned int) length;
+	file.write( "CYPB", 4 );
+	file.write( (char const*)&hash, sizeof(hash) );
+	file.write( (char const*)&format, sizeof(format) );
+	file.write( (char const*)&size, sizeof(size) );
+	file.write( binary.data(), size );
+	file.close();
+	bool ok = file.good();
+	if ( ok ) std::filesystem::rename( tmpFile, filename, ec );
+	if ( ! ok || ec ) {
+		std::filesystem::remove( tmpFile, ec );
+		if ( outStream ) *outStream << "ERROR: Cannot write program binary \"" << filename << "\"" << std::endl;
 	}
-	return Link(outStream);
 }
 
+#endif
+
 inline void GLSLProgram::RegisterUniform( unsigned int index, char const *name, std::ostream *outStream )
 {
+	if ( pending ) Finish();
 	if ( params.size() <= index ) params.resize( index+1, -1 );
 	params[index] = glGetUniformLocation( programID, name );
 	if ( params[index] < 0 ) {
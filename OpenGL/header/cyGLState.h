@@ -0,0 +1,208 @@
+//-------------------------------------------------------------------------------
+//! \file   cyGLState.h
+//!
+//! \brief  A cache of the OpenGL state that drops redundant state changes.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_GL_STATE_H_INCLUDED_
+#define _CY_GL_STATE_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyGL.h"
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Keeps a copy of the OpenGL state that the render passes change, and issues a state change only if it differs
+//! from the copy.
+//!
+//! It covers the GL_FRAMEBUFFER binding, the viewport, the program, the vertex array, the textures of the first
+//! MAX_TEXTURE_UNITS texture units, the enabled capabilities, the depth, cull, and blend functions, and the clear
+//! color. The state is unknown after construction and after Reset(), so the first call of each function is issued.
+//! The copy is wrong if the same state is changed without the cache, or if a bound object is deleted and its name
+//! is reused, so Reset() must be called after such changes, for example after the render targets are recreated.
+//! The cache does not call OpenGL to query the state, so it can be created before the OpenGL context.
+
+class GLStateCache
+{
+public:
+	//! The cached functions, which have separate statistics
+	enum Function {
+		BIND_FRAMEBUFFER,	//!< glBindFramebuffer
+		VIEWPORT,			//!< glViewport
+		USE_PROGRAM,		//!< glUseProgram
+		BIND_VERTEX_ARRAY,	//!< glBindVertexArray
+		BIND_TEXTURE_UNIT,	//!< glBindTextureUnit
+		ENABLE,				//!< glEnable and glDisable
+		DEPTH_FUNC,			//!< glDepthFunc
+		DEPTH_MASK,			//!< glDepthMask
+		CULL_FACE,			//!< glCullFace
+		FRONT_FACE,			//!< glFrontFace
+		BLEND_FUNC,			//!< glBlendFunc
+		CLEAR_COLOR,		//!< glClearColor
+		NUM_FUNCTIONS
+	};
+
+	static constexpr unsigned int MAX_TEXTURE_UNITS = 32;	//!< Textures bound to the units above are not cached
+	static constexpr unsigned int MAX_CAPABILITIES  = 16;	//!< Capabilities that are enabled or disabled after this many are not cached
+
+	GLStateCache() { Reset(); }
+
+	//! Forgets the cached state, so that the next call of each function is issued. The statistics are kept.
+	void Reset()
+	{
+		framebuffer = program = vertexArray = UNKNOWN;
+		for ( GLuint &t : textures ) t = UNKNOWN;
+		numCapabilities = 0;
+		depthFunc = cullFace = frontFace = blendSrc = blendDst = UNKNOWN;
+		depthMask = -1;
+		viewportKnown = clearColorKnown = false;
+	}
+
+	//!@name State Changes
+
+	//! Binds the framebuffer to GL_FRAMEBUFFER, for both drawing and reading.
+	void BindFramebuffer( GLuint fb ) { if ( Changed( BIND_FRAMEBUFFER, framebuffer != fb ) ) { framebuffer = fb; glBindFramebuffer( GL_FRAMEBUFFER, fb ); } }
+
+	//! Sets the viewport.
+	void Viewport( GLint x, GLint y, GLsizei width, GLsizei height )
+	{
+		bool const changed = ! viewportKnown || viewport[0] != x || viewport[1] != y || viewport[2] != width || viewport[3] != height;
+		if ( ! Changed( VIEWPORT, changed ) ) return;
+		viewport[0] = x;
+		viewport[1] = y;
+		viewport[2] = width;
+		viewport[3] = height;
+		viewportKnown = true;
+		glViewport( x, y, width, height );
+	}
+
+	//! Binds the program for rendering.
+	void UseProgram( GLuint prog ) { if ( Changed( USE_PROGRAM, program != prog ) ) { program = prog; glUseProgram( prog ); } }
+
+	//! Binds the program for rendering, after finishing the build started by GLSLProgram::BuildAsync().
+	//! The name-based GLSLProgram::SetUniform methods call glUseProgram without the cache, so the uniforms of a
+	//! program bound here should be set through GLSLUniform handles.
+	void UseProgram( GLSLProgram const &prog ) { if ( prog.IsPending() ) prog.Finish(); UseProgram( prog.GetID() ); }
+
+	//! Binds the vertex array object.
+	void BindVertexArray( GLuint vao ) { if ( Changed( BIND_VERTEX_ARRAY, vertexArray != vao ) ) { vertexArray = vao; glBindVertexArray( vao ); } }
+
+	//! Binds the texture to the given texture unit with glBindTextureUnit.
+	void BindTextureUnit( GLuint unit, GLuint texture )
+	{
+		if ( unit < MAX_TEXTURE_UNITS ) {
+			if ( ! Changed( BIND_TEXTURE_UNIT, textures[unit] != texture ) ) return;
+			textures[unit] = texture;
+		} else issued[ BIND_TEXTURE_UNIT ]++;
+		glBindTextureUnit( unit, texture );
+	}
+
+	void Enable ( GLenum cap ) { SetCapability( cap, true  ); }	//!< Enables the capability
+	void Disable( GLenum cap ) { SetCapability( cap, false ); }	//!< Disables the capability
+
+	//! Enables or disables the capability.
+	void SetCapability( GLenum cap, bool enable )
+	{
+		unsigned int i = 0;
+		while ( i < numCapabilities && capabilities[i].cap != cap ) i++;
+		if ( i < numCapabilities ) {
+			if ( ! Changed( ENABLE, capabilities[i].enabled != enable ) ) return;
+			capabilities[i].enabled = enable;
+		} else {
+			issued[ ENABLE ]++;
+			if ( numCapabilities < MAX_CAPABILITIES ) capabilities[ numCapabilities++ ] = { cap, enable };
+		}
+		if ( enable ) glEnable( cap );
+		else glDisable( cap );
+	}
+
+	void DepthFunc( GLenum func ) { if ( Changed( DEPTH_FUNC, depthFunc != func ) ) { depthFunc = func; glDepthFunc( func ); } }	//!< Sets the depth comparison function
+	void CullFace ( GLenum mode ) { if ( Changed( CULL_FACE,  cullFace  != mode ) ) { cullFace  = mode; glCullFace ( mode ); } }	//!< Sets the faces that are culled
+	void FrontFace( GLenum mode ) { if ( Changed( FRONT_FACE, frontFace != mode ) ) { frontFace = mode; glFrontFace( mode ); } }	//!< Sets the winding of the front faces
+
+	//! Enables or disables writing to the depth buffer.
+	void DepthMask( bool write ) { if ( Changed( DEPTH_MASK, depthMask != (int)write ) ) { depthMask = write; glDepthMask( write ? GL_TRUE : GL_FALSE ); } }
+
+	//! Sets the blend function.
+	void BlendFunc( GLenum src, GLenum dst )
+	{
+		if ( ! Changed( BLEND_FUNC, blendSrc != src || blendDst != dst ) ) return;
+		blendSrc = src;
+		blendDst = dst;
+		glBlendFunc( src, dst );
+	}
+
+	//! Sets the color used by glClear.
+	void ClearColor( float r, float g, float b, float a )
+	{
+		bool const changed = ! clearColorKnown || clearColor[0] != r || clearColor[1] != g || clearColor[2] != b || clearColor[3] != a;
+		if ( ! Changed( CLEAR_COLOR, changed ) ) return;
+		clearColor[0] = r;
+		clearColor[1] = g;
+		clearColor[2] = b;
+		clearColor[3] = a;
+		clearColorKnown = true;
+		glClearColor( r, g, b, a );
+	}
+
+	//!@name Statistics
+
+	uint64_t NumIssued  ( Function f ) const { return issued  [f]; }	//!< Returns the number of calls of the function that were issued to OpenGL
+	uint64_t NumFiltered( Function f ) const { return filtered[f]; }	//!< Returns the number of calls of the function that were dropped as redundant
+	uint64_t NumIssued  () const { uint64_t n=0; for ( uint64_t c : issued   ) n += c; return n; }	//!< Returns the number of calls that were issued to OpenGL
+	uint64_t NumFiltered() const { uint64_t n=0; for ( uint64_t c : filtered ) n += c; return n; }	//!< Returns the number of calls that were dropped as redundant
+	void     ResetStats () { for ( int f=0; f<NUM_FUNCTIONS; f++ ) issued[f] = filtered[f] = 0; }		//!< Sets the statistics to zero
+
+	//! Returns the name of the OpenGL function
+	static char const* FunctionName( Function f )
+	{
+		static char const* const names[ NUM_FUNCTIONS ] = { "glBindFramebuffer", "glViewport", "glUseProgram", "glBindVertexArray", "glBindTextureUnit",
+			"glEnable/glDisable", "glDepthFunc", "glDepthMask", "glCullFace", "glFrontFace", "glBlendFunc", "glClearColor" };
+		return names[f];
+	}
+
+private:
+	static constexpr GLuint UNKNOWN = 0xFFFFFFFF;	// not a valid object name or enum value
+
+	struct Capability
+	{
+		GLenum cap;
+		bool   enabled;
+	};
+
+	GLuint       framebuffer;
+	GLint        viewport[4];
+	bool         viewportKnown;
+	GLuint       program;
+	GLuint       vertexArray;
+	GLuint       textures[ MAX_TEXTURE_UNITS ];
+	Capability   capabilities[ MAX_CAPABILITIES ];
+	unsigned int numCapabilities;
+	GLenum       depthFunc;
+	int          depthMask;		// -1 if unknown
+	GLenum       cullFace;
+	GLenum       frontFace;
+	GLenum       blendSrc, blendDst;
+	float        clearColor[4];
+	bool         clearColorKnown;
+	uint64_t     issued  [ NUM_FUNCTIONS ] = {};
+	uint64_t     filtered[ NUM_FUNCTIONS ] = {};
+
+	// Counts the call and returns true if it must be issued
+	bool Changed( Function f, bool changed ) { if ( changed ) issued[f]++; else filtered[f]++; return changed; }
+};
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::GLStateCache cyGLStateCache;	//!< A cache of the OpenGL state that drops redundant state changes
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,90 @@
+//-------------------------------------------------------------------------------
+//! \file   cyHash.h
+//!
+//! \brief  Fast non-cryptographic hash functions and checksums.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_HASH_H_INCLUDED_
+#define _CY_HASH_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Computes the 64-bit xxHash (XXH64) of the given data.
+//! It is meant for detecting changes in files and data blocks, not for security.
+CY_NODISCARD inline uint64_t Hash64( void const *data, size_t size, uint64_t seed=0 )
+{
+	uint64_t const p1 = 0x9E3779B185EBCA87ull;
+	uint64_t const p2 = 0xC2B2AE3D27D4EB4Full;
+	uint64_t const p3 = 0x165667B19E3779F9ull;
+	uint64_t const p4 = 0x85EBCA77C2B2AE63ull;
+	uint64_t const p5 = 0x27D4EB2F165667C5ull;
+	auto rotl  = []( uint64_t x, int r ) { return (x << r) | (x >> (64-r)); };
+	auto read8 = []( unsigned char const *p ) { uint64_t v; memcpy(&v,p,8); return v; };
+	auto read4 = []( unsigned char const *p ) { uint32_t v; memcpy(&v,p,4); return (uint64_t)v; };
+	auto round = [&]( uint64_t acc, uint64_t input ) { acc += input * p2; acc = rotl(acc,31); return acc * p1; };
+	auto merge = [&]( uint64_t acc, uint64_t val ) { acc ^= round(0,val); return acc * p1 + p4; };
+
+	unsigned char const *p   = (unsigned char const*) data;
+	unsigned char const *end = p + size;
+	uint64_t h;
+	if ( size >= 32 ) {
+		uint64_t v1 = seed + p1 + p2;
+		uint64_t v2 = seed + p2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - p1;
+		for ( unsigned char const *limit = end - 32; p <= limit; p += 32 ) {
+			v1 = round( v1, read8(p     ) );
+			v2 = round( v2, read8(p +  8) );
+			v3 = round( v3, read8(p + 16) );
+			v4 = round( v4, read8(p + 24) );
+		}
+		h = rotl(v1,1) + rotl(v2,7) + rotl(v3,12) + rotl(v4,18);
+		h = merge(h,v1);
+		h = merge(h,v2);
+		h = merge(h,v3);
+		h = merge(h,v4);
+	} else {
+		h = seed + p5;
+	}
+	h += (uint64_t) size;
+	for ( ; p + 8 <= end; p += 8 ) { h ^= round(0,read8(p)); h = rotl(h,27) * p1 + p4; }
+	if  ( p + 4 <= end ) { h ^= read4(p) * p1; h = rotl(h,23) * p2 + p3; p += 4; }
+	for ( ; p < end; p++ ) { h ^= (*p) * p5; h = rotl(h,11) * p1; }
+	h ^= h >> 33;
+	h *= p2;
+	h ^= h >> 29;
+	h *= p3;
+	h ^= h >> 32;
+	return h;
+}
+
+//! Computes the Adler-32 checksum of zlib streams. To checksum data in pieces, pass the checksum
+//! of the previous pieces as adler.
+CY_NODISCARD inline uint32_t Adler32( void const *data, size_t size, uint32_t adler=1 )
+{
+	unsigned char const *p = (unsigned char const*) data;
+	uint32_t a = adler & 0xFFFF, b = adler >> 16;
+	// The modulo is taken every 5552 bytes, the largest n that cannot overflow 32 bits
+	while ( size > 0 ) {
+		size_t const n = size < 5552 ? size : 5552;
+		for ( size_t i=0; i<n; i++ ) { a += p[i]; b += a; }
+		a %= 65521;
+		b %= 65521;
+		p    += n;
+		size -= n;
+	}
+	return ( b << 16 ) | a;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,190 @@
+//-------------------------------------------------------------------------------
+//! \file   cyImageLoader.h
+//!
+//! \brief  Asynchronous PNG decoding on a pool of worker threads.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_IMAGE_LOADER_H_INCLUDED_
+#define _CY_IMAGE_LOADER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyParallel.h"
+#include "cyPngDecoder.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Decodes PNG files to 8-bit RGBA images on a pool of worker threads, using DecodePNG of cyPngDecoder.h.
+//!
+//! Load() queues a file and returns immediately. Next() returns the decoded images
+//! in the order they are finished, so the calling thread can upload each image to
+//! the GPU while the workers are still decoding the others. The loader does not use
+//! OpenGL, so the worker threads do not need a GL context. With an Allocator, the
+//! pixels can be decoded directly to mapped GPU memory, such as a PixelUnpackRing.
+
+class ImageLoader
+{
+public:
+	//! Decoded image
+	struct Image
+	{
+		unsigned int               id     = 0;	//!< the id returned by Load()
+		std::string                path;		//!< the file path
+		std::vector<unsigned char> rgba;		//!< image data, 4 bytes per pixel, top row first
+		unsigned int               width  = 0;	//!< image width
+		unsigned int               height = 0;	//!< image height
+		unsigned int               error  = 0;	//!< lodepng error code, zero if the image is decoded (see lodepng_error_text)
+		unsigned char             *memory = nullptr;	//!< the pixels, if they are decoded to memory from the Allocator, otherwise null
+		size_t                     offset = 0;	//!< can be set by the Allocator, for example to the offset of the memory in a buffer
+
+		unsigned char const* Pixels() const { return memory ? memory : rgba.data(); }	//!< Returns the decoded pixels
+	};
+
+	//! Provides the memory for the decoded pixels, so that they can be written directly to their destination.
+	//! The functions are called from the worker threads.
+	class Allocator
+	{
+	public:
+		virtual ~Allocator() {}
+		//! Returns memory for the width*height*4 bytes of the given image, or null to decode it to Image::rgba.
+		virtual unsigned char* Allocate( Image &image ) = 0;
+		//! Called if the image cannot be decoded after its memory is allocated.
+		virtual void Free( Image &image ) = 0;
+	};
+
+	//! Starts the worker threads. If numThreads is zero, all hardware threads are used.
+	explicit ImageLoader( unsigned int numThreads=0 )
+	{
+		if ( numThreads == 0 ) numThreads = NumHardwareThreads();
+		threads.reserve( numThreads );
+		for ( unsigned int t=0; t<numThreads; t++ ) threads.emplace_back( [this]() { Worker(); } );
+	}
+	ImageLoader( ImageLoader const & ) CY_CLASS_FUNCTION_DELETE
+	ImageLoader& operator = ( ImageLoader const & ) CY_CLASS_FUNCTION_DELETE
+
+	//! Stops the worker threads. Queued images that are not decoded yet are discarded.
+	~ImageLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stop = true;
+		}
+		jobReady.notify_all();
+		for ( std::thread &t : threads ) t.join();
+	}
+
+	//! Queues the given PNG file for decoding and returns its id. Ids are assigned in the order of the calls, starting from zero.
+	unsigned int Load( std::string const &path )
+	{
+		Image image;
+		image.path = path;
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			image.id = nextId++;
+			jobs.push_back( image );
+			numPending++;
+		}
+		jobReady.notify_one();
+		return image.id;
+	}
+
+	//! Waits until the next image is decoded and moves it to the given image.
+	//! Returns false without waiting if all queued images have already been returned.
+	bool Next( Image &image )
+	{
+		std::unique_lock<std::mutex> lock( mutex );
+		if ( numPending == 0 ) return false;
+		imageReady.wait( lock, [this]() { return !done.empty(); } );
+		image = std::move( done.front() );
+		done.pop_front();
+		numPending--;
+		return true;
+	}
+
+	//! Moves the next decoded image to the given image without waiting. Returns false if no image is decoded yet.
+	bool TryNext( Image &image )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		if ( done.empty() ) return false;
+		image = std::move( done.front() );
+		done.pop_front();
+		numPending--;
+		return true;
+	}
+
+	//! Sets the allocator for the pixels of the images that are decoded after this call. If null, the images are decoded to Image::rgba.
+	void SetAllocator( Allocator *a ) { std::lock_guard<std::mutex> lock( mutex ); allocator = a; }
+
+	//! Returns the number of queued images that are not returned by Next() yet.
+	unsigned int NumPending() const { std::lock_guard<std::mutex> lock( mutex ); return numPending; }
+
+private:
+	mutable std::mutex       mutex;
+	std::condition_variable  jobReady;		// signaled when a job is queued or the loader stops
+	std::condition_variable  imageReady;	// signaled when an image is decoded
+	std::deque<Image>        jobs;			// images to decode
+	std::deque<Image>        done;			// decoded images
+	unsigned int             nextId     = 0;
+	unsigned int             numPending = 0;
+	bool                     stop       = false;
+	Allocator               *allocator  = nullptr;
+	std::vector<std::thread> threads;
+
+	void Worker()
+	{
+		for (;;) {
+			Image image;
+			Allocator *alloc;
+			{
+				std::unique_lock<std::mutex> lock( mutex );
+				jobReady.wait( lock, [this]() { return stop || !jobs.empty(); } );
+				if ( stop ) return;
+				image = std::move( jobs.front() );
+				jobs.pop_front();
+				alloc = allocator;
+			}
+			std::vector<unsigned char> png;
+			image.error = lodepng::load_file( png, image.path );
+			if ( image.error == 0 ) {
+				image.error = DecodePNG( image.width, image.height, png.data(), png.size(), [&]( unsigned int w, unsigned int h ) {
+					image.width  = w;
+					image.height = h;
+					image.memory = alloc ? alloc->Allocate( image ) : nullptr;
+					if ( image.memory ) return image.memory;
+					image.rgba.resize( size_t(w) * h * 4 );
+					return image.rgba.data();
+				} );
+			}
+			if ( image.error != 0 ) {
+				if ( image.memory ) alloc->Free( image );
+				image.memory = nullptr;
+				image.rgba.clear();
+				image.width = image.height = 0;
+			}
+			{
+				std::lock_guard<std::mutex> lock( mutex );
+				done.push_back( std::move(image) );
+			}
+			imageReady.notify_one();
+		}
+	}
+};
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::ImageLoader cyImageLoader;	//!< Asynchronous PNG decoding on a pool of worker threads
+
+//-------------------------------------------------------------------------------
+
+#endif
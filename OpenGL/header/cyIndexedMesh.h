@@ -0,0 +1,345 @@
+//-------------------------------------------------------------------------------
+//! \file   cyIndexedMesh.h
+//!
+//! \brief  Indexed triangle mesh with a single index per vertex.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_INDEXED_MESH_H_INCLUDED_
+#define _CY_INDEXED_MESH_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyTriMesh.h"
+#include "cyMeshOptimizer.h"
+#include "cyMeshlet.h"
+#include "cyMeshSimplifier.h"
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Indexed triangle mesh with a single index per vertex.
+//!
+//! TriMesh uses separate indices for positions, normals, and texture coordinates,
+//! which cannot be rendered with a single index buffer. IndexedMesh welds every
+//! unique (position, normal, texture coordinate) index triple of a TriMesh into a
+//! single vertex, so that the mesh can be drawn with glDrawElements. Faces keep the
+//! order of the TriMesh, so material face ranges remain valid.
+//!
+//! The index buffer can also hold simplified levels of detail after the full mesh (see BuildLods).
+
+struct IndexedMesh
+{
+	//! Material face range
+	struct MtlRange
+	{
+		unsigned int firstFace;	//!< first face of the material
+		unsigned int faceCount;	//!< number of faces of the material
+	};
+
+	//! Level of detail face range
+	struct LodLevel
+	{
+		unsigned int firstFace;	//!< first face of the level
+		unsigned int faceCount;	//!< number of faces of the level
+		float        error;		//!< upper bound of the geometric deviation from the full mesh, in object space units
+		unsigned int reserved;	//!< unused, keeps the size 16 bytes
+	};
+
+	std::vector<float>        positions;	//!< vertex positions (3 floats per vertex)
+	std::vector<float>        normals;		//!< vertex normals (3 floats per vertex)
+	std::vector<float>        texCoords;	//!< texture coordinates (2 floats per vertex)
+	std::vector<uint32_t>     indices;		//!< vertex indices (3 per face)
+	std::vector<MtlRange>     mtlRanges;	//!< face ranges of the materials, for each level of detail (level major)
+	std::vector<LodLevel>     lods;			//!< levels of detail, empty if BuildLods is not called
+	Vec3f boundMin     = Vec3f(0,0,0);		//!< bounding box minimum
+	Vec3f boundMax     = Vec3f(0,0,0);		//!< bounding box maximum
+	bool  hasTexCoords = false;				//!< true if the source mesh has texture coordinates
+
+	unsigned int NumVertices() const { return (unsigned int)positions.size()/3; }	//!< Returns the number of vertices
+	unsigned int NumIndices () const { return (unsigned int)indices.size(); }		//!< Returns the number of indices
+	unsigned int NumFaces   () const { return (unsigned int)indices.size()/3; }		//!< Returns the number of faces
+	bool         Use16BitIndices() const { return NumVertices() < 0xFFFF; }			//!< Returns true if all indices fit in 16 bits (0xFFFF is left for primitive restart)
+
+	//! Builds the indexed mesh from the given mesh by welding face corners with identical
+	//! position, normal, and texture coordinate indices. Corners with an invalid normal index
+	//! get the normal (0,1,0), and corners with an invalid texture coordinate index get (0,0).
+	void Build( TriMesh const &mesh );
+
+	//! Reorders the triangles for post-transform vertex cache locality and then for overdraw,
+	//! and finally renumbers the vertices in the order they are first used (see cyMeshOptimizer.h).
+	//! Triangles are only reordered within material ranges, so each range stays contiguous.
+	void Optimize( unsigned int cacheSize=defaultVertexCacheSize, float overdrawThreshold=1.05f );
+
+	//! Groups the triangles into meshlets and appends them to the given array (see cyMeshlet.h). The triangles
+	//! are reordered, so that each meshlet is a contiguous face range within a material range, and the
+	//! triangles of each meshlet are reordered for the post-transform vertex cache, unless cacheSize is zero.
+	//! Finally, the vertices are renumbered in the order they are first used.
+	void BuildMeshlets( std::vector<Meshlet> &meshlets, unsigned int maxVertices=meshletMaxVertices, unsigned int maxTriangles=meshletMaxTriangles, unsigned int cacheSize=defaultVertexCacheSize );
+
+	//! Appends simplified levels of detail to the index buffer (see cyMeshSimplifier.h). Each level targets half
+	//! the triangles of the previous one and is simplified from it, so the error of a level is the sum of the
+	//! simplification errors of the levels before it. No level is added once the error would exceed maxError,
+	//! relative to the bounding box diagonal, or a level would remove less than 10% of the triangles. The vertices
+	//! are shared by all levels. The material ranges of the levels are appended to mtlRanges, and the triangles of
+	//! each range are reordered for the post-transform vertex cache, unless cacheSize is zero. The first level is
+	//! the full mesh. Since NumFaces() then includes all levels, call Optimize and BuildMeshlets before this method.
+	void BuildLods( unsigned int maxLevels=8, float maxError=0.05f, unsigned int cacheSize=defaultVertexCacheSize );
+
+	unsigned int NumLods() const { return lods.empty() ? 1 : (unsigned int) lods.size(); }	//!< Returns the number of levels of detail
+
+	//! Returns the post-transform vertex cache statistics of the index buffer.
+	VertexCacheStats AnalyzeVertexCache( unsigned int cacheSize=defaultVertexCacheSize ) const { return cy::AnalyzeVertexCache( indices.data(), indices.size(), NumVertices(), cacheSize ); }
+
+	//! Copies the indices to the given 16-bit index array. Use16BitIndices() must be true.
+	void GetIndices16( std::vector<uint16_t> &indices16 ) const { indices16.assign( indices.begin(), indices.end() ); }
+
+private:
+	std::vector<FaceRange> GetParts() const;	// face ranges split at all material range boundaries
+	void OptimizeParts( uint32_t *faceIndices, std::vector<FaceRange> const &parts, unsigned int cacheSize, float overdrawThreshold ) const;	// reorders the triangles within each part
+	void ReorderVertices();						// renumbers the vertices in the order they are first used
+};
+
+//-------------------------------------------------------------------------------
+
+inline void IndexedMesh::Build( TriMesh const &mesh )
+{
+	unsigned int const nf = mesh.NF();
+	unsigned int const invalid = 0xFFFFFFFF;
+	bool const hasNormals = mesh.HasNormals();
+	hasTexCoords = mesh.HasTextureVertices();
+
+	// Open addressing hash table of corner keys, at most half full
+	struct Key { unsigned int v, n, t; };
+	size_t tableSize = 16;
+	while ( tableSize < size_t(nf)*3*2 ) tableSize *= 2;
+	std::vector<Key>          keys( tableSize );
+	std::vector<unsigned int> slots( tableSize, invalid );
+
+	positions.clear();
+	normals  .clear();
+	texCoords.clear();
+	positions.reserve( size_t(mesh.NV())*3 );
+	normals  .reserve( size_t(mesh.NV())*3 );
+	texCoords.reserve( size_t(mesh.NV())*2 );
+	indices  .resize( size_t(nf)*3 );
+
+	for ( unsigned int fi=0; fi<nf; fi++ ) {
+		for ( int c=0; c<3; c++ ) {
+			Key key;
+			key.v = mesh.F(fi).v[c];
+			key.n = hasNormals   ? mesh.FN(fi).v[c] : invalid;
+			key.t = hasTexCoords ? mesh.FT(fi).v[c] : invalid;
+			if ( key.n >= mesh.NVN() ) key.n = invalid;
+			if ( key.t >= mesh.NVT() ) key.t = invalid;
+
+			uint64_t h = ( uint64_t(key.v) * 0x9E3779B185EBCA87ull ) ^ ( uint64_t(key.n) * 0xC2B2AE3D27D4EB4Full ) ^ ( uint64_t(key.t) * 0x165667B19E3779F9ull );
+			size_t slot = size_t( h ^ (h >> 29) ) & (tableSize-1);
+			while ( slots[slot] != invalid ) {
+				Key const &k = keys[slot];
+				if ( k.v == key.v && k.n == key.n && k.t == key.t ) break;
+				slot = (slot+1) & (tableSize-1);
+			}
+			if ( slots[slot] == invalid ) {
+				slots[slot] = NumVertices();
+				keys [slot] = key;
+				Vec3f const &p = mesh.V(key.v);
+				Vec3f n = key.n != invalid ? mesh.VN(key.n) : Vec3f(0,1,0);
+				Vec3f t = key.t != invalid ? mesh.VT(key.t) : Vec3f(0,0,0);
+				positions.insert( positions.end(), { p.x, p.y, p.z } );
+				normals  .insert( normals  .end(), { n.x, n.y, n.z } );
+				texCoords.insert( texCoords.end(), { t.x, t.y } );
+			}
+			indices[ size_t(fi)*3 + c ] = slots[slot];
+		}
+	}
+
+	mtlRanges.resize( mesh.NM() );
+	for ( unsigned int i=0; i<mesh.NM(); i++ ) {
+		mtlRanges[i].firstFace = mesh.GetMaterialFirstFace(i);
+		mtlRanges[i].faceCount = mesh.GetMaterialFaceCount(i);
+	}
+
+	boundMin.Zero();
+	boundMax.Zero();
+	if ( mesh.NV() > 0 ) {
+		boundMin = boundMax = mesh.V(0);
+		for ( unsigned int i=1; i<mesh.NV(); i++ ) {
+			Vec3f const &p = mesh.V(i);
+			for ( int j=0; j<3; j++ ) {
+				boundMin[j] = Min( boundMin[j], p[j] );
+				boundMax[j] = Max( boundMax[j], p[j] );
+			}
+		}
+	}
+}
+
+//-------------------------------------------------------------------------------
+
+inline void IndexedMesh::Optimize( unsigned int cacheSize, float overdrawThreshold )
+{
+	OptimizeParts( indices.data(), GetParts(), cacheSize, overdrawThreshold );
+	ReorderVertices();
+}
+
+inline void IndexedMesh::BuildMeshlets( std::vector<Meshlet> &meshlets, unsigned int maxVertices, unsigned int maxTriangles, unsigned int cacheSize )
+{
+	std::vector<FaceRange> parts = GetParts();
+	cy::BuildMeshlets( meshlets, indices.data(), positions.data(), NumVertices(), parts.data(), (unsigned int) parts.size(), maxVertices, maxTriangles, cacheSize );
+	ReorderVertices();
+}
+
+inline void IndexedMesh::BuildLods( unsigned int maxLevels, float maxError, unsigned int cacheSize )
+{
+	unsigned int const nm = (unsigned int) mtlRanges.size() / NumLods();
+	if ( !lods.empty() ) {	// remove the previous levels
+		indices.resize( size_t(lods[0].faceCount)*3 );
+		mtlRanges.resize( nm );
+		lods.clear();
+	}
+	std::vector<FaceRange> parts = GetParts();
+	unsigned int const np = (unsigned int) parts.size();
+	lods.push_back( LodLevel{ 0, NumFaces(), 0.0f, 0 } );
+
+	// Material range i consists of the parts [partFirst[i],partEnd[i])
+	std::vector<unsigned int> partFirst( nm ), partEnd( nm );
+	for ( unsigned int i=0; i<nm; i++ ) {
+		partFirst[i] = partEnd[i] = 0;
+		for ( unsigned int p=0; p<np; p++ ) {
+			if ( parts[p].firstFace < mtlRanges[i].firstFace ) partFirst[i] = partEnd[i] = p+1;
+			else if ( parts[p].firstFace < mtlRanges[i].firstFace + mtlRanges[i].faceCount ) partEnd[i] = p+1;
+		}
+	}
+
+	// The parts are the simplifier materials, so that the part boundaries are kept and the triangles stay sorted by part
+	std::vector<uint32_t> level( indices ), levelParts( NumFaces() ), simplified, simplifiedParts;
+	for ( unsigned int p=0; p<np; p++ ) std::fill( levelParts.begin() + parts[p].firstFace, levelParts.begin() + parts[p].firstFace + parts[p].faceCount, p );
+	float const diagonal = ( boundMax - boundMin ).Length();
+	float error = 0;
+	while ( lods.size() < maxLevels && error < maxError ) {
+		// The simplifier error is relative to the bounds of the referenced vertices
+		Vec3f bmin( FLT_MAX, FLT_MAX, FLT_MAX ), bmax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		for ( uint32_t v : level ) {
+			Vec3f p( positions.data() + size_t(v)*3 );
+			for ( int j=0; j<3; j++ ) { bmin[j] = Min( bmin[j], p[j] ); bmax[j] = Max( bmax[j], p[j] ); }
+		}
+		float const scale = diagonal > 0 ? ( bmax - bmin ).Length() / diagonal : 1.0f;
+		if ( !( scale > 0 ) ) break;
+		size_t target = level.size() / 6 * 3;
+		float levelError = SimplifyMesh( simplified, level.data(), level.size(), positions.data(), NumVertices(), target, ( maxError - error ) / scale, levelParts.data(), &simplifiedParts );
+		if ( simplified.empty() || simplified.size() > level.size() / 10 * 9 ) break;
+		error += levelError * scale;
+		level.swap( simplified );
+		levelParts.swap( simplifiedParts );
+
+		// Split the level into parts and reorder them for the vertex cache
+		std::vector<FaceRange> levelRanges( np, FaceRange{ 0, 0 } );
+		for ( uint32_t p : levelParts ) levelRanges[p].faceCount++;
+		for ( unsigned int p=1; p<np; p++ ) levelRanges[p].firstFace = levelRanges[p-1].firstFace + levelRanges[p-1].faceCount;
+		if ( cacheSize > 0 ) OptimizeParts( level.data(), levelRanges, cacheSize, 1.05f );
+
+		unsigned int firstFace = NumFaces();
+		lods.push_back( LodLevel{ firstFace, (unsigned int) level.size()/3, error * diagonal, 0 } );
+		indices.insert( indices.end(), level.begin(), level.end() );
+		for ( unsigned int i=0; i<nm; i++ ) {
+			MtlRange r = { firstFace, 0 };
+			if ( partFirst[i] < partEnd[i] ) {
+				r.firstFace += levelRanges[ partFirst[i] ].firstFace;
+				for ( unsigned int p=partFirst[i]; p<partEnd[i]; p++ ) r.faceCount += levelRanges[p].faceCount;
+			}
+			mtlRanges.push_back( r );
+		}
+	}
+}
+
+inline void IndexedMesh::OptimizeParts( uint32_t *faceIndices, std::vector<FaceRange> const &parts, unsigned int cacheSize, float overdrawThreshold ) const
+{
+	unsigned int const nv = NumVertices();
+	unsigned int const invalid = 0xFFFFFFFF;
+
+	// Optimize each part with local vertex indices, so that the cost does not depend on the number of parts
+	std::vector<uint32_t> localIndex( nv, invalid );
+	std::vector<uint32_t> globalIndex;
+	std::vector<uint32_t> partIndices;
+	std::vector<uint32_t> cacheOrder;
+	std::vector<float>    partPositions;
+	for ( FaceRange const &part : parts ) {
+		uint32_t *ix = faceIndices + size_t(part.firstFace)*3;
+		size_t numIndices = size_t(part.faceCount) * 3;
+		globalIndex.clear();
+		partIndices.resize( numIndices );
+		for ( size_t i=0; i<numIndices; i++ ) {
+			uint32_t v = ix[i];
+			if ( localIndex[v] == invalid ) {
+				localIndex[v] = (uint32_t) globalIndex.size();
+				globalIndex.push_back( v );
+			}
+			partIndices[i] = localIndex[v];
+		}
+		unsigned int partVertices = (unsigned int) globalIndex.size();
+		partPositions.resize( size_t(partVertices)*3 );
+		for ( unsigned int i=0; i<partVertices; i++ ) {
+			for ( int j=0; j<3; j++ ) partPositions[ size_t(i)*3+j ] = positions[ size_t(globalIndex[i])*3+j ];
+			localIndex[ globalIndex[i] ] = invalid;
+		}
+		// Keep the overdraw order only if it does not make the vertex cache use worse than the input order.
+		// Already well ordered parts can get worse when clusters are sorted, since each cluster starts with an empty cache.
+		unsigned int inputTransforms = cy::AnalyzeVertexCache( partIndices.data(), numIndices, partVertices, cacheSize ).transforms;
+		OptimizeVertexCache( partIndices.data(), numIndices, partVertices, cacheSize );
+		unsigned int cacheTransforms = cy::AnalyzeVertexCache( partIndices.data(), numIndices, partVertices, cacheSize ).transforms;
+		if ( cacheTransforms > inputTransforms ) continue;
+		cacheOrder = partIndices;
+		OptimizeOverdraw( partIndices.data(), numIndices, partPositions.data(), partVertices, cacheSize, overdrawThreshold );
+		if ( cy::AnalyzeVertexCache( partIndices.data(), numIndices, partVertices, cacheSize ).transforms > inputTransforms ) partIndices.swap( cacheOrder );
+		for ( size_t i=0; i<numIndices; i++ ) ix[i] = globalIndex[ partIndices[i] ];
+	}
+}
+
+inline std::vector<FaceRange> IndexedMesh::GetParts() const
+{
+	unsigned int const nf = NumFaces();
+	std::vector<unsigned int> bounds;
+	bounds.reserve( mtlRanges.size()*2 + 2 );
+	bounds.push_back( 0 );
+	bounds.push_back( nf );
+	for ( MtlRange const &r : mtlRanges ) {
+		bounds.push_back( Min( r.firstFace, nf ) );
+		bounds.push_back( Min( r.firstFace + r.faceCount, nf ) );
+	}
+	std::sort( bounds.begin(), bounds.end() );
+	bounds.erase( std::unique( bounds.begin(), bounds.end() ), bounds.end() );
+	std::vector<FaceRange> parts;
+	for ( size_t b=0; b+1<bounds.size(); b++ ) parts.push_back( FaceRange{ bounds[b], bounds[b+1] - bounds[b] } );
+	return parts;
+}
+
+inline void IndexedMesh::ReorderVertices()
+{
+	unsigned int const nv = NumVertices();
+	unsigned int const invalid = 0xFFFFFFFF;
+	std::vector<uint32_t> remap;
+	unsigned int numUsed = OptimizeVertexFetch( indices.data(), indices.size(), nv, remap );
+	auto reorder = [&]( std::vector<float> &data, int n ) {
+		std::vector<float> r( size_t(numUsed)*n );
+		for ( unsigned int v=0; v<nv; v++ ) {
+			if ( remap[v] == invalid ) continue;
+			for ( int j=0; j<n; j++ ) r[ size_t(remap[v])*n + j ] = data[ size_t(v)*n + j ];
+		}
+		data.swap( r );
+	};
+	reorder( positions, 3 );
+	reorder( normals,   3 );
+	reorder( texCoords, 2 );
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::IndexedMesh cyIndexedMesh;	//!< Indexed triangle mesh with a single index per vertex
+
+//-------------------------------------------------------------------------------
+
+#endif
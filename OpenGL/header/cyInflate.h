@@ -0,0 +1,453 @@
+//-------------------------------------------------------------------------------
+//! \file   cyInflate.h
+//!
+//! \brief  Table-driven inflate (deflate decompression) for lodepng.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_INFLATE_H_INCLUDED_
+#define _CY_INFLATE_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyHash.h"
+#include "lodepng.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Decompresses raw deflate data. The signature matches the custom_inflate field of LodePNGDecompressSettings.
+//! The decompressed data is appended to *out, which must be null or allocated with malloc, as lodepng does by
+//! default. Returns zero on success, or a lodepng error code.
+inline unsigned Inflate( unsigned char **out, size_t *outsize, unsigned char const *in, size_t insize, LodePNGDecompressSettings const *settings );
+
+//! Decompresses zlib data using Inflate and checks the Adler-32 checksum, unless settings->ignore_adler32 is set.
+//! The signature matches the custom_zlib field of LodePNGDecompressSettings.
+inline unsigned ZlibDecompress( unsigned char **out, size_t *outsize, unsigned char const *in, size_t insize, LodePNGDecompressSettings const *settings );
+
+//! Sets the zlib decoder of the given lodepng settings to ZlibDecompress.
+inline void SetFastInflate( LodePNGDecompressSettings &settings ) { settings.custom_zlib = ZlibDecompress; }
+
+//-------------------------------------------------------------------------------
+
+namespace inflate {
+
+// A decode table entry packs the number of bits to consume (bits 0-4), the kind (bits 5-7),
+// the number of extra bits or the subtable bits (bits 8-11), and a value (bits 16-31):
+// one or two literals, a length or distance base, or a subtable offset.
+enum Kind : uint32_t { KIND_INVALID=0, KIND_LITERAL=1<<5, KIND_LITERAL_PAIR=2<<5, KIND_BASE=3<<5, KIND_END=4<<5, KIND_SUBTABLE=5<<5 };
+uint32_t const kindMask = 7<<5;
+unsigned int const litLenTableBits = 11;
+unsigned int const distTableBits   = 8;
+
+inline uint32_t Entry( uint32_t kind, uint32_t bits, uint32_t extra, uint32_t value ) { return kind | bits | (extra << 8) | (value << 16); }
+inline uint32_t EntryBits ( uint32_t e ) { return e & 31; }
+inline uint32_t EntryExtra( uint32_t e ) { return (e >> 8) & 15; }
+inline uint32_t EntryValue( uint32_t e ) { return e >> 16; }
+
+uint16_t const lengthBase [29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+uint8_t  const lengthExtra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+uint16_t const distBase   [30] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577 };
+uint8_t  const distExtra  [30] = { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
+
+//! Two-level Huffman decode table indexed by the next input bits (deflate codes are stored LSB first).
+//! Codes up to tableBits long are decoded with a single lookup, longer ones with a subtable.
+struct Table
+{
+	std::vector<uint32_t> entries;
+
+	//! Builds the table for the given code lengths. The entry of symbol s is symbolEntry(s, length).
+	//! Returns false if the code is oversubscribed or incomplete. As in zlib, the only incomplete codes allowed are
+	//! an empty code and a single one-bit code, which deflate uses for blocks with no or one distance; the unused
+	//! bit patterns of these codes are invalid.
+	template <typename SYMBOL_ENTRY>
+	bool Build( uint8_t const *lengths, unsigned int numSymbols, unsigned int tableBits, SYMBOL_ENTRY symbolEntry )
+	{
+		unsigned int count[16] = {}, nextCode[16] = {};
+		for ( unsigned int s=0; s<numSymbols; s++ ) count[ lengths[s] ]++;
+		count[0] = 0;
+		int left = 1;
+		for ( int len=1; len<16; len++ ) {
+			left = left*2 - int(count[len]);
+			if ( left < 0 ) return false;
+		}
+		if ( left > 0 && left != (1<<15) && !( count[1] == 1 && left == (1<<14) ) ) return false;
+		for ( int len=1; len<16; len++ ) nextCode[len] = ( nextCode[len-1] + count[len-1] ) << 1;
+
+		// Bit-reversed canonical codes, and the subtable size of each prefix of the long codes
+		unsigned int const tableSize = 1u << tableBits;
+		std::vector<uint16_t> codes( numSymbols );
+		std::vector<uint8_t>  subBits( tableSize, 0 );
+		for ( unsigned int s=0; s<numSymbols; s++ ) {
+			unsigned int len = lengths[s];
+			if ( len == 0 ) continue;
+			unsigned int c = nextCode[len]++, r = 0;
+			for ( unsigned int i=0; i<len; i++ ) { r = (r << 1) | (c & 1); c >>= 1; }
+			codes[s] = uint16_t(r);
+			if ( len > tableBits ) {
+				uint8_t &sb = subBits[ r & (tableSize-1) ];
+				sb = uint8_t( Max( (unsigned int) sb, len - tableBits ) );
+			}
+		}
+		unsigned int total = tableSize;
+		for ( unsigned int p=0; p<tableSize; p++ ) if ( subBits[p] ) total += 1u << subBits[p];
+		entries.assign( total, Entry( KIND_INVALID, 0, 0, 0 ) );
+		unsigned int offset = tableSize;
+		for ( unsigned int p=0; p<tableSize; p++ ) {
+			if ( !subBits[p] ) continue;
+			entries[p] = Entry( KIND_SUBTABLE, tableBits, subBits[p], offset );
+			offset += 1u << subBits[p];
+		}
+		for ( unsigned int s=0; s<numSymbols; s++ ) {
+			unsigned int len = lengths[s];
+			if ( len == 0 ) continue;
+			unsigned int code = codes[s];
+			if ( len <= tableBits ) {
+				uint32_t e = symbolEntry( s, len );
+				for ( unsigned int i=code; i<tableSize; i+=1u<<len ) entries[i] = e;
+			} else {
+				uint32_t sub = entries[ code & (tableSize-1) ];
+				unsigned int subSize = 1u << EntryExtra(sub);
+				unsigned int rest = len - tableBits;
+				uint32_t e = symbolEntry( s, rest );
+				uint32_t *subTable = entries.data() + EntryValue(sub);
+				for ( unsigned int i=code>>tableBits; i<subSize; i+=1u<<rest ) subTable[i] = e;
+			}
+		}
+		return true;
+	}
+
+	//! Merges literals, such that entries whose bits contain two complete literal codes output both.
+	void PairLiterals( unsigned int tableBits )
+	{
+		unsigned int const tableSize = 1u << tableBits;
+		std::vector<uint32_t> paired( entries.begin(), entries.begin() + tableSize );
+		for ( unsigned int i=0; i<tableSize; i++ ) {
+			uint32_t e = entries[i];
+			if ( ( e & kindMask ) != KIND_LITERAL ) continue;
+			unsigned int len = EntryBits(e);
+			uint32_t e2 = entries[ i >> len ];
+			if ( ( e2 & kindMask ) != KIND_LITERAL || len + EntryBits(e2) > tableBits ) continue;
+			paired[i] = Entry( KIND_LITERAL_PAIR, len + EntryBits(e2), 0, EntryValue(e) | ( EntryValue(e2) << 8 ) );
+		}
+		std::copy( paired.begin(), paired.end(), entries.begin() );
+	}
+};
+
+inline uint32_t LitLenEntry( unsigned int s, unsigned int len )
+{
+	if ( s < 256  ) return Entry( KIND_LITERAL, len, 0, s );
+	if ( s == 256 ) return Entry( KIND_END, len, 0, 0 );
+	if ( s < 286  ) return Entry( KIND_BASE, len, lengthExtra[s-257], lengthBase[s-257] );
+	return Entry( KIND_INVALID, len, 0, 0 );
+}
+inline uint32_t DistEntry( unsigned int s, unsigned int len )
+{
+	if ( s < 30 ) return Entry( KIND_BASE, len, distExtra[s], distBase[s] );
+	return Entry( KIND_INVALID, len, 0, 0 );
+}
+inline uint32_t CodeLengthEntry( unsigned int s, unsigned int len ) { return Entry( KIND_BASE, len, 0, s ); }
+
+//! Tables of the fixed Huffman codes (block type 1)
+struct FixedTables
+{
+	Table litLen, dist;
+	FixedTables()
+	{
+		uint8_t lengths[288];
+		for ( int i=0;   i<144; i++ ) lengths[i] = 8;
+		for ( int i=144; i<256; i++ ) lengths[i] = 9;
+		for ( int i=256; i<280; i++ ) lengths[i] = 7;
+		for ( int i=280; i<288; i++ ) lengths[i] = 8;
+		litLen.Build( lengths, 288, litLenTableBits, LitLenEntry );
+		litLen.PairLiterals( litLenTableBits );
+		for ( int i=0; i<32; i++ ) lengths[i] = 5;
+		dist.Build( lengths, 32, distTableBits, DistEntry );
+	}
+	static FixedTables const & Get() { static FixedTables tables; return tables; }
+};
+
+//! LSB-first bit reader with a 64-bit buffer. Reading past the end of the input returns zero bits,
+//! which is detected by Overrun().
+struct BitReader
+{
+	unsigned char const *in;
+	size_t   size;
+	size_t   pos      = 0;	// next input byte to load
+	uint64_t buffer   = 0;
+	unsigned int count = 0;	// number of bits in the buffer
+	size_t   padding  = 0;	// number of zero bytes loaded past the end of the input
+
+	BitReader( unsigned char const *data, size_t dataSize ) : in(data), size(dataSize) {}
+
+	//! Fills the buffer with at least 56 bits
+	void Refill()
+	{
+		if ( pos + 8 <= size ) {
+			uint64_t v;
+			memcpy( &v, in + pos, 8 );	// deflate is little endian, as are the platforms we target
+			buffer |= v << count;
+			pos   += ( 63 - count ) >> 3;
+			count |= 56;
+		} else {
+			while ( count <= 56 ) {
+				if ( pos < size ) buffer |= uint64_t( in[pos++] ) << count;
+				else padding++;
+				count += 8;
+			}
+		}
+	}
+	uint32_t Peek( unsigned int n ) const { return uint32_t( buffer & ( ( uint64_t(1) << n ) - 1 ) ); }
+	void     Consume( unsigned int n ) { buffer >>= n; count -= n; }
+	uint32_t Read( unsigned int n ) { uint32_t v = Peek(n); Consume(n); return v; }
+	bool     Overrun() const { return padding*8 > count; }	// true if any of the consumed bits were past the end
+
+	//! Discards the bits up to the next byte boundary and returns the input position of that byte.
+	//! The buffer is emptied, so the bytes can be read directly from the input.
+	size_t AlignToByte()
+	{
+		Consume( count & 7 );
+		size_t bytePos = pos + padding - count/8;
+		buffer = 0;
+		count  = 0;
+		padding = 0;
+		pos = bytePos;
+		return bytePos;
+	}
+};
+
+//! Growable output buffer that keeps some slack at the end for wide copies
+struct Output
+{
+	unsigned char *data;
+	size_t size, capacity;
+	size_t maxSize;
+	static size_t const slack = 258 + 16;
+
+	Output( unsigned char *d, size_t s, size_t maxOutputSize ) : data(d), size(s), capacity(s), maxSize(maxOutputSize) {}
+
+	//! Makes sure that n more bytes plus the slack fit. Returns false if the allocation fails.
+	bool Reserve( size_t n )
+	{
+		if ( size + n + slack <= capacity ) return true;
+		size_t newCapacity = Max( capacity * 2, size + n + slack + 4096 );
+		unsigned char *d = (unsigned char*) realloc( data, newCapacity );
+		if ( !d ) return false;
+		data = d;
+		capacity = newCapacity;
+		return true;
+	}
+};
+
+//! Copies a match of the given length from distance bytes back. dst has at least 16 bytes of slack.
+inline void CopyMatch( unsigned char *dst, size_t distance, unsigned int length )
+{
+	unsigned char const *src = dst - distance;
+	if ( distance >= 8 ) {
+		// Each 8-byte chunk reads bytes that are at least 8 bytes back, so they are already written
+		unsigned char *end = dst + length;
+		do {
+			uint64_t v;
+			memcpy( &v, src, 8 );
+			memcpy( dst, &v, 8 );
+			src += 8;
+			dst += 8;
+		} while ( dst < end );
+	} else if ( distance == 1 ) {
+		memset( dst, *src, length );
+	} else {
+		for ( unsigned int i=0; i<length; i++ ) dst[i] = src[i];
+	}
+}
+
+//! Decodes a Huffman compressed block with the given tables
+inline unsigned DecodeBlock( BitReader &bitReader, Output &output, size_t outStart, Table const &litLen, Table const &dist )
+{
+	// Decode with local copies, so that the bit buffer stays in registers; the byte stores to the output could alias it otherwise
+	BitReader bits = bitReader;
+	Output    out  = output;
+	uint32_t const *lt = litLen.entries.data();
+	uint32_t const *dt = dist.entries.data();
+	uint32_t const litLenMask = (1u << litLenTableBits) - 1;
+	uint32_t const distMask   = (1u << distTableBits) - 1;
+	auto decode = [&]() -> unsigned {
+		for (;;) {
+			if ( !out.Reserve( 4 ) ) return 83;
+			bits.Refill();	// at least 56 bits, enough for a length, a distance, and their extra bits (at most 48 bits)
+			if ( bits.padding && bits.Overrun() ) return 51;	// the previous symbol ended past the end of the input
+			uint32_t e = lt[ bits.Peek(litLenTableBits) & litLenMask ];
+			if ( ( e & kindMask ) == KIND_SUBTABLE ) {
+				bits.Consume( EntryBits(e) );
+				e = lt[ EntryValue(e) + bits.Peek( EntryExtra(e) ) ];
+			}
+			bits.Consume( EntryBits(e) );
+			uint32_t kind = e & kindMask;
+			if ( kind <= KIND_LITERAL_PAIR ) {
+				if ( kind == KIND_INVALID ) return 16;
+				// Literals, followed by another literal or pair from the same refill if it is in the primary table
+				out.data[out.size  ] = (unsigned char) EntryValue(e);
+				out.data[out.size+1] = (unsigned char)( EntryValue(e) >> 8 );
+				out.size += kind == KIND_LITERAL_PAIR ? 2 : 1;
+				e = lt[ bits.Peek(litLenTableBits) & litLenMask ];
+				kind = e & kindMask;
+				if ( kind != KIND_LITERAL && kind != KIND_LITERAL_PAIR ) continue;
+				bits.Consume( EntryBits(e) );
+				out.data[out.size  ] = (unsigned char) EntryValue(e);
+				out.data[out.size+1] = (unsigned char)( EntryValue(e) >> 8 );
+				out.size += kind == KIND_LITERAL_PAIR ? 2 : 1;
+				continue;
+			}
+			if ( kind == KIND_END ) break;
+			if ( kind != KIND_BASE ) return 16;	// invalid code
+			unsigned int length = EntryValue(e) + bits.Read( EntryExtra(e) );
+
+			uint32_t d = dt[ bits.Peek(distTableBits) & distMask ];
+			if ( ( d & kindMask ) == KIND_SUBTABLE ) {
+				bits.Consume( EntryBits(d) );
+				d = dt[ EntryValue(d) + bits.Peek( EntryExtra(d) ) ];
+			}
+			bits.Consume( EntryBits(d) );
+			if ( ( d & kindMask ) != KIND_BASE ) return 18;	// invalid distance code
+			size_t distance = EntryValue(d) + bits.Read( EntryExtra(d) );
+			if ( distance > out.size - outStart ) return 52;	// distance before the start of the output
+			if ( !out.Reserve( length ) ) return 83;
+			CopyMatch( out.data + out.size, distance, length );
+			out.size += length;
+			if ( out.maxSize && out.size > out.maxSize ) return 109;
+		}
+		if ( bits.Overrun() ) return 51;	// the block ended past the end of the input
+		return 0;
+	};
+	unsigned error = decode();
+	bitReader = bits;
+	output    = out;
+	return error;
+}
+
+//! Reads the code lengths of a dynamic block and builds its tables
+inline unsigned ReadDynamicTables( BitReader &bits, Table &litLen, Table &dist, Table &codeLength )
+{
+	static uint8_t const order[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 };
+	bits.Refill();
+	unsigned int hlit  = bits.Read(5) + 257;
+	unsigned int hdist = bits.Read(5) + 1;
+	unsigned int hclen = bits.Read(4) + 4;
+	if ( hlit > 286 || hdist > 30 ) return 17;
+	uint8_t clLengths[19] = {};
+	for ( unsigned int i=0; i<hclen; i++ ) {
+		bits.Refill();
+		clLengths[ order[i] ] = (uint8_t) bits.Read(3);
+	}
+	if ( !codeLength.Build( clLengths, 19, 7, CodeLengthEntry ) ) return 16;
+
+	uint8_t lengths[286+30] = {};
+	unsigned int n = 0, total = hlit + hdist;
+	uint32_t const *ct = codeLength.entries.data();
+	while ( n < total ) {
+		bits.Refill();
+		uint32_t e = ct[ bits.Peek(7) ];
+		if ( ( e & kindMask ) != KIND_BASE ) return 16;
+		bits.Consume( EntryBits(e) );
+		unsigned int s = EntryValue(e);
+		if ( s < 16 ) { lengths[n++] = (uint8_t) s; continue; }
+		unsigned int repeat;
+		uint8_t value = 0;
+		if ( s == 16 ) {
+			if ( n == 0 ) return 54;	// no previous length to repeat
+			value  = lengths[n-1];
+			repeat = 3 + bits.Read(2);
+		} else if ( s == 17 ) {
+			repeat = 3 + bits.Read(3);
+		} else {
+			repeat = 11 + bits.Read(7);
+		}
+		if ( n + repeat > total ) return 13;
+		memset( lengths + n, value, repeat );
+		n += repeat;
+	}
+	if ( bits.Overrun() ) return 50;
+	if ( lengths[256] == 0 ) return 64;	// the end code must be present
+	if ( !litLen.Build( lengths, hlit, litLenTableBits, LitLenEntry ) ) return 55;
+	if ( !dist.Build( lengths + hlit, hdist, distTableBits, DistEntry ) ) return 57;
+	litLen.PairLiterals( litLenTableBits );
+	return 0;
+}
+
+} // namespace inflate
+
+//-------------------------------------------------------------------------------
+
+inline unsigned Inflate( unsigned char **out, size_t *outsize, unsigned char const *in, size_t insize, LodePNGDecompressSettings const *settings )
+{
+	using namespace inflate;
+	BitReader bits( in, insize );
+	Output output( *out, *outsize, settings ? settings->max_output_size : 0 );
+	size_t const outStart = output.size;
+	output.Reserve( insize * 4 );	// a guess to avoid most reallocations, PNG data usually compresses less than 4:1
+	Table litLen, dist, codeLength;
+	unsigned error = 0;
+	bool last = false;
+	while ( !error && !last ) {
+		bits.Refill();
+		last = bits.Read(1) != 0;
+		unsigned int type = bits.Read(2);
+		if ( bits.Overrun() ) { error = 52; break; }
+		if ( type == 0 ) {
+			// Stored block
+			size_t p = bits.AlignToByte();
+			if ( p + 4 > insize ) { error = 52; break; }
+			unsigned int len  = in[p] | ( unsigned(in[p+1]) << 8 );
+			unsigned int nlen = in[p+2] | ( unsigned(in[p+3]) << 8 );
+			p += 4;
+			if ( !( settings && settings->ignore_nlen ) && len + nlen != 65535 ) { error = 21; break; }
+			if ( p + len > insize ) { error = 23; break; }
+			if ( !output.Reserve( len ) ) { error = 83; break; }
+			memcpy( output.data + output.size, in + p, len );
+			output.size += len;
+			bits.pos = p + len;
+			if ( output.maxSize && output.size > output.maxSize ) error = 109;
+		} else if ( type == 1 ) {
+			FixedTables const &fixed = FixedTables::Get();
+			error = DecodeBlock( bits, output, outStart, fixed.litLen, fixed.dist );
+		} else if ( type == 2 ) {
+			error = ReadDynamicTables( bits, litLen, dist, codeLength );
+			if ( !error ) error = DecodeBlock( bits, output, outStart, litLen, dist );
+		} else {
+			error = 20;	// invalid block type
+		}
+	}
+	*out = output.data;
+	*outsize = output.size;
+	return error;
+}
+
+inline unsigned ZlibDecompress( unsigned char **out, size_t *outsize, unsigned char const *in, size_t insize, LodePNGDecompressSettings const *settings )
+{
+	if ( insize < 2 ) return 53;
+	if ( ( in[0]*256 + in[1] ) % 31 != 0 ) return 24;
+	if ( ( in[0] & 15 ) != 8 || ( in[0] >> 4 ) > 7 ) return 25;	// only deflate with a window of at most 32K
+	if ( ( in[1] >> 5 ) & 1 ) return 26;	// no preset dictionary in PNG
+	size_t start = *outsize;
+	unsigned error = Inflate( out, outsize, in + 2, insize - 2, settings );
+	if ( error ) return error;
+	if ( !( settings && settings->ignore_adler32 ) ) {
+		if ( insize < 6 ) return 58;
+		unsigned char const *c = in + insize - 4;
+		uint32_t adler = ( uint32_t(c[0]) << 24 ) | ( uint32_t(c[1]) << 16 ) | ( uint32_t(c[2]) << 8 ) | c[3];
+		if ( adler != Adler32( *out + start, *outsize - start ) ) return 58;
+	}
+	return 0;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,135 @@
+//-------------------------------------------------------------------------------
+//! \file   cyMappedFile.h
+//!
+//! \brief  Read-only memory-mapped file.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_MAPPED_FILE_H_INCLUDED_
+#define _CY_MAPPED_FILE_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+
+#ifdef _WIN32
+# ifndef NOMINMAX
+#  define NOMINMAX				// keeps windows.h from defining the min and max macros
+# endif
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h>
+#else
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Read-only memory-mapped file.
+//!
+//! Maps the whole file into the address space of the process, so that it can be
+//! parsed or uploaded directly without copying it into an intermediate buffer.
+//! The mapped data is not null-terminated. Empty files are opened successfully,
+//! but they return a null data pointer.
+
+class MappedFile
+{
+public:
+	MappedFile() : data(nullptr), size(0), isOpen(false)
+#ifdef _WIN32
+		, file(INVALID_HANDLE_VALUE), mapping(nullptr)
+#endif
+		{}
+	~MappedFile() { Close(); }
+
+	MappedFile( MappedFile const & ) CY_CLASS_FUNCTION_DELETE
+	MappedFile& operator = ( MappedFile const & ) CY_CLASS_FUNCTION_DELETE
+
+	//! Maps the given file. Any previously mapped file is closed.
+	//! Returns false if the file cannot be opened or mapped.
+	bool Open( char const *filename );
+
+	//! Unmaps the file.
+	void Close();
+
+	bool        IsOpen() const { return isOpen; }	//!< Returns true if a file is mapped
+	char const* Data  () const { return data; }		//!< Returns the beginning of the mapped file data
+	size_t      Size  () const { return size; }		//!< Returns the size of the mapped file in bytes
+	char const* End   () const { return data+size; }	//!< Returns the end of the mapped file data
+
+private:
+	char const *data;
+	size_t      size;
+	bool        isOpen;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+};
+
+//-------------------------------------------------------------------------------
+
+inline bool MappedFile::Open( char const *filename )
+{
+	Close();
+#ifdef _WIN32
+	file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr );
+	if ( file == INVALID_HANDLE_VALUE ) return false;
+	LARGE_INTEGER fileSize;
+	if ( !GetFileSizeEx( file, &fileSize ) ) { Close(); return false; }
+	size = (size_t) fileSize.QuadPart;
+	if ( size > 0 ) {
+		mapping = CreateFileMappingA( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if ( !mapping ) { Close(); return false; }
+		data = (char const*) MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+		if ( !data ) { Close(); return false; }
+	}
+#else
+	int fd = open( filename, O_RDONLY );
+	if ( fd < 0 ) return false;
+	struct stat st;
+	if ( fstat( fd, &st ) != 0 ) { close(fd); return false; }
+	size = (size_t) st.st_size;
+	if ( size > 0 ) {
+		void *p = mmap( nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+		if ( p == MAP_FAILED ) { close(fd); size=0; return false; }
+		madvise( p, size, MADV_SEQUENTIAL );
+		data = (char const*) p;
+	}
+	close(fd);	// the mapping keeps its own reference to the file
+#endif
+	isOpen = true;
+	return true;
+}
+
+inline void MappedFile::Close()
+{
+#ifdef _WIN32
+	if ( data ) UnmapViewOfFile( data );
+	if ( mapping ) CloseHandle( mapping );
+	if ( file != INVALID_HANDLE_VALUE ) CloseHandle( file );
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if ( data ) munmap( (void*) data, size );
+#endif
+	data = nullptr;
+	size = 0;
+	isOpen = false;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::MappedFile cyMappedFile;	//!< Read-only memory-mapped file
+
+//-------------------------------------------------------------------------------
+
+#endif
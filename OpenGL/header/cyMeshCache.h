@@ -0,0 +1,464 @@
+//-------------------------------------------------------------------------------
+//! \file   cyMeshCache.h
+//!
+//! \brief  Binary cache of GPU-ready mesh data (.cymesh files).
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_MESH_CACHE_H_INCLUDED_
+#define _CY_MESH_CACHE_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyTriMesh.h"
+#include "cyIndexedMesh.h"
+#include "cyMappedFile.h"
+#include "cyHash.h"
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <filesystem>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Binary cache of GPU-ready mesh data.
+//!
+//! Holds the welded vertex streams and the index buffer (see IndexedMesh), the material
+//! face ranges, the materials, and the bounding box of a mesh. The triangle and vertex
+//! order is optimized for the post-transform vertex cache, overdraw, and vertex fetch when
+//! the cache is built, and the vertex cache statistics before and after the optimization
+//! are kept in the cache file. The faces are also grouped into meshlets with bounding
+//! spheres and normal cones for per-cluster culling (see cyMeshlet.h), and simplified
+//! levels of detail are appended to the index buffer (see IndexedMesh::BuildLods). Indices
+//! are stored with 16 bits when possible. A cache file is keyed on the size, modification
+//! time, and hash of the source file it was built from, and it is memory-mapped when
+//! loaded, so the vertex and index data can be uploaded to the GPU directly from the mapped
+//! file.
+//!
+//! The .mtl files referenced by the source file are not part of the key. Delete the
+//! cache file after editing them.
+
+class MeshCache
+{
+public:
+	typedef IndexedMesh::MtlRange MtlRange;	//!< Material face range
+	typedef IndexedMesh::LodLevel LodLevel;	//!< Level of detail face range
+
+	MeshCache() {}
+	MeshCache( MeshCache const & ) CY_CLASS_FUNCTION_DELETE
+	MeshCache& operator = ( MeshCache const & ) CY_CLASS_FUNCTION_DELETE
+
+	//!@name Creating and storing the cache
+	bool Load ( char const *cacheFile, char const *sourceFile );	//!< Maps the cache file. Returns false if the cache file does not exist, is invalid, or it does not match the current source file.
+	void Build( TriMesh const &mesh, bool optimize=true );			//!< Builds the cache data from the given mesh by welding its vertices, optionally optimizing their order, building meshlets, and building levels of detail. The mesh should have vertex normals.
+	bool Save ( char const *cacheFile, char const *sourceFile ) const;	//!< Writes the cache data to a file, keyed on the given source file.
+	void Clear();													//!< Releases all data
+
+	//! Returns the cache file name for the given source file by replacing its extension with .cymesh.
+	static std::string GetCacheFileName( char const *sourceFile ) { return std::filesystem::path(sourceFile).replace_extension(".cymesh").string(); }
+
+	//!@name Access methods
+	bool           IsMapped    () const { return file.IsOpen(); }	//!< Returns true if the data is read from a mapped cache file
+	unsigned int   NumVertices () const { return numVertices; }		//!< Returns the number of vertices
+	unsigned int   NumIndices  () const { return numIndices; }		//!< Returns the number of indices of the full mesh, which is three times the number of faces
+	unsigned int   NumFaces    () const { return numIndices / 3; }	//!< Returns the number of faces of the full mesh
+	unsigned int   IndexSize   () const { return indexSize; }		//!< Returns the size of an index in bytes (2 or 4)
+	void const *   Indices     () const { return indices; }			//!< Returns the index data
+	size_t         IndicesSize () const { return size_t(numLodIndices)*indexSize; }	//!< Returns the size of the index data of all levels of detail in bytes
+	bool           HasTexCoords() const { return hasTexCoords; }	//!< Returns true if the source mesh had texture coordinates
+	float const *  Positions   () const { return positions; }		//!< Returns the vertex positions (3 floats per vertex)
+	float const *  Normals     () const { return normals; }			//!< Returns the vertex normals (3 floats per vertex)
+	float const *  TexCoords   () const { return texCoords; }		//!< Returns the texture coordinates (2 floats per vertex)
+	size_t         PositionsSize() const { return size_t(numVertices)*3*sizeof(float); }	//!< Returns the size of the position data in bytes
+	size_t         NormalsSize  () const { return size_t(numVertices)*3*sizeof(float); }	//!< Returns the size of the normal data in bytes
+	size_t         TexCoordsSize() const { return size_t(numVertices)*2*sizeof(float); }	//!< Returns the size of the texture coordinate data in bytes
+	unsigned int   NumMtls     () const { return (unsigned int)mtls.size(); }	//!< Returns the number of materials
+	TriMesh::Mtl const & M     ( int i ) const { return mtls[i]; }		//!< Returns the i^th material
+	MtlRange const & GetMtlRange( int i, int lod=0 ) const { return mtlRanges[ size_t(lod)*mtls.size() + i ]; }	//!< Returns the face range of the i^th material in the given level of detail
+	unsigned int   NumMeshlets () const { return numMeshlets; }		//!< Returns the number of meshlets
+	Meshlet const *Meshlets    () const { return meshlets; }		//!< Returns the meshlets, sorted by their first face
+	Meshlet const & GetMeshlet ( int i ) const { return meshlets[i]; }	//!< Returns the i^th meshlet
+	unsigned int   NumLods     () const { return numLods; }			//!< Returns the number of levels of detail, including the full mesh
+	LodLevel const & GetLod    ( int i ) const { return lods[i]; }	//!< Returns the face range and error of the i^th level of detail, the first one is the full mesh
+	Vec3f          GetBoundMin () const { return boundMin; }			//!< Returns the minimum bound of the bounding box
+	Vec3f          GetBoundMax () const { return boundMax; }			//!< Returns the maximum bound of the bounding box
+	size_t         FileSize    () const { return file.Size(); }		//!< Returns the size of the mapped cache file
+	VertexCacheStats const & GetOriginalCacheStats () const { return originalCacheStats; }	//!< Returns the vertex cache statistics of the welded mesh before optimization
+	VertexCacheStats const & GetOptimizedCacheStats() const { return optimizedCacheStats; }	//!< Returns the vertex cache statistics of the stored index buffer
+
+private:
+	static uint32_t const version = 5;
+	enum SectionType : uint32_t { SECTION_POSITIONS=1, SECTION_NORMALS, SECTION_TEXCOORDS, SECTION_MATERIALS, SECTION_STRINGS, SECTION_INDICES, SECTION_MESHLETS, SECTION_LODS, SECTION_LOD_RANGES, SECTION_COUNT };
+	enum Flags : uint32_t { FLAG_TEXCOORDS=1 };
+	static size_t const alignment = 64;
+
+	struct Header
+	{
+		char     magic[8];
+		uint32_t version;
+		uint32_t numSections;
+		uint64_t sourceSize;
+		int64_t  sourceTime;
+		uint64_t sourceHash;
+		uint32_t numVertices;
+		uint32_t numIndices;
+		uint32_t indexSize;
+		uint32_t numMtls;
+		uint32_t flags;
+		float    boundMin[3];
+		float    boundMax[3];
+		uint32_t cacheSize;
+		uint32_t originalTransforms;
+		uint32_t optimizedTransforms;
+		uint32_t numLodIndices;
+	};
+	struct Section
+	{
+		uint32_t type;
+		uint32_t reserved;
+		uint64_t offset;
+		uint64_t size;
+	};
+	struct MtlRecord
+	{
+		uint32_t firstFace, faceCount;
+		float    Ka[3], Kd[3], Ks[3], Tf[3];
+		float    Ns, Ni;
+		int32_t  illum;
+		uint32_t name, map_Ka, map_Kd, map_Ks, map_Ns, map_d, map_bump, map_disp;	// offsets in the string section
+	};
+	static uint32_t const noString = 0xFFFFFFFF;
+
+	MappedFile   file;
+	unsigned int numVertices  = 0;
+	unsigned int numIndices   = 0;
+	unsigned int numLodIndices= 0;
+	unsigned int indexSize    = 4;
+	bool         hasTexCoords = false;
+	float const *positions    = nullptr;
+	float const *normals      = nullptr;
+	float const *texCoords    = nullptr;
+	void  const *indices      = nullptr;
+	Meshlet const *meshlets   = nullptr;
+	unsigned int numMeshlets  = 0;
+	LodLevel const *lods      = nullptr;
+	unsigned int numLods      = 0;
+	IndexedMesh           indexedMesh;	// used when the data is not mapped
+	std::vector<uint16_t> indices16;
+	std::vector<Meshlet>  meshletData;	// used when the data is not mapped
+	std::vector<TriMesh::Mtl> mtls;
+	std::vector<MtlRange>     mtlRanges;	// level major
+	Vec3f boundMin = Vec3f(0,0,0);
+	Vec3f boundMax = Vec3f(0,0,0);
+	VertexCacheStats originalCacheStats;
+	VertexCacheStats optimizedCacheStats;
+
+	static bool GetSourceKey( char const *sourceFile, Header &header );
+};
+
+//-------------------------------------------------------------------------------
+
+// Fills in the source size, time, and hash of the header. Returns false if the source file cannot be read.
+inline bool MeshCache::GetSourceKey( char const *sourceFile, Header &header )
+{
+	std::error_code ec;
+	auto time = std::filesystem::last_write_time( sourceFile, ec );
+	if ( ec ) return false;
+	MappedFile source;
+	if ( !source.Open(sourceFile) ) return false;
+	header.sourceSize = source.Size();
+	header.sourceTime = (int64_t) time.time_since_epoch().count();
+	header.sourceHash = Hash64( source.Data(), source.Size() );
+	return true;
+}
+
+inline void MeshCache::Clear()
+{
+	file.Close();
+	numVertices = numIndices = numLodIndices = 0;
+	indexSize = 4;
+	hasTexCoords = false;
+	positions = normals = texCoords = nullptr;
+	indices = nullptr;
+	meshlets = nullptr;
+	numMeshlets = 0;
+	lods = nullptr;
+	numLods = 0;
+	indexedMesh = IndexedMesh();
+	indices16.clear();
+	indices16.shrink_to_fit();
+	meshletData.clear();
+	meshletData.shrink_to_fit();
+	mtls.clear();
+	mtlRanges.clear();
+	boundMin.Zero();
+	boundMax.Zero();
+	originalCacheStats  = VertexCacheStats();
+	optimizedCacheStats = VertexCacheStats();
+}
+
+inline bool MeshCache::Load( char const *cacheFile, char const *sourceFile )
+{
+	Clear();
+	if ( !file.Open(cacheFile) ) return false;
+
+	auto fail = [this]() { Clear(); return false; };
+
+	Header header;
+	if ( file.Size() < sizeof(Header) ) return fail();
+	memcpy( &header, file.Data(), sizeof(Header) );
+	if ( memcmp( header.magic, "CYMESH\0\0", 8 ) != 0 || header.version != version ) return fail();
+	if ( header.numIndices % 3 != 0 || header.numLodIndices % 3 != 0 || header.numLodIndices < header.numIndices || ( header.indexSize != 2 && header.indexSize != 4 ) ) return fail();
+	size_t tableEnd = sizeof(Header) + size_t(header.numSections)*sizeof(Section);
+	if ( header.numSections > 64 || file.Size() < tableEnd ) return fail();
+
+	// Check the source file; the hash is only computed if the size and time match
+	Header source;
+	std::error_code ec;
+	auto time = std::filesystem::last_write_time( sourceFile, ec );
+	if ( ec || header.sourceTime != (int64_t) time.time_since_epoch().count() ) return fail();
+	if ( header.sourceSize != (uint64_t) std::filesystem::file_size( sourceFile, ec ) || ec ) return fail();
+	if ( !GetSourceKey(sourceFile,source) || source.sourceHash != header.sourceHash ) return fail();
+
+	// Find the sections
+	char const *data = file.Data();
+	char const *sectionData[SECTION_COUNT] = {};
+	uint64_t    sectionSize[SECTION_COUNT] = {};
+	for ( uint32_t i=0; i<header.numSections; i++ ) {
+		Section s;
+		memcpy( &s, data + sizeof(Header) + i*sizeof(Section), sizeof(Section) );
+		if ( s.offset > file.Size() || s.size > file.Size() - s.offset ) return fail();
+		if ( s.type >= SECTION_POSITIONS && s.type < SECTION_COUNT ) {
+			sectionData[s.type] = data + s.offset;
+			sectionSize[s.type] = s.size;
+		}
+	}
+	numVertices = header.numVertices;
+	numIndices  = header.numIndices;
+	numLodIndices = header.numLodIndices;
+	indexSize   = header.indexSize;
+	if ( sectionSize[SECTION_POSITIONS] != PositionsSize() ||
+	     sectionSize[SECTION_NORMALS  ] != NormalsSize  () ||
+	     sectionSize[SECTION_TEXCOORDS] != TexCoordsSize() ||
+	     sectionSize[SECTION_INDICES  ] != IndicesSize  () ||
+	     sectionSize[SECTION_MATERIALS] != header.numMtls*sizeof(MtlRecord) ) return fail();
+	positions = (float const*) sectionData[SECTION_POSITIONS];
+	normals   = (float const*) sectionData[SECTION_NORMALS  ];
+	texCoords = (float const*) sectionData[SECTION_TEXCOORDS];
+	indices   = sectionData[SECTION_INDICES];
+	// indices must not reference vertices beyond the vertex streams
+	uint32_t maxIndex = 0;
+	if ( indexSize == 2 ) { uint16_t const *ix = (uint16_t const*) indices; for ( unsigned int i=0; i<numLodIndices; i++ ) maxIndex = Max( maxIndex, (uint32_t) ix[i] ); }
+	else                  { uint32_t const *ix = (uint32_t const*) indices; for ( unsigned int i=0; i<numLodIndices; i++ ) maxIndex = Max( maxIndex, ix[i] ); }
+	if ( numLodIndices > 0 && maxIndex >= numVertices ) return fail();
+	// meshlets must be sorted, disjoint face ranges
+	if ( sectionSize[SECTION_MESHLETS] % sizeof(Meshlet) != 0 ) return fail();
+	meshlets    = (Meshlet const*) sectionData[SECTION_MESHLETS];
+	numMeshlets = (unsigned int)( sectionSize[SECTION_MESHLETS] / sizeof(Meshlet) );
+	for ( unsigned int i=0, end=0; i<numMeshlets; i++ ) {
+		if ( meshlets[i].firstFace < end || meshlets[i].firstFace > NumFaces() || meshlets[i].faceCount > NumFaces() - meshlets[i].firstFace ) return fail();
+		end = meshlets[i].firstFace + meshlets[i].faceCount;
+	}
+	// the first level of detail is the full mesh, and the levels must be within the index buffer
+	unsigned int const numLodFaces = numLodIndices / 3;
+	if ( sectionSize[SECTION_LODS] % sizeof(LodLevel) != 0 || sectionSize[SECTION_LODS] == 0 ) return fail();
+	lods    = (LodLevel const*) sectionData[SECTION_LODS];
+	numLods = (unsigned int)( sectionSize[SECTION_LODS] / sizeof(LodLevel) );
+	if ( lods[0].firstFace != 0 || lods[0].faceCount != NumFaces() ) return fail();
+	for ( unsigned int i=1; i<numLods; i++ ) {
+		if ( lods[i].firstFace > numLodFaces || lods[i].faceCount > numLodFaces - lods[i].firstFace ) return fail();
+	}
+	if ( sectionSize[SECTION_LOD_RANGES] != uint64_t(numLods-1)*header.numMtls*sizeof(MtlRange) ) return fail();
+	hasTexCoords = (header.flags & FLAG_TEXCOORDS) != 0;
+	boundMin.Set( header.boundMin[0], header.boundMin[1], header.boundMin[2] );
+	boundMax.Set( header.boundMax[0], header.boundMax[1], header.boundMax[2] );
+	auto setStats = [this,&header]( VertexCacheStats &stats, uint32_t transforms ) {
+		stats.cacheSize  = header.cacheSize;
+		stats.transforms = transforms;
+		stats.acmr = numIndices  > 0 ? float(transforms) / float(NumFaces())  : 0.0f;
+		stats.atvr = numVertices > 0 ? float(transforms) / float(numVertices) : 0.0f;
+	};
+	setStats( originalCacheStats,  header.originalTransforms  );
+	setStats( optimizedCacheStats, header.optimizedTransforms );
+
+	// Materials
+	char const *strings     = sectionData[SECTION_STRINGS];
+	uint64_t    stringsSize = sectionSize[SECTION_STRINGS];
+	auto getString = [&]( uint32_t offset, TriMesh::Str &str ) {
+		if ( offset == noString ) return true;
+		if ( offset >= stringsSize || !memchr( strings+offset, '\0', stringsSize-offset ) ) return false;
+		str = strings + offset;
+		return true;
+	};
+	mtls.resize( header.numMtls );
+	mtlRanges.resize( size_t(numLods)*header.numMtls );
+	for ( uint32_t i=0; i<header.numMtls; i++ ) {
+		MtlRecord r;
+		memcpy( &r, sectionData[SECTION_MATERIALS] + i*sizeof(MtlRecord), sizeof(MtlRecord) );
+		if ( r.firstFace > NumFaces() || r.faceCount > NumFaces() - r.firstFace ) return fail();
+		mtlRanges[i].firstFace = r.firstFace;
+		mtlRanges[i].faceCount = r.faceCount;
+		TriMesh::Mtl &m = mtls[i];
+		for ( int j=0; j<3; j++ ) { m.Ka[j]=r.Ka[j]; m.Kd[j]=r.Kd[j]; m.Ks[j]=r.Ks[j]; m.Tf[j]=r.Tf[j]; }
+		m.Ns = r.Ns;
+		m.Ni = r.Ni;
+		m.illum = r.illum;
+		if ( !getString( r.name,     m.name     ) || !getString( r.map_Ka,   m.map_Ka   ) ||
+		     !getString( r.map_Kd,   m.map_Kd   ) || !getString( r.map_Ks,   m.map_Ks   ) ||
+		     !getString( r.map_Ns,   m.map_Ns   ) || !getString( r.map_d,    m.map_d    ) ||
+		     !getString( r.map_bump, m.map_bump ) || !getString( r.map_disp, m.map_disp ) ) return fail();
+	}
+	if ( numLods > 1 ) memcpy( mtlRanges.data() + header.numMtls, sectionData[SECTION_LOD_RANGES], sectionSize[SECTION_LOD_RANGES] );
+	for ( unsigned int l=1; l<numLods; l++ ) {
+		for ( uint32_t i=0; i<header.numMtls; i++ ) {
+			MtlRange const &r = mtlRanges[ size_t(l)*header.numMtls + i ];
+			if ( r.firstFace < lods[l].firstFace || r.firstFace > lods[l].firstFace + lods[l].faceCount || r.faceCount > lods[l].firstFace + lods[l].faceCount - r.firstFace ) return fail();
+		}
+	}
+	return true;
+}
+
+inline void MeshCache::Build( TriMesh const &mesh, bool optimize )
+{
+	Clear();
+	indexedMesh.Build( mesh );
+	originalCacheStats = indexedMesh.AnalyzeVertexCache();
+	if ( optimize ) indexedMesh.Optimize( originalCacheStats.cacheSize );
+	indexedMesh.BuildMeshlets( meshletData, meshletMaxVertices, meshletMaxTriangles, optimize ? originalCacheStats.cacheSize : 0 );
+	meshlets    = meshletData.data();
+	numMeshlets = (unsigned int) meshletData.size();
+	optimizedCacheStats = optimize ? indexedMesh.AnalyzeVertexCache( originalCacheStats.cacheSize ) : originalCacheStats;
+	indexedMesh.BuildLods( 8, 0.05f, optimize ? originalCacheStats.cacheSize : 0 );
+	lods    = indexedMesh.lods.data();
+	numLods = (unsigned int) indexedMesh.lods.size();
+	numVertices   = indexedMesh.NumVertices();
+	numIndices    = lods[0].faceCount * 3;
+	numLodIndices = indexedMesh.NumIndices();
+	hasTexCoords = indexedMesh.hasTexCoords;
+	positions    = indexedMesh.positions.data();
+	normals      = indexedMesh.normals  .data();
+	texCoords    = indexedMesh.texCoords.data();
+	if ( indexedMesh.Use16BitIndices() ) {
+		indexedMesh.GetIndices16( indices16 );
+		indexedMesh.indices.clear();
+		indexedMesh.indices.shrink_to_fit();
+		indexSize = 2;
+		indices   = indices16.data();
+	} else {
+		indexSize = 4;
+		indices   = indexedMesh.indices.data();
+	}
+	mtlRanges = indexedMesh.mtlRanges;
+	boundMin  = indexedMesh.boundMin;
+	boundMax  = indexedMesh.boundMax;
+
+	mtls.resize( mesh.NM() );
+	for ( unsigned int i=0; i<mesh.NM(); i++ ) mtls[i] = mesh.M(i);
+}
+
+inline bool MeshCache::Save( char const *cacheFile, char const *sourceFile ) const
+{
+	Header header = {};
+	memcpy( header.magic, "CYMESH\0\0", 8 );
+	header.version     = version;
+	header.numVertices = numVertices;
+	header.numIndices  = numIndices;
+	header.numLodIndices = numLodIndices;
+	header.indexSize   = indexSize;
+	header.numMtls     = (uint32_t) mtls.size();
+	header.flags       = hasTexCoords ? uint32_t(FLAG_TEXCOORDS) : 0u;
+	for ( int j=0; j<3; j++ ) { header.boundMin[j] = boundMin[j]; header.boundMax[j] = boundMax[j]; }
+	header.cacheSize           = originalCacheStats.cacheSize;
+	header.originalTransforms  = originalCacheStats.transforms;
+	header.optimizedTransforms = optimizedCacheStats.transforms;
+	if ( !GetSourceKey(sourceFile,header) ) return false;
+
+	// Materials and strings
+	std::vector<char> strings;
+	auto addString = [&strings]( TriMesh::Str const &str ) {
+		if ( !str.data ) return noString;
+		uint32_t offset = (uint32_t) strings.size();
+		strings.insert( strings.end(), str.data, str.data + strlen(str.data) + 1 );
+		return offset;
+	};
+	std::vector<MtlRecord> records( mtls.size() );
+	for ( size_t i=0; i<mtls.size(); i++ ) {
+		TriMesh::Mtl const &m = mtls[i];
+		MtlRecord &r = records[i];
+		r.firstFace = mtlRanges[i].firstFace;
+		r.faceCount = mtlRanges[i].faceCount;
+		for ( int j=0; j<3; j++ ) { r.Ka[j]=m.Ka[j]; r.Kd[j]=m.Kd[j]; r.Ks[j]=m.Ks[j]; r.Tf[j]=m.Tf[j]; }
+		r.Ns = m.Ns;
+		r.Ni = m.Ni;
+		r.illum    = m.illum;
+		r.name     = addString( m.name     );
+		r.map_Ka   = addString( m.map_Ka   );
+		r.map_Kd   = addString( m.map_Kd   );
+		r.map_Ks   = addString( m.map_Ks   );
+		r.map_Ns   = addString( m.map_Ns   );
+		r.map_d    = addString( m.map_d    );
+		r.map_bump = addString( m.map_bump );
+		r.map_disp = addString( m.map_disp );
+	}
+
+	struct Block { SectionType type; void const *data; size_t size; };
+	Block const blocks[] = {
+		{ SECTION_POSITIONS, positions,      PositionsSize() },
+		{ SECTION_NORMALS,   normals,        NormalsSize  () },
+		{ SECTION_TEXCOORDS, texCoords,      TexCoordsSize() },
+		{ SECTION_INDICES,   indices,        IndicesSize  () },
+		{ SECTION_MESHLETS,  meshlets,       size_t(numMeshlets)*sizeof(Meshlet) },
+		{ SECTION_LODS,      lods,           size_t(numLods)*sizeof(LodLevel) },
+		{ SECTION_LOD_RANGES, mtlRanges.data() + mtls.size(), ( mtlRanges.size() - mtls.size() )*sizeof(MtlRange) },
+		{ SECTION_MATERIALS, records.data(), records.size()*sizeof(MtlRecord) },
+		{ SECTION_STRINGS,   strings.data(), strings.size() },
+	};
+	int const numBlocks = sizeof(blocks)/sizeof(Block);
+	header.numSections = numBlocks;
+
+	// Sections are aligned, so that the data can be accessed directly from the mapped file
+	Section sections[numBlocks];
+	uint64_t offset = sizeof(Header) + sizeof(sections);
+	for ( int i=0; i<numBlocks; i++ ) {
+		offset = (offset + alignment-1) & ~uint64_t(alignment-1);
+		sections[i].type     = blocks[i].type;
+		sections[i].reserved = 0;
+		sections[i].offset   = offset;
+		sections[i].size     = blocks[i].size;
+		offset += blocks[i].size;
+	}
+
+	// Write to a temporary file first, so that an interrupted write never leaves a partial cache file
+	std::string tmpFile = std::string(cacheFile) + ".tmp";
+	FILE *fp = fopen( tmpFile.c_str(), "wb" );
+	if ( !fp ) return false;
+	bool ok = fwrite( &header, sizeof(Header), 1, fp ) == 1 && fwrite( sections, sizeof(sections), 1, fp ) == 1;
+	uint64_t pos = sizeof(Header) + sizeof(sections);
+	char const zeros[alignment] = {};
+	for ( int i=0; ok && i<numBlocks; i++ ) {
+		size_t pad = size_t( sections[i].offset - pos );
+		if ( pad > 0 ) ok = fwrite( zeros, 1, pad, fp ) == pad;
+		if ( ok && blocks[i].size > 0 ) ok = fwrite( blocks[i].data, 1, blocks[i].size, fp ) == blocks[i].size;
+		pos = sections[i].offset + blocks[i].size;
+	}
+	ok = ( fclose(fp) == 0 ) && ok;
+	std::error_code ec;
+	if ( ok ) std::filesystem::rename( tmpFile, cacheFile, ec );
+	if ( !ok || ec ) {
+		std::filesystem::remove( tmpFile, ec );
+		return false;
+	}
+	return true;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::MeshCache cyMeshCache;	//!< Binary cache of GPU-ready mesh data
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,253 @@
+//-------------------------------------------------------------------------------
+//! \file   cyMeshOptimizer.h
+//!
+//! \brief  Triangle and vertex order optimization for indexed triangle meshes.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_MESH_OPTIMIZER_H_INCLUDED_
+#define _CY_MESH_OPTIMIZER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyVector.h"
+#include <vector>
+#include <algorithm>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Post-transform vertex cache statistics of an index buffer.
+struct VertexCacheStats
+{
+	unsigned int cacheSize  = 0;	//!< number of entries of the simulated FIFO cache
+	unsigned int transforms = 0;	//!< number of vertex shader invocations (cache misses)
+	float        acmr       = 0;	//!< average cache miss ratio: transformed vertices per triangle (0.5 at best, 3 at worst)
+	float        atvr       = 0;	//!< average transformed vertex ratio: transformed vertices per vertex (1 at best)
+};
+
+//! The default post-transform vertex cache size used for optimization and statistics.
+unsigned int const defaultVertexCacheSize = 16;
+
+//-------------------------------------------------------------------------------
+
+//! Simulates a FIFO post-transform vertex cache with the given size on the given triangle
+//! index buffer and returns the number of vertex transforms, ACMR, and ATVR.
+CY_NODISCARD inline VertexCacheStats AnalyzeVertexCache( uint32_t const *indices, size_t numIndices, unsigned int numVertices, unsigned int cacheSize=defaultVertexCacheSize )
+{
+	VertexCacheStats stats;
+	stats.cacheSize = cacheSize;
+	// A vertex is in the FIFO cache, if fewer than cacheSize vertices were added after it.
+	std::vector<unsigned int> cacheTime( numVertices, 0 );
+	unsigned int time = cacheSize + 1;
+	for ( size_t i=0; i<numIndices; i++ ) {
+		uint32_t v = indices[i];
+		if ( time - cacheTime[v] > cacheSize ) {
+			cacheTime[v] = time++;
+			stats.transforms++;
+		}
+	}
+	size_t numFaces = numIndices / 3;
+	stats.acmr = numFaces    > 0 ? float(stats.transforms) / float(numFaces)    : 0.0f;
+	stats.atvr = numVertices > 0 ? float(stats.transforms) / float(numVertices) : 0.0f;
+	return stats;
+}
+
+//-------------------------------------------------------------------------------
+
+//! Reorders the triangles of the given index buffer for post-transform vertex cache locality
+//! using Tipsify (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced
+//! Overdraw", 2007). It runs in linear time. The vertex order within each triangle is kept,
+//! so the winding does not change.
+inline void OptimizeVertexCache( uint32_t *indices, size_t numIndices, unsigned int numVertices, unsigned int cacheSize=defaultVertexCacheSize )
+{
+	size_t const numFaces = numIndices / 3;
+	if ( numFaces < 2 ) return;
+	unsigned int const invalid = 0xFFFFFFFF;
+
+	// Vertex-triangle adjacency and the number of triangles of each vertex that are not emitted yet
+	std::vector<unsigned int> live   ( numVertices, 0 );
+	std::vector<unsigned int> offsets( size_t(numVertices)+1, 0 );
+	for ( size_t i=0; i<numFaces*3; i++ ) live[ indices[i] ]++;
+	for ( unsigned int v=0; v<numVertices; v++ ) offsets[v+1] = offsets[v] + live[v];
+	std::vector<unsigned int> adjacency( numFaces*3 );
+	{
+		std::vector<unsigned int> pos( offsets.begin(), offsets.end()-1 );
+		for ( size_t i=0; i<numFaces*3; i++ ) adjacency[ pos[ indices[i] ]++ ] = (unsigned int)(i/3);
+	}
+
+	std::vector<unsigned int> cacheTime( numVertices, 0 );
+	std::vector<bool>         emitted  ( numFaces, false );
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<uint32_t>     output;
+	deadEnd.reserve( numFaces*3 );
+	output .reserve( numFaces*3 );
+	unsigned int time   = cacheSize + 1;
+	unsigned int cursor = 0;
+
+	unsigned int f = indices[0];	// fanning vertex
+	while ( f != invalid ) {
+		// Emit all remaining triangles of the fanning vertex
+		candidates.clear();
+		for ( unsigned int j=offsets[f]; j<offsets[f+1]; j++ ) {
+			unsigned int t = adjacency[j];
+			if ( emitted[t] ) continue;
+			for ( int c=0; c<3; c++ ) {
+				uint32_t v = indices[ size_t(t)*3 + c ];
+				output    .push_back( v );
+				deadEnd   .push_back( v );
+				candidates.push_back( v );
+				live[v]--;
+				if ( time - cacheTime[v] > cacheSize ) cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Pick the candidate that stays in the cache the longest while fanning its remaining triangles
+		f = invalid;
+		int bestPriority = -1;
+		for ( unsigned int v : candidates ) {
+			if ( live[v] == 0 ) continue;
+			int priority = 0;
+			if ( time - cacheTime[v] + 2*live[v] <= cacheSize ) priority = int( time - cacheTime[v] );
+			if ( priority > bestPriority ) { bestPriority = priority; f = v; }
+		}
+		// Dead end: use the most recently referenced vertex with remaining triangles, or the next one in order
+		while ( f == invalid && !deadEnd.empty() ) {
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if ( live[v] > 0 ) f = v;
+		}
+		for ( ; f == invalid && cursor < numVertices; cursor++ ) {
+			if ( live[cursor] > 0 ) f = cursor;
+		}
+	}
+	std::copy( output.begin(), output.end(), indices );
+}
+
+//-------------------------------------------------------------------------------
+
+//! Reorders clusters of triangles of the given index buffer so that triangles that are likely
+//! to occlude others are drawn first. It should be called after OptimizeVertexCache. The triangles
+//! are split into clusters, such that the ACMR within a cluster is at most threshold times the
+//! ACMR of the input, and the clusters are sorted from the outside of the mesh to the inside
+//! (Sander et al. 2007). The order of triangles within a cluster does not change.
+//! The positions array contains 3 floats per vertex.
+inline void OptimizeOverdraw( uint32_t *indices, size_t numIndices, float const *positions, unsigned int numVertices, unsigned int cacheSize=defaultVertexCacheSize, float threshold=1.05f )
+{
+	size_t const numFaces = numIndices / 3;
+	if ( numFaces < 2 ) return;
+
+	std::vector<unsigned int> cacheTime( numVertices, 0 );
+	unsigned int time = cacheSize + 1;
+	auto flush = [&]() { time += cacheSize + 1; };
+	auto simulate = [&]( size_t t ) {
+		int misses = 0;
+		for ( int c=0; c<3; c++ ) {
+			uint32_t v = indices[ t*3 + c ];
+			if ( time - cacheTime[v] > cacheSize ) { cacheTime[v] = time++; misses++; }
+		}
+		return misses;
+	};
+
+	// Hard boundaries: triangles where the cache was effectively restarted
+	std::vector<size_t> hard;
+	for ( size_t t=0; t<numFaces; t++ ) {
+		if ( simulate(t) == 3 || t == 0 ) hard.push_back( t );
+	}
+	hard.push_back( numFaces );
+
+	// Soft boundaries: split hard clusters where the running ACMR is close to that of the cluster
+	std::vector<size_t> clusters;
+	for ( size_t h=0; h+1<hard.size(); h++ ) {
+		size_t start = hard[h], end = hard[h+1];
+		flush();
+		int misses = 0;
+		for ( size_t t=start; t<end; t++ ) misses += simulate(t);
+		float clusterThreshold = threshold * float(misses) / float(end-start);
+
+		flush();
+		clusters.push_back( start );
+		int runMisses = 0, runFaces = 0;
+		for ( size_t t=start; t<end; t++ ) {
+			runMisses += simulate(t);
+			runFaces++;
+			if ( t+1 < end && float(runMisses) <= clusterThreshold * float(runFaces) ) {
+				clusters.push_back( t+1 );
+				flush();
+				runMisses = runFaces = 0;
+			}
+		}
+	}
+	clusters.push_back( numFaces );
+	size_t const numClusters = clusters.size() - 1;
+
+	// Sort the clusters by how much they face away from the center of the mesh
+	auto P = [&]( size_t t, int c ) { float const *p = positions + size_t(indices[t*3+c])*3; return Vec3f(p[0],p[1],p[2]); };
+	std::vector<Vec3f> clusterCenter( numClusters, Vec3f(0,0,0) );
+	std::vector<Vec3f> clusterNormal( numClusters, Vec3f(0,0,0) );
+	Vec3f meshCenter(0,0,0);
+	float meshArea = 0;
+	for ( size_t i=0; i<numClusters; i++ ) {
+		float area = 0;
+		for ( size_t t=clusters[i]; t<clusters[i+1]; t++ ) {
+			Vec3f p0 = P(t,0), p1 = P(t,1), p2 = P(t,2);
+			Vec3f n = (p1-p0).Cross(p2-p0);
+			float a = n.Length();
+			clusterCenter[i] += (p0+p1+p2) * (a/3);
+			clusterNormal[i] += n;
+			area += a;
+		}
+		meshCenter += clusterCenter[i];
+		meshArea   += area;
+		clusterCenter[i] = area > 0 ? clusterCenter[i] / area : P(clusters[i],0);
+		float len = clusterNormal[i].Length();
+		if ( len > 0 ) clusterNormal[i] /= len;
+	}
+	if ( meshArea > 0 ) meshCenter /= meshArea;
+
+	std::vector<float>        sortKey( numClusters );
+	std::vector<unsigned int> order  ( numClusters );
+	for ( size_t i=0; i<numClusters; i++ ) {
+		sortKey[i] = (clusterCenter[i] - meshCenter).Dot( clusterNormal[i] );
+		order  [i] = (unsigned int) i;
+	}
+	std::stable_sort( order.begin(), order.end(), [&]( unsigned int a, unsigned int b ) { return sortKey[a] > sortKey[b]; } );
+
+	std::vector<uint32_t> output;
+	output.reserve( numFaces*3 );
+	for ( unsigned int i : order ) {
+		output.insert( output.end(), indices + clusters[i]*3, indices + clusters[i+1]*3 );
+	}
+	std::copy( output.begin(), output.end(), indices );
+}
+
+//-------------------------------------------------------------------------------
+
+//! Renumbers the vertices in the order they are first referenced by the given index buffer,
+//! so that vertex fetches access memory sequentially. The indices are updated in place, and
+//! remap[v] receives the new index of vertex v (or 0xFFFFFFFF for unreferenced vertices).
+//! Returns the number of referenced vertices. The vertex data must be reordered by the caller.
+inline unsigned int OptimizeVertexFetch( uint32_t *indices, size_t numIndices, unsigned int numVertices, std::vector<uint32_t> &remap )
+{
+	remap.assign( numVertices, 0xFFFFFFFF );
+	unsigned int next = 0;
+	for ( size_t i=0; i<numIndices; i++ ) {
+		uint32_t &v = indices[i];
+		if ( remap[v] == 0xFFFFFFFF ) remap[v] = next++;
+		v = remap[v];
+	}
+	return next;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::VertexCacheStats cyVertexCacheStats;	//!< Post-transform vertex cache statistics of an index buffer
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,326 @@
+//-------------------------------------------------------------------------------
+//! \file   cyMeshSimplifier.h
+//!
+//! \brief  Quadric error metric edge-collapse simplification of indexed triangle meshes.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_MESH_SIMPLIFIER_H_INCLUDED_
+#define _CY_MESH_SIMPLIFIER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyVector.h"
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Simplifies the given triangle index buffer by collapsing edges in the order of their quadric
+//! error (Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics", 1997), until
+//! the number of indices is at most targetIndexCount or the next collapse would exceed targetError.
+//! The simplified triangles are written to the destination array. Vertices are never moved; a
+//! collapse merges a vertex into one of its neighbors, so the vertex data is shared by all levels.
+//!
+//! The simplification is attribute-aware. Vertices that share a position but have different
+//! normals or texture coordinates (seams) only collapse along the seam, together with their twin
+//! vertices, so seams stay closed. Open mesh borders only collapse along the border. If faceMaterials
+//! is not null, it contains a material id per triangle, and vertices on material borders are locked,
+//! so that the material ranges of the result do not crack. Triangles keep their material and their
+//! relative order, so the destination can be split into the same material ranges as the input.
+//! If destinationMaterials is not null, it receives the material id of each simplified triangle.
+//!
+//! The errors are distances relative to the bounding box diagonal of the referenced positions.
+//! Returns the largest error of the performed collapses, which approximates the geometric deviation.
+//! The positions array contains 3 floats per vertex.
+inline float SimplifyMesh( std::vector<uint32_t> &destination, uint32_t const *indices, size_t numIndices, float const *positions, unsigned int numVertices, size_t targetIndexCount, float targetError, uint32_t const *faceMaterials=nullptr, std::vector<uint32_t> *destinationMaterials=nullptr );
+
+//-------------------------------------------------------------------------------
+
+namespace simplifier {
+
+//! Symmetric 4x4 quadric with a weight
+struct Quadric
+{
+	float a00=0, a11=0, a22=0, a01=0, a02=0, a12=0, b0=0, b1=0, b2=0, c=0, w=0;
+
+	void AddPlane( Vec3f const &n, float d, float weight )
+	{
+		a00 += weight*n.x*n.x;  a11 += weight*n.y*n.y;  a22 += weight*n.z*n.z;
+		a01 += weight*n.x*n.y;  a02 += weight*n.x*n.z;  a12 += weight*n.y*n.z;
+		b0  += weight*n.x*d;    b1  += weight*n.y*d;    b2  += weight*n.z*d;
+		c   += weight*d*d;
+		w   += weight;
+	}
+	void operator += ( Quadric const &q ) { a00+=q.a00; a11+=q.a11; a22+=q.a22; a01+=q.a01; a02+=q.a02; a12+=q.a12; b0+=q.b0; b1+=q.b1; b2+=q.b2; c+=q.c; w+=q.w; }
+
+	//! Returns the weighted average squared distance of p to the planes of the quadric
+	float Error( Vec3f const &p ) const
+	{
+		float rx = a00*p.x + a01*p.y + a02*p.z + 2*b0;
+		float ry = a01*p.x + a11*p.y + a12*p.z + 2*b1;
+		float rz = a02*p.x + a12*p.y + a22*p.z + 2*b2;
+		float r = rx*p.x + ry*p.y + rz*p.z + c;
+		return w > 0 ? std::abs(r) / w : 0.0f;
+	}
+};
+
+//! Vertex kinds that define the allowed collapses
+enum VertexKind : uint8_t { KIND_MANIFOLD, KIND_BORDER, KIND_SEAM, KIND_LOCKED };
+
+} // namespace simplifier
+
+//-------------------------------------------------------------------------------
+
+inline float SimplifyMesh( std::vector<uint32_t> &destination, uint32_t const *indices, size_t numIndices, float const *positions, unsigned int numVertices, size_t targetIndexCount, float targetError, uint32_t const *faceMaterials, std::vector<uint32_t> *destinationMaterials )
+{
+	using namespace simplifier;
+	unsigned int const invalid = 0xFFFFFFFF;
+	destination.assign( indices, indices + numIndices );
+	std::vector<uint32_t> materials;
+	if ( faceMaterials ) materials.assign( faceMaterials, faceMaterials + numIndices/3 );
+	auto result = [&]( float error ) {
+		if ( destinationMaterials ) destinationMaterials->swap( materials );
+		return error;
+	};
+	if ( numIndices <= targetIndexCount ) return result(0);
+
+	// Normalize the positions, so that the errors are relative to the size of the mesh
+	Vec3f bmin( FLT_MAX, FLT_MAX, FLT_MAX ), bmax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+	for ( size_t i=0; i<numIndices; i++ ) {
+		float const *p = positions + size_t(indices[i])*3;
+		for ( int j=0; j<3; j++ ) { bmin[j] = Min( bmin[j], p[j] ); bmax[j] = Max( bmax[j], p[j] ); }
+	}
+	float const extent = ( bmax - bmin ).Length();
+	float const scale = extent > 0 ? 1 / extent : 1.0f;
+	std::vector<Vec3f> pos( numVertices );
+	for ( unsigned int v=0; v<numVertices; v++ ) pos[v] = ( Vec3f( positions + size_t(v)*3 ) - bmin ) * scale;
+
+	// Vertices with the same position form a ring of wedges, and remap points to the first one
+	std::vector<uint32_t> remap( numVertices, invalid ), wedge( numVertices );
+	{
+		struct PosHash { size_t operator () ( Vec3f const &p ) const { uint32_t h[3]; memcpy( h, &p, 12 ); return size_t( h[0]*73856093u ^ h[1]*19349663u ^ h[2]*83492791u ); } };
+		struct PosEqual { bool operator () ( Vec3f const &a, Vec3f const &b ) const { return a.x == b.x && a.y == b.y && a.z == b.z; } };
+		std::unordered_map<Vec3f,uint32_t,PosHash,PosEqual> first;
+		first.reserve( numVertices );
+		for ( unsigned int v=0; v<numVertices; v++ ) {
+			auto r = first.try_emplace( pos[v], v );
+			remap[v] = r.first->second;
+		}
+		for ( unsigned int v=0; v<numVertices; v++ ) wedge[v] = v;
+		for ( unsigned int v=0; v<numVertices; v++ ) {
+			uint32_t r = remap[v];
+			if ( r != v ) { wedge[v] = wedge[r]; wedge[r] = v; }
+		}
+	}
+
+	// Half-edge adjacency: the outgoing edges of each vertex
+	struct Edge { uint32_t next, prev; };	// the other two corners of the triangle, in order
+	std::vector<uint32_t> offsets, counts( numVertices );
+	std::vector<Edge>     edges;
+	auto UpdateAdjacency = [&]() {
+		size_t n = destination.size();
+		std::fill( counts.begin(), counts.end(), 0 );
+		for ( size_t i=0; i<n; i++ ) counts[ destination[i] ]++;
+		offsets.resize( size_t(numVertices)+1 );
+		offsets[0] = 0;
+		for ( unsigned int v=0; v<numVertices; v++ ) offsets[v+1] = offsets[v] + counts[v];
+		edges.resize( n );
+		std::fill( counts.begin(), counts.end(), 0 );
+		for ( size_t i=0; i<n; i+=3 ) {
+			for ( int c=0; c<3; c++ ) {
+				uint32_t v = destination[i+c];
+				edges[ offsets[v] + counts[v]++ ] = Edge{ destination[ i + (c+1)%3 ], destination[ i + (c+2)%3 ] };
+			}
+		}
+	};
+	auto HasEdge = [&]( uint32_t a, uint32_t b ) {
+		for ( uint32_t j=offsets[a]; j<offsets[a+1]; j++ ) if ( edges[j].next == b ) return true;
+		return false;
+	};
+
+	// The open edges of each vertex: the other end of the single open outgoing / incoming edge,
+	// invalid if there is none, or the vertex itself if there are several
+	std::vector<uint32_t> openOut( numVertices ), openIn( numVertices );
+	auto UpdateOpenEdges = [&]() {
+		std::fill( openOut.begin(), openOut.end(), invalid );
+		std::fill( openIn .begin(), openIn .end(), invalid );
+		for ( unsigned int v=0; v<numVertices; v++ ) {
+			for ( uint32_t j=offsets[v]; j<offsets[v+1]; j++ ) {
+				uint32_t t = edges[j].next;
+				if ( HasEdge( t, v ) ) continue;
+				openOut[v] = openOut[v] == invalid ? t : v;
+				openIn [t] = openIn [t] == invalid ? v : t;
+			}
+		}
+	};
+	UpdateAdjacency();
+	UpdateOpenEdges();
+
+	// Classify the vertices
+	std::vector<VertexKind> kind( numVertices, KIND_MANIFOLD );
+	for ( unsigned int v=0; v<numVertices; v++ ) {
+		bool single = openOut[v] != v && openIn[v] != v && ( openOut[v] == invalid ) == ( openIn[v] == invalid );
+		if ( wedge[v] == v ) {
+			kind[v] = !single ? KIND_LOCKED : openOut[v] == invalid ? KIND_MANIFOLD : KIND_BORDER;
+		} else if ( wedge[wedge[v]] == v ) {
+			uint32_t w = wedge[v];
+			bool wsingle = openOut[w] != w && openIn[w] != w && openOut[w] != invalid && openIn[w] != invalid;
+			// a seam: both wedges have one open edge pair, and the open edges of one wedge match the other in reverse
+			if ( single && wsingle && openOut[v] != invalid && remap[openOut[v]] == remap[openIn[w]] && remap[openIn[v]] == remap[openOut[w]] ) kind[v] = KIND_SEAM;
+			else kind[v] = KIND_LOCKED;
+		} else {
+			kind[v] = KIND_LOCKED;
+		}
+	}
+	if ( faceMaterials ) {
+		std::vector<uint32_t> vertexMaterial( numVertices, invalid );
+		for ( size_t i=0; i<numIndices; i++ ) {
+			uint32_t r = remap[ indices[i] ], m = faceMaterials[i/3];
+			if ( vertexMaterial[r] == invalid ) vertexMaterial[r] = m;
+			else if ( vertexMaterial[r] != m ) vertexMaterial[r] = invalid - 1;
+		}
+		for ( unsigned int v=0; v<numVertices; v++ ) if ( vertexMaterial[ remap[v] ] == invalid - 1 ) kind[v] = KIND_LOCKED;
+	}
+	// The wedges of a position must agree on their kind
+	for ( unsigned int v=0; v<numVertices; v++ ) if ( kind[v] == KIND_LOCKED ) for ( uint32_t w=wedge[v]; w!=v; w=wedge[w] ) kind[w] = KIND_LOCKED;
+
+	// Quadrics of the positions: the planes of the triangles, and planes perpendicular to the open borders
+	std::vector<Quadric> quadric( numVertices );
+	for ( size_t i=0; i<numIndices; i+=3 ) {
+		uint32_t a = indices[i], b = indices[i+1], c = indices[i+2];
+		Vec3f n = ( pos[b] - pos[a] ).Cross( pos[c] - pos[a] );
+		float area = n.Length();
+		if ( area <= 0 ) continue;
+		n /= area;
+		Quadric q;
+		q.AddPlane( n, -n.Dot(pos[a]), area * 0.5f );
+		quadric[ remap[a] ] += q;
+		quadric[ remap[b] ] += q;
+		quadric[ remap[c] ] += q;
+		for ( int k=0; k<3; k++ ) {
+			uint32_t v0 = indices[i+k], v1 = indices[i+(k+1)%3];
+			if ( kind[v0] != KIND_BORDER || openOut[v0] != v1 ) continue;
+			Vec3f e = pos[v1] - pos[v0];
+			float len = e.Length();
+			if ( len <= 0 ) continue;
+			Vec3f en = n.Cross( e / len );
+			Quadric qb;
+			qb.AddPlane( en, -en.Dot(pos[v0]), len * len * 10 );	// border planes are weighted higher to keep the silhouette
+			quadric[ remap[v0] ] += qb;
+			quadric[ remap[v1] ] += qb;
+		}
+	}
+
+	// Collapse passes: in each pass, the cheapest collapses of disjoint vertices are performed
+	struct Collapse { uint32_t v, t; float error; };
+	std::vector<Collapse> collapses;
+	std::vector<uint32_t> collapseRemap( numVertices );
+	std::vector<bool>     locked( numVertices );
+	float maxError = 0;
+	float const errorLimit = targetError * targetError;
+	auto CanCollapse = [&]( uint32_t v, uint32_t t ) {
+		switch ( kind[v] ) {
+			case KIND_MANIFOLD: return true;
+			case KIND_BORDER:   return kind[t] == KIND_BORDER && ( openOut[v] == t || openIn[v] == t );
+			case KIND_SEAM:     return kind[t] == KIND_SEAM   && ( openOut[v] == t || openIn[v] == t );
+			default:            return false;
+		}
+	};
+	// Returns the wedge of t that the twin of seam vertex v collapses to
+	auto TwinTarget = [&]( uint32_t v, uint32_t t ) {
+		uint32_t w = wedge[v];
+		if ( openOut[w] != invalid && remap[openOut[w]] == remap[t] ) return openOut[w];
+		if ( openIn [w] != invalid && remap[openIn [w]] == remap[t] ) return openIn [w];
+		return invalid;
+	};
+	// Returns true if moving v to the position of t flips or degenerates a triangle around v
+	auto HasFlips = [&]( uint32_t v, uint32_t t ) {
+		Vec3f const &pt = pos[t];
+		uint32_t w = v;
+		do {
+			for ( uint32_t j=offsets[w]; j<offsets[w+1]; j++ ) {
+				uint32_t a = collapseRemap[ edges[j].next ], b = collapseRemap[ edges[j].prev ];
+				if ( remap[a] == remap[t] || remap[b] == remap[t] ) continue;	// this triangle is removed
+				Vec3f const &pa = pos[a], &pb = pos[b];
+				Vec3f n0 = ( pa - pos[w] ).Cross( pb - pos[w] );
+				Vec3f n1 = ( pa - pt ).Cross( pb - pt );
+				if ( n0.Dot(n1) < 0.25f * std::sqrt( n0.LengthSquared() * n1.LengthSquared() ) ) return true;
+			}
+			w = wedge[w];
+		} while ( w != v );
+		return false;
+	};
+
+	while ( destination.size() > targetIndexCount ) {
+		// Candidate collapses, the cheaper direction of each edge
+		collapses.clear();
+		for ( size_t i=0; i<destination.size(); i+=3 ) {
+			for ( int k=0; k<3; k++ ) {
+				uint32_t a = destination[i+k], b = destination[i+(k+1)%3];
+				if ( remap[a] == remap[b] ) continue;
+				if ( HasEdge( b, a ) && a > b ) continue;	// interior edges are visited from one side
+				float ea = CanCollapse( a, b ) ? quadric[remap[a]].Error( pos[b] ) : FLT_MAX;
+				float eb = CanCollapse( b, a ) ? quadric[remap[b]].Error( pos[a] ) : FLT_MAX;
+				if ( ea == FLT_MAX && eb == FLT_MAX ) continue;
+				if ( ea <= eb ) collapses.push_back( Collapse{ a, b, ea } );
+				else            collapses.push_back( Collapse{ b, a, eb } );
+			}
+		}
+		if ( collapses.empty() ) break;
+		std::sort( collapses.begin(), collapses.end(), []( Collapse const &x, Collapse const &y ) { return x.error < y.error; } );
+
+		// Perform collapses until enough triangles are removed
+		for ( unsigned int v=0; v<numVertices; v++ ) collapseRemap[v] = v;
+		std::fill( locked.begin(), locked.end(), false );
+		size_t const goal = ( destination.size() - targetIndexCount ) / 3;
+		size_t removed = 0;
+		size_t performed = 0;
+		for ( Collapse const &c : collapses ) {
+			if ( c.error > errorLimit || removed >= goal ) break;
+			if ( locked[remap[c.v]] || locked[remap[c.t]] ) continue;
+			if ( HasFlips( c.v, c.t ) ) continue;
+			if ( kind[c.v] == KIND_SEAM ) {
+				uint32_t tw = TwinTarget( c.v, c.t );
+				if ( tw == invalid ) continue;
+				collapseRemap[ wedge[c.v] ] = tw;
+			}
+			collapseRemap[c.v] = c.t;
+			quadric[remap[c.t]] += quadric[remap[c.v]];
+			locked[remap[c.v]] = locked[remap[c.t]] = true;
+			maxError = Max( maxError, c.error );
+			removed += kind[c.v] == KIND_MANIFOLD ? 2 : 1;
+			performed++;
+		}
+		if ( performed == 0 ) break;
+
+		// Apply the collapses and remove the degenerate triangles
+		size_t n = 0;
+		for ( size_t i=0; i<destination.size(); i+=3 ) {
+			uint32_t a = collapseRemap[destination[i]], b = collapseRemap[destination[i+1]], c = collapseRemap[destination[i+2]];
+			if ( remap[a] == remap[b] || remap[b] == remap[c] || remap[c] == remap[a] ) continue;
+			if ( faceMaterials ) materials[n/3] = materials[i/3];
+			destination[n++] = a;
+			destination[n++] = b;
+			destination[n++] = c;
+		}
+		destination.resize( n );
+		if ( faceMaterials ) materials.resize( n/3 );
+		UpdateAdjacency();
+		UpdateOpenEdges();
+	}
+
+	return result( std::sqrt( maxError ) );
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,347 @@
+//-------------------------------------------------------------------------------
+//! \file   cyMeshlet.h
+//!
+//! \brief  Meshlets (small triangle clusters) with bounds for per-cluster culling.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_MESHLET_H_INCLUDED_
+#define _CY_MESHLET_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyMatrix.h"
+#include "cyMeshOptimizer.h"
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Contiguous range of faces of an index buffer
+struct FaceRange
+{
+	unsigned int firstFace;	//!< first face of the range
+	unsigned int faceCount;	//!< number of faces in the range
+};
+
+//! Meshlet: a contiguous range of at most meshletMaxTriangles faces of an index buffer that
+//! reference at most meshletMaxVertices unique vertices, with a bounding sphere and a normal
+//! cone. The normal cone contains the geometric normals of all faces, assuming counter-clockwise
+//! front faces. It is used for culling the whole meshlet when all of its faces are back-facing.
+struct Meshlet
+{
+	uint32_t firstFace;		//!< first face of the meshlet in the index buffer
+	uint32_t faceCount;		//!< number of faces
+	uint32_t vertexCount;	//!< number of unique vertices referenced by the faces
+	uint32_t reserved;		//!< unused, always zero
+	float    center[3];		//!< bounding sphere center
+	float    radius;		//!< bounding sphere radius
+	float    coneAxis[3];	//!< normal cone axis, or zero if the cone cannot be used for culling
+	float    coneCutoff;	//!< sine of the normal cone half angle, or 1 if the cone cannot be used for culling
+
+	Vec3f GetCenter  () const { return Vec3f( center[0], center[1], center[2] ); }			//!< Returns the bounding sphere center
+	Vec3f GetConeAxis() const { return Vec3f( coneAxis[0], coneAxis[1], coneAxis[2] ); }	//!< Returns the normal cone axis
+	bool  HasCone    () const { return coneCutoff < 1; }									//!< Returns true if the normal cone can be used for culling
+};
+static_assert( sizeof(Meshlet) == 48, "Meshlet must be 48 bytes" );
+
+unsigned int const meshletMaxVertices  = 64;	//!< default maximum number of unique vertices of a meshlet
+unsigned int const meshletMaxTriangles = 124;	//!< default maximum number of triangles of a meshlet
+
+//-------------------------------------------------------------------------------
+
+//! Splits each of the given face ranges of an index buffer into meshlets and appends them to the
+//! meshlets array. The faces are reordered within each range, such that each meshlet is a contiguous
+//! range of faces. Meshlets are grown over adjacent faces with similar normals, which keeps their
+//! bounding spheres small and their normal cones narrow. If cacheSize is not zero, the faces of each
+//! meshlet are then reordered for the post-transform vertex cache (see cyMeshOptimizer.h).
+//! The positions array contains 3 floats per vertex.
+inline void BuildMeshlets( std::vector<Meshlet> &meshlets, uint32_t *indices, float const *positions, unsigned int numVertices, FaceRange const *ranges, unsigned int numRanges, unsigned int maxVertices=meshletMaxVertices, unsigned int maxTriangles=meshletMaxTriangles, unsigned int cacheSize=defaultVertexCacheSize );
+
+//! Computes the bounding sphere and the normal cone of the given meshlet from its faces.
+inline void ComputeMeshletBounds( Meshlet &meshlet, uint32_t const *indices, float const *positions );
+
+//-------------------------------------------------------------------------------
+
+//! Visibility test of meshlets against a view frustum and a viewpoint.
+//!
+//! The tests are done in the object space of the meshlets, so Set takes the projection and
+//! the model-view matrices. A meshlet is rejected when its bounding sphere is outside of the
+//! frustum, or, depending on the cull mode, when its normal cone shows that all of its faces
+//! are back-facing (CULL_BACK) or front-facing (CULL_FRONT). The cone test is conservative, so
+//! with the matching glCullFace mode enabled, culling never changes the rendered image.
+class MeshletCuller
+{
+public:
+	enum CullMode { CULL_NONE, CULL_BACK, CULL_FRONT };	//!< Face orientation culling modes
+
+	//! Sets the view. Perspective and orthographic projections are supported.
+	void Set( Matrix4f const &proj, Matrix4f const &modelView, CullMode mode=CULL_NONE )
+	{
+		Matrix4f mvp = proj * modelView;
+		Vec4f r0 = mvp.GetRow(0), r1 = mvp.GetRow(1), r2 = mvp.GetRow(2), r3 = mvp.GetRow(3);
+		Vec4f p[6] = { r3+r0, r3-r0, r3+r1, r3-r1, r3+r2, r3-r2 };
+		for ( int i=0; i<6; i++ ) {
+			float len = Vec3f(p[i].x,p[i].y,p[i].z).Length();
+			planes[i] = len > 0 ? p[i] / len : Vec4f(0,0,0,1);
+		}
+		cullMode = mode;
+		// The viewpoint is the model-view inverse of the view space origin, or of the view direction for orthographic projections
+		Matrix4f inv = modelView.GetInverse();
+		perspective = proj(3,3) == 0;
+		Vec4f v = inv * ( perspective ? Vec4f(0,0,0,1) : Vec4f(0,0,-1,0) );
+		viewpoint.Set( v.x, v.y, v.z );
+		if ( !perspective ) viewpoint.Normalize();
+		if ( modelView.GetSubMatrix3().GetDeterminant() < 0 ) cullMode = mode == CULL_BACK ? CULL_FRONT : mode == CULL_FRONT ? CULL_BACK : mode;	// mirrored transformations flip the winding
+	}
+
+	//! Returns true if the given meshlet may be visible.
+	bool IsVisible( Meshlet const &m ) const
+	{
+		Vec3f c = m.GetCenter();
+		for ( int i=0; i<6; i++ ) {
+			if ( planes[i].x*c.x + planes[i].y*c.y + planes[i].z*c.z + planes[i].w < -m.radius ) return false;
+		}
+		if ( cullMode == CULL_NONE || !m.HasCone() ) return true;
+		Vec3f axis = cullMode == CULL_BACK ? m.GetConeAxis() : -m.GetConeAxis();
+		if ( perspective ) {
+			Vec3f d = c - viewpoint;
+			return d.Dot(axis) < m.coneCutoff * d.Length() + m.radius;
+		}
+		return viewpoint.Dot(axis) < m.coneCutoff;
+	}
+
+private:
+	Vec4f    planes[6];
+	Vec3f    viewpoint   = Vec3f(0,0,0);	// camera position, or view direction for orthographic projections
+	bool     perspective = true;
+	CullMode cullMode    = CULL_NONE;
+};
+
+//! Appends the face ranges of the meshlets in the given face range that pass the culler to the
+//! visible array. Meshlets must be sorted by their first face. Adjacent visible meshlets are
+//! merged into a single range, so that they can be drawn with fewer draws.
+inline void CullMeshlets( std::vector<FaceRange> &visible, Meshlet const *meshlets, unsigned int numMeshlets, MeshletCuller const &culler, unsigned int firstFace, unsigned int faceCount )
+{
+	Meshlet const *end = meshlets + numMeshlets;
+	Meshlet const *m = std::lower_bound( meshlets, end, firstFace, []( Meshlet const &a, unsigned int f ) { return a.firstFace < f; } );
+	unsigned int lastFace = firstFace + faceCount;
+	size_t start = visible.size();
+	for ( ; m != end && m->firstFace < lastFace; m++ ) {
+		if ( !culler.IsVisible(*m) ) continue;
+		if ( visible.size() > start && visible.back().firstFace + visible.back().faceCount == m->firstFace ) visible.back().faceCount += m->faceCount;
+		else visible.push_back( FaceRange{ m->firstFace, m->faceCount } );
+	}
+}
+
+//-------------------------------------------------------------------------------
+
+inline void BuildMeshlets( std::vector<Meshlet> &meshlets, uint32_t *indices, float const *positions, unsigned int numVertices, FaceRange const *ranges, unsigned int numRanges, unsigned int maxVertices, unsigned int maxTriangles, unsigned int cacheSize )
+{
+	unsigned int const invalid = 0xFFFFFFFF;
+	std::vector<uint32_t>     localIndex( numVertices, invalid );
+	std::vector<uint32_t>     globalIndex;
+	std::vector<unsigned int> offsets, adjacency, positionID, stamp, candidates;
+	std::vector<Vec3f>        faceNormal, faceCenter;
+	std::vector<bool>         emitted;
+	std::vector<uint32_t>     output, meshletIndices;
+	std::vector<uint32_t>     meshletVertex;					// index of a vertex in the current meshlet
+	std::vector<uint32_t>     meshletGlobal( maxVertices );	// vertices of the current meshlet
+	size_t const firstMeshlet = meshlets.size();
+
+	for ( unsigned int r=0; r<numRanges; r++ ) {
+		uint32_t *ix = indices + size_t(ranges[r].firstFace)*3;
+		unsigned int const numFaces = ranges[r].faceCount;
+		if ( numFaces == 0 ) continue;
+
+		// Local vertex indices of the range, so that the cost does not depend on the number of ranges
+		globalIndex.clear();
+		for ( size_t i=0; i<size_t(numFaces)*3; i++ ) {
+			if ( localIndex[ix[i]] == invalid ) { localIndex[ix[i]] = (uint32_t) globalIndex.size(); globalIndex.push_back( ix[i] ); }
+		}
+		unsigned int const nv = (unsigned int) globalIndex.size();
+		auto L = [&]( unsigned int t, int c ) { return localIndex[ ix[ size_t(t)*3 + c ] ]; };
+
+		// Vertices at the same position share their triangle adjacency, so that meshlets can grow across
+		// texture and normal seams
+		positionID.resize( nv );
+		for ( unsigned int v=0; v<nv; v++ ) positionID[v] = v;
+		auto PosLess = [&]( unsigned int a, unsigned int b ) { float const *pa = positions + size_t(globalIndex[a])*3, *pb = positions + size_t(globalIndex[b])*3; return std::lexicographical_compare( pa, pa+3, pb, pb+3 ); };
+		std::sort( positionID.begin(), positionID.end(), PosLess );
+		{
+			std::vector<unsigned int> id( nv );
+			unsigned int rep = 0;
+			for ( unsigned int i=0; i<nv; i++ ) {
+				if ( i > 0 && PosLess( positionID[i-1], positionID[i] ) ) rep = i;
+				id[ positionID[i] ] = positionID[rep];
+			}
+			positionID.swap( id );
+		}
+
+		// Vertex-triangle adjacency and face normals
+		offsets.assign( size_t(nv)+1, 0 );
+		for ( unsigned int t=0; t<numFaces; t++ ) for ( int c=0; c<3; c++ ) offsets[ positionID[ L(t,c) ] + 1 ]++;
+		for ( unsigned int v=0; v<nv; v++ ) offsets[v+1] += offsets[v];
+		adjacency.resize( size_t(numFaces)*3 );
+		{
+			std::vector<unsigned int> pos( offsets.begin(), offsets.end()-1 );
+			for ( unsigned int t=0; t<numFaces; t++ ) for ( int c=0; c<3; c++ ) adjacency[ pos[ positionID[ L(t,c) ] ]++ ] = t;
+		}
+		faceNormal.resize( numFaces );
+		faceCenter.resize( numFaces );
+		for ( unsigned int t=0; t<numFaces; t++ ) {
+			auto P = [&]( int c ) { float const *p = positions + size_t(ix[size_t(t)*3+c])*3; return Vec3f(p[0],p[1],p[2]); };
+			Vec3f n = ( P(1) - P(0) ).Cross( P(2) - P(0) );
+			float len = n.Length();
+			faceNormal[t] = len > 0 ? n / len : Vec3f(0,0,0);
+			faceCenter[t] = ( P(0) + P(1) + P(2) ) / 3;
+		}
+
+		// Grow each meshlet from a seed triangle by adding the adjacent triangle that adds the fewest new
+		// vertices and whose normal is the closest to the average normal of the meshlet. Seeds are taken
+		// in the input order, so that the meshlets roughly follow the order of the index buffer.
+		emitted.assign( numFaces, false );
+		stamp.assign( nv, invalid );
+		meshletVertex.resize( nv );
+		output.clear();
+		output.reserve( size_t(numFaces)*3 );
+		unsigned int cursor = 0;
+		while ( true ) {
+			while ( cursor < numFaces && emitted[cursor] ) cursor++;
+			if ( cursor >= numFaces ) break;
+			Meshlet m = {};
+			m.firstFace = ranges[r].firstFace + (unsigned int)( output.size() / 3 );
+			unsigned int const id = (unsigned int) meshlets.size();
+			Vec3f normalSum(0,0,0), centerSum(0,0,0);
+			candidates.clear();
+			unsigned int t = cursor;
+			while ( t != invalid ) {
+				emitted[t] = true;
+				normalSum += faceNormal[t];
+				centerSum += faceCenter[t];
+				for ( int c=0; c<3; c++ ) {
+					unsigned int v = L(t,c);
+					output.push_back( ix[ size_t(t)*3 + c ] );
+					if ( stamp[v] == id ) continue;
+					stamp[v] = id;
+					meshletVertex[v] = m.vertexCount;
+					meshletGlobal[m.vertexCount++] = ix[ size_t(t)*3 + c ];
+					unsigned int p = positionID[v];
+					for ( unsigned int j=offsets[p]; j<offsets[p+1]; j++ ) if ( !emitted[ adjacency[j] ] ) candidates.push_back( adjacency[j] );
+				}
+				m.faceCount++;
+				if ( m.faceCount >= maxTriangles ) break;
+
+				t = invalid;
+				float bestScore = FLT_MAX, bestDist2 = FLT_MAX;
+				Vec3f center = centerSum / float(m.faceCount);
+				Vec3f axis = normalSum.GetNormalized();
+				size_t n = 0;
+				for ( size_t i=0; i<candidates.size(); i++ ) {
+					unsigned int ct = candidates[i];
+					if ( emitted[ct] ) continue;
+					candidates[n++] = ct;
+					unsigned int newVertices = 0;
+					for ( int c=0; c<3; c++ ) newVertices += stamp[ L(ct,c) ] != id;
+					if ( m.vertexCount + newVertices > maxVertices ) continue;
+					float score = float(newVertices) + 2 * ( 1 - axis.Dot( faceNormal[ct] ) );
+					float dist2 = ( faceCenter[ct] - center ).LengthSquared();	// ties are broken by the distance, which keeps meshlets compact
+					if ( score < bestScore || ( score == bestScore && dist2 < bestDist2 ) ) { bestScore = score; bestDist2 = dist2; t = ct; }
+				}
+				candidates.resize( n );
+			}
+
+			// Reorder the triangles of the meshlet for the vertex cache
+			if ( cacheSize > 0 ) {
+				size_t first = output.size() - size_t(m.faceCount)*3;
+				meshletIndices.resize( size_t(m.faceCount)*3 );
+				for ( size_t i=first; i<output.size(); i++ ) meshletIndices[i-first] = meshletVertex[ localIndex[ output[i] ] ];
+				OptimizeVertexCache( meshletIndices.data(), meshletIndices.size(), m.vertexCount, cacheSize );
+				for ( size_t i=first; i<output.size(); i++ ) output[i] = meshletGlobal[ meshletIndices[i-first] ];
+			}
+			meshlets.push_back( m );
+		}
+		std::copy( output.begin(), output.end(), ix );
+		for ( unsigned int v=0; v<nv; v++ ) localIndex[ globalIndex[v] ] = invalid;
+	}
+
+	for ( size_t i=firstMeshlet; i<meshlets.size(); i++ ) ComputeMeshletBounds( meshlets[i], indices, positions );
+}
+
+inline void ComputeMeshletBounds( Meshlet &meshlet, uint32_t const *indices, float const *positions )
+{
+	uint32_t const *ix = indices + size_t(meshlet.firstFace)*3;
+	size_t const numIndices = size_t(meshlet.faceCount)*3;
+	auto P = [&]( size_t i ) { float const *p = positions + size_t(ix[i])*3; return Vec3f(p[0],p[1],p[2]); };
+
+	// Bounding sphere (Ritter): start with the most distant pair of the axis extremes and grow it to contain all vertices
+	size_t pmin[3] = { 0, 0, 0 }, pmax[3] = { 0, 0, 0 };
+	for ( size_t i=1; i<numIndices; i++ ) {
+		Vec3f p = P(i);
+		for ( int j=0; j<3; j++ ) {
+			if ( p[j] < P(pmin[j])[j] ) pmin[j] = i;
+			if ( p[j] > P(pmax[j])[j] ) pmax[j] = i;
+		}
+	}
+	int axis = 0;
+	float maxDist2 = -1;
+	for ( int j=0; j<3; j++ ) {
+		float d2 = ( P(pmax[j]) - P(pmin[j]) ).LengthSquared();
+		if ( d2 > maxDist2 ) { maxDist2 = d2; axis = j; }
+	}
+	Vec3f center = ( P(pmin[axis]) + P(pmax[axis]) ) * 0.5f;
+	float radius = std::sqrt(maxDist2) * 0.5f;
+	for ( size_t i=0; i<numIndices; i++ ) {
+		Vec3f p = P(i);
+		float d = ( p - center ).Length();
+		if ( d > radius ) {
+			float newRadius = ( radius + d ) * 0.5f;
+			center += ( p - center ) * ( ( newRadius - radius ) / d );
+			radius = newRadius;
+		}
+	}
+	// The final radius is the exact distance to the farthest vertex, so that rounding cannot leave a vertex outside
+	radius = 0;
+	for ( size_t i=0; i<numIndices; i++ ) radius = Max( radius, ( P(i) - center ).Length() );
+	for ( int j=0; j<3; j++ ) meshlet.center[j] = center[j];
+	meshlet.radius = radius;
+
+	// Normal cone: the axis is the average face normal and the half angle covers all face normals.
+	// Degenerate faces have no normal and are ignored, since they are never rasterized.
+	Vec3f normalSum(0,0,0);
+	for ( size_t i=0; i<numIndices; i+=3 ) {
+		Vec3f n = ( P(i+1) - P(i) ).Cross( P(i+2) - P(i) );
+		float len = n.Length();
+		if ( len > 0 ) normalSum += n / len;
+	}
+	float sumLen = normalSum.Length();
+	Vec3f coneAxis = sumLen > 0 ? normalSum / sumLen : Vec3f(0,0,0);
+	float minDot = 1;
+	for ( size_t i=0; i<numIndices && sumLen > 0; i+=3 ) {
+		Vec3f n = ( P(i+1) - P(i) ).Cross( P(i+2) - P(i) );
+		float len = n.Length();
+		if ( len > 0 ) minDot = Min( minDot, coneAxis.Dot(n) / len );
+	}
+	// A cone of 90 degrees or wider never culls, so it is not stored
+	if ( sumLen <= 0 || minDot <= 0 ) {
+		coneAxis.Zero();
+		meshlet.coneCutoff = 1;
+	} else {
+		meshlet.coneCutoff = std::sqrt( 1 - minDot*minDot );
+	}
+	for ( int j=0; j<3; j++ ) meshlet.coneAxis[j] = coneAxis[j];
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::Meshlet       cyMeshlet;		//!< Meshlet with a bounding sphere and a normal cone
+typedef cy::MeshletCuller cyMeshletCuller;	//!< Visibility test of meshlets against a view frustum and a viewpoint
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,159 @@
+//-------------------------------------------------------------------------------
+//! \file   cyParallel.h
+//!
+//! \brief  Simple parallel loop helpers.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_PARALLEL_H_INCLUDED_
+#define _CY_PARALLEL_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Returns the number of hardware threads, or 1 if it cannot be determined.
+inline unsigned int NumHardwareThreads()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+//! A persistent pool of worker threads that execute the loops of ParallelFor.
+//!
+//! The workers are started by the first loop that needs them and wait on a condition variable between loops,
+//! so that the thread startup cost is paid once, not once per call. The pool runs one loop at a time. A loop
+//! that is started while the pool is busy, or from a worker of the pool, is not handed to the pool.
+
+class ParallelForPool
+{
+public:
+	//! Returns the pool, which is created with NumHardwareThreads()-1 workers on the first call.
+	static ParallelForPool& Get() { static ParallelForPool pool( NumHardwareThreads() - 1 ); return pool; }
+
+	ParallelForPool( ParallelForPool const & ) CY_CLASS_FUNCTION_DELETE
+	ParallelForPool& operator = ( ParallelForPool const & ) CY_CLASS_FUNCTION_DELETE
+
+	//! Stops the worker threads.
+	~ParallelForPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			stop = true;
+		}
+		jobReady.notify_all();
+		for ( std::thread &t : threads ) t.join();
+	}
+
+	unsigned int NumWorkers() const { return (unsigned int) threads.size(); }	//!< Returns the number of worker threads
+
+	//! Calls func(i) for all i in [0,count) on the calling thread and up to numHelpers workers.
+	//! Returns false without calling func if the pool is busy or if it is called from within a loop.
+	template <typename FUNC>
+	bool Run( unsigned int count, FUNC &func, unsigned int numHelpers )
+	{
+		if ( InLoop() ) return false;
+		std::unique_lock<std::mutex> runLock( runMutex, std::try_to_lock );
+		if ( ! runLock.owns_lock() ) return false;
+		InLoop() = true;
+		{
+			std::lock_guard<std::mutex> lock( mutex );
+			job.call       = []( void *f, unsigned int i ) { (*(FUNC*)f)(i); };
+			job.func       = &func;
+			job.count      = count;
+			job.next       = 0;
+			job.numHelpers = Min( numHelpers, NumWorkers() );
+			job.numJoined  = 0;
+			job.numBusy    = 0;
+			job.open       = true;
+		}
+		jobReady.notify_all();
+		Execute();
+		// All indices are handed out, so the workers that have not joined yet are not needed
+		std::unique_lock<std::mutex> lock( mutex );
+		job.open = false;
+		jobDone.wait( lock, [this]() { return job.numBusy == 0; } );
+		InLoop() = false;
+		return true;
+	}
+
+private:
+	struct Job
+	{
+		void                    (*call)( void*, unsigned int ) = nullptr;
+		void                     *func       = nullptr;
+		unsigned int              count      = 0;
+		std::atomic<unsigned int> next{0};
+		unsigned int              numHelpers = 0;	// maximum number of workers that join the loop
+		unsigned int              numJoined  = 0;	// number of workers that joined the loop
+		unsigned int              numBusy    = 0;	// number of workers that are executing the loop
+		bool                      open       = false;	// workers can join the loop
+	};
+
+	std::mutex               runMutex;		// held by the thread that runs a loop on the pool
+	std::mutex               mutex;
+	std::condition_variable  jobReady;		// signaled when a loop starts or the pool stops
+	std::condition_variable  jobDone;		// signaled when a worker leaves a loop
+	Job                      job;
+	bool                     stop = false;
+	std::vector<std::thread> threads;
+
+	explicit ParallelForPool( unsigned int numWorkers )
+	{
+		threads.reserve( numWorkers );
+		for ( unsigned int t=0; t<numWorkers; t++ ) threads.emplace_back( [this]() { Worker(); } );
+	}
+
+	// True on the workers and on the thread that runs a loop, which must not start another loop on the pool
+	static bool& InLoop() { static thread_local bool inLoop = false; return inLoop; }
+
+	void Execute() { for ( unsigned int i=job.next++; i<job.count; i=job.next++ ) job.call( job.func, i ); }
+
+	void Worker()
+	{
+		InLoop() = true;
+		std::unique_lock<std::mutex> lock( mutex );
+		for (;;) {
+			jobReady.wait( lock, [this]() { return stop || ( job.open && job.numJoined < job.numHelpers ); } );
+			if ( stop ) return;
+			job.numJoined++;
+			job.numBusy++;
+			lock.unlock();
+			Execute();
+			lock.lock();
+			job.numBusy--;
+			if ( job.numBusy == 0 ) jobDone.notify_all();
+		}
+	}
+};
+
+//! Calls func(i) for all i in [0,count) using up to numThreads threads.
+//! If numThreads is zero, all hardware threads are used.
+//! Indices are handed out one at a time, so work items may have different costs.
+//! The calling thread also executes work items and the function returns after all items are done.
+//! The other threads are the workers of ParallelForPool. If the pool is busy with another loop, or if
+//! ParallelFor is called from within a loop, the calling thread executes all items.
+template <typename FUNC>
+inline void ParallelFor( unsigned int count, FUNC func, unsigned int numThreads=0 )
+{
+	if ( numThreads == 0 ) numThreads = NumHardwareThreads();
+	numThreads = Min( numThreads, count );
+	if ( numThreads <= 1 || ! ParallelForPool::Get().Run( count, func, numThreads-1 ) ) {
+		for ( unsigned int i=0; i<count; i++ ) func(i);
+	}
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+#endif
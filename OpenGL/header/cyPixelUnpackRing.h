@@ -0,0 +1,197 @@
+//-------------------------------------------------------------------------------
+//! \file   cyPixelUnpackRing.h
+//!
+//! \brief  Persistently mapped pixel unpack buffer for streaming texture uploads.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_PIXEL_UNPACK_RING_H_INCLUDED_
+#define _CY_PIXEL_UNPACK_RING_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyGL.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! A GL_PIXEL_UNPACK_BUFFER that is allocated with glNamedBufferStorage and stays mapped, used as a ring
+//! of regions for texture uploads. Image decoders write the pixels directly to a region and the texture
+//! is updated from the buffer, so the pixels are not copied on the CPU.
+//!
+//! Regions are allocated in ring order. After the upload commands that read a region are issued,
+//! Fence() inserts a fence for it, and Retire() frees the regions whose uploads are finished, in
+//! allocation order. Allocate(), TryAllocate(), and Cancel() can be called from any thread, the other
+//! functions must be called from the thread of the OpenGL context.
+
+class PixelUnpackRing
+{
+public:
+	PixelUnpackRing() = default;
+	PixelUnpackRing( PixelUnpackRing const & ) CY_CLASS_FUNCTION_DELETE
+	PixelUnpackRing& operator = ( PixelUnpackRing const & ) CY_CLASS_FUNCTION_DELETE
+	~PixelUnpackRing() { if ( GL::CheckContext() ) Delete(); }	//!< Destructor that deletes the buffer
+
+	//! Creates and maps the buffer with the given size in bytes. Returns false if the buffer cannot be mapped.
+	bool Create( size_t size )
+	{
+		Delete();
+		glCreateBuffers( 1, &bufferID );
+		GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glNamedBufferStorage( bufferID, (GLsizeiptr)size, nullptr, flags );
+		mapped = (unsigned char*) glMapNamedBufferRange( bufferID, 0, (GLsizeiptr)size, flags );
+		if ( !mapped ) { Delete(); return false; }
+		capacity = size;
+		return true;
+	}
+
+	//! Waits for the uploads in flight, then unmaps and deletes the buffer.
+	void Delete()
+	{
+		if ( bufferID == 0 ) return;
+		for ( Region &r : regions ) if ( r.fence ) {
+			glClientWaitSync( r.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED );
+			glDeleteSync( r.fence );
+		}
+		regions.clear();
+		if ( mapped ) glUnmapNamedBuffer( bufferID );
+		glDeleteBuffers( 1, &bufferID );
+		bufferID = 0;
+		mapped   = nullptr;
+		capacity = 0;
+		head     = 0;
+	}
+
+	GLuint GetID   () const { return bufferID; }	//!< Returns the buffer id
+	size_t Size    () const { return capacity; }	//!< Returns the size of the buffer in bytes
+	bool   IsNull  () const { return bufferID == 0; }	//!< Returns true if the buffer is not created
+
+	//! Binds the buffer to GL_PIXEL_UNPACK_BUFFER. The pixel data pointer of texture uploads is then the region offset.
+	void Bind  () const { glBindBuffer( GL_PIXEL_UNPACK_BUFFER, bufferID ); }
+	void Unbind() const { glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 ); }	//!< Unbinds GL_PIXEL_UNPACK_BUFFER
+
+	//! Allocates a region with the given size and returns its mapped address and its offset in the buffer.
+	//! Waits until another thread frees enough space with Retire(). Returns null if the size is zero or
+	//! larger than the buffer.
+	unsigned char* Allocate( size_t size, size_t &offset ) { return AllocateRegion( size, offset, true ); }
+
+	//! Allocates a region like Allocate(), but returns null instead of waiting if there is not enough free space.
+	unsigned char* TryAllocate( size_t size, size_t &offset ) { return AllocateRegion( size, offset, false ); }
+
+	//! Inserts a fence for the region at the given offset. Call it after issuing the commands that read the region.
+	void Fence( size_t offset )
+	{
+		GLsync fence = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+		std::lock_guard<std::mutex> lock( mutex );
+		Region *r = Find( offset );
+		if ( r ) { r->fence = fence; r->done = true; }
+		else glDeleteSync( fence );
+	}
+
+	//! Marks the region at the given offset as unused, so that it is freed without a fence.
+	void Cancel( size_t offset )
+	{
+		std::lock_guard<std::mutex> lock( mutex );
+		Region *r = Find( offset );
+		if ( r ) r->done = true;
+	}
+
+	//! Frees the regions whose uploads are finished, in allocation order, and returns the number of freed regions.
+	//! If wait is true, waits for the fenced uploads instead of only checking them.
+	//! Regions that are still being written (neither fenced nor canceled) stop the retirement.
+	int Retire( bool wait )
+	{
+		int freed = 0;
+		std::unique_lock<std::mutex> lock( mutex );
+		while ( !regions.empty() && regions.front().done ) {
+			GLsync fence = regions.front().fence;
+			if ( fence ) {
+				GLenum status = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? GL_TIMEOUT_IGNORED : 0 );
+				if ( status == GL_TIMEOUT_EXPIRED ) break;
+				if ( status == GL_CONDITION_SATISFIED ) numWaits++;
+				glDeleteSync( fence );
+			}
+			regions.pop_front();
+			freed++;
+		}
+		if ( regions.empty() ) head = 0;
+		lock.unlock();
+		if ( freed > 0 ) spaceFreed.notify_all();
+		return freed;
+	}
+
+	//! Returns the number of times Retire() had to wait for an upload to finish.
+	unsigned int NumWaits() const { std::lock_guard<std::mutex> lock( mutex ); return numWaits; }
+
+private:
+	struct Region
+	{
+		size_t offset;
+		GLsync fence;
+		bool   done;	// fenced or canceled
+	};
+
+	static size_t const alignment = 64;
+
+	GLuint                  bufferID = 0;
+	unsigned char          *mapped   = nullptr;
+	size_t                  capacity = 0;
+	size_t                  head     = 0;	// the end of the last allocated region
+	std::deque<Region>      regions;		// in allocation order
+	unsigned int            numWaits = 0;
+	mutable std::mutex      mutex;
+	std::condition_variable spaceFreed;
+
+	Region* Find( size_t offset )
+	{
+		for ( Region &r : regions ) if ( r.offset == offset ) return &r;
+		return nullptr;
+	}
+
+	// Returns the offset of a free range of the given size at the head of the ring, or capacity if there is none
+	size_t FindSpace( size_t size ) const
+	{
+		if ( regions.empty() ) return 0;
+		size_t const tail = regions.front().offset;
+		if ( regions.back().offset >= tail ) {
+			// the used range is [tail,head), the free ranges are [head,capacity) and [0,tail)
+			if ( head + size <= capacity ) return head;
+			if ( size <= tail ) return 0;
+		} else {
+			// the used ranges are [tail,capacity) and [0,head)
+			if ( head + size <= tail ) return head;
+		}
+		return capacity;
+	}
+
+	unsigned char* AllocateRegion( size_t size, size_t &offset, bool wait )
+	{
+		if ( size == 0 || size > capacity ) return nullptr;
+		std::unique_lock<std::mutex> lock( mutex );
+		size_t start = FindSpace( size );
+		while ( start == capacity ) {
+			if ( !wait ) return nullptr;
+			spaceFreed.wait( lock );
+			start = FindSpace( size );
+		}
+		regions.push_back( Region{ start, nullptr, false } );
+		head = Min( ( start + size + alignment - 1 ) & ~( alignment - 1 ), capacity );
+		offset = start;
+		return mapped + start;
+	}
+};
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::PixelUnpackRing cyPixelUnpackRing;	//!< Persistently mapped pixel unpack buffer for streaming texture uploads
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,548 @@
+//-------------------------------------------------------------------------------
+//! \file   cyPngDecoder.h
+//!
+//! \brief  PNG decoding to 8-bit RGBA with SIMD scanline unfiltering and color conversion.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_PNG_DECODER_H_INCLUDED_
+#define _CY_PNG_DECODER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyInflate.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+# define _CY_PNG_X86
+# include <immintrin.h>
+# ifdef _MSC_VER
+#  include <intrin.h>
+# endif
+#endif
+
+// The SIMD kernels are compiled for their instruction set regardless of the compiler flags
+// and they are only called if the CPU supports that instruction set.
+#if defined(__GNUC__) || defined(__clang__)
+# define _CY_PNG_TARGET(isa) __attribute__((target(isa)))
+#else
+# define _CY_PNG_TARGET(isa)
+#endif
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Instruction sets used by the PNG kernels, in increasing order
+enum PngIsa { PNG_ISA_SCALAR, PNG_ISA_SSE2, PNG_ISA_SSSE3, PNG_ISA_AVX2 };
+
+//! Returns the best instruction set of PngIsa that the CPU and the operating system support.
+inline PngIsa DetectPngIsa();
+
+//! Scanline kernels for 8-bit PNG images.
+//!
+//! An unfilter kernel reconstructs a filtered scanline in place, given the reconstructed previous scanline
+//! (all zeros for the first one). rowBytes must be a multiple of the bytes per pixel. A conversion kernel
+//! expands numPixels pixels with 1 to 4 channels (grey, grey-alpha, RGB, RGBA) to RGBA, as lodepng_convert does.
+struct PngKernels
+{
+	typedef void (*Unfilter)( unsigned char *row, unsigned char const *prev, size_t rowBytes );
+	typedef void (*ToRGBA)  ( unsigned char *rgba, unsigned char const *src, size_t numPixels );
+
+	Unfilter unfilter[5][4];	//!< unfilter[filterType][bytesPerPixel-1], the entries for filter type 0 (none) are null
+	ToRGBA   toRGBA[4];			//!< toRGBA[channels-1]
+	PngIsa   isa;				//!< the instruction set of the kernels
+
+	//! Returns the fastest kernels that use the given instruction set or older ones.
+	static PngKernels Make( PngIsa isa );
+
+	//! Returns the kernels for the instruction set of this CPU.
+	static PngKernels const & Get() { static PngKernels const kernels = Make( DetectPngIsa() ); return kernels; }
+};
+
+//! Decodes the given PNG data to 8-bit RGBA and writes the pixels to the memory returned by getOutput(width,height),
+//! which must have room for width*height*4 bytes. getOutput is called at most once, after the image data is
+//! decompressed, so that the pixels can be written directly to their destination, such as a mapped buffer.
+//! If it returns null, the decoding stops with error 83 (memory allocation failed).
+//! 8-bit grey, grey-alpha, RGB, and RGBA images that are not interlaced and have no tRNS chunk are decoded
+//! with ZlibDecompress and PngKernels. All other images and all files with errors are decoded by lodepng,
+//! using ZlibDecompress, and then copied. Returns zero on success, or a lodepng error code.
+template <typename GET_OUTPUT>
+inline unsigned DecodePNG( unsigned &width, unsigned &height, unsigned char const *png, size_t pngSize, GET_OUTPUT getOutput );
+
+//! Decodes the given PNG data to 8-bit RGBA and appends the pixels to out, like lodepng::decode.
+inline unsigned DecodePNG( std::vector<unsigned char> &out, unsigned &width, unsigned &height, unsigned char const *png, size_t pngSize )
+{
+	size_t const start = out.size();
+	unsigned error = DecodePNG( width, height, png, pngSize, [&]( unsigned w, unsigned h ) {
+		out.resize( start + size_t(w) * h * 4 );
+		return out.data() + start;
+	} );
+	if ( error ) out.resize( start );
+	return error;
+}
+
+//! Decodes the given PNG file to 8-bit RGBA. Returns zero on success, or a lodepng error code.
+inline unsigned DecodePNG( std::vector<unsigned char> &out, unsigned &width, unsigned &height, std::string const &filename )
+{
+	std::vector<unsigned char> png;
+	unsigned error = lodepng::load_file( png, filename );
+	if ( error ) return error;
+	return DecodePNG( out, width, height, png.data(), png.size() );
+}
+
+//-------------------------------------------------------------------------------
+
+namespace png {
+
+//-------------------------------------------------------------------------------
+// Scalar kernels
+//-------------------------------------------------------------------------------
+
+template <int BPP> inline void UnfilterSub( unsigned char *row, unsigned char const *, size_t n )
+{
+	for ( size_t i=BPP; i<n; i++ ) row[i] = (unsigned char)( row[i] + row[i-BPP] );
+}
+
+inline void UnfilterUp( unsigned char *row, unsigned char const *prev, size_t n )
+{
+	for ( size_t i=0; i<n; i++ ) row[i] = (unsigned char)( row[i] + prev[i] );
+}
+
+template <int BPP> inline void UnfilterAvg( unsigned char *row, unsigned char const *prev, size_t n )
+{
+	for ( size_t i=0;   i<BPP && i<n; i++ ) row[i] = (unsigned char)( row[i] + ( prev[i] >> 1 ) );
+	for ( size_t i=BPP; i<n;          i++ ) row[i] = (unsigned char)( row[i] + ( ( row[i-BPP] + prev[i] ) >> 1 ) );
+}
+
+inline int PaethPredictor( int a, int b, int c )
+{
+	int pa = abs( b - c );
+	int pb = abs( a - c );
+	int pc = abs( a + b - 2*c );
+	// a if pa is the smallest, else b if pb is not larger than pc, else c, selected with masks,
+	// since the branches are not predictable
+	int m = -int( pb < pa );
+	a  = ( a  & ~m ) | ( b  & m );
+	pa = ( pa & ~m ) | ( pb & m );
+	m = -int( pc < pa );
+	return ( a & ~m ) | ( c & m );
+}
+
+template <int BPP> inline void UnfilterPaeth( unsigned char *row, unsigned char const *prev, size_t n )
+{
+	for ( size_t i=0;   i<BPP && i<n; i++ ) row[i] = (unsigned char)( row[i] + prev[i] );	// the predictor of the first pixel is the one above
+	for ( size_t i=BPP; i<n;          i++ ) row[i] = (unsigned char)( row[i] + PaethPredictor( row[i-BPP], prev[i], prev[i-BPP] ) );
+}
+
+inline void GreyToRGBA( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	for ( size_t i=0; i<n; i++, dst+=4 ) { dst[0] = dst[1] = dst[2] = src[i]; dst[3] = 255; }
+}
+
+inline void GreyAlphaToRGBA( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	for ( size_t i=0; i<n; i++, dst+=4, src+=2 ) { dst[0] = dst[1] = dst[2] = src[0]; dst[3] = src[1]; }
+}
+
+inline void RGBToRGBA( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	for ( size_t i=0; i<n; i++, dst+=4, src+=3 ) { dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255; }
+}
+
+inline void RGBAToRGBA( unsigned char *dst, unsigned char const *src, size_t n ) { if ( n > 0 ) memcpy( dst, src, n*4 ); }
+
+#ifdef _CY_PNG_X86
+
+//-------------------------------------------------------------------------------
+// SSE2 kernels
+//-------------------------------------------------------------------------------
+
+// Sub is a prefix sum with a stride of BPP bytes, computed for 16 bytes at a time in log2 steps.
+// The sum of the last whole pixel is carried to the next block, repeated over all 16 bytes.
+// With 3 bytes per pixel, the blocks overlap by one byte, so the next block is loaded before the store.
+template <int BPP> _CY_PNG_TARGET("sse2") inline void UnfilterSubSSE2( unsigned char *row, unsigned char const *, size_t n )
+{
+	constexpr int step = 16 - 16 % BPP;	// whole pixels per block
+	__m128i const pixelMask = _mm_setr_epi32( int( 0xFFFFFFFFu >> ( 32 - BPP*8 ) ), 0, 0, 0 );
+	__m128i carry = _mm_setzero_si128();
+	size_t i = 0;
+	if ( n >= 16 ) {
+		__m128i x = _mm_loadu_si128( (__m128i const*)row );
+		for (;;) {
+			bool const last = i + step + 16 > n;
+			__m128i next = last ? x : _mm_loadu_si128( (__m128i const*)(row+i+step) );
+			x = _mm_add_epi8( x, _mm_slli_si128( x, BPP ) );
+			if constexpr ( BPP*2 < 16 ) x = _mm_add_epi8( x, _mm_slli_si128( x, BPP*2 ) );
+			if constexpr ( BPP*4 < 16 ) x = _mm_add_epi8( x, _mm_slli_si128( x, BPP*4 ) );
+			if constexpr ( BPP*8 < 16 ) x = _mm_add_epi8( x, _mm_slli_si128( x, BPP*8 ) );
+			x = _mm_add_epi8( x, carry );
+			_mm_storeu_si128( (__m128i*)(row+i), x );
+			if ( last ) { i += 16; break; }	// all 16 bytes are reconstructed, including a partial pixel
+			carry = _mm_and_si128( _mm_srli_si128( x, step - BPP ), pixelMask );
+			carry = _mm_or_si128( carry, _mm_slli_si128( carry, BPP ) );
+			if constexpr ( BPP*2 < 16 ) carry = _mm_or_si128( carry, _mm_slli_si128( carry, BPP*2 ) );
+			if constexpr ( BPP*4 < 16 ) carry = _mm_or_si128( carry, _mm_slli_si128( carry, BPP*4 ) );
+			if constexpr ( BPP*8 < 16 ) carry = _mm_or_si128( carry, _mm_slli_si128( carry, BPP*8 ) );
+			x = next;
+			i += step;
+		}
+	}
+	for ( i=Max(i,size_t(BPP)); i<n; i++ ) row[i] = (unsigned char)( row[i] + row[i-BPP] );
+}
+
+_CY_PNG_TARGET("sse2") inline void UnfilterUpSSE2( unsigned char *row, unsigned char const *prev, size_t n )
+{
+	size_t i = 0;
+	for ( ; i+16 <= n; i+=16 ) {
+		__m128i x = _mm_add_epi8( _mm_loadu_si128( (__m128i const*)(row+i) ), _mm_loadu_si128( (__m128i const*)(prev+i) ) );
+		_mm_storeu_si128( (__m128i*)(row+i), x );
+	}
+	for ( ; i<n; i++ ) row[i] = (unsigned char)( row[i] + prev[i] );
+}
+
+// Pixels are loaded and stored with integer loads and stores of the same size as the pixel,
+// since going through memory with a different size would stall the store forwarding.
+template <int BPP> _CY_PNG_TARGET("sse2") inline __m128i LoadPixel( unsigned char const *p )
+{
+	if constexpr ( BPP == 4 ) { uint32_t v; memcpy( &v, p, 4 ); return _mm_cvtsi32_si128( int(v) ); }
+	if constexpr ( BPP == 3 ) { uint16_t v; memcpy( &v, p, 2 ); return _mm_cvtsi32_si128( int( v | ( uint32_t(p[2]) << 16 ) ) ); }
+	if constexpr ( BPP == 2 ) { uint16_t v; memcpy( &v, p, 2 ); return _mm_cvtsi32_si128( int(v) ); }
+	if constexpr ( BPP == 1 ) return _mm_cvtsi32_si128( int(p[0]) );
+}
+
+template <int BPP> _CY_PNG_TARGET("sse2") inline void StorePixel( unsigned char *p, __m128i v )
+{
+	uint32_t x = uint32_t( _mm_cvtsi128_si32(v) );
+	if constexpr ( BPP == 4 ) memcpy( p, &x, 4 );
+	if constexpr ( BPP == 3 ) { uint16_t lo = uint16_t(x); memcpy( p, &lo, 2 ); p[2] = (unsigned char)( x >> 16 ); }
+	if constexpr ( BPP == 2 ) { uint16_t lo = uint16_t(x); memcpy( p, &lo, 2 ); }
+	if constexpr ( BPP == 1 ) p[0] = (unsigned char)x;
+}
+
+// Avg and Paeth depend on the reconstructed pixel on the left, so they process one pixel at a time.
+template <int BPP> _CY_PNG_TARGET("sse2") inline void UnfilterAvgSSE2( unsigned char *row, unsigned char const *prev, size_t n )
+{
+	__m128i const one = _mm_set1_epi8(1);
+	__m128i a = _mm_setzero_si128();
+	for ( size_t i=0; i<n; i+=BPP ) {
+		__m128i b = LoadPixel<BPP>( prev+i );
+		__m128i avg = _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), one ) );	// floor((a+b)/2)
+		a = _mm_add_epi8( LoadPixel<BPP>( row+i ), avg );
+		StorePixel<BPP>( row+i, a );
+	}
+}
+
+_CY_PNG_TARGET("sse2") inline __m128i Abs16( __m128i x ) { return _mm_max_epi16( x, _mm_sub_epi16( _mm_setzero_si128(), x ) ); }
+_CY_PNG_TARGET("sse2") inline __m128i Select( __m128i mask, __m128i a, __m128i b ) { return _mm_or_si128( _mm_and_si128( mask, a ), _mm_andnot_si128( mask, b ) ); }
+
+template <int BPP> _CY_PNG_TARGET("sse2") inline void UnfilterPaethSSE2( unsigned char *row, unsigned char const *prev, size_t n )
+{
+	__m128i const zero = _mm_setzero_si128();
+	__m128i a = zero, c = zero;		// 16-bit lanes
+	for ( size_t i=0; i<n; i+=BPP ) {
+		__m128i b = _mm_unpacklo_epi8( LoadPixel<BPP>( prev+i ), zero );
+		__m128i x = _mm_unpacklo_epi8( LoadPixel<BPP>( row +i ), zero );
+		__m128i p = _mm_sub_epi16( b, c );
+		__m128i q = _mm_sub_epi16( a, c );
+		__m128i pa = Abs16( p );
+		__m128i pb = Abs16( q );
+		__m128i pc = Abs16( _mm_add_epi16( p, q ) );
+		__m128i smallest = _mm_min_epi16( pc, _mm_min_epi16( pa, pb ) );
+		__m128i predictor = Select( _mm_cmpeq_epi16( smallest, pa ), a, Select( _mm_cmpeq_epi16( smallest, pb ), b, c ) );
+		a = _mm_and_si128( _mm_add_epi16( x, predictor ), _mm_set1_epi16(0xFF) );
+		StorePixel<BPP>( row+i, _mm_packus_epi16( a, a ) );
+		c = b;
+	}
+}
+
+_CY_PNG_TARGET("sse2") inline void GreyToRGBASSE2( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	__m128i const alpha = _mm_set1_epi8( -1 );
+	size_t i = 0;
+	for ( ; i+16 <= n; i+=16, dst+=64 ) {
+		__m128i g  = _mm_loadu_si128( (__m128i const*)(src+i) );
+		__m128i gg0 = _mm_unpacklo_epi8( g, g );
+		__m128i gg1 = _mm_unpackhi_epi8( g, g );
+		__m128i ga0 = _mm_unpacklo_epi8( g, alpha );
+		__m128i ga1 = _mm_unpackhi_epi8( g, alpha );
+		_mm_storeu_si128( (__m128i*)(dst   ), _mm_unpacklo_epi16( gg0, ga0 ) );
+		_mm_storeu_si128( (__m128i*)(dst+16), _mm_unpackhi_epi16( gg0, ga0 ) );
+		_mm_storeu_si128( (__m128i*)(dst+32), _mm_unpacklo_epi16( gg1, ga1 ) );
+		_mm_storeu_si128( (__m128i*)(dst+48), _mm_unpackhi_epi16( gg1, ga1 ) );
+	}
+	GreyToRGBA( dst, src+i, n-i );
+}
+
+_CY_PNG_TARGET("sse2") inline void GreyAlphaToRGBASSE2( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	__m128i const greyMask = _mm_set1_epi16( 0xFF );
+	size_t i = 0;
+	for ( ; i+8 <= n; i+=8, dst+=32 ) {
+		__m128i ga = _mm_loadu_si128( (__m128i const*)(src+i*2) );
+		__m128i g  = _mm_and_si128( ga, greyMask );
+		__m128i gg = _mm_or_si128( g, _mm_slli_epi16( g, 8 ) );
+		_mm_storeu_si128( (__m128i*)(dst   ), _mm_unpacklo_epi16( gg, ga ) );
+		_mm_storeu_si128( (__m128i*)(dst+16), _mm_unpackhi_epi16( gg, ga ) );
+	}
+	GreyAlphaToRGBA( dst, src+i*2, n-i );
+}
+
+//-------------------------------------------------------------------------------
+// SSSE3 kernels
+//-------------------------------------------------------------------------------
+
+_CY_PNG_TARGET("ssse3") inline void RGBToRGBASSSE3( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	__m128i const shuffle = _mm_setr_epi8( 0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1 );
+	__m128i const alpha   = _mm_set1_epi32( int(0xFF000000) );
+	size_t i = 0;
+	for ( ; i+6 <= n; i+=4, dst+=16 ) {	// reads 16 bytes for 4 pixels
+		__m128i rgb = _mm_loadu_si128( (__m128i const*)(src+i*3) );
+		_mm_storeu_si128( (__m128i*)dst, _mm_or_si128( _mm_shuffle_epi8( rgb, shuffle ), alpha ) );
+	}
+	RGBToRGBA( dst, src+i*3, n-i );
+}
+
+//-------------------------------------------------------------------------------
+// AVX2 kernels
+//-------------------------------------------------------------------------------
+
+_CY_PNG_TARGET("avx2") inline void UnfilterUpAVX2( unsigned char *row, unsigned char const *prev, size_t n )
+{
+	size_t i = 0;
+	for ( ; i+32 <= n; i+=32 ) {
+		__m256i x = _mm256_add_epi8( _mm256_loadu_si256( (__m256i const*)(row+i) ), _mm256_loadu_si256( (__m256i const*)(prev+i) ) );
+		_mm256_storeu_si256( (__m256i*)(row+i), x );
+	}
+	for ( ; i<n; i++ ) row[i] = (unsigned char)( row[i] + prev[i] );
+}
+
+_CY_PNG_TARGET("avx2") inline void GreyToRGBAAVX2( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	__m256i const shuffle0 = _mm256_setr_epi8( 0,0,0,-1, 1,1,1,-1,  2, 2, 2,-1,  3, 3, 3,-1,  4, 4, 4,-1,  5, 5, 5,-1,  6, 6, 6,-1,  7, 7, 7,-1 );
+	__m256i const shuffle1 = _mm256_setr_epi8( 8,8,8,-1, 9,9,9,-1, 10,10,10,-1, 11,11,11,-1, 12,12,12,-1, 13,13,13,-1, 14,14,14,-1, 15,15,15,-1 );
+	__m256i const alpha = _mm256_set1_epi32( int(0xFF000000) );
+	size_t i = 0;
+	for ( ; i+16 <= n; i+=16, dst+=64 ) {
+		// vpshufb does not cross 128-bit lanes, so both lanes get all 16 grey values
+		__m256i g = _mm256_broadcastsi128_si256( _mm_loadu_si128( (__m128i const*)(src+i) ) );
+		_mm256_storeu_si256( (__m256i*)(dst   ), _mm256_or_si256( _mm256_shuffle_epi8( g, shuffle0 ), alpha ) );
+		_mm256_storeu_si256( (__m256i*)(dst+32), _mm256_or_si256( _mm256_shuffle_epi8( g, shuffle1 ), alpha ) );
+	}
+	GreyToRGBA( dst, src+i, n-i );
+}
+
+_CY_PNG_TARGET("avx2") inline void GreyAlphaToRGBAAVX2( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	__m256i const shuffle0 = _mm256_setr_epi8( 0,0,0,1, 2,2,2,3, 4,4,4,5, 6,6,6,7, 8,8,8,9, 10,10,10,11, 12,12,12,13, 14,14,14,15 );
+	size_t i = 0;
+	for ( ; i+8 <= n; i+=8, dst+=32 ) {
+		__m256i ga = _mm256_broadcastsi128_si256( _mm_loadu_si128( (__m128i const*)(src+i*2) ) );
+		_mm256_storeu_si256( (__m256i*)dst, _mm256_shuffle_epi8( ga, shuffle0 ) );
+	}
+	GreyAlphaToRGBA( dst, src+i*2, n-i );
+}
+
+_CY_PNG_TARGET("avx2") inline void RGBToRGBAAVX2( unsigned char *dst, unsigned char const *src, size_t n )
+{
+	__m256i const shuffle = _mm256_setr_epi8( 0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1, 0,1,2,-1, 3,4,5,-1, 6,7,8,-1, 9,10,11,-1 );
+	__m256i const alpha   = _mm256_set1_epi32( int(0xFF000000) );
+	size_t i = 0;
+	for ( ; i+10 <= n; i+=8, dst+=32 ) {	// reads 28 bytes for 8 pixels, 12 bytes in each 128-bit lane
+		unsigned char const *s = src + i*3;
+		__m256i rgb = _mm256_inserti128_si256( _mm256_castsi128_si256( _mm_loadu_si128( (__m128i const*)s ) ), _mm_loadu_si128( (__m128i const*)(s+12) ), 1 );
+		_mm256_storeu_si256( (__m256i*)dst, _mm256_or_si256( _mm256_shuffle_epi8( rgb, shuffle ), alpha ) );
+	}
+	RGBToRGBASSSE3( dst, src+i*3, n-i );
+}
+
+#endif // _CY_PNG_X86
+
+//-------------------------------------------------------------------------------
+
+//! Decodes the PNG with PngKernels if it is a plain 8-bit image without errors. Returns false if lodepng must decode it,
+//! or if getOutput returns null.
+template <typename GET_OUTPUT>
+inline bool DecodeFast( unsigned &width, unsigned &height, unsigned char const *png, size_t size, GET_OUTPUT &getOutput )
+{
+	lodepng::State state;
+	SetFastInflate( state.decoder.zlibsettings );
+	unsigned w, h;
+	if ( lodepng_inspect( &w, &h, &state, png, size ) ) return false;
+	if ( state.info_png.color.bitdepth != 8 || state.info_png.interlace_method != 0 ) return false;
+	unsigned int channels;
+	switch ( state.info_png.color.colortype ) {
+		case LCT_GREY:       channels = 1; break;
+		case LCT_GREY_ALPHA: channels = 2; break;
+		case LCT_RGB:        channels = 3; break;
+		case LCT_RGBA:       channels = 4; break;
+		default: return false;
+	}
+	if ( ( uint64_t(w)*4 + 1 ) * h > uint64_t( PTRDIFF_MAX / 2 ) ) return false;
+
+	// Gather the IDAT data. Any chunk that lodepng would reject, or that changes the pixels (PLTE, tRNS), is left to lodepng.
+	std::vector<unsigned char> idat;
+	size_t pos = 33;	// the first chunk after the signature and IHDR
+	for (;;) {
+		if ( pos + 12 > size ) return false;
+		unsigned char const *chunk = png + pos;
+		unsigned int length = lodepng_chunk_length( chunk );
+		if ( length > 2147483647u || length > size - pos - 12 ) return false;
+		if ( lodepng_chunk_check_crc( chunk ) ) return false;
+		if ( lodepng_chunk_type_equals( chunk, "IDAT" ) ) {
+			idat.insert( idat.end(), chunk + 8, chunk + 8 + length );
+		} else if ( lodepng_chunk_type_equals( chunk, "IEND" ) ) {
+			break;
+		} else {
+			for ( int j=4; j<8; j++ ) if ( ( chunk[j] | 32 ) < 'a' || ( chunk[j] | 32 ) > 'z' ) return false;
+			if ( ( chunk[4] & 32 ) == 0 || ( chunk[6] & 32 ) != 0 ) return false;	// critical or reserved
+			if ( lodepng_chunk_type_equals( chunk, "tRNS" ) ) return false;
+			if ( lodepng_inspect_chunk( &state, pos, png, size ) ) return false;
+		}
+		pos += size_t(length) + 12;
+	}
+
+	size_t const rowBytes = size_t(w) * channels;
+	unsigned char *scanlines = nullptr;
+	size_t scanlinesSize = 0;
+	unsigned error = ZlibDecompress( &scanlines, &scanlinesSize, idat.data(), idat.size(), &state.decoder.zlibsettings );
+	bool ok = !error && scanlinesSize == ( rowBytes + 1 ) * h;
+	unsigned char *rgba = ok ? getOutput( w, h ) : nullptr;
+	if ( rgba ) {
+		PngKernels const &kernels = PngKernels::Get();
+		PngKernels::ToRGBA toRGBA = kernels.toRGBA[channels-1];
+		std::vector<unsigned char> zeros( rowBytes, 0 );
+		unsigned char const *prev = zeros.data();
+		for ( unsigned y=0; y<h; y++ ) {
+			unsigned char *row = scanlines + y * ( rowBytes + 1 );
+			unsigned int filterType = *row++;
+			if ( filterType > 4 ) { ok = false; break; }
+			if ( filterType > 0 ) kernels.unfilter[filterType][channels-1]( row, prev, rowBytes );
+			toRGBA( rgba + size_t(y) * w * 4, row, w );
+			prev = row;
+		}
+	}
+	free( scanlines );
+	if ( !rgba || !ok ) return false;
+	width  = w;
+	height = h;
+	return true;
+}
+
+} // namespace png
+
+//-------------------------------------------------------------------------------
+
+inline PngIsa DetectPngIsa()
+{
+#ifdef _CY_PNG_X86
+# ifdef _MSC_VER
+	int r[4];
+	__cpuid( r, 0 );
+	int maxLeaf = r[0];
+	__cpuid( r, 1 );
+	bool sse2    = ( r[3] >> 26 ) & 1;
+	bool ssse3   = ( r[2] >>  9 ) & 1;
+	bool osxsave = ( r[2] >> 27 ) & 1;
+	bool avx     = ( r[2] >> 28 ) & 1;
+	bool avx2    = false;
+	if ( maxLeaf >= 7 && osxsave && avx && ( _xgetbv(0) & 6 ) == 6 ) {	// the OS saves the YMM registers
+		__cpuidex( r, 7, 0 );
+		avx2 = ( r[1] >> 5 ) & 1;
+	}
+# else
+	__builtin_cpu_init();
+	bool sse2  = __builtin_cpu_supports( "sse2"  );
+	bool ssse3 = __builtin_cpu_supports( "ssse3" );
+	bool avx2  = __builtin_cpu_supports( "avx2"  );
+# endif
+	if ( avx2 && ssse3 ) return PNG_ISA_AVX2;
+	if ( ssse3 && sse2 ) return PNG_ISA_SSSE3;
+	if ( sse2 ) return PNG_ISA_SSE2;
+#endif
+	return PNG_ISA_SCALAR;
+}
+
+inline PngKernels PngKernels::Make( PngIsa isa )
+{
+	using namespace png;
+	PngKernels k;
+	k.isa = PNG_ISA_SCALAR;
+	for ( int b=0; b<4; b++ ) {
+		k.unfilter[0][b] = nullptr;
+		k.unfilter[2][b] = UnfilterUp;
+	}
+	k.unfilter[1][0] = UnfilterSub<1>;   k.unfilter[1][1] = UnfilterSub<2>;   k.unfilter[1][2] = UnfilterSub<3>;   k.unfilter[1][3] = UnfilterSub<4>;
+	k.unfilter[3][0] = UnfilterAvg<1>;   k.unfilter[3][1] = UnfilterAvg<2>;   k.unfilter[3][2] = UnfilterAvg<3>;   k.unfilter[3][3] = UnfilterAvg<4>;
+	k.unfilter[4][0] = UnfilterPaeth<1>; k.unfilter[4][1] = UnfilterPaeth<2>; k.unfilter[4][2] = UnfilterPaeth<3>; k.unfilter[4][3] = UnfilterPaeth<4>;
+	k.toRGBA[0] = GreyToRGBA;
+	k.toRGBA[1] = GreyAlphaToRGBA;
+	k.toRGBA[2] = RGBToRGBA;
+	k.toRGBA[3] = RGBAToRGBA;
+#ifdef _CY_PNG_X86
+	if ( isa >= PNG_ISA_SSE2 ) {
+		k.isa = PNG_ISA_SSE2;
+		for ( int b=0; b<4; b++ ) k.unfilter[2][b] = UnfilterUpSSE2;
+		k.unfilter[1][0] = UnfilterSubSSE2<1>; k.unfilter[1][1] = UnfilterSubSSE2<2>; k.unfilter[1][2] = UnfilterSubSSE2<3>; k.unfilter[1][3] = UnfilterSubSSE2<4>;
+		// With 1 or 2 bytes per pixel, a pixel at a time is not faster than the scalar code
+		k.unfilter[3][2] = UnfilterAvgSSE2<3>;   k.unfilter[3][3] = UnfilterAvgSSE2<4>;
+		k.unfilter[4][2] = UnfilterPaethSSE2<3>; k.unfilter[4][3] = UnfilterPaethSSE2<4>;
+		k.toRGBA[0] = GreyToRGBASSE2;
+		k.toRGBA[1] = GreyAlphaToRGBASSE2;
+	}
+	if ( isa >= PNG_ISA_SSSE3 ) {
+		k.isa = PNG_ISA_SSSE3;
+		k.toRGBA[2] = RGBToRGBASSSE3;
+	}
+	if ( isa >= PNG_ISA_AVX2 ) {
+		k.isa = PNG_ISA_AVX2;
+		for ( int b=0; b<4; b++ ) k.unfilter[2][b] = UnfilterUpAVX2;
+		k.toRGBA[0] = GreyToRGBAAVX2;
+		k.toRGBA[1] = GreyAlphaToRGBAAVX2;
+		k.toRGBA[2] = RGBToRGBAAVX2;
+	}
+#else
+	(void)isa;
+#endif
+	return k;
+}
+
+template <typename GET_OUTPUT>
+inline unsigned DecodePNG( unsigned &width, unsigned &height, unsigned char const *png, size_t pngSize, GET_OUTPUT getOutput )
+{
+	unsigned char *output = nullptr;
+	bool outputRequested = false;
+	auto getOutputOnce = [&]( unsigned w, unsigned h ) {
+		if ( !outputRequested ) { output = getOutput( w, h ); outputRequested = true; }
+		return output;
+	};
+	if ( png::DecodeFast( width, height, png, pngSize, getOutputOnce ) ) return 0;
+	if ( outputRequested && !output ) return 83;
+
+	lodepng::State state;
+	SetFastInflate( state.decoder.zlibsettings );
+	unsigned char *rgba = nullptr;
+	unsigned error = lodepng_decode( &rgba, &width, &height, &state, png, pngSize );
+	if ( !error ) {
+		unsigned char *dst = getOutputOnce( width, height );
+		if ( dst ) memcpy( dst, rgba, size_t(width) * height * 4 );
+		else error = 83;
+	}
+	free( rgba );	// lodepng allocates with malloc
+	return error;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::PngKernels cyPngKernels;	//!< Scanline kernels for 8-bit PNG images
+
+//-------------------------------------------------------------------------------
+
+#endif
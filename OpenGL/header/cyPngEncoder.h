@@ -0,0 +1,313 @@
+//-------------------------------------------------------------------------------
+//! \file   cyPngEncoder.h
+//!
+//! \brief  PNG encoding of 8-bit RGBA images with selectable compression effort.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_PNG_ENCODER_H_INCLUDED_
+#define _CY_PNG_ENCODER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyHash.h"
+#include "lodepng.h"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Compression effort of EncodePNG
+enum PngEffort
+{
+	PNG_STORE,	//!< no filtering, stored deflate blocks; the fastest and the largest files
+	PNG_FAST,	//!< filter none or up for each row, run length deflate with the fixed Huffman codes
+	PNG_SMALL,	//!< lodepng with its default settings; the slowest and the smallest files
+};
+
+//! Returns the name of the given effort
+inline char const * PngEffortName( PngEffort effort )
+{
+	switch ( effort ) {
+		case PNG_STORE: return "store";
+		case PNG_FAST:  return "fast";
+		case PNG_SMALL: return "small";
+	}
+	return "unknown";
+}
+
+//! Encodes the given 8-bit RGBA image as a PNG file in memory, replacing the contents of png.
+//! If bottomUp is true, the first row of the image is the bottom row, as glReadPixels returns it.
+//! If alpha is false, the alpha channel is dropped and an RGB file is written.
+//! Returns zero on success, or a lodepng error code.
+inline unsigned EncodePNG( std::vector<unsigned char> &png, unsigned char const *rgba, unsigned width, unsigned height,
+                           PngEffort effort, bool bottomUp=false, bool alpha=true );
+
+//-------------------------------------------------------------------------------
+// Implementation
+//-------------------------------------------------------------------------------
+
+namespace pngenc {
+
+//-------------------------------------------------------------------------------
+
+// CRC-32 of PNG chunks, eight bytes at a time (slicing-by-8)
+struct Crc32Table
+{
+	uint32_t t[8][256];
+	Crc32Table()
+	{
+		for ( uint32_t i=0; i<256; i++ ) {
+			uint32_t c = i;
+			for ( int k=0; k<8; k++ ) c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+			t[0][i] = c;
+		}
+		for ( uint32_t i=0; i<256; i++ ) {
+			for ( int s=1; s<8; s++ ) t[s][i] = ( t[s-1][i] >> 8 ) ^ t[0][ t[s-1][i] & 0xFF ];
+		}
+	}
+	static Crc32Table const & Get() { static Crc32Table const table; return table; }
+};
+
+inline uint32_t Crc32( uint32_t crc, unsigned char const *p, size_t n )
+{
+	uint32_t const (&t)[8][256] = Crc32Table::Get().t;
+	crc = ~crc;
+	for ( ; n >= 8; n-=8, p+=8 ) {
+		uint32_t a = crc ^ ( uint32_t(p[0]) | ( uint32_t(p[1]) << 8 ) | ( uint32_t(p[2]) << 16 ) | ( uint32_t(p[3]) << 24 ) );
+		crc = t[7][a & 0xFF] ^ t[6][(a>>8) & 0xFF] ^ t[5][(a>>16) & 0xFF] ^ t[4][a>>24] ^ t[3][p[4]] ^ t[2][p[5]] ^ t[1][p[6]] ^ t[0][p[7]];
+	}
+	for ( ; n > 0; n--, p++ ) crc = t[0][ ( crc ^ *p ) & 0xFF ] ^ ( crc >> 8 );
+	return ~crc;
+}
+
+inline void Put32( std::vector<unsigned char> &out, uint32_t v )
+{
+	out.push_back( (unsigned char)( v >> 24 ) );
+	out.push_back( (unsigned char)( v >> 16 ) );
+	out.push_back( (unsigned char)( v >>  8 ) );
+	out.push_back( (unsigned char)( v       ) );
+}
+
+// Appends a chunk with the given data
+inline void WriteChunk( std::vector<unsigned char> &out, char const *type, unsigned char const *data, size_t size )
+{
+	Put32( out, (uint32_t)size );
+	size_t const start = out.size();
+	out.insert( out.end(), type, type+4 );
+	if ( data ) out.insert( out.end(), data, data+size );
+	Put32( out, Crc32( 0, out.data()+start, size+4 ) );
+}
+
+//-------------------------------------------------------------------------------
+
+// Deflate bit writer, least significant bit first
+class BitWriter
+{
+public:
+	explicit BitWriter( std::vector<unsigned char> &o ) : out(o) {}
+	void Write( uint32_t bits, int count )	// count <= 32
+	{
+		acc |= uint64_t(bits) << numBits;
+		numBits += count;
+		if ( numBits >= 32 ) {
+			unsigned char const b[4] = { (unsigned char) acc, (unsigned char)( acc >> 8 ), (unsigned char)( acc >> 16 ), (unsigned char)( acc >> 24 ) };
+			out.insert( out.end(), b, b+4 );
+			acc >>= 32;
+			numBits -= 32;
+		}
+	}
+	void Flush() { for ( ; numBits > 0; numBits -= 8 ) { out.push_back( (unsigned char) acc ); acc >>= 8; } numBits = 0; }
+private:
+	std::vector<unsigned char> &out;
+	uint64_t acc     = 0;
+	int      numBits = 0;
+};
+
+// The fixed Huffman codes of deflate, bit reversed for the bit writer
+struct FixedCodes
+{
+	uint16_t litCode[288];
+	uint8_t  litBits[288];
+	uint16_t lenSymbol[259];	// length code of each match length in [3,258]
+	uint8_t  lenExtraBits[259];
+	uint16_t lenExtra[259];
+
+	static uint32_t Reverse( uint32_t code, int bits ) { uint32_t r=0; for ( int i=0; i<bits; i++ ) { r = ( r << 1 ) | ( code & 1 ); code >>= 1; } return r; }
+
+	FixedCodes()
+	{
+		for ( int s=0; s<288; s++ ) {
+			uint32_t code; int bits;
+			if      ( s < 144 ) { code = 0x30  + s;         bits = 8; }
+			else if ( s < 256 ) { code = 0x190 + (s-144);   bits = 9; }
+			else if ( s < 280 ) { code = s-256;             bits = 7; }
+			else                { code = 0xC0  + (s-280);   bits = 8; }
+			litCode[s] = (uint16_t) Reverse( code, bits );
+			litBits[s] = (uint8_t) bits;
+		}
+		static int const base [29] = { 3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258 };
+		static int const extra[29] = { 0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0 };
+		for ( int c=0; c<29; c++ ) {
+			int const end = ( c == 28 ) ? 259 : base[c] + ( 1 << extra[c] );
+			for ( int len=base[c]; len<end && len<259; len++ ) {
+				lenSymbol   [len] = uint16_t( 257 + c );
+				lenExtraBits[len] = uint8_t( extra[c] );
+				lenExtra    [len] = uint16_t( len - base[c] );
+			}
+		}
+	}
+	static FixedCodes const & Get() { static FixedCodes const codes; return codes; }
+};
+
+// Compresses data to a single fixed Huffman block that only has matches with distance 1 (a repeated byte)
+// or pixelBytes (a repeated pixel), which is a run length encoding that needs no hash table.
+inline void DeflateRLE( std::vector<unsigned char> &out, unsigned char const *data, size_t size, int pixelBytes )
+{
+	FixedCodes const &fc = FixedCodes::Get();
+	BitWriter bw( out );
+	bw.Write( 1, 1 );	// final block
+	bw.Write( 1, 2 );	// fixed Huffman codes
+	size_t i = 0;
+	while ( i < size ) {
+		size_t const maxLen = Min( size - i, size_t(258) );
+		size_t bestLen = 0;
+		int    bestDistCode = 0;
+		if ( i >= 1 ) {
+			size_t len = 0;
+			while ( len < maxLen && data[i+len] == data[i+len-1] ) len++;
+			bestLen = len;
+		}
+		if ( i >= size_t(pixelBytes) && bestLen < maxLen ) {
+			size_t len = 0;
+			while ( len < maxLen && data[i+len] == data[i+len-pixelBytes] ) len++;
+			if ( len > bestLen ) { bestLen = len; bestDistCode = pixelBytes - 1; }	// distance codes 0-3 are distances 1-4
+		}
+		if ( bestLen >= 3 ) {
+			int const s = fc.lenSymbol[bestLen];
+			bw.Write( fc.litCode[s], fc.litBits[s] );
+			if ( fc.lenExtraBits[bestLen] ) bw.Write( fc.lenExtra[bestLen], fc.lenExtraBits[bestLen] );
+			bw.Write( FixedCodes::Reverse( bestDistCode, 5 ), 5 );
+			i += bestLen;
+		} else {
+			bw.Write( fc.litCode[ data[i] ], fc.litBits[ data[i] ] );
+			i++;
+		}
+	}
+	bw.Write( fc.litCode[256], fc.litBits[256] );	// end of block
+	bw.Flush();
+}
+
+// Copies data to stored deflate blocks of up to 65535 bytes
+inline void DeflateStore( std::vector<unsigned char> &out, unsigned char const *data, size_t size )
+{
+	size_t i = 0;
+	do {
+		size_t const n = Min( size - i, size_t(65535) );
+		out.push_back( i+n == size ? 1 : 0 );	// final flag, stored block type
+		out.push_back( (unsigned char)( n      ) );
+		out.push_back( (unsigned char)( n >> 8 ) );
+		out.push_back( (unsigned char)( ~n      ) );
+		out.push_back( (unsigned char)( ~n >> 8 ) );
+		out.insert( out.end(), data+i, data+i+n );
+		i += n;
+	} while ( i < size );
+}
+
+// Writes the scanlines with their filter bytes. The filter of each row is the one with the smaller sum of
+// absolute differences, among none and up, as the minimum sum heuristic of the PNG specification.
+inline void FilterRows( std::vector<unsigned char> &filtered, unsigned char const *rgba, unsigned width, unsigned height,
+                        bool bottomUp, bool alpha, bool useUp )
+{
+	int    const bpp      = alpha ? 4 : 3;
+	size_t const rowBytes = size_t(width) * bpp;
+	filtered.resize( ( rowBytes + 1 ) * height );
+	std::vector<unsigned char> row[2];
+	row[0].resize( rowBytes );
+	row[1].resize( rowBytes );
+	for ( unsigned y=0; y<height; y++ ) {
+		unsigned char const *src = rgba + size_t( bottomUp ? height-1-y : y ) * width * 4;
+		unsigned char *cur = row[y & 1].data();
+		unsigned char const *prev = row[(y+1) & 1].data();
+		if ( alpha ) memcpy( cur, src, rowBytes );
+		else for ( unsigned x=0; x<width; x++ ) { cur[x*3] = src[x*4]; cur[x*3+1] = src[x*4+1]; cur[x*3+2] = src[x*4+2]; }
+		unsigned char *dst = filtered.data() + y * ( rowBytes + 1 );
+		bool up = false;
+		if ( useUp && y > 0 ) {
+			size_t sumNone = 0, sumUp = 0;
+			for ( size_t i=0; i<rowBytes; i++ ) {
+				sumNone += (size_t) std::abs( (int)(signed char) cur[i] );
+				sumUp   += (size_t) std::abs( (int)(signed char)( cur[i] - prev[i] ) );
+			}
+			up = sumUp < sumNone;
+		}
+		dst[0] = up ? 2 : 0;
+		if ( up ) for ( size_t i=0; i<rowBytes; i++ ) dst[1+i] = (unsigned char)( cur[i] - prev[i] );
+		else memcpy( dst+1, cur, rowBytes );
+	}
+}
+
+//-------------------------------------------------------------------------------
+} // namespace pngenc
+//-------------------------------------------------------------------------------
+
+inline unsigned EncodePNG( std::vector<unsigned char> &png, unsigned char const *rgba, unsigned width, unsigned height,
+                           PngEffort effort, bool bottomUp, bool alpha )
+{
+	png.clear();
+	if ( width == 0 || height == 0 ) return 93;	// zero width or height
+	if ( effort == PNG_SMALL ) {
+		std::vector<unsigned char> flipped;
+		if ( bottomUp ) {
+			size_t const rowBytes = size_t(width) * 4;
+			flipped.resize( rowBytes * height );
+			for ( unsigned y=0; y<height; y++ ) memcpy( flipped.data() + y*rowBytes, rgba + size_t(height-1-y)*rowBytes, rowBytes );
+			rgba = flipped.data();
+		}
+		lodepng::State state;
+		state.encoder.auto_convert = 0;
+		state.info_png.color.colortype = alpha ? LCT_RGBA : LCT_RGB;
+		return lodepng::encode( png, rgba, width, height, state );
+	}
+
+	std::vector<unsigned char> filtered;
+	pngenc::FilterRows( filtered, rgba, width, height, bottomUp, alpha, effort == PNG_FAST );
+
+	static unsigned char const signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	png.reserve( filtered.size() + filtered.size() / 8 + 1024 );
+	png.insert( png.end(), signature, signature+8 );
+
+	unsigned char ihdr[13] = {
+		(unsigned char)( width  >> 24 ), (unsigned char)( width  >> 16 ), (unsigned char)( width  >> 8 ), (unsigned char) width,
+		(unsigned char)( height >> 24 ), (unsigned char)( height >> 16 ), (unsigned char)( height >> 8 ), (unsigned char) height,
+		8, (unsigned char)( alpha ? 6 : 2 ), 0, 0, 0 };	// 8 bits, RGBA or RGB, deflate, adaptive filtering, no interlace
+	pngenc::WriteChunk( png, "IHDR", ihdr, sizeof(ihdr) );
+
+	// The zlib stream is written in place of the IDAT chunk data
+	size_t const idat = png.size();
+	png.resize( idat + 8 );
+	png.push_back( 0x78 );	// deflate with a 32K window
+	png.push_back( 0x01 );	// fastest compression, no dictionary
+	if ( effort == PNG_FAST ) pngenc::DeflateRLE( png, filtered.data(), filtered.size(), alpha ? 4 : 3 );
+	else pngenc::DeflateStore( png, filtered.data(), filtered.size() );
+	pngenc::Put32( png, Adler32( filtered.data(), filtered.size() ) );
+	size_t const idatSize = png.size() - idat - 8;
+	unsigned char const type[4] = { 'I', 'D', 'A', 'T' };
+	for ( int i=0; i<4; i++ ) png[idat+i] = (unsigned char)( idatSize >> ( 24 - 8*i ) );
+	memcpy( png.data()+idat+4, type, 4 );
+	pngenc::Put32( png, pngenc::Crc32( 0, png.data()+idat+4, idatSize+4 ) );
+
+	pngenc::WriteChunk( png, "IEND", nullptr, 0 );
+	return 0;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,231 @@
+//-------------------------------------------------------------------------------
+//! \file   cyQuantizedMesh.h
+//!
+//! \brief  Compact interleaved vertex format with quantized attributes.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_QUANTIZED_MESH_H_INCLUDED_
+#define _CY_QUANTIZED_MESH_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyVector.h"
+#include "cyParallel.h"
+#include <vector>
+#include <cmath>
+#include <limits>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Converts a float to a half float (IEEE 754 binary16) with round-to-nearest-even.
+CY_NODISCARD inline uint16_t FloatToHalf( float f )
+{
+	uint32_t x;
+	memcpy( &x, &f, 4 );
+	uint32_t sign = (x >> 16) & 0x8000;
+	uint32_t absx = x & 0x7FFFFFFF;
+	if ( absx >= 0x7F800000 ) return uint16_t( sign | 0x7C00 | ( absx > 0x7F800000 ? 0x200 : 0 ) );	// infinity or NaN
+	if ( absx >= 0x477FF000 ) return uint16_t( sign | 0x7C00 );	// overflow
+	if ( absx <  0x38800000 ) {	// subnormal half
+		if ( absx < 0x33000000 ) return uint16_t( sign );
+		uint32_t e = absx >> 23;
+		uint32_t m = (absx & 0x7FFFFF) | 0x800000;
+		uint32_t shift = 126 - e;
+		uint32_t r = m >> shift;
+		uint32_t rem  = m & ((1u << shift) - 1);
+		uint32_t half = 1u << (shift - 1);
+		if ( rem > half || ( rem == half && (r & 1) ) ) r++;
+		return uint16_t( sign | r );
+	}
+	uint32_t r = absx - 0x38000000;	// rebias the exponent
+	r = ( r + 0xFFF + ((r >> 13) & 1) ) >> 13;
+	return uint16_t( sign | r );
+}
+
+//! Converts a half float (IEEE 754 binary16) to a float.
+CY_NODISCARD inline float HalfToFloat( uint16_t h )
+{
+	uint32_t sign = uint32_t(h & 0x8000) << 16;
+	uint32_t e = (h >> 10) & 0x1F;
+	uint32_t m = h & 0x3FF;
+	if ( e == 0 ) {
+		float v = float(m) * (1.0f / 16777216.0f);
+		return sign ? -v : v;
+	}
+	uint32_t x = sign | ( e == 31 ? 0x7F800000 : ((e + 112) << 23) ) | (m << 13);
+	float f;
+	memcpy( &f, &x, 4 );
+	return f;
+}
+
+//! Converts a value in [-1,1] to a 16-bit signed normalized integer.
+CY_NODISCARD inline int16_t FloatToSnorm16( float f ) { return int16_t( std::lround( Clamp( f, -1.0f, 1.0f ) * 32767.0f ) ); }
+
+//! Converts a 16-bit signed normalized integer to a value in [-1,1], as OpenGL does.
+CY_NODISCARD inline float Snorm16ToFloat( int16_t i ) { return Max( float(i) / 32767.0f, -1.0f ); }
+
+//! Maps a unit vector to a point in [-1,1]^2 using octahedral encoding.
+//! A zero vector is mapped to the origin, which decodes to (0,0,1).
+CY_NODISCARD inline Vec2f OctEncode( Vec3f const &n )
+{
+	float len1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if ( len1 == 0 ) return Vec2f(0,0);
+	Vec3f p = n / len1;
+	if ( p.z < 0 ) {
+		float x = ( 1 - std::abs(p.y) ) * ( p.x >= 0 ? 1.0f : -1.0f );
+		float y = ( 1 - std::abs(p.x) ) * ( p.y >= 0 ? 1.0f : -1.0f );
+		p.x = x;
+		p.y = y;
+	}
+	return Vec2f( p.x, p.y );
+}
+
+//! Maps an octahedral encoded point in [-1,1]^2 back to a unit vector.
+CY_NODISCARD inline Vec3f OctDecode( Vec2f const &e )
+{
+	Vec3f n( e.x, e.y, 1 - std::abs(e.x) - std::abs(e.y) );
+	float t = Max( -n.z, 0.0f );
+	n.x += n.x >= 0 ? -t : t;
+	n.y += n.y >= 0 ? -t : t;
+	return n.GetNormalized();
+}
+
+//-------------------------------------------------------------------------------
+
+//! Quantized vertex with 16 bytes.
+//!
+//! The position is stored as 16-bit signed normalized integers relative to the bounding
+//! box, the normal is octahedral encoded with two 16-bit signed normalized integers, and
+//! the texture coordinates are half floats.
+struct QuantizedVertex
+{
+	int16_t  position[3];	//!< position in the bounding box mapped to [-1,1]
+	int16_t  padding;		//!< unused, keeps the normal 4-byte aligned
+	int16_t  normal[2];		//!< octahedral encoded normal
+	uint16_t texCoord[2];	//!< half float texture coordinates
+};
+static_assert( sizeof(QuantizedVertex) == 16, "QuantizedVertex must be 16 bytes" );
+
+//! Maximum errors of quantized vertex data.
+struct QuantizationError
+{
+	float position    = 0;	//!< maximum position error as a distance
+	float normalAngle = 0;	//!< maximum normal error in degrees
+	float texCoord    = 0;	//!< maximum texture coordinate error, relative to the magnitude of the texture coordinate if it is above 1
+};
+
+//-------------------------------------------------------------------------------
+
+//! Interleaved, quantized vertex buffer.
+//!
+//! A position is dequantized as p*positionScale + positionOffset, where p is the
+//! signed normalized position in [-1,1]^3. OpenGL does the conversion to [-1,1] when
+//! the attribute format is GL_SHORT with normalized set to true, so a vertex shader
+//! only needs to apply the scale and offset, and decode the octahedral normal.
+
+struct QuantizedMesh
+{
+	std::vector<QuantizedVertex> vertices;							//!< quantized vertices
+	Vec3f positionScale  = Vec3f(1,1,1);							//!< position dequantization scale
+	Vec3f positionOffset = Vec3f(0,0,0);							//!< position dequantization offset
+
+	unsigned int NumVertices() const { return (unsigned int) vertices.size(); }				//!< Returns the number of vertices
+	size_t       VerticesSize() const { return vertices.size() * sizeof(QuantizedVertex); }	//!< Returns the size of the vertex data in bytes
+
+	//! Quantizes the given vertex data. The positions and normals have 3 floats per vertex and the
+	//! texture coordinates have 2 floats per vertex. All positions must be inside the given bounding box.
+	void Build( float const *positions, float const *normals, float const *texCoords, unsigned int numVertices, Vec3f const &boundMin, Vec3f const &boundMax );
+
+	Vec3f GetPosition( unsigned int i ) const { QuantizedVertex const &v = vertices[i]; return Vec3f( Snorm16ToFloat(v.position[0]), Snorm16ToFloat(v.position[1]), Snorm16ToFloat(v.position[2]) ) * positionScale + positionOffset; }	//!< Returns the dequantized position
+	Vec3f GetNormal  ( unsigned int i ) const { QuantizedVertex const &v = vertices[i]; return OctDecode( Vec2f( Snorm16ToFloat(v.normal[0]), Snorm16ToFloat(v.normal[1]) ) ); }	//!< Returns the decoded normal
+	Vec2f GetTexCoord( unsigned int i ) const { QuantizedVertex const &v = vertices[i]; return Vec2f( HalfToFloat(v.texCoord[0]), HalfToFloat(v.texCoord[1]) ); }	//!< Returns the texture coordinates
+
+	//! Dequantizes all vertices and returns the maximum errors compared to the given source data.
+	QuantizationError MeasureError( float const *positions, float const *normals, float const *texCoords ) const;
+
+	//! Returns true if the given errors are within the precision the format should provide:
+	//! half a quantization step for positions, 0.01 degrees for normals, and the half float
+	//! precision for texture coordinates. The position bound also allows for the float rounding
+	//! of the dequantization, which matters when the offset is large compared to the scale.
+	bool IsAccurate( QuantizationError const &error ) const
+	{
+		float positionStep = ( positionScale / 32767.0f ).Length();
+		Vec3f magnitude( std::abs(positionScale.x) + std::abs(positionOffset.x), std::abs(positionScale.y) + std::abs(positionOffset.y), std::abs(positionScale.z) + std::abs(positionOffset.z) );
+		float rounding = 2 * std::numeric_limits<float>::epsilon() * magnitude.Length();
+		return error.position <= 0.5f * positionStep * 1.001f + rounding && error.normalAngle <= 0.01f && error.texCoord <= 1.0f / 2048.0f;
+	}
+};
+
+//-------------------------------------------------------------------------------
+
+inline void QuantizedMesh::Build( float const *positions, float const *normals, float const *texCoords, unsigned int numVertices, Vec3f const &boundMin, Vec3f const &boundMax )
+{
+	positionOffset = (boundMin + boundMax) * 0.5f;
+	positionScale  = (boundMax - boundMin) * 0.5f;
+	for ( int j=0; j<3; j++ ) if ( !( positionScale[j] > 0 ) ) positionScale[j] = 1;	// flat or empty bounding box
+
+	vertices.resize( numVertices );
+	unsigned int const blockSize = 4096;
+	ParallelFor( (numVertices + blockSize - 1) / blockSize, [&]( unsigned int block ) {
+		unsigned int end = Min( numVertices, (block+1)*blockSize );
+		for ( unsigned int i=block*blockSize; i<end; i++ ) {
+			QuantizedVertex &v = vertices[i];
+			for ( int j=0; j<3; j++ ) v.position[j] = FloatToSnorm16( ( positions[ size_t(i)*3+j ] - positionOffset[j] ) / positionScale[j] );
+			v.padding = 0;
+
+			// Pick the rounding of the encoded normal with the smallest error
+			Vec3f n( normals + size_t(i)*3 );
+			Vec2f e = OctEncode(n);
+			float nLen = n.Length();
+			Vec3f nn = nLen > 0 ? n / nLen : Vec3f(0,0,1);
+			float bestDot = -2;
+			for ( int k=0; k<4; k++ ) {
+				int16_t x = int16_t( Clamp( (k&1) ? std::ceil(e.x*32767.0f) : std::floor(e.x*32767.0f), -32767.0f, 32767.0f ) );
+				int16_t y = int16_t( Clamp( (k&2) ? std::ceil(e.y*32767.0f) : std::floor(e.y*32767.0f), -32767.0f, 32767.0f ) );
+				float d = OctDecode( Vec2f( Snorm16ToFloat(x), Snorm16ToFloat(y) ) ).Dot( nn );
+				if ( d > bestDot ) { bestDot = d; v.normal[0] = x; v.normal[1] = y; }
+			}
+
+			v.texCoord[0] = FloatToHalf( texCoords[ size_t(i)*2   ] );
+			v.texCoord[1] = FloatToHalf( texCoords[ size_t(i)*2+1 ] );
+		}
+	} );
+}
+
+inline QuantizationError QuantizedMesh::MeasureError( float const *positions, float const *normals, float const *texCoords ) const
+{
+	QuantizationError error;
+	for ( unsigned int i=0; i<NumVertices(); i++ ) {
+		Vec3f p( positions + size_t(i)*3 );
+		error.position = Max( error.position, ( GetPosition(i) - p ).Length() );
+
+		Vec3f n( normals + size_t(i)*3 );
+		if ( n.LengthSquared() > 0 ) {
+			// atan2 is accurate for small angles, unlike acos of the dot product
+			Vec3f d = GetNormal(i);
+			float angle = std::atan2( d.Cross(n).Length(), d.Dot(n) );
+			error.normalAngle = Max( error.normalAngle, angle * 180.0f / Pi<float>() );
+		}
+
+		Vec2f t = GetTexCoord(i);
+		for ( int j=0; j<2; j++ ) {
+			float s = texCoords[ size_t(i)*2+j ];
+			error.texCoord = Max( error.texCoord, std::abs( t[j] - s ) / Max( std::abs(s), 1.0f ) );
+		}
+	}
+	return error;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::QuantizedVertex   cyQuantizedVertex;	//!< Quantized vertex with 16 bytes
+typedef cy::QuantizedMesh     cyQuantizedMesh;		//!< Interleaved, quantized vertex buffer
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,312 @@
+//-------------------------------------------------------------------------------
+//! \file   cyTextureManager.h
+//!
+//! \brief  Texture residency manager with a memory budget and least recently used eviction of top mipmap levels.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_TEXTURE_MANAGER_H_INCLUDED_
+#define _CY_TEXTURE_MANAGER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyGL.h"
+#include "cyCookedTexture.h"
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// S3TC formats (EXT_texture_compression_s3tc, EXT_texture_sRGB), which the GL loader does not define
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! Residency of a managed texture
+struct TextureResidency
+{
+	GLuint       id             = 0;	//!< texture id
+	std::string  cacheFile;				//!< the cooked texture file that the levels are loaded from
+	unsigned int width          = 0;	//!< width of the first level
+	unsigned int height         = 0;	//!< height of the first level
+	unsigned int numLevels      = 0;	//!< number of mipmap levels
+	unsigned int baseLevel      = 0;	//!< the first resident level, which is GL_TEXTURE_BASE_LEVEL
+	unsigned int maxBaseLevel   = 0;	//!< the levels from this one on are never evicted
+	size_t       residentBytes  = 0;	//!< memory of the resident levels
+	size_t       totalBytes     = 0;	//!< memory of all levels
+	uint64_t     lastUsedFrame  = 0;	//!< the last frame the texture was used in
+	unsigned int evictedLevels  = 0;	//!< number of levels evicted so far
+	unsigned int restoredLevels = 0;	//!< number of levels loaded back so far
+	unsigned int refCount       = 0;	//!< number of users that share the texture
+};
+
+//! Owns 2D textures created from cooked textures and keeps their memory within a budget.
+//!
+//! The levels of a managed texture are specified one by one (mutable storage), so that the top levels can be
+//! released. A level is evicted by raising GL_TEXTURE_BASE_LEVEL above it and then respecifying it with a zero
+//! size, which frees its memory. Evicted levels are loaded back from the cooked texture file, which is mapped
+//! only while the levels are uploaded.
+//!
+//! Use() marks a texture as sampled in the current frame. Update(), called once per frame, loads back the
+//! missing levels of the textures used in the frame and then evicts the top levels of the least recently used
+//! textures until the resident levels fit in the budget. Textures used in the current frame are not evicted,
+//! and the levels that are not larger than minResidentSize are always resident, so every texture can be sampled.
+//! Textures are shared by their cache file name, which identifies the source image and its decode settings.
+//! Acquire() returns an existing texture with a new reference, so that a cooked texture is loaded and created
+//! once no matter how many materials use it, and Release() deletes a texture when its last reference is gone.
+//! All functions must be called from the thread of the OpenGL context, with no pixel unpack buffer bound.
+
+class TextureManager
+{
+public:
+	TextureManager() = default;
+	TextureManager( TextureManager const & ) CY_CLASS_FUNCTION_DELETE
+	TextureManager& operator = ( TextureManager const & ) CY_CLASS_FUNCTION_DELETE
+	~TextureManager() { if ( GL::CheckContext() ) Clear(); }	//!< Destructor that deletes all textures
+
+	//! Creates a texture with all levels of the given cooked texture, which is stored in the given cache file.
+	//! The levels are loaded back from the cache file after they are evicted, and none of them are evicted if the
+	//! cache file does not exist. Returns zero if the cooked texture is empty. The new texture has one reference.
+	//! If a texture of the same cache file exists, a reference to it is returned instead.
+	GLuint Create( CookedTexture const &cooked, char const *cacheFile );
+
+	//! Returns the texture of the given cache file with a new reference, or zero if there is no such texture.
+	//! Each call counts as a hit or a miss of the texture cache.
+	GLuint Acquire( char const *cacheFile );
+
+	void Release( GLuint id );	//!< Removes a reference to the given texture and deletes it if it was the last one
+	void Delete ( GLuint id );	//!< Deletes the given texture, regardless of its references
+	void Clear  ();				//!< Deletes all textures
+
+	//! Marks the given texture as used in the current frame. Unmanaged textures, including zero, are ignored.
+	void Use( GLuint id ) { auto it = index.find(id); if ( it != index.end() ) textures[it->second].lastUsedFrame = frame; }
+
+	//! Loads back and evicts levels for the budget, then starts a new frame
+	void Update();
+
+	//!@name Budget and statistics
+	void   SetBudget         ( size_t bytes ) { budget = bytes; }				//!< Sets the memory budget of the resident levels in bytes
+	size_t GetBudget         () const { return budget; }						//!< Returns the memory budget in bytes
+	void   SetMaxUploadBytes ( size_t bytes ) { maxUploadBytes = bytes; }		//!< Sets the maximum size of the levels loaded back per frame
+	void   SetMinResidentSize( unsigned int size ) { minResidentSize = size; }	//!< Sets the size of the largest levels that are never evicted, for new textures
+	size_t ResidentBytes     () const { size_t s=0; for ( Texture const &t : textures ) s += t.residentBytes; return s; }	//!< Returns the memory of all resident levels
+	size_t TotalBytes        () const { size_t s=0; for ( Texture const &t : textures ) s += t.totalBytes;    return s; }	//!< Returns the memory of all levels
+	uint64_t               Frame      () const { return frame; }					//!< Returns the current frame number
+	unsigned int           NumTextures() const { return (unsigned int) textures.size(); }	//!< Returns the number of managed textures
+	TextureResidency const & GetResidency( unsigned int i ) const { return textures[i]; }	//!< Returns the residency of the i^th texture
+	unsigned int           NumHits    () const { return numHits; }		//!< Returns the number of Acquire() calls that found a texture
+	unsigned int           NumMisses  () const { return numMisses; }	//!< Returns the number of Acquire() calls that did not find a texture
+
+	//! Returns the internal format that matches the levels of the cooked texture
+	static GLenum GetInternalFormat( CookedTexture const &cooked );
+
+private:
+	struct Texture : TextureResidency
+	{
+		bool                srgb           = false;
+		BlockFormat         format         = BLOCK_NONE;
+		GLenum              internalFormat = GL_RGBA8;
+		std::vector<size_t> levelSize;
+	};
+
+	std::vector<Texture>               textures;
+	std::unordered_map<GLuint,size_t>  index;	// texture id to the index in textures
+	std::unordered_map<std::string,GLuint> byFile;	// cache file name to the texture id
+	size_t       budget          = size_t(256) << 20;
+	size_t       maxUploadBytes  = size_t(32)  << 20;
+	unsigned int minResidentSize = 128;
+	uint64_t     frame           = 1;
+	unsigned int numHits         = 0;
+	unsigned int numMisses       = 0;
+
+	void SpecifyLevel( Texture const &t, unsigned int level, unsigned char const *data, bool empty ) const;
+	void Evict  ( Texture &t, unsigned int newBase );
+	bool Restore( Texture &t, unsigned int newBase );
+};
+
+//-------------------------------------------------------------------------------
+
+inline GLenum TextureManager::GetInternalFormat( CookedTexture const &cooked )
+{
+	bool const srgb = cooked.IsSRGB();
+	switch ( cooked.GetFormat() ) {
+		case BLOCK_BC1: return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		case BLOCK_BC3: return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case BLOCK_BC4: return GL_COMPRESSED_RED_RGTC1;
+		case BLOCK_BC5: return GL_COMPRESSED_RG_RGTC2;
+		case BLOCK_BC7: return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+		default:        return srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+	}
+}
+
+// Specifies a level with its data, or with a zero size if empty is true. Mutable levels cannot be specified
+// with the direct state access functions, so the texture is bound temporarily.
+inline void TextureManager::SpecifyLevel( Texture const &t, unsigned int level, unsigned char const *data, bool empty ) const
+{
+	GLint prevTex = 0;
+	glGetIntegerv( GL_TEXTURE_BINDING_2D, &prevTex );
+	glBindTexture( GL_TEXTURE_2D, t.id );
+	GLsizei const w = empty ? 0 : (GLsizei) Max( t.width  >> level, 1u );
+	GLsizei const h = empty ? 0 : (GLsizei) Max( t.height >> level, 1u );
+	if ( t.format == BLOCK_NONE ) glTexImage2D( GL_TEXTURE_2D, (GLint)level, (GLint)t.internalFormat, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+	else glCompressedTexImage2D( GL_TEXTURE_2D, (GLint)level, t.internalFormat, w, h, 0, empty ? 0 : (GLsizei) t.levelSize[level], data );
+	glBindTexture( GL_TEXTURE_2D, (GLuint)prevTex );
+}
+
+inline GLuint TextureManager::Create( CookedTexture const &cooked, char const *cacheFile )
+{
+	if ( cooked.NumLevels() == 0 ) return 0;
+	auto shared = byFile.find( cacheFile );
+	if ( shared != byFile.end() ) {
+		textures[ index[shared->second] ].refCount++;
+		return shared->second;
+	}
+	Texture t;
+	glCreateTextures( GL_TEXTURE_2D, 1, &t.id );
+	t.cacheFile      = cacheFile;
+	t.srgb           = cooked.IsSRGB();
+	t.format         = cooked.GetFormat();
+	t.internalFormat = GetInternalFormat( cooked );
+	t.width          = cooked.Width();
+	t.height         = cooked.Height();
+	t.numLevels      = cooked.NumLevels();
+	t.maxBaseLevel   = 0;
+	// Nothing is evicted if the levels cannot be loaded back, since the cache file could not be written
+	std::error_code ec;
+	if ( std::filesystem::exists( t.cacheFile, ec ) ) {
+		while ( t.maxBaseLevel+1 < t.numLevels && Max( cooked.Width(t.maxBaseLevel), cooked.Height(t.maxBaseLevel) ) > minResidentSize ) t.maxBaseLevel++;
+	}
+	t.levelSize.resize( t.numLevels );
+	for ( unsigned int l=0; l<t.numLevels; l++ ) {
+		t.levelSize[l] = cooked.LevelSize(l);
+		t.totalBytes  += t.levelSize[l];
+		SpecifyLevel( t, l, cooked.LevelData(l), false );
+	}
+	t.residentBytes = t.totalBytes;
+	t.lastUsedFrame = frame;
+	t.refCount      = 1;
+	glTextureParameteri( t.id, GL_TEXTURE_BASE_LEVEL, 0 );
+	glTextureParameteri( t.id, GL_TEXTURE_MAX_LEVEL, (GLint)t.numLevels - 1 );
+	index[t.id] = textures.size();
+	byFile[t.cacheFile] = t.id;
+	textures.push_back( std::move(t) );
+	return textures.back().id;
+}
+inline GLuint TextureManager::Acquire( char const *cacheFile )
+{
+	auto it = byFile.find( cacheFile );
+	if ( it == byFile.end() ) { numMisses++; return 0; }
+	numHits++;
+	textures[ index[it->second] ].refCount++;
+	return it->second;
+}
+inline void TextureManager::Release( GLuint id )
+{
+	auto it = index.find( id );
+	if ( it == index.end() ) return;
+	if ( --textures[it->second].refCount == 0 ) Delete( id );
+}
+
+inline void TextureManager::Delete( GLuint id )
+{
+	auto it = index.find( id );
+	if ( it == index.end() ) return;
+	size_t const i = it->second;
+	glDeleteTextures( 1, &textures[i].id );
+	byFile.erase( textures[i].cacheFile );
+	index.erase( it );
+	if ( i+1 < textures.size() ) {
+		textures[i] = std::move( textures.back() );
+		index[ textures[i].id ] = i;
+	}
+	textures.pop_back();
+}
+
+inline void TextureManager::Clear()
+{
+	for ( Texture &t : textures ) glDeleteTextures( 1, &t.id );
+	textures.clear();
+	index.clear();
+	byFile.clear();
+}
+
+// The base level is raised before the levels are released, so that the texture stays complete
+inline void TextureManager::Evict( Texture &t, unsigned int newBase )
+{
+	glTextureParameteri( t.id, GL_TEXTURE_BASE_LEVEL, (GLint)newBase );
+	for ( unsigned int l=t.baseLevel; l<newBase; l++ ) {
+		SpecifyLevel( t, l, nullptr, true );
+		t.residentBytes -= t.levelSize[l];
+		t.evictedLevels++;
+	}
+	t.baseLevel = newBase;
+}
+
+// The levels are specified before the base level is lowered, so that the texture stays complete
+inline bool TextureManager::Restore( Texture &t, unsigned int newBase )
+{
+	CookedTexture cooked;
+	if ( !cooked.Load( t.cacheFile.c_str(), nullptr, t.srgb, t.format ) || cooked.NumLevels() != t.numLevels || cooked.Width() != t.width || cooked.Height() != t.height ) return false;
+	for ( unsigned int l=newBase; l<t.baseLevel; l++ ) {
+		SpecifyLevel( t, l, cooked.LevelData(l), false );
+		t.residentBytes += t.levelSize[l];
+		t.restoredLevels++;
+	}
+	t.baseLevel = newBase;
+	glTextureParameteri( t.id, GL_TEXTURE_BASE_LEVEL, (GLint)newBase );
+	return true;
+}
+
+inline void TextureManager::Update()
+{
+	// Eviction candidates, least recently used first; the textures used in this frame are not evicted
+	std::vector<Texture*> lru;
+	for ( Texture &t : textures ) if ( t.lastUsedFrame < frame ) lru.push_back( &t );
+	std::stable_sort( lru.begin(), lru.end(), []( Texture const *a, Texture const *b ) { return a->lastUsedFrame < b->lastUsedFrame; } );
+	size_t resident = ResidentBytes();
+	size_t next = 0;	// the first candidate that can still be evicted
+	auto evictFor = [&]( size_t bytes ) {
+		while ( resident + bytes > budget && next < lru.size() ) {
+			Texture &t = *lru[next];
+			if ( t.baseLevel >= t.maxBaseLevel ) { next++; continue; }
+			resident -= t.levelSize[t.baseLevel];
+			Evict( t, t.baseLevel + 1 );
+		}
+		return resident + bytes <= budget;
+	};
+
+	// Load back the missing levels of the used textures, smallest first, as far as the budget and the upload limit allow
+	size_t uploaded = 0;
+	for ( Texture &t : textures ) {
+		if ( t.lastUsedFrame != frame || t.baseLevel == 0 ) continue;
+		unsigned int newBase = t.baseLevel;
+		size_t bytes = 0;
+		while ( newBase > 0 && uploaded + bytes + t.levelSize[newBase-1] <= maxUploadBytes && evictFor( bytes + t.levelSize[newBase-1] ) ) bytes += t.levelSize[--newBase];
+		if ( newBase < t.baseLevel && Restore( t, newBase ) ) {
+			resident += bytes;
+			uploaded += bytes;
+		}
+	}
+
+	evictFor( 0 );
+	frame++;
+}
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+typedef cy::TextureManager cyTextureManager;	//!< Texture residency manager with a memory budget
+
+//-------------------------------------------------------------------------------
+
+#endif
@@ -37,8 +37,14 @@
 //-------------------------------------------------------------------------------
 
 #include "cyVector.h"
+#include "cyMappedFile.h"
+#include "cyParallel.h"
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
 #include <iostream>
+#include <cfloat>
 
 //-------------------------------------------------------------------------------
 
@@ -178,10 +184,11 @@ public:
 
 	//!@name Compute Methods
 	void ComputeBoundingBox();						//!< Computes the bounding box
-	void ComputeNormals(bool clockwise=false);		//!< Computes and stores vertex normals
+	void ComputeNormals(bool clockwise=false, bool angleWeighted=false, unsigned int numThreads=0);	//!< Computes and stores vertex normals. Face normals are weighted by face area, or by the corner angle if angleWeighted is true. Large meshes are processed with up to numThreads threads (0 uses all hardware threads), which changes the summation order, so the result can differ from the serial one by rounding.
 
 	//!@name Load and Save methods
 	bool LoadFromFileObj( char const *filename, bool loadMtl=true, std::ostream *outStream=&std::cout );	//!< Loads the mesh from an OBJ file. Automatically converts all faces to triangles.
+	bool LoadFromFileObjMapped( char const *filename, bool loadMtl=true, std::ostream *outStream=&std::cout, unsigned int numThreads=0 );	//!< Loads the mesh from an OBJ file by memory-mapping it and parsing it in place. Large files are split into chunks that are parsed in parallel using up to numThreads threads (0 uses all hardware threads). Produces the same mesh data as LoadFromFileObj, but it is considerably faster for large files.
 	bool SaveToFileObj( char const *filename, std::ostream *outStream );									//!< Saves the mesh to an OBJ file with the given name.
 
 private:
@@ -200,6 +207,64 @@ private:
 		MtlData() { faceCount=0; firstFace=0; }
 	};
 	struct MtlLibName { std::string filename; };
+	struct MtlList
+	{
+		std::vector<MtlData> mtlData;
+		std::unordered_map<std::string,int> mtlIndex;	// material name to index in mtlData
+		int GetMtlIndex( char const *mtlName ) const
+		{
+			auto it = mtlIndex.find(mtlName);
+			return it != mtlIndex.end() ? it->second : -1;
+		}
+		int CreateMtl( char const *mtlName, unsigned int firstFace )
+		{
+			if ( mtlName[0] == '\0' ) return 0;
+			auto r = mtlIndex.try_emplace( mtlName, (int)mtlData.size() );
+			if ( ! r.second ) return r.first->second;
+			MtlData m;
+			m.mtlName = r.first->first;
+			m.firstFace = firstFace;
+			mtlData.push_back(m);
+			return (int)mtlData.size()-1;
+		}
+	};
+	struct ObjData
+	{
+		std::vector<Vec3f>      _v;		// vertices
+		std::vector<TriFace>    _f;		// faces
+		std::vector<Vec3f>      _vn;	// vertex normal
+		std::vector<TriFace>    _fn;	// normal faces
+		std::vector<Vec3f>      _vt;	// texture vertices
+		std::vector<TriFace>    _ft;	// texture faces
+		std::vector<MtlLibName> mtlFiles;
+		std::vector<int>        faceMtlIndex;
+		MtlList                 mtlList;
+		int  currentMtlIndex = -1;
+		bool hasTextures = false;
+		bool hasNormals  = false;
+
+		// A chunk is a part of the file parsed independently (see MergeObjChunks).
+		// Texture and normal faces are stored for all faces, material indices are local to the chunk,
+		// and the faces with relative (negative) indices are recorded, so that they can be offset later.
+		bool isChunk = false;
+		unsigned int texFaceStart  = 0;		// number of faces before hasTextures was set
+		unsigned int normFaceStart = 0;		// number of faces before hasNormals was set
+		struct RelIndex { unsigned int face, mask; };	// mask bits: 3*type + corner, types are vertex, texture, normal
+		std::vector<RelIndex> relIndices;
+		void SetTextures() { if ( !hasTextures ) { hasTextures=true; texFaceStart =(unsigned int)_f.size(); } }
+		void SetNormals () { if ( !hasNormals  ) { hasNormals =true; normFaceStart=(unsigned int)_f.size(); } }
+		static int const inheritedMtl = -2;	// material index used by the faces of a chunk before its first usemtl
+	};
+	class Buffer;
+
+	static bool        IsSpace   ( char c ) { return c==' ' || c=='\t' || c=='\v' || c=='\f'; }
+	static char const* SkipSpace ( char const *s, char const *end ) { while ( s<end && IsSpace(*s) ) s++; return s; }
+	static char const* ParseFloat( char const *s, char const *end, float &f );
+	static void        ParseFloat3( char const *s, char const *end, float f[3] );
+	static void        ParseObj  ( char const *data, char const *end, ObjData &obj, bool loadMtl );
+	static void        MergeObjChunks( std::vector<ObjData> &chunks, ObjData &obj, unsigned int numThreads );
+	bool SetObjData  ( ObjData &obj, bool loadMtl );
+	void LoadMtlFiles( char const *filename, ObjData &obj, std::ostream *outStream );
 };
 
 //-------------------------------------------------------------------------------
@@ -246,136 +311,148 @@ inline void TriMesh::ComputeBoundingBox()
 	}
 }
 
-inline void TriMesh::ComputeNormals(bool clockwise)
+inline void TriMesh::ComputeNormals(bool clockwise, bool angleWeighted, unsigned int numThreads)
 {
 	SetNumNormals(nv);
 	for ( unsigned int i=0; i<nvn; i++ ) vn[i].Set(0,0,0);	// initialize all normals to zero
-	for ( unsigned int i=0; i<nf; i++ ) {
-		Vec3f N = (v[f[i].v[1]]-v[f[i].v[0]]) ^ (v[f[i].v[2]]-v[f[i].v[0]]);	// face normal (not normalized)
-		if ( clockwise ) N = -N;
-		vn[f[i].v[0]] += N;
-		vn[f[i].v[1]] += N;
-		vn[f[i].v[2]] += N;
-		fn[i] = f[i];
-	}
-	for ( unsigned int i=0; i<nvn; i++ ) vn[i].Normalize();
-}
 
-inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::ostream *outStream )
-{
-	FILE *fp = fopen(filename,"r");
-	if ( !fp ) {
-		if ( outStream ) *outStream << "ERROR: Cannot open file " << filename << std::endl;
-		return false;
-	}
-
-	Clear();
+	// The faces are split into parts that accumulate into separate normal arrays, so that no
+	// atomics are needed. The first part uses vn directly, so a single part matches the serial sum.
+	unsigned int const minFacesPerPart = 1 << 16;
+	if ( numThreads == 0 ) numThreads = NumHardwareThreads();
+	unsigned int const numParts = Max( 1u, Min( numThreads, nf / minFacesPerPart ) );
+	std::vector<Vec3f> partNormals( size_t(numParts-1)*nv, Vec3f(0,0,0) );
 
-	class Buffer
-	{
-		char data[1024];
-		int readLine;
-	public:
-		int ReadLine(FILE *fp)
-		{
-			int c = fgetc(fp);
-			while ( !feof(fp) ) {
-				while ( isspace(c) && ( !feof(fp) || c!='\0' ) ) c = fgetc(fp);	// skip empty space
-				if ( c == '#' ) while ( !feof(fp) && c!='\n' && c!='\r' && c!='\0' ) c = fgetc(fp);	// skip comment line
-				else break;
-			}
-			int i=0;
-			bool inspace = false;
-			while ( i<1024-1 ) {
-				if ( feof(fp) || c=='\n' || c=='\r' || c=='\0' ) break;
-				if ( isspace(c) ) {	// only use a single space as the space character
-					inspace = true;
-				} else {
-					if ( inspace ) data[i++] = ' ';
-					inspace = false;
-					data[i++] = static_cast<char>(c);
+	ParallelFor( numParts, [&]( unsigned int part ) {
+		Vec3f *sum = part == 0 ? vn : partNormals.data() + size_t(part-1)*nv;
+		unsigned int const begin = (unsigned int)( uint64_t(nf) *  part    / numParts );
+		unsigned int const end   = (unsigned int)( uint64_t(nf) * (part+1) / numParts );
+		for ( unsigned int i=begin; i<end; i++ ) {
+			TriFace const &face = f[i];
+			Vec3f const &p0 = v[face.v[0]];
+			Vec3f const &p1 = v[face.v[1]];
+			Vec3f const &p2 = v[face.v[2]];
+			Vec3f N = (p1-p0) ^ (p2-p0);	// face normal (not normalized)
+			if ( clockwise ) N = -N;
+			if ( angleWeighted ) {
+				// Weight the unit face normal by the angle of the face at each corner
+				float len = N.Length();
+				if ( len > 0 ) {
+					N /= len;
+					Vec3f e0 = (p1-p0).GetNormalized();
+					Vec3f e1 = (p2-p1).GetNormalized();
+					Vec3f e2 = (p0-p2).GetNormalized();
+					sum[face.v[0]] += N * ACosSafe( -e2.Dot(e0) );
+					sum[face.v[1]] += N * ACosSafe( -e0.Dot(e1) );
+					sum[face.v[2]] += N * ACosSafe( -e1.Dot(e2) );
 				}
-				c = fgetc(fp);
-			}
-			data[i] = '\0';
-			readLine = i;
-			return i;
-		}
-		char& operator[](int i) { return data[i]; }
-		void ReadVertex( Vec3f &v ) const { v.Zero(); sscanf( data+2, "%f %f %f", &v.x, &v.y, &v.z ); }
-		void ReadFloat3( float f[3] ) const { f[2]=f[1]=f[0]=0; int n = sscanf( data+2, "%f %f %f", &f[0], &f[1], &f[2] ); if ( n==1 ) f[2]=f[1]=f[0]; }
-		void ReadFloat( float *f ) const { sscanf( data+2, "%f", f ); }
-		void ReadInt( int *i, int start ) const { sscanf( data+start, "%d", i ); }
-		bool IsCommand( char const *cmd ) const {
-			int i=0;
-			while ( cmd[i]!='\0' ) {
-				if ( cmd[i] != data[i] ) return false;
-				i++;
+			} else {
+				sum[face.v[0]] += N;
+				sum[face.v[1]] += N;
+				sum[face.v[2]] += N;
 			}
-			return (data[i]=='\0' || data[i]==' ');
+			fn[i] = face;
 		}
-		char const * Data(int start=0) { return data+start; }
-		void Copy( Str &str, int start=0 )
-		{
-			while ( data[start] != '\0' && data[start] <= ' ' ) start++;
-			str = Data(start);
+	}, numParts );
+
+	// Add the parts in order and normalize
+	unsigned int const blockSize = 4096;
+	ParallelFor( (nv + blockSize - 1) / blockSize, [&]( unsigned int block ) {
+		unsigned int const begin = block*blockSize;
+		unsigned int const end   = Min( nv, begin+blockSize );
+		for ( unsigned int part=1; part<numParts; part++ ) {
+			Vec3f const *sum = partNormals.data() + size_t(part-1)*nv;
+			for ( unsigned int i=begin; i<end; i++ ) vn[i] += sum[i];
 		}
-	};
-	Buffer buffer;
+		for ( unsigned int i=begin; i<end; i++ ) vn[i].Normalize();
+	}, numThreads );
+}
 
+//-------------------------------------------------------------------------------
 
-	struct MtlList {
-		std::vector<MtlData> mtlData;
-		int GetMtlIndex( char const *mtlName )
-		{
-			for ( unsigned int i=0; i<mtlData.size(); i++ ) {
-				if ( mtlData[i].mtlName == mtlName ) return (int)i;
+class TriMesh::Buffer
+{
+	char data[1024];
+	int readLine;
+public:
+	int ReadLine(FILE *fp)
+	{
+		int c = fgetc(fp);
+		while ( !feof(fp) ) {
+			while ( isspace(c) && ( !feof(fp) || c!='\0' ) ) c = fgetc(fp);	// skip empty space
+			if ( c == '#' ) while ( !feof(fp) && c!='\n' && c!='\r' && c!='\0' ) c = fgetc(fp);	// skip comment line
+			else break;
+		}
+		int i=0;
+		bool inspace = false;
+		while ( i<1024-1 ) {
+			if ( feof(fp) || c=='\n' || c=='\r' || c=='\0' ) break;
+			if ( isspace(c) ) {	// only use a single space as the space character
+				inspace = true;
+			} else {
+				if ( inspace ) data[i++] = ' ';
+				inspace = false;
+				data[i++] = static_cast<char>(c);
 			}
-			return -1;
+			c = fgetc(fp);
 		}
-		int CreateMtl( char const *mtlName, unsigned int firstFace )
-		{
-			if ( mtlName[0] == '\0' ) return 0;
-			int i = GetMtlIndex(mtlName);
-			if ( i >= 0 ) return i;
-			MtlData m;
-			m.mtlName = mtlName;
-			m.firstFace = firstFace;
-			mtlData.push_back(m);
-			return (int)mtlData.size()-1;
+		data[i] = '\0';
+		readLine = i;
+		return i;
+	}
+	char& operator[](int i) { return data[i]; }
+	void ReadVertex( Vec3f &v ) const { v.Zero(); sscanf( data+2, "%f %f %f", &v.x, &v.y, &v.z ); }
+	void ReadFloat3( float f[3] ) const { f[2]=f[1]=f[0]=0; int n = sscanf( data+2, "%f %f %f", &f[0], &f[1], &f[2] ); if ( n==1 ) f[2]=f[1]=f[0]; }
+	void ReadFloat( float *f ) const { sscanf( data+2, "%f", f ); }
+	void ReadInt( int *i, int start ) const { sscanf( data+start, "%d", i ); }
+	bool IsCommand( char const *cmd ) const {
+		int i=0;
+		while ( cmd[i]!='\0' ) {
+			if ( cmd[i] != data[i] ) return false;
+			i++;
 		}
-	};
-	MtlList mtlList;
+		return (data[i]=='\0' || data[i]==' ');
+	}
+	char const * Data(int start=0) { return data+start; }
+	void Copy( Str &str, int start=0 )
+	{
+		while ( data[start] != '\0' && data[start] <= ' ' ) start++;
+		str = Data(start);
+	}
+};
+
+//-------------------------------------------------------------------------------
 
-	std::vector<Vec3f>      _v;		// vertices
-	std::vector<TriFace>    _f;		// faces
-	std::vector<Vec3f>      _vn;	// vertex normal
-	std::vector<TriFace>    _fn;	// normal faces
-	std::vector<Vec3f>      _vt;	// texture vertices
-	std::vector<TriFace>    _ft;	// texture faces
-	std::vector<MtlLibName> mtlFiles;
-	std::vector<int>        faceMtlIndex;
+inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::ostream *outStream )
+{
+	FILE *fp = fopen(filename,"r");
+	if ( !fp ) {
+		if ( outStream ) *outStream << "ERROR: Cannot open file " << filename << std::endl;
+		return false;
+	}
+
+	Clear();
 
-	int currentMtlIndex = -1;
-	bool hasTextures=false, hasNormals=false;
+	Buffer buffer;
+	ObjData obj;
 
 	while ( int rb = buffer.ReadLine(fp) ) {
 		if ( buffer.IsCommand("v") ) {
 			Vec3f vertex;
 			buffer.ReadVertex(vertex);
-			_v.push_back(vertex);
+			obj._v.push_back(vertex);
 		}
 		else if ( buffer.IsCommand("vt") ) {
 			Vec3f texVert;
 			buffer.ReadVertex(texVert);
-			_vt.push_back(texVert);
-			hasTextures = true;
+			obj._vt.push_back(texVert);
+			obj.hasTextures = true;
 		}
 		else if ( buffer.IsCommand("vn") ) {
 			Vec3f normal;
 			buffer.ReadVertex(normal);
-			_vn.push_back(normal);
-			hasNormals = true;
+			obj._vn.push_back(normal);
+			obj.hasNormals = true;
 		}
 		else if ( buffer.IsCommand("f") ) {
 			int facevert = -1;
@@ -384,7 +461,7 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 			int type = 0;
 			unsigned int index;
 			TriFace face, textureFace, normalFace;
-			unsigned int nFacesBefore = (unsigned int)_f.size();
+			unsigned int nFacesBefore = (unsigned int)obj._f.size();
 			for ( int i=2; i<rb; i++ ) {
 				if ( buffer[i] == ' ' ) inspace = true;
 				else {
@@ -405,17 +482,17 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 								break;
 							case 2:
 								// copy the first two vertices from the previous face
-								_f.push_back(face);
+								obj._f.push_back(face);
 								face.v[1] = face.v[2];
-								if ( hasTextures ) {
-									_ft.push_back(textureFace);
+								if ( obj.hasTextures ) {
+									obj._ft.push_back(textureFace);
 									textureFace.v[1] = textureFace.v[2];
 								}
-								if ( hasNormals ) {
-									_fn.push_back(normalFace);
+								if ( obj.hasNormals ) {
+									obj._fn.push_back(normalFace);
 									normalFace.v[1] = normalFace.v[2];
 								}
-								faceMtlIndex.push_back(currentMtlIndex);
+								obj.faceMtlIndex.push_back(obj.currentMtlIndex);
 								break;
 						}
 					}
@@ -424,27 +501,27 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 					if ( buffer[i] >= '0' && buffer[i] <= '9' ) {
 						index = index*10 + (buffer[i]-'0');
 						switch ( type ) {
-							case 0: face.v       [facevert] = negative ? (unsigned int)_v. size()-index : index-1; break;
-							case 1: textureFace.v[facevert] = negative ? (unsigned int)_vt.size()-index : index-1; hasTextures=true; break;
-							case 2: normalFace.v [facevert] = negative ? (unsigned int)_vn.size()-index : index-1; hasNormals =true; break;
+							case 0: face.v       [facevert] = negative ? (unsigned int)obj._v. size()-index : index-1; break;
+							case 1: textureFace.v[facevert] = negative ? (unsigned int)obj._vt.size()-index : index-1; obj.hasTextures=true; break;
+							case 2: normalFace.v [facevert] = negative ? (unsigned int)obj._vn.size()-index : index-1; obj.hasNormals =true; break;
 						}
 					}
 				}
 			}
-			_f.push_back(face);
-			if ( hasTextures ) _ft.push_back(textureFace);
-			if ( hasNormals  ) _fn.push_back(normalFace);
-			faceMtlIndex.push_back(currentMtlIndex);
-			if ( currentMtlIndex>=0 ) mtlList.mtlData[currentMtlIndex].faceCount += (unsigned int)_f.size() - nFacesBefore;
+			obj._f.push_back(face);
+			if ( obj.hasTextures ) obj._ft.push_back(textureFace);
+			if ( obj.hasNormals  ) obj._fn.push_back(normalFace);
+			obj.faceMtlIndex.push_back(obj.currentMtlIndex);
+			if ( obj.currentMtlIndex>=0 ) obj.mtlList.mtlData[obj.currentMtlIndex].faceCount += (unsigned int)obj._f.size() - nFacesBefore;
 		}
 		else if ( loadMtl ) {
 			if ( buffer.IsCommand("usemtl") ) {
-				currentMtlIndex = mtlList.CreateMtl(buffer.Data(7), (unsigned int)_f.size());
+				obj.currentMtlIndex = obj.mtlList.CreateMtl(buffer.Data(7), (unsigned int)obj._f.size());
 			}
 			if ( buffer.IsCommand("mtllib") ) {
 				MtlLibName libName;
 				libName.filename = buffer.Data(7);
-				mtlFiles.push_back(libName);
+				obj.mtlFiles.push_back(libName);
 			}
 		}
 		if ( feof(fp) ) break;
@@ -452,8 +529,356 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 
 	fclose(fp);
 
+	if ( !SetObjData(obj,loadMtl) ) return true; // No faces found
+	if ( loadMtl ) LoadMtlFiles(filename,obj,outStream);
+	return true;
+}
+
+//-------------------------------------------------------------------------------
+
+inline bool TriMesh::LoadFromFileObjMapped( char const *filename, bool loadMtl, std::ostream *outStream, unsigned int numThreads )
+{
+	MappedFile file;
+	if ( !file.Open(filename) ) {
+		if ( outStream ) *outStream << "ERROR: Cannot open file " << filename << std::endl;
+		return false;
+	}
+
+	Clear();
+
+	// Split the file into chunks at line boundaries. There are more chunks than threads to balance the load.
+	size_t const minChunkSize = 1 << 20;
+	if ( numThreads == 0 ) numThreads = NumHardwareThreads();
+	size_t numChunks = numThreads > 1 ? Min( (size_t)numThreads*4, file.Size()/minChunkSize ) : 1;
+
+	ObjData obj;
+	if ( numChunks <= 1 ) {
+		ParseObj( file.Data(), file.End(), obj, loadMtl );
+	} else {
+		std::vector<char const*> chunkStart(numChunks+1);
+		chunkStart[0] = file.Data();
+		for ( size_t i=1; i<numChunks; i++ ) {
+			char const *p = Max( file.Data() + file.Size()*i/numChunks, chunkStart[i-1] );
+			char const *eol = (char const*) memchr( p, '\n', file.End()-p );
+			chunkStart[i] = eol ? eol+1 : file.End();
+		}
+		chunkStart[numChunks] = file.End();
+		std::vector<ObjData> chunks(numChunks);
+		ParallelFor( (unsigned int)numChunks, [&]( unsigned int i ) {
+			chunks[i].isChunk = true;
+			chunks[i].currentMtlIndex = ObjData::inheritedMtl;
+			ParseObj( chunkStart[i], chunkStart[i+1], chunks[i], loadMtl );
+		}, numThreads );
+		MergeObjChunks( chunks, obj, numThreads );
+	}
+	file.Close();
+
+	if ( !SetObjData(obj,loadMtl) ) return true; // No faces found
+	if ( loadMtl ) LoadMtlFiles(filename,obj,outStream);
+	return true;
+}
+
+//-------------------------------------------------------------------------------
+
+// Parses a floating point number with the same result as strtof, without requiring a null-terminated string.
+// Numbers with up to 15 significant digits and small exponents are converted using a single correctly rounded
+// double precision multiplication or division. The result is then rounded to float, which is exact unless the double
+// value falls precisely halfway between two floats. Everything else falls back to strtof. Returns nullptr if there is no number.
+inline char const* TriMesh::ParseFloat( char const *s, char const *end, float &f )
+{
+	static double const pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	char const *p = s;
+	bool negative = false;
+	if ( p<end && ( *p=='-' || *p=='+' ) ) { negative = (*p=='-'); p++; }
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool anyDigit = false, exact = true;
+	for ( ; p<end && *p>='0' && *p<='9'; p++ ) {
+		anyDigit = true;
+		if ( mantissa==0 && *p=='0' ) continue;
+		if ( digits < 18 ) { mantissa = mantissa*10 + (*p-'0'); digits++; }
+		else { exponent++; exact=false; }
+	}
+	if ( p<end && *p=='.' ) {
+		for ( p++; p<end && *p>='0' && *p<='9'; p++ ) {
+			anyDigit = true;
+			if ( mantissa==0 && *p=='0' ) { exponent--; continue; }
+			if ( digits < 18 ) { mantissa = mantissa*10 + (*p-'0'); digits++; exponent--; }
+			else exact=false;
+		}
+	}
+	if ( anyDigit && p<end && ( *p=='e' || *p=='E' ) ) {
+		char const *e = p+1;
+		bool expNegative = false;
+		if ( e<end && ( *e=='-' || *e=='+' ) ) { expNegative = (*e=='-'); e++; }
+		if ( e<end && *e>='0' && *e<='9' ) {
+			int x = 0;
+			for ( ; e<end && *e>='0' && *e<='9'; e++ ) if ( x < 10000 ) x = x*10 + (*e-'0');
+			exponent += expNegative ? -x : x;
+			p = e;
+		}
+	}
+	if ( anyDigit && ( p>=end || ( *p!='x' && *p!='X' ) ) ) {
+		if ( mantissa == 0 ) { f = negative ? -0.0f : 0.0f; return p; }
+		if ( exact && mantissa <= (uint64_t(1)<<53) && exponent >= -22 && exponent <= 22 ) {
+			double d = exponent < 0 ? double(mantissa) / pow10[-exponent] : double(mantissa) * pow10[exponent];
+			uint64_t bits;
+			memcpy( &bits, &d, sizeof(bits) );
+			bool midpoint = ( bits & 0x1FFFFFFF ) == 0x10000000;	// the 29 bits dropped when rounding to float
+			if ( !midpoint && d >= (double)FLT_MIN && d <= (double)FLT_MAX ) {
+				f = negative ? -(float)d : (float)d;
+				return p;
+			}
+		}
+	}
+	// Fallback for long mantissas, large exponents, hexadecimal numbers, inf, and nan
+	char buffer[128];
+	size_t n = Min( (size_t)(end-s), sizeof(buffer)-1 );
+	memcpy( buffer, s, n );
+	buffer[n] = '\0';
+	char *bufferEnd;
+	f = strtof( buffer, &bufferEnd );
+	if ( bufferEnd == buffer ) return nullptr;
+	return s + (bufferEnd-buffer);
+}
+
+// Parses up to three floats, matching the behavior of sscanf( s, "%f %f %f", ... ) with zero-initialized outputs.
+inline void TriMesh::ParseFloat3( char const *s, char const *end, float f[3] )
+{
+	f[0] = f[1] = f[2] = 0;
+	for ( int i=0; i<3; i++ ) {
+		s = SkipSpace(s,end);
+		s = ParseFloat(s,end,f[i]);
+		if ( !s ) break;
+	}
+}
+
+// Parses the OBJ data in the given memory range. Lines are handled in place without copying them.
+// The face parsing mimics the behavior of LoadFromFileObj exactly, including the handling of negative indices.
+inline void TriMesh::ParseObj( char const *data, char const *end, ObjData &obj, bool loadMtl )
+{
+	auto appendName = []( std::string &str, char const *s, char const *e ) {
+		// use a single space between words, like Buffer::ReadLine does
+		str.clear();
+		bool inspace = false;
+		for ( s=SkipSpace(s,e); s<e; s++ ) {
+			if ( IsSpace(*s) ) inspace = true;
+			else {
+				if ( inspace ) str.push_back(' ');
+				inspace = false;
+				str.push_back(*s);
+			}
+		}
+	};
+	std::string name;
+
+	char const *p = data;
+	while ( p < end ) {
+		// find the end of the line
+		char const *eol = (char const*) memchr( p, '\n', end-p );
+		if ( !eol ) eol = end;
+		char const *cr = (char const*) memchr( p, '\r', eol-p );
+		if ( cr ) eol = cr;
+		char const *next = eol < end ? eol+1 : end;
+
+		char const *s = SkipSpace(p,eol);
+		p = next;
+		if ( s >= eol || *s == '#' || *s == '\0' ) continue;	// skip empty and comment lines
+
+		char const *cmd = s;
+		while ( s<eol && !IsSpace(*s) ) s++;
+		size_t cmdLen = s - cmd;
+
+		if ( cmd[0] == 'v' ) {
+			std::vector<Vec3f> *target = nullptr;
+			if      ( cmdLen == 1 ) target = &obj._v;
+			else if ( cmdLen == 2 && cmd[1] == 't' ) { target = &obj._vt; obj.SetTextures(); }
+			else if ( cmdLen == 2 && cmd[1] == 'n' ) { target = &obj._vn; obj.SetNormals(); }
+			if ( target ) {
+				Vec3f vertex;
+				ParseFloat3( s, eol, &vertex.x );
+				target->push_back(vertex);
+			}
+		}
+		else if ( cmdLen == 1 && cmd[0] == 'f' ) {
+			int facevert = -1;
+			bool inspace = true;
+			bool negative = false;
+			int type = 0;
+			unsigned int index = 0;
+			unsigned int relMask = 0;
+			TriFace face = {}, textureFace = {}, normalFace = {};
+			unsigned int nFacesBefore = (unsigned int)obj._f.size();
+			auto pushFace = [&]() {
+				if ( relMask && obj.isChunk ) obj.relIndices.push_back( { (unsigned int)obj._f.size(), relMask } );
+				obj._f.push_back(face);
+				if ( obj.hasTextures || obj.isChunk ) obj._ft.push_back(textureFace);
+				if ( obj.hasNormals  || obj.isChunk ) obj._fn.push_back(normalFace);
+				obj.faceMtlIndex.push_back(obj.currentMtlIndex);
+			};
+			for ( ; s<eol; s++ ) {
+				char c = *s;
+				if ( IsSpace(c) ) inspace = true;
+				else {
+					if ( inspace ) {
+						inspace=false;
+						negative = false;
+						type=0;
+						index=0;
+						switch ( facevert ) {
+							case -1:
+								// initialize face
+								face.v[0] = face.v[1] = face.v[2] = 0;
+								textureFace.v[0] = textureFace.v[1] = textureFace.v[2] = 0;
+								normalFace. v[0] = normalFace. v[1] = normalFace. v[2] = 0;
+								relMask = 0;
+							case 0:
+							case 1:
+								facevert++;
+								break;
+							case 2:
+								// copy the first two vertices from the previous face
+								pushFace();
+								face.v[1] = face.v[2];
+								if ( obj.hasTextures || obj.isChunk ) textureFace.v[1] = textureFace.v[2];
+								if ( obj.hasNormals  || obj.isChunk ) normalFace. v[1] = normalFace. v[2];
+								relMask = ( relMask & ~0x92u ) | ( ( relMask & 0x124u ) >> 1 );
+								break;
+						}
+					}
+					if ( c == '/' ) { type++; index=0; }
+					else if ( c == '-' ) negative = true;
+					else if ( c >= '0' && c <= '9' ) {
+						index = index*10 + (c-'0');
+						switch ( type ) {
+							case 0: face.v       [facevert] = negative ? (unsigned int)obj._v. size()-index : index-1; break;
+							case 1: textureFace.v[facevert] = negative ? (unsigned int)obj._vt.size()-index : index-1; obj.SetTextures(); break;
+							case 2: normalFace.v [facevert] = negative ? (unsigned int)obj._vn.size()-index : index-1; obj.SetNormals(); break;
+						}
+						if ( type < 3 ) {
+							unsigned int bit = 1u << (type*3 + facevert);
+							relMask = negative ? (relMask | bit) : (relMask & ~bit);
+						}
+					}
+				}
+			}
+			pushFace();
+			if ( obj.currentMtlIndex>=0 ) obj.mtlList.mtlData[obj.currentMtlIndex].faceCount += (unsigned int)obj._f.size() - nFacesBefore;
+		}
+		else if ( loadMtl && cmdLen == 6 ) {
+			if ( strncmp(cmd,"usemtl",6) == 0 ) {
+				appendName( name, s, eol );
+				// usemtl without a name is treated as no material
+				obj.currentMtlIndex = name.empty() ? -1 : obj.mtlList.CreateMtl(name.c_str(), (unsigned int)obj._f.size());
+			}
+			else if ( strncmp(cmd,"mtllib",6) == 0 ) {
+				MtlLibName libName;
+				appendName( libName.filename, s, eol );
+				obj.mtlFiles.push_back(libName);
+			}
+		}
+	}
+}
+
+// Merges the chunks of an OBJ file into a single ObjData in file order, producing the same data as parsing the whole file at once.
+// Offsets and material indices are resolved sequentially using prefix sums, then the chunk data is copied in parallel.
+inline void TriMesh::MergeObjChunks( std::vector<ObjData> &chunks, ObjData &obj, unsigned int numThreads )
+{
+	size_t nc = chunks.size();
+	struct Offsets {
+		size_t v, vt, vn, f, ft, fn;
+		unsigned int texFirst, normFirst;	// the first chunk face with texture/normal face data in the output
+		int inheritedMtl;
+		std::vector<int> mtlMap;
+	};
+	std::vector<Offsets> offsets(nc);
+	Offsets sum = {};
+	for ( size_t c=0; c<nc; c++ ) {
+		ObjData const &chunk = chunks[c];
+		Offsets &o = offsets[c];
+		unsigned int nf = (unsigned int)chunk._f.size();
+		o.v  = sum.v;  sum.v  += chunk._v .size();
+		o.vt = sum.vt; sum.vt += chunk._vt.size();
+		o.vn = sum.vn; sum.vn += chunk._vn.size();
+		o.f  = sum.f;  sum.f  += nf;
+		o.texFirst  = obj.hasTextures ? 0 : ( chunk.hasTextures ? chunk.texFaceStart  : nf );
+		o.normFirst = obj.hasNormals  ? 0 : ( chunk.hasNormals  ? chunk.normFaceStart : nf );
+		o.ft = sum.ft; sum.ft += nf - o.texFirst;
+		o.fn = sum.fn; sum.fn += nf - o.normFirst;
+		obj.hasTextures |= chunk.hasTextures;
+		obj.hasNormals  |= chunk.hasNormals;
+		// materials are created in the order of their first use
+		o.inheritedMtl = obj.currentMtlIndex;
+		o.mtlMap.resize( chunk.mtlList.mtlData.size() );
+		for ( size_t m=0; m<o.mtlMap.size(); m++ ) {
+			MtlData const &md = chunk.mtlList.mtlData[m];
+			o.mtlMap[m] = obj.mtlList.CreateMtl( md.mtlName.c_str(), (unsigned int)o.f + md.firstFace );
+		}
+		if ( chunk.currentMtlIndex != ObjData::inheritedMtl ) obj.currentMtlIndex = chunk.currentMtlIndex < 0 ? -1 : o.mtlMap[chunk.currentMtlIndex];
+		obj.mtlFiles.insert( obj.mtlFiles.end(), chunk.mtlFiles.begin(), chunk.mtlFiles.end() );
+	}
+
+	obj._v .resize(sum.v);
+	obj._vt.resize(sum.vt);
+	obj._vn.resize(sum.vn);
+	obj._f .resize(sum.f);
+	obj._ft.resize(sum.ft);
+	obj._fn.resize(sum.fn);
+	obj.faceMtlIndex.resize(sum.f);
+
+	size_t nm = obj.mtlList.mtlData.size();
+	std::vector<unsigned int> faceCounts( nc*nm, 0 );
+	ParallelFor( (unsigned int)nc, [&]( unsigned int c ) {
+		ObjData &chunk = chunks[c];
+		Offsets const &o = offsets[c];
+		std::copy( chunk._v .begin(), chunk._v .end(), obj._v .begin()+o.v  );
+		std::copy( chunk._vt.begin(), chunk._vt.end(), obj._vt.begin()+o.vt );
+		std::copy( chunk._vn.begin(), chunk._vn.end(), obj._vn.begin()+o.vn );
+		std::copy( chunk._f .begin(), chunk._f .end(), obj._f .begin()+o.f  );
+		std::copy( chunk._ft.begin()+o.texFirst,  chunk._ft.end(), obj._ft.begin()+o.ft );
+		std::copy( chunk._fn.begin()+o.normFirst, chunk._fn.end(), obj._fn.begin()+o.fn );
+		// offset relative indices by the number of elements in the previous chunks
+		for ( ObjData::RelIndex const &r : chunk.relIndices ) {
+			for ( int i=0; i<3; i++ ) {
+				if ( r.mask & (1u<<i) ) obj._f[o.f+r.face].v[i] += (unsigned int)o.v;
+				if ( ( r.mask & (8u <<i) ) && r.face >= o.texFirst  ) obj._ft[o.ft+r.face-o.texFirst ].v[i] += (unsigned int)o.vt;
+				if ( ( r.mask & (64u<<i) ) && r.face >= o.normFirst ) obj._fn[o.fn+r.face-o.normFirst].v[i] += (unsigned int)o.vn;
+			}
+		}
+		unsigned int *counts = faceCounts.data() + c*nm;
+		for ( size_t i=0; i<chunk.faceMtlIndex.size(); i++ ) {
+			int m = chunk.faceMtlIndex[i];
+			m = ( m == ObjData::inheritedMtl ) ? o.inheritedMtl : ( m < 0 ? -1 : o.mtlMap[m] );
+			obj.faceMtlIndex[o.f+i] = m;
+			if ( m >= 0 ) counts[m]++;
+		}
+		chunk = ObjData();	// release the chunk memory
+	}, numThreads );
+
+	for ( size_t c=0; c<nc; c++ ) {
+		for ( size_t m=0; m<nm; m++ ) obj.mtlList.mtlData[m].faceCount += faceCounts[c*nm+m];
+	}
+}
+
+// Copies the parsed OBJ data to the mesh. Faces are sorted by material.
+// Returns false if there are no faces.
+inline bool TriMesh::SetObjData( ObjData &obj, bool loadMtl )
+{
+	std::vector<Vec3f>   &_v  = obj._v;
+	std::vector<TriFace> &_f  = obj._f;
+	std::vector<Vec3f>   &_vn = obj._vn;
+	std::vector<TriFace> &_fn = obj._fn;
+	std::vector<Vec3f>   &_vt = obj._vt;
+	std::vector<TriFace> &_ft = obj._ft;
+	std::vector<int> const &faceMtlIndex = obj.faceMtlIndex;
+	MtlList const &mtlList = obj.mtlList;
+
+	if ( _f.size() == 0 ) return false; // No faces found
+
+	// Faces that appear before the first texture coordinate or normal have no texture or normal faces
+	if ( _vt.size() > 0 && _ft.size() < _f.size() ) _ft.insert( _ft.begin(), _f.size()-_ft.size(), TriFace{} );
+	if ( _vn.size() > 0 && _fn.size() < _f.size() ) _fn.insert( _fn.begin(), _f.size()-_fn.size(), TriFace{} );
 
-	if ( _f.size() == 0 ) return true; // No faces found
 	SetNumVertex((unsigned int)_v.size());
 	SetNumFaces((unsigned int)_f.size());
 	SetNumTexVerts((unsigned int)_vt.size());
@@ -466,85 +891,80 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 	if ( _vn.size() > 0 ) memcpy(vn, _vn.data(), sizeof(Vec3f)*_vn.size());
 
 	if ( mtlList.mtlData.size() > 0 ) {
-		unsigned int fid = 0;
-		for ( int mi=0; mi<(int)mtlList.mtlData.size(); mi++ ) {
-			for ( unsigned int i=mtlList.mtlData[mi].firstFace, j=0; j<mtlList.mtlData[mi].faceCount && i<_f.size(); i++ ) {
-				if ( faceMtlIndex[i] == mi ) {
-					f[fid] = _f[i];
-					if ( fn ) fn[fid] = _fn[i];
-					if ( ft ) ft[fid] = _ft[i];
-					fid++;
-					j++;
-				}
-			}
-			mcfc[mi] = fid;
-		}
-		if ( fid <_f.size() ) {
-			for ( unsigned int i=0; i<_f.size(); i++ ) {
-				if ( faceMtlIndex[i] < 0 ) {
-					f[fid] = _f[i];
-					if ( fn ) fn[fid] = _fn[i];
-					if ( ft ) ft[fid] = _ft[i];
-					fid++;
-				}
-			}
+		// Counting sort by material: faces without a material go last and the order of faces within a material is kept
+		int const nm = (int)mtlList.mtlData.size();
+		std::vector<unsigned int> first( nm+1, 0 );
+		for ( int mi : faceMtlIndex ) first[ mi < 0 ? nm : mi ]++;
+		unsigned int sum = 0;
+		for ( int mi=0; mi<=nm; mi++ ) {
+			unsigned int count = first[mi];
+			first[mi] = sum;
+			sum += count;
+			if ( mi < nm ) mcfc[mi] = (int)sum;
+		}
+		for ( unsigned int i=0; i<_f.size(); i++ ) {
+			unsigned int fid = first[ faceMtlIndex[i] < 0 ? nm : faceMtlIndex[i] ]++;
+			f[fid] = _f[i];
+			if ( fn ) fn[fid] = _fn[i];
+			if ( ft ) ft[fid] = _ft[i];
 		}
 	} else {
 		memcpy(f, _f.data(), sizeof(TriFace)*_f.size());
 		if ( ft ) memcpy(ft, _ft.data(), sizeof(TriFace)*_ft.size());
 		if ( fn ) memcpy(fn, _fn.data(), sizeof(TriFace)*_fn.size());
 	}
+	return true;
+}
 
+// Loads the .mtl files referenced by the OBJ file.
+inline void TriMesh::LoadMtlFiles( char const *filename, ObjData &obj, std::ostream *outStream )
+{
+	Buffer buffer;
 
-	// Load the .mtl files
-	if ( loadMtl ) {
-		// get the path from filename
-		char *mtlPathName = nullptr;
-		char const *pathEnd = strrchr(filename,'\\');
-		if ( !pathEnd ) pathEnd = strrchr(filename,'/');
-		if ( pathEnd ) {
-			int n = int(pathEnd-filename) + 1;
-			mtlPathName = new char[n+1];
-			strncpy(mtlPathName,filename,n);
-			mtlPathName[n] = '\0';
-		}
-		for ( unsigned int mi=0; mi<mtlFiles.size(); mi++ ) {
-			std::string mtlFilename = ( mtlPathName ) ? std::string(mtlPathName) + mtlFiles[mi].filename : mtlFiles[mi].filename;
-			FILE *fpm = fopen(mtlFilename.data(),"r");
-			if ( !fpm ) {
-				if ( outStream ) *outStream << "ERROR: Cannot open file " << mtlFilename.c_str() << std::endl;
-				continue;
-			}
-			int mtlID = -1;
-			while ( buffer.ReadLine(fpm) ) {
-				if ( buffer.IsCommand("newmtl") ) {
-					mtlID = mtlList.GetMtlIndex(buffer.Data(7));
-					if ( mtlID >= 0 ) buffer.Copy( m[mtlID].name, 7 );
-				} else if ( mtlID >= 0 ) {
-					if ( buffer.IsCommand("Ka") ) buffer.ReadFloat3( m[mtlID].Ka );
-					else if ( buffer.IsCommand("Kd") ) buffer.ReadFloat3( m[mtlID].Kd );
-					else if ( buffer.IsCommand("Ks") ) buffer.ReadFloat3( m[mtlID].Ks );
-					else if ( buffer.IsCommand("Tf") ) buffer.ReadFloat3( m[mtlID].Tf );
-					else if ( buffer.IsCommand("Ns") ) buffer.ReadFloat( &m[mtlID].Ns );
-					else if ( buffer.IsCommand("Ni") ) buffer.ReadFloat( &m[mtlID].Ni );
-					else if ( buffer.IsCommand("illum") ) buffer.ReadInt( &m[mtlID].illum, 5 );
-					else if ( buffer.IsCommand("map_Ka"  ) ) buffer.Copy( m[mtlID].map_Ka,   7 );
-					else if ( buffer.IsCommand("map_Kd"  ) ) buffer.Copy( m[mtlID].map_Kd,   7 );
-					else if ( buffer.IsCommand("map_Ks"  ) ) buffer.Copy( m[mtlID].map_Ks,   7 );
-					else if ( buffer.IsCommand("map_Ns"  ) ) buffer.Copy( m[mtlID].map_Ns,   7 );
-					else if ( buffer.IsCommand("map_d"   ) ) buffer.Copy( m[mtlID].map_d,    6 );
-					else if ( buffer.IsCommand("map_bump") ) buffer.Copy( m[mtlID].map_bump, 9 );
-					else if ( buffer.IsCommand("bump"    ) ) buffer.Copy( m[mtlID].map_bump, 5 );
-					else if ( buffer.IsCommand("map_disp") ) buffer.Copy( m[mtlID].map_disp, 9 );
-					else if ( buffer.IsCommand("disp"    ) ) buffer.Copy( m[mtlID].map_disp, 5 );
-				}
+	// get the path from filename
+	char *mtlPathName = nullptr;
+	char const *pathEnd = strrchr(filename,'\\');
+	if ( !pathEnd ) pathEnd = strrchr(filename,'/');
+	if ( pathEnd ) {
+		int n = int(pathEnd-filename) + 1;
+		mtlPathName = new char[n+1];
+		strncpy(mtlPathName,filename,n);
+		mtlPathName[n] = '\0';
+	}
+	for ( unsigned int mi=0; mi<obj.mtlFiles.size(); mi++ ) {
+		std::string mtlFilename = ( mtlPathName ) ? std::string(mtlPathName) + obj.mtlFiles[mi].filename : obj.mtlFiles[mi].filename;
+		FILE *fpm = fopen(mtlFilename.data(),"r");
+		if ( !fpm ) {
+			if ( outStream ) *outStream << "ERROR: Cannot open file " << mtlFilename.c_str() << std::endl;
+			continue;
+		}
+		int mtlID = -1;
+		while ( buffer.ReadLine(fpm) ) {
+			if ( buffer.IsCommand("newmtl") ) {
+				mtlID = obj.mtlList.GetMtlIndex(buffer.Data(7));
+				if ( mtlID >= 0 ) buffer.Copy( m[mtlID].name, 7 );
+			} else if ( mtlID >= 0 ) {
+				if ( buffer.IsCommand("Ka") ) buffer.ReadFloat3( m[mtlID].Ka );
+				else if ( buffer.IsCommand("Kd") ) buffer.ReadFloat3( m[mtlID].Kd );
+				else if ( buffer.IsCommand("Ks") ) buffer.ReadFloat3( m[mtlID].Ks );
+				else if ( buffer.IsCommand("Tf") ) buffer.ReadFloat3( m[mtlID].Tf );
+				else if ( buffer.IsCommand("Ns") ) buffer.ReadFloat( &m[mtlID].Ns );
+				else if ( buffer.IsCommand("Ni") ) buffer.ReadFloat( &m[mtlID].Ni );
+				else if ( buffer.IsCommand("illum") ) buffer.ReadInt( &m[mtlID].illum, 5 );
+				else if ( buffer.IsCommand("map_Ka"  ) ) buffer.Copy( m[mtlID].map_Ka,   7 );
+				else if ( buffer.IsCommand("map_Kd"  ) ) buffer.Copy( m[mtlID].map_Kd,   7 );
+				else if ( buffer.IsCommand("map_Ks"  ) ) buffer.Copy( m[mtlID].map_Ks,   7 );
+				else if ( buffer.IsCommand("map_Ns"  ) ) buffer.Copy( m[mtlID].map_Ns,   7 );
+				else if ( buffer.IsCommand("map_d"   ) ) buffer.Copy( m[mtlID].map_d,    6 );
+				else if ( buffer.IsCommand("map_bump") ) buffer.Copy( m[mtlID].map_bump, 9 );
+				else if ( buffer.IsCommand("bump"    ) ) buffer.Copy( m[mtlID].map_bump, 5 );
+				else if ( buffer.IsCommand("map_disp") ) buffer.Copy( m[mtlID].map_disp, 9 );
+				else if ( buffer.IsCommand("disp"    ) ) buffer.Copy( m[mtlID].map_disp, 5 );
 			}
-			fclose(fpm);
 		}
-		if ( mtlPathName ) delete [] mtlPathName;
+		fclose(fpm);
 	}
-
-	return true;
+	if ( mtlPathName ) delete [] mtlPathName;
 }
 
 //-------------------------------------------------------------------------------
@@ -0,0 +1,138 @@
+//-------------------------------------------------------------------------------
+//! \file   cyUniformBuffer.h
+//!
+//! \brief  Uniform buffer objects holding arrays of std140 blocks.
+//!
+//-------------------------------------------------------------------------------
+
+#ifndef _CY_UNIFORM_BUFFER_H_INCLUDED_
+#define _CY_UNIFORM_BUFFER_H_INCLUDED_
+
+//-------------------------------------------------------------------------------
+
+#include "cyCore.h"
+#include "cyGL.h"
+#include <new>
+#include <vector>
+
+//-------------------------------------------------------------------------------
+namespace cy {
+//-------------------------------------------------------------------------------
+
+//! A uniform buffer object that holds an array of blocks of type T, with a copy of the buffer in CPU memory.
+//!
+//! T must match the std140 layout of the uniform block in the shaders: vec3 members are followed by a
+//! scalar or padding, and the size is a multiple of 16 bytes. The elements are changed with operator[],
+//! which marks them as modified, and Update() uploads the modified range with a single call.
+//!
+//! If the buffer is created with bindElements, each element starts at a multiple of
+//! GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT and can be bound alone to a uniform block with Bind(binding,index),
+//! so that the draws of different passes select their own block without updating the buffer.
+//! Otherwise, the elements are packed and the whole buffer is bound to a block that is an array of T.
+//! A packed buffer can also be bound to a shader storage block with BindStorage(), which has no size limit
+//! on the array. The std430 layout of such an array matches std140 when T is made of scalars and vec4-aligned
+//! vec3 and vec4 members, as above.
+
+template <typename T>
+class UniformBuffer
+{
+	static_assert( sizeof(T) % 16 == 0, "The size of a std140 uniform block array element must be a multiple of 16 bytes." );
+
+public:
+	UniformBuffer() = default;
+	UniformBuffer( UniformBuffer const & ) CY_CLASS_FUNCTION_DELETE
+	UniformBuffer& operator = ( UniformBuffer const & ) CY_CLASS_FUNCTION_DELETE
+	~UniformBuffer() { if ( GL::CheckContext() ) Delete(); }	//!< Destructor that deletes the buffer
+
+	//! Creates the buffer with the given number of elements, initialized to T().
+	void Create( unsigned int count, bool bindElements=false )
+	{
+		Delete();
+		stride = sizeof(T);
+		if ( bindElements ) {
+			GLint align = 0;
+			glGetIntegerv( GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align );
+			if ( align > 0 ) stride = ( stride + align - 1 ) / align * align;
+		}
+		data.assign( stride * count, 0 );
+		numElements = count;
+		for ( unsigned int i=0; i<count; i++ ) new ( data.data() + stride*i ) T();
+		glCreateBuffers( 1, &bufferID );
+		glNamedBufferStorage( bufferID, (GLsizeiptr)data.size(), nullptr, GL_DYNAMIC_STORAGE_BIT );
+		dirtyBegin = 0;
+		dirtyEnd   = count;
+		Update();
+	}
+
+	//! Deletes the buffer.
+	void Delete()
+	{
+		if ( bufferID ) glDeleteBuffers( 1, &bufferID );
+		bufferID = 0;
+		data.clear();
+		numElements = 0;
+		dirtyBegin = dirtyEnd = 0;
+	}
+
+	GLuint       GetID () const { return bufferID; }							//!< Returns the buffer id
+	unsigned int Count () const { return numElements; }						//!< Returns the number of elements
+	size_t       Stride() const { return stride; }							//!< Returns the distance between the elements in bytes
+	bool         IsNull() const { return bufferID == 0; }						//!< Returns true if the buffer is not created
+
+	//! Returns the element with the given index and marks it as modified.
+	T& operator [] ( unsigned int i )
+	{
+		if ( dirtyBegin < dirtyEnd ) {
+			dirtyBegin = Min( dirtyBegin, i );
+			dirtyEnd   = Max( dirtyEnd, i+1 );
+		} else {
+			dirtyBegin = i;
+			dirtyEnd   = i+1;
+		}
+		return *(T*)( data.data() + stride*i );
+	}
+	T const& operator [] ( unsigned int i ) const { return *(T const*)( data.data() + stride*i ); }	//!< Returns the element with the given index
+
+	//! Uploads the modified elements, if any. Returns the number of uploaded bytes.
+	size_t Update()
+	{
+		if ( dirtyBegin >= dirtyEnd ) return 0;
+		size_t const offset = stride * dirtyBegin;
+		size_t const size   = stride * ( dirtyEnd - dirtyBegin - 1 ) + sizeof(T);
+		glNamedBufferSubData( bufferID, (GLintptr)offset, (GLsizeiptr)size, data.data() + offset );
+		dirtyBegin = dirtyEnd = 0;
+		numUpdates++;
+		uploadedBytes += size;
+		return size;
+	}
+
+	//! Binds the whole buffer to the given uniform block binding point.
+	void Bind( GLuint binding ) const { glBindBufferBase( GL_UNIFORM_BUFFER, binding, bufferID ); }
+
+	//! Binds the whole buffer to the given shader storage block binding point.
+	void BindStorage( GLuint binding ) const { glBindBufferBase( GL_SHADER_STORAGE_BUFFER, binding, bufferID ); }
+
+	//! Binds the element with the given index to the given uniform block binding point.
+	//! The buffer must be created with bindElements, unless the index is zero.
+	void Bind( GLuint binding, unsigned int index ) const { glBindBufferRange( GL_UNIFORM_BUFFER, binding, bufferID, (GLintptr)(stride*index), (GLsizeiptr)sizeof(T) ); }
+
+	//!@name Statistics
+	unsigned int NumUpdates   () const { return numUpdates; }		//!< Returns the number of Update() calls that uploaded data
+	size_t       UploadedBytes() const { return uploadedBytes; }	//!< Returns the total number of uploaded bytes
+
+private:
+	GLuint                     bufferID      = 0;
+	size_t                     stride        = sizeof(T);
+	std::vector<unsigned char> data;		// elements at their offsets in the buffer
+	unsigned int               numElements   = 0;
+	unsigned int               dirtyBegin    = 0;
+	unsigned int               dirtyEnd      = 0;
+	unsigned int               numUpdates    = 0;
+	size_t                     uploadedBytes = 0;
+};
+
+//-------------------------------------------------------------------------------
+} // namespace cy
+//-------------------------------------------------------------------------------
+
+#endif
@@ -6,34 +6,47 @@ in vec3 vNormalW;
 in vec4 vPosLightClip;
 
 uniform int uVisMode;
-// World space light & camera
-uniform vec3 uLightPosW;
-uniform vec3 uCamPosW;
 
-// Spotlight
-uniform vec3 uLightDirW;
-uniform float uSpotCosInner;
-uniform float uSpotCosOuter;
+// World space camera, light and spotlight
+layout(std140, binding = 0) uniform FrameBlock
+{
+    mat4 uV;
+    mat4 uP;
+    mat4 uLightVP;
+    vec3 uCamPosW;
+    float uSpotCosInner;
+    vec3 uLightPosW;
+    float uSpotCosOuter;
+    vec3 uLightDirW;
+};
+
+// Material properties from .mtl file, indexed by uMaterialID; the plane uses the last one
+struct MaterialData
+{
+    vec3 Ka;
+    float Ns;
+    vec3 Kd;
+    float Ni;
+    vec3 Ks;
+    int illum;
+    vec3 Tf;
+    int hasDiffuseTex;
+    int hasSpecularTex;
+};
+layout(std430, binding = 1) readonly buffer MaterialBuffer
+{
+    MaterialData uMaterials[];
+};
+uniform int uMaterialID;
 
 // Shadow Map
-uniform sampler2DShadow uShadowMap;
-
-// Material properties from .mtl file
-uniform vec3 uKa;
-uniform vec3 uKd;
-uniform vec3 uKs;
-uniform vec3 uTf;
-uniform float uNs;
-uniform float uNi;
-uniform int uIllum;
-
-uniform sampler2D uDiffuseTex;
-uniform bool uHasDiffuseTex;
-uniform sampler2D uSpecularTex;
-uniform bool uHasSpecularTex;
+layout(binding = 3) uniform sampler2DShadow uShadowMap;
+
+layout(binding = 0) uniform sampler2D uDiffuseTex;
+layout(binding = 1) uniform sampler2D uSpecularTex;
 
 // Envrionment mapping
-uniform samplerCube uEnvMap;
+layout(binding = 2) uniform samplerCube uEnvMap;
 uniform float uReflectStrength;
 
 out vec4 FragColor;
@@ -88,21 +101,23 @@ void main()
     float NdotL = max(dot(N, L), 0.0);
     float NdotH = max(dot(N, H), 0.0);
 
-    vec3 kdTex = uHasDiffuseTex ? texture(uDiffuseTex, vUV).rgb : vec3(1.0);
-    vec3 ksTex = uHasSpecularTex ? texture(uSpecularTex, vUV).rgb : vec3(1.0);
+    MaterialData mtl = uMaterials[uMaterialID];
+    bool hasDiffuseTex = mtl.hasDiffuseTex != 0;
+    vec3 kdTex = hasDiffuseTex ? texture(uDiffuseTex, vUV).rgb : vec3(1.0);
+    vec3 ksTex = mtl.hasSpecularTex != 0 ? texture(uSpecularTex, vUV).rgb : vec3(1.0);
 
     // Simple Blinn-Phong from .mtl
-    vec3 Ka = uKa;
-    vec3 Kd = uHasDiffuseTex ? kdTex : uKd;
-    vec3 Ks = uKs * ksTex;
-    float shininess = max(uNs, 1.0);
+    vec3 Ka = mtl.Ka;
+    vec3 Kd = hasDiffuseTex ? kdTex : mtl.Kd;
+    vec3 Ks = mtl.Ks * ksTex;
+    float shininess = max(mtl.Ns, 1.0);
 
-    vec3 albedo = uHasDiffuseTex ? kdTex : uKd;
+    vec3 albedo = hasDiffuseTex ? kdTex : mtl.Kd;
     vec3 ambient  = 0.1 * albedo;
     vec3 diffuse  = albedo * NdotL;
 
     vec3 specular = vec3(0.0);
-    if (uIllum >= 2 && NdotL > 0.0)
+    if (mtl.illum >= 2 && NdotL > 0.0)
     {
         specular = Ks * pow(NdotH, shininess);
     }
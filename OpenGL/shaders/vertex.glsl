@@ -4,23 +4,48 @@ layout(location=0) in vec3 aPos;
 layout(location = 1) in vec3 aNormal;
 layout(location=2) in vec2 aUV;
 
+// Per-frame data of the current view (std140, shared by all lit programs)
+layout(std140, binding = 0) uniform FrameBlock
+{
+    mat4 uV;
+    mat4 uP;
+    mat4 uLightVP;
+    vec3 uCamPosW;
+    float uSpotCosInner;
+    vec3 uLightPosW;
+    float uSpotCosOuter;
+    vec3 uLightDirW;
+};
+
 uniform mat4 uM;
-uniform mat4 uV;
-uniform mat4 uP;
 
-uniform mat4 uLightVP;
+// Quantized vertex format (identity for float vertices)
+uniform vec3 uPosScale = vec3(1.0);
+uniform vec3 uPosOffset = vec3(0.0);
+uniform bool uOctNormal = false;
 
 out vec2 vUV;
 out vec3 vPosW;
 out vec3 vNormalW;
 out vec4 vPosLightClip;
 
+vec3 OctDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main()
 {
-	vec4 posW = uM * vec4(aPos, 1.0);
+    vec3 pos = aPos * uPosScale + uPosOffset;
+    vec3 normal = uOctNormal ? OctDecode(aNormal.xy) : aNormal;
+
+	vec4 posW = uM * vec4(pos, 1.0);
     vPosW = posW.xyz;
     mat3 normalMat = transpose(inverse(mat3(uM)));
-    vNormalW = normalMat * aNormal;
+    vNormalW = normalMat * normal;
     vUV = vec2(aUV.x, 1.0 - aUV.y);     // Flip V coordinate for OpenGL
     //vUV = aUV;
 
@@ -2,12 +2,24 @@
 #include <vector>
 #include <algorithm>
 #include <cmath>
+#include <cstddef>
+#include <chrono>
+#include <filesystem>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "cyMatrix.h"
 #include "cyGL.h"
 #include "cyTriMesh.h"
-#include "cyMatrix.h"
+#include "cyMeshCache.h"
+#include "cyQuantizedMesh.h"
+#include "cyPngDecoder.h"
+#include "cyCookedTexture.h"
+#include "cyTextureManager.h"
+#include "cyFramebufferReadback.h"
+#include "cyFrameWriter.h"
+#include "cyUniformBuffer.h"
+#include "cyGLState.h"
 #include "lodepng.h"
 
 // Properties
@@ -60,6 +72,34 @@ static float g_lightYaw = 0.7f;
 static float g_lightPitch = 0.4f;
 static float g_lightRadius = 3.0f;
 
+// Mesh vertex format: 16 B quantized interleaved vertices instead of 32 B float streams
+static bool g_quantizeMesh = true;
+
+// Block compression of the material textures, applied when they are cooked
+static cy::BlockFormat g_diffuseMapFormat = cy::BLOCK_BC7;
+static cy::BlockFormat g_specularMapFormat = cy::BLOCK_BC1;
+
+// Memory budget of the material textures; the top levels of the least recently used ones are evicted above it
+static size_t g_textureBudgetMB = 256;
+static bool g_printTextureResidency = false;
+
+// Frame capture: the FXAA output is read back a few frames late and written as a numbered PNG sequence
+static bool g_captureFrames = false;
+static cy::PngEffort g_captureEffort = cy::PNG_FAST;
+static const char* g_capturePrefix = "capture/frame_";
+
+// Linked shader programs are stored here and loaded back at the next start instead of compiling the shaders
+static const char* g_shaderCacheDir = "shader_cache";
+
+// The passes change the framebuffer, viewport, program, vertex array, texture and capability state through this cache
+static cy::GLStateCache g_glState;
+
+// Back-face culling of the mesh; meshlets whose normal cone faces away from the camera are skipped on the CPU
+static bool g_backfaceCulling = false;
+
+// Simplified levels of detail of the mesh, selected by their projected error
+static bool g_useLod = true;
+
 static const char* kFullscreenVS = R"GLSL(
     #version 460 core
     layout(location=0) in vec2 aPos;
@@ -94,6 +134,40 @@ struct Material
     std::string mapKs;
 };
 
+// Uniform blocks of the lit shader (std140). FrameBlock holds the camera and the light and is written once
+// per frame. MaterialBlock holds the materials, and the draws select theirs with uMaterialID.
+static const GLuint kFrameBlockBinding = 0;
+static const GLuint kMaterialBlockBinding = 1;
+static const unsigned int kMaxMaterials = 16;   // size of uMaterials in the lit shader
+
+struct FrameUniforms
+{
+    cy::Matrix4f V;
+    cy::Matrix4f P;
+    cy::Vec3f camPosW;
+    float pad0;
+    cy::Vec3f lightPosW;
+    float pad1;
+    cy::Vec3f ambientColor;
+    float pad2;
+    cy::Vec3f lightColor;
+    float pad3;
+};
+static_assert(sizeof(FrameUniforms) == 192, "FrameUniforms must match the std140 layout of FrameBlock");
+
+struct MaterialUniforms
+{
+    cy::Vec3f Ka{ 1, 1, 1 };
+    float Ns = 32.0f;
+    cy::Vec3f Kd{ 1, 1, 1 };
+    int hasDiffuseTex = 0;
+    cy::Vec3f Ks{ 0.5f, 0.5f, 0.5f };
+    int hasSpecularTex = 0;
+    cy::Vec3f Ke{ 0, 0, 0 };
+    float pad = 0.0f;
+};
+static_assert(sizeof(MaterialUniforms) == 64, "MaterialUniforms must match the std140 layout of MaterialData");
+
 static std::string GetDirectoryFromPath(const std::string& path)
 {
     size_t pos = path.find_last_of("/\\");
@@ -173,21 +247,44 @@ struct LitShader
         layout(location=1) in vec3 aNormal;
         layout(location=2) in vec2 aUV;
 
+        layout(std140, binding = 0) uniform FrameBlock
+        {
+            mat4 uV;
+            mat4 uP;
+            vec3 uCamPosW;
+            vec3 uLightPosW;
+            vec3 uAmbientColor;
+            vec3 uLightColor;
+        };
         uniform mat4 uM;
-        uniform mat4 uV;
-        uniform mat4 uP;
+
+        // Quantized vertex format (identity for float vertices)
+        uniform vec3 uPosScale = vec3(1.0);
+        uniform vec3 uPosOffset = vec3(0.0);
+        uniform bool uOctNormal = false;
 
         out vec3 vWorldPos;
         out vec3 vWorldNormal;
         out vec2 vUV;
 
+        vec3 OctDecode(vec2 e)
+        {
+            vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+            float t = max(-n.z, 0.0);
+            n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+            return normalize(n);
+        }
+
         void main()
         {
-            vec4 worldPos = uM * vec4(aPos, 1.0);
+            vec3 pos = aPos * uPosScale + uPosOffset;
+            vec3 normal = uOctNormal ? OctDecode(aNormal.xy) : aNormal;
+
+            vec4 worldPos = uM * vec4(pos, 1.0);
             vWorldPos = worldPos.xyz;
 
             mat3 normalMat = transpose(inverse(mat3(uM)));
-            vWorldNormal = normalize(normalMat * aNormal);
+            vWorldNormal = normalize(normalMat * normal);
 
             vUV = vec2(aUV.x, 1.0 - aUV.y);
             gl_Position = uP * uV * worldPos;
@@ -202,50 +299,75 @@ struct LitShader
 
         out vec4 FragColor;
 
-        uniform vec3 uCamPosW;
-        uniform vec3 uLightPosW;
-
-        uniform vec3 uKa;
-        uniform vec3 uKd;
-        uniform vec3 uKs;
-        uniform vec3 uKe;
-        uniform float uNs;
-
-        uniform vec3 uAmbientColor;
-        uniform vec3 uLightColor;
+        layout(std140, binding = 0) uniform FrameBlock
+        {
+            mat4 uV;
+            mat4 uP;
+            vec3 uCamPosW;
+            vec3 uLightPosW;
+            vec3 uAmbientColor;
+            vec3 uLightColor;
+        };
+
+        struct MaterialData
+        {
+            vec3 Ka;
+            float Ns;
+            vec3 Kd;
+            int hasDiffuseTex;
+            vec3 Ks;
+            int hasSpecularTex;
+            vec3 Ke;
+        };
+        layout(std140, binding = 1) uniform MaterialBlock
+        {
+            MaterialData uMaterials[16];
+        };
+        uniform int uMaterialID;
 
-        uniform sampler2D uDiffuseTex;
-        uniform sampler2D uSpecularTex;
-        uniform int uHasDiffuseTex;
-        uniform int uHasSpecularTex;
+        layout(binding = 0) uniform sampler2D uDiffuseTex;
+        layout(binding = 1) uniform sampler2D uSpecularTex;
 
         void main()
         {
+            MaterialData mtl = uMaterials[uMaterialID];
             vec3 N = normalize(vWorldNormal);
             vec3 L = normalize(uLightPosW - vWorldPos);
             vec3 V = normalize(uCamPosW - vWorldPos);
             vec3 H = normalize(L + V);
 
-            vec3 diffuseColor = uKd;
-            if (uHasDiffuseTex == 1)
+            vec3 diffuseColor = mtl.Kd;
+            if (mtl.hasDiffuseTex == 1)
                 diffuseColor *= texture(uDiffuseTex, vUV).rgb;
 
-            vec3 specularColor = uKs;
-            if (uHasSpecularTex == 1)
+            vec3 specularColor = mtl.Ks;
+            if (mtl.hasSpecularTex == 1)
                 specularColor *= texture(uSpecularTex, vUV).rgb;
 
             float diff = max(dot(N, L), 0.0);
-            float spec = pow(max(dot(N, H), 0.0), max(uNs, 1.0));
+            float spec = pow(max(dot(N, H), 0.0), max(mtl.Ns, 1.0));
 
-            vec3 ambient = uAmbientColor * uKa * diffuseColor;
+            vec3 ambient = uAmbientColor * mtl.Ka * diffuseColor;
             vec3 diffuse = diff * uLightColor * diffuseColor;
             vec3 specular = spec * uLightColor * specularColor;
-            vec3 emissive = uKe;
+            vec3 emissive = mtl.Ke;
 
             vec3 color = ambient + diffuse + specular + emissive;
             FragColor = vec4(color, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without looking up the names every frame.
+    // The camera, the light and the materials come from the uniform blocks.
+    cy::GLSLUniform<cy::Matrix4f> uM;
+    cy::GLSLUniform<int> uMaterialID;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uM = prog.GetUniform<cy::Matrix4f>("uM");
+        uMaterialID = prog.GetUniform<int>("uMaterialID");
+    }
 };
 
 struct MotionBlurShader
@@ -259,8 +381,8 @@ struct MotionBlurShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uSceneColor;
-        uniform sampler2D uSceneDepth;
+        layout(binding = 0) uniform sampler2D uSceneColor;
+        layout(binding = 1) uniform sampler2D uSceneDepth;
         uniform int uEnableMotionBlur;
         uniform mat4 uCurrInvVP;
         uniform mat4 uPrevVP;
@@ -319,6 +441,19 @@ struct MotionBlurShader
             FragColor = vec4(color, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<int> uEnableMotionBlur;
+    cy::GLSLUniform<cy::Matrix4f> uCurrInvVP;
+    cy::GLSLUniform<cy::Matrix4f> uPrevVP;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uEnableMotionBlur = prog.GetUniform<int>("uEnableMotionBlur");
+        uCurrInvVP = prog.GetUniform<cy::Matrix4f>("uCurrInvVP");
+        uPrevVP = prog.GetUniform<cy::Matrix4f>("uPrevVP");
+    }
 };
 
 struct BrightExtractShader
@@ -332,7 +467,7 @@ struct BrightExtractShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uInputTex;
+        layout(binding = 0) uniform sampler2D uInputTex;
         uniform float uThreshold;
         uniform int uEnableBloom;
 
@@ -350,6 +485,17 @@ struct BrightExtractShader
             FragColor = vec4(bright, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<float> uThreshold;
+    cy::GLSLUniform<int> uEnableBloom;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uThreshold = prog.GetUniform<float>("uThreshold");
+        uEnableBloom = prog.GetUniform<int>("uEnableBloom");
+    }
 };
 
 struct BlurShader
@@ -363,7 +509,7 @@ struct BlurShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uInputTex;
+        layout(binding = 0) uniform sampler2D uInputTex;
         uniform vec2 uTexelSize;
         uniform int uHorizontal;
 
@@ -382,6 +528,17 @@ struct BlurShader
             FragColor = vec4(result, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<cy::Vec2f> uTexelSize;
+    cy::GLSLUniform<int> uHorizontal;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uTexelSize = prog.GetUniform<cy::Vec2f>("uTexelSize");
+        uHorizontal = prog.GetUniform<int>("uHorizontal");
+    }
 };
 
 struct CombineShader
@@ -395,8 +552,8 @@ struct CombineShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uSceneTex;
-        uniform sampler2D uBloomTex;
+        layout(binding = 0) uniform sampler2D uSceneTex;
+        layout(binding = 1) uniform sampler2D uBloomTex;
         uniform int uEnableBloom;
         uniform float uBloomStrength;
 
@@ -412,6 +569,17 @@ struct CombineShader
             FragColor = vec4(color, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<int> uEnableBloom;
+    cy::GLSLUniform<float> uBloomStrength;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uEnableBloom = prog.GetUniform<int>("uEnableBloom");
+        uBloomStrength = prog.GetUniform<float>("uBloomStrength");
+    }
 };
 
 struct ToneMapShader
@@ -425,7 +593,7 @@ struct ToneMapShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uInputTex;
+        layout(binding = 0) uniform sampler2D uInputTex;
         uniform int uEnableToneMapping;
         uniform float uExposure;
         uniform int uToneMapMode;
@@ -462,6 +630,19 @@ struct ToneMapShader
             FragColor = vec4(color, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<int> uEnableToneMapping;
+    cy::GLSLUniform<float> uExposure;
+    cy::GLSLUniform<int> uToneMapMode;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uEnableToneMapping = prog.GetUniform<int>("uEnableToneMapping");
+        uExposure = prog.GetUniform<float>("uExposure");
+        uToneMapMode = prog.GetUniform<int>("uToneMapMode");
+    }
 };
 
 struct ColorGradingShader
@@ -475,7 +656,7 @@ struct ColorGradingShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uInputTex;
+        layout(binding = 0) uniform sampler2D uInputTex;
         uniform int uEnableColorGrading;
         uniform float uSaturation;
         uniform float uContrast;
@@ -509,6 +690,23 @@ struct ColorGradingShader
             FragColor = vec4(clamp(color, 0.0, 1.0), 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<int> uEnableColorGrading;
+    cy::GLSLUniform<float> uSaturation;
+    cy::GLSLUniform<float> uContrast;
+    cy::GLSLUniform<float> uBrightness;
+    cy::GLSLUniform<cy::Vec3f> uColorFilter;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uEnableColorGrading = prog.GetUniform<int>("uEnableColorGrading");
+        uSaturation = prog.GetUniform<float>("uSaturation");
+        uContrast = prog.GetUniform<float>("uContrast");
+        uBrightness = prog.GetUniform<float>("uBrightness");
+        uColorFilter = prog.GetUniform<cy::Vec3f>("uColorFilter");
+    }
 };
 
 struct FXAAShader
@@ -522,7 +720,7 @@ struct FXAAShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uInputTex;
+        layout(binding = 0) uniform sampler2D uInputTex;
         uniform int uEnableFXAA;
         uniform vec2 uInvScreenSize;
 
@@ -587,6 +785,17 @@ struct FXAAShader
             FragColor = vec4(color, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<int> uEnableFXAA;
+    cy::GLSLUniform<cy::Vec2f> uInvScreenSize;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uEnableFXAA = prog.GetUniform<int>("uEnableFXAA");
+        uInvScreenSize = prog.GetUniform<cy::Vec2f>("uInvScreenSize");
+    }
 };
 
 struct MotionVectorShader
@@ -600,7 +809,7 @@ struct MotionVectorShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uSceneDepth;
+        layout(binding = 0) uniform sampler2D uSceneDepth;
         uniform mat4 uCurrInvVP;
         uniform mat4 uPrevVP;
 
@@ -634,6 +843,17 @@ struct MotionVectorShader
             FragColor = vec4(vis, 0.0, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<cy::Matrix4f> uCurrInvVP;
+    cy::GLSLUniform<cy::Matrix4f> uPrevVP;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uCurrInvVP = prog.GetUniform<cy::Matrix4f>("uCurrInvVP");
+        uPrevVP = prog.GetUniform<cy::Matrix4f>("uPrevVP");
+    }
 };
 
 struct DebugDisplayShader
@@ -647,7 +867,7 @@ struct DebugDisplayShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uInputTex;
+        layout(binding = 0) uniform sampler2D uInputTex;
         uniform int uApplyToneMap;
 
         vec3 ToneMapACES(vec3 x)
@@ -671,6 +891,15 @@ struct DebugDisplayShader
             FragColor = vec4(color, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<int> uApplyToneMap;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uApplyToneMap = prog.GetUniform<int>("uApplyToneMap");
+    }
 };
 
 struct DepthPreviewShader
@@ -684,7 +913,7 @@ struct DepthPreviewShader
         in vec2 vUV;
         out vec4 FragColor;
 
-        uniform sampler2D uSceneDepth;
+        layout(binding = 0) uniform sampler2D uSceneDepth;
 
         float LinearizeDepth(float z, float nearPlane, float farPlane)
         {
@@ -702,11 +931,20 @@ struct DepthPreviewShader
     )GLSL";
 };
 
-// Build Shader
+// Submit Shader: the driver compiles the program while the caller continues
+template <typename ShaderType>
+void SubmitShader(ShaderType& shader)
+{
+    shader.prog.template BuildAsync<false, false>(shader.vs, shader.fs);
+}
+
+// Finish Shader: waits for the submitted program; numReady counts it if it was already compiled
 template <typename ShaderType>
-bool BuildShader(ShaderType& shader, const char* errorMessage)
+bool FinishShader(ShaderType& shader, const char* errorMessage, unsigned int& numReady)
 {
-    if (!shader.prog.Build<false, false>(shader.vs, shader.fs))
+    if (shader.prog.IsReady())
+        ++numReady;
+    if (!shader.prog.Finish())
     {
         std::cerr << errorMessage << std::endl;
         return false;
@@ -718,6 +956,116 @@ bool BuildShader(ShaderType& shader, const char* errorMessage)
 
 
 // Helping tools
+// Print file load time & throughput
+static void PrintLoadTime(const char* label, const char* path, std::chrono::steady_clock::time_point start)
+{
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::error_code ec;
+    double mb = (double)std::filesystem::file_size(path, ec) / (1024.0 * 1024.0);
+    if (ec)
+        mb = 0.0;
+    std::cout << label << ": " << mb << " MB in " << ms << " ms (" << (ms > 0.0 ? mb * 1000.0 / ms : 0.0) << " MB/s)\n";
+}
+
+// Print the vertex reduction of the indexed mesh compared to one vertex per face corner
+static void PrintMeshStats(const cy::MeshCache& meshCache)
+{
+    const double vertexSize = (3 + 3 + 2) * sizeof(float);
+    const double mb = 1.0 / (1024.0 * 1024.0);
+    double flatSize = meshCache.NumIndices() * vertexSize * mb;
+    double indexedSize = (meshCache.NumVertices() * vertexSize + meshCache.IndicesSize()) * mb;
+    std::cout << "Mesh: " << meshCache.NumIndices() << " corners -> " << meshCache.NumVertices() << " vertices, "
+              << meshCache.IndexSize() * 8 << "-bit indices, " << flatSize << " MB -> " << indexedSize << " MB\n";
+    const cy::VertexCacheStats& before = meshCache.GetOriginalCacheStats();
+    const cy::VertexCacheStats& after = meshCache.GetOptimizedCacheStats();
+    std::cout << "Vertex cache (" << after.cacheSize << " entries): ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+    unsigned int numCones = 0;
+    for (unsigned int i = 0; i < meshCache.NumMeshlets(); ++i)
+        numCones += meshCache.GetMeshlet((int)i).HasCone() ? 1 : 0;
+    if (meshCache.NumMeshlets() > 0)
+        std::cout << "Meshlets: " << meshCache.NumMeshlets() << ", " << (double)meshCache.NumFaces() / meshCache.NumMeshlets()
+                  << " triangles on average, " << 100.0 * numCones / meshCache.NumMeshlets() << "% with normal cones\n";
+    for (unsigned int i = 1; i < meshCache.NumLods(); ++i)
+        std::cout << "LOD " << i << ": " << meshCache.GetLod((int)i).faceCount << " triangles, error " << meshCache.GetLod((int)i).error << "\n";
+}
+
+// Draw the faces of the given range whose meshlets pass the culler; adjacent visible meshlets are merged into one draw
+static void DrawMeshlets(const cy::MeshCache& meshCache, const cy::MeshletCuller& culler, GLenum indexType, unsigned int firstFace, unsigned int faceCount)
+{
+    static std::vector<cy::FaceRange> visible;
+    static std::vector<GLsizei> counts;
+    static std::vector<const void*> offsets;
+    visible.clear();
+    cy::CullMeshlets(visible, meshCache.Meshlets(), meshCache.NumMeshlets(), culler, firstFace, faceCount);
+    counts.resize(visible.size());
+    offsets.resize(visible.size());
+    for (size_t i = 0; i < visible.size(); ++i)
+    {
+        counts[i] = (GLsizei)visible[i].faceCount * 3;
+        offsets[i] = (const void*)((size_t)visible[i].firstFace * 3 * meshCache.IndexSize());
+    }
+    if (!visible.empty())
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), indexType, offsets.data(), (GLsizei)visible.size());
+}
+
+// Select the coarsest level of detail whose error projects to at most maxPixels at the given distance.
+// P(1,1) is cot(fovy/2) for a perspective projection and 1/halfHeight for an orthographic one.
+static int SelectLod(const cy::MeshCache& meshCache, const cy::Matrix4f& P, int fbH, float objScale, float distance, float maxPixels)
+{
+    bool perspective = P(3, 3) == 0.0f;
+    float pixelsPerUnit = P(1, 1) * 0.5f * (float)fbH;
+    if (perspective)
+        pixelsPerUnit /= (distance > 1e-4f) ? distance : 1e-4f;
+    int lod = 0;
+    for (unsigned int i = 1; i < meshCache.NumLods(); ++i)
+    {
+        if (meshCache.GetLod((int)i).error * objScale * pixelsPerUnit <= maxPixels)
+            lod = (int)i;
+    }
+    return lod;
+}
+
+// Draw a face range of the given level of detail; only the full mesh has meshlets to cull
+static void DrawLod(const cy::MeshCache& meshCache, const cy::MeshletCuller& culler, GLenum indexType, int lod, unsigned int firstFace, unsigned int faceCount)
+{
+    if (lod == 0)
+        DrawMeshlets(meshCache, culler, indexType, firstFace, faceCount);
+    else if (faceCount > 0)
+        glDrawElements(GL_TRIANGLES, (GLsizei)faceCount * 3, indexType, (const void*)((size_t)firstFace * 3 * meshCache.IndexSize()));
+}
+
+// Dequantization parameters of the mesh vertex format (identity for float vertices)
+struct MeshVertexFormat
+{
+    bool quantized = false;
+    cy::Vec3f posScale = cy::Vec3f(1.0f, 1.0f, 1.0f);
+    cy::Vec3f posOffset = cy::Vec3f(0.0f, 0.0f, 0.0f);
+
+    // The values do not change, so they are set once after the program is built
+    void SetUniforms(const cy::GLSLProgram& prog) const
+    {
+        prog.GetUniform<cy::Vec3f>("uPosScale").Set(posScale);
+        prog.GetUniform<cy::Vec3f>("uPosOffset").Set(posOffset);
+        prog.GetUniform<int>("uOctNormal").Set(quantized ? 1 : 0);
+    }
+};
+
+// Quantize the cached vertex streams and check the round-trip error before using them
+static bool QuantizeMesh(const cy::MeshCache& meshCache, cy::QuantizedMesh& quantized)
+{
+    quantized.Build(meshCache.Positions(), meshCache.Normals(), meshCache.TexCoords(), meshCache.NumVertices(), meshCache.GetBoundMin(), meshCache.GetBoundMax());
+    cy::QuantizationError error = quantized.MeasureError(meshCache.Positions(), meshCache.Normals(), meshCache.TexCoords());
+    std::cout << "Quantized vertices: " << sizeof(cy::QuantizedVertex) << " B/vertex, max error position " << error.position
+              << ", normal " << error.normalAngle << " deg, uv " << error.texCoord << "\n";
+    if (!quantized.IsAccurate(error))
+    {
+        std::cout << "Quantization error is above the tolerance, using float vertices.\n";
+        return false;
+    }
+    return true;
+}
+
 static float DegToRad(float deg)
 {
     return deg * 3.1415926535f / 180.0f;
@@ -772,46 +1120,136 @@ static cy::Vec3f ComputeLightPosWorld()
 
 static void DrawFullscreenQuad(GLuint fsQuadVAO)
 {
-    glBindVertexArray(fsQuadVAO);
+    g_glState.BindVertexArray(fsQuadVAO);
     glDrawArrays(GL_TRIANGLES, 0, 6);
 }
 
-static GLuint LoadTexture2D(const std::string& path, bool srgb)
+// Prints the quality and the memory of a block compressed texture against uncompressed RGBA
+static void PrintTextureCompression(const std::string& path, const cy::CookedTexture& cooked)
 {
-    std::vector<unsigned char> image;
-    unsigned w = 0, h = 0;
+    if (cooked.GetFormat() == cy::BLOCK_NONE)
+        return;
+    const double rgbaMB = (double)cooked.RGBASize() / (1024.0 * 1024.0);
+    const double dataMB = (double)cooked.DataSize() / (1024.0 * 1024.0);
+    std::cout << "Texture compression: " << path << " " << cy::BlockFormatName(cooked.GetFormat()) << " PSNR " << cooked.GetPSNR() << " dB, "
+        << rgbaMB << " MB -> " << dataMB << " MB (" << (rgbaMB - dataMB) << " MB saved)\n";
+}
+
+// Prints how many material texture requests were served by a texture that already existed
+static void PrintTextureSharing(const cy::TextureManager& textureManager)
+{
+    const unsigned int requests = textureManager.NumHits() + textureManager.NumMisses();
+    std::cout << "Texture sharing: " << requests << " requests, " << textureManager.NumTextures() << " textures, hit rate "
+        << (requests > 0 ? 100.0 * textureManager.NumHits() / requests : 0.0) << "%\n";
+}
 
-    unsigned error = lodepng::decode(image, w, h, path);
-    if (error)
+// Prints the resident levels and the memory of each managed texture
+static void PrintTextureResidency(const cy::TextureManager& textureManager)
+{
+    std::cout << "Texture residency: " << (double)textureManager.ResidentBytes() / (1024.0 * 1024.0) << " of " << (double)textureManager.TotalBytes() / (1024.0 * 1024.0)
+        << " MB resident (budget " << (double)textureManager.GetBudget() / (1024.0 * 1024.0) << " MB)\n";
+    for (unsigned int i = 0; i < textureManager.NumTextures(); ++i)
     {
-        std::cerr << "Failed to load PNG texture: " << path
-            << " | error: " << error
-            << " | " << lodepng_error_text(error) << std::endl;
-        return 0;
+        const cy::TextureResidency& r = textureManager.GetResidency(i);
+        std::cout << "  " << r.cacheFile << ": " << r.width << "x" << r.height << ", levels " << r.baseLevel << "-" << (r.numLevels - 1) << " resident, "
+            << (double)r.residentBytes / (1024.0 * 1024.0) << " of " << (double)r.totalBytes / (1024.0 * 1024.0) << " MB, last used "
+            << (textureManager.Frame() - r.lastUsedFrame) << " frames ago, " << r.evictedLevels << " levels evicted, " << r.restoredLevels << " loaded back\n";
     }
+}
 
-    if (image.empty() || w == 0 || h == 0)
+// Prints the time spent submitting the shader programs, how many were compiled in the background before they were
+// needed, the time spent waiting for the others, and how many were loaded from the program binary cache
+static void PrintShaderBuildTime(unsigned int numPrograms, unsigned int numReady, double submitMs, std::chrono::steady_clock::time_point waitStart)
+{
+    double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+    std::cout << "Shaders: " << numPrograms << " programs submitted in " << submitMs << " ms, waited " << waitMs << " ms";
+    if (cy::GLSLProgram::IsParallelCompileEnabled())
+        std::cout << " (" << numReady << " compiled in parallel before use)";
+    else
+        std::cout << " (parallel compile not supported)";
+    std::cout << ", binary cache " << g_shaderCacheDir << ": "
+        << cy::GLSLProgram::NumBinaryCacheHits() << " hits, " << cy::GLSLProgram::NumBinaryCacheMisses() << " misses, "
+        << cy::GLSLProgram::NumBinaryCacheRejected() << " rejected\n";
+}
+
+// Prints how many state changes the GL state cache issued and how many it dropped as redundant
+static void PrintGLStateStats(const cy::GLStateCache& state, uint64_t numFrames)
+{
+    const uint64_t issued = state.NumIssued();
+    const uint64_t filtered = state.NumFiltered();
+    std::cout << "GL state: " << issued << " calls issued, " << filtered << " filtered";
+    if (numFrames > 0)
+        std::cout << " (" << (double)issued / numFrames << " and " << (double)filtered / numFrames << " per frame)";
+    std::cout << "\n";
+    for (int i = 0; i < cy::GLStateCache::NUM_FUNCTIONS; ++i)
     {
-        std::cerr << "Invalid PNG texture data: " << path << std::endl;
-        return 0;
+        const cy::GLStateCache::Function f = (cy::GLStateCache::Function)i;
+        if (state.NumIssued(f) + state.NumFiltered(f) > 0)
+            std::cout << "  " << cy::GLStateCache::FunctionName(f) << ": " << state.NumIssued(f) << " issued, " << state.NumFiltered(f) << " filtered\n";
     }
+}
 
-    GLuint tex = 0;
-    glCreateTextures(GL_TEXTURE_2D, 1, &tex);
+// Prints the readback latency and the PNG throughput of the frame capture
+static void PrintCaptureStats(const cy::FramebufferReadback& readback, const cy::FrameWriter& frameWriter)
+{
+    const cy::FrameWriterStats stats = frameWriter.GetStats();
+    std::cout << "Capture readback: " << readback.NumCaptured() << " frames, " << readback.NumSkipped() << " skipped, "
+        << readback.AverageDelay() << " frames late on average (" << readback.NumBuffers() << " buffers)\n";
+    std::cout << "Capture PNG (" << cy::PngEffortName(frameWriter.GetEffort()) << ", " << frameWriter.NumThreads() << " threads): "
+        << stats.framesWritten << " written, " << frameWriter.NumPending() << " pending, " << stats.framesDropped << " dropped, "
+        << stats.FramesPerSecond() << " frames/s, "
+        << (stats.framesWritten > 0 ? (double)stats.fileBytes / (1024.0 * 1024.0) / stats.framesWritten : 0.0) << " MB/frame\n";
+}
 
-    GLenum internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
-    glTextureStorage2D(tex, 1, internalFormat, (GLsizei)w, (GLsizei)h);
-    glTextureSubImage2D(
-        tex,
-        0,
-        0, 0,
-        (GLsizei)w, (GLsizei)h,
-        GL_RGBA,
-        GL_UNSIGNED_BYTE,
-        image.data()
-    );
+// Loads the cooked texture beside the PNG, or decodes the PNG and cooks its mipmaps if the cooked texture is missing or stale,
+// then creates the texture with all levels and uploads them directly from the cooked texture.
+// The cooked levels are block compressed to the given format, and the internal format follows them.
+// The texture manager owns the texture and loads its evicted levels back from the cooked texture file.
+// A texture of the same image with the same settings is shared instead of loaded again.
+static GLuint LoadTexture2D(cy::TextureManager& textureManager, const std::string& path, bool srgb, cy::BlockFormat format)
+{
+    const std::string cachePath = cy::CookedTexture::GetCacheFileName(std::filesystem::path(path).lexically_normal().string().c_str(), srgb, format);
+    if (GLuint shared = textureManager.Acquire(cachePath.c_str()))
+    {
+        std::cout << "Texture shared: " << path << "\n";
+        return shared;
+    }
+    cy::CookedTexture cooked;
+    auto loadStart = std::chrono::steady_clock::now();
+    if (cooked.Load(cachePath.c_str(), path.c_str(), srgb, format))
+    {
+        PrintLoadTime("Texture cache load", cachePath.c_str(), loadStart);
+    }
+    else
+    {
+        std::vector<unsigned char> image;
+        unsigned w = 0, h = 0;
+        unsigned error = cy::DecodePNG(image, w, h, path);
+        if (error)
+        {
+            std::cerr << "Failed to load PNG texture: " << path
+                << " | error: " << error
+                << " | " << lodepng_error_text(error) << std::endl;
+            return 0;
+        }
+        if (w == 0 || h == 0)
+        {
+            std::cerr << "Invalid PNG texture data: " << path << std::endl;
+            return 0;
+        }
+        cooked.Build(image.data(), w, h, srgb, format);
+        PrintLoadTime("Texture cook", path.c_str(), loadStart);
+        if (cooked.Save(cachePath.c_str(), path.c_str()))
+            std::cout << "Texture cache written: " << cachePath << "\n";
+        else
+            std::cout << "Texture cache could not be written: " << cachePath << "\n";
+    }
+
+    PrintTextureCompression(path, cooked);
 
-    glGenerateTextureMipmap(tex);
+    GLuint tex = textureManager.Create(cooked, cachePath.c_str());
+    if (tex == 0)
+        return 0;
 
     glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -938,7 +1376,7 @@ static bool CreateColorRenderTarget(ColorRenderTarget& renderTarget, int width,
 // Event Callback
 static void framebuffer_size_callback(GLFWwindow*, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    g_glState.Viewport(0, 0, width, height);
 }
 
 static void mouse_button_callback(GLFWwindow* window, int button, int action, int)
@@ -1033,6 +1471,16 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         g_enableColorGrading = !g_enableColorGrading;
         std::cout << "[G] Color Grading = " << (g_enableColorGrading ? "ON" : "OFF") << std::endl;
     }
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+    {
+        g_backfaceCulling = !g_backfaceCulling;
+        std::cout << "[C] Backface Culling = " << (g_backfaceCulling ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_L && action == GLFW_PRESS)
+    {
+        g_useLod = !g_useLod;
+        std::cout << "[L] Level of Detail = " << (g_useLod ? "ON" : "OFF") << std::endl;
+    }
     if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS)
     {
         g_exposure = max(0.1f, g_exposure - 0.1f);
@@ -1043,6 +1491,20 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         g_exposure += 0.1f;
         std::cout << "[Exposure] " << g_exposure << std::endl;
     }
+    if (key == GLFW_KEY_R && action == GLFW_PRESS)
+    {
+        g_printTextureResidency = true;
+    }
+    if (key == GLFW_KEY_K && action == GLFW_PRESS)
+    {
+        g_captureFrames = !g_captureFrames;
+        std::cout << "[K] Capture = " << (g_captureFrames ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_J && action == GLFW_PRESS)
+    {
+        g_captureEffort = (cy::PngEffort)((g_captureEffort + 1) % (cy::PNG_SMALL + 1));
+        std::cout << "[J] Capture PNG effort = " << cy::PngEffortName(g_captureEffort) << " (from the next capture)" << std::endl;
+    }
     if (key == GLFW_KEY_COMMA && action == GLFW_PRESS)
     {
         g_bloomStrength = max(0.0f, g_bloomStrength - 0.1f);
@@ -1082,26 +1544,36 @@ int main(int argc, char** argv)
     GLuint kdTex = 0;
     GLuint ksTex = 0;
 
-    cy::TriMesh mesh;
-    if (!mesh.LoadFromFileObj(objPath.c_str(), true, &std::cout))
+    // Mesh: use the binary cache beside the OBJ, rebuild it if it is missing or stale
+    const std::string meshCachePath = cy::MeshCache::GetCacheFileName(objPath.c_str());
+    cy::MeshCache meshCache;
+    auto loadStart = std::chrono::steady_clock::now();
+    if (meshCache.Load(meshCachePath.c_str(), objPath.c_str()))
     {
-        std::cerr << "ERROR: failed to load obj: " << objPath << "\n";
-        return -1;
+        PrintLoadTime("Mesh cache load", meshCachePath.c_str(), loadStart);
     }
-
-	// Get bound & xcenter & scale
-    cy::Vec3f bbMin(1e30f, 1e30f, 1e30f);
-	cy::Vec3f bbMax(-1e30f, -1e30f, -1e30f);
-    for (unsigned int i = 0; i < mesh.NV(); ++i)
+    else
     {
-		cy::Vec3f p = mesh.V((int)i);
-        bbMin.x = min(bbMin.x, p.x);
-        bbMin.y = min(bbMin.y, p.y);
-        bbMin.z = min(bbMin.z, p.z);
-        bbMax.x = max(bbMax.x, p.x);
-        bbMax.y = max(bbMax.y, p.y);
-        bbMax.z = max(bbMax.z, p.z);
+        cy::TriMesh mesh;
+        if (!mesh.LoadFromFileObjMapped(objPath.c_str(), true, &std::cout))
+        {
+            std::cerr << "ERROR: failed to load obj: " << objPath << "\n";
+            return -1;
+        }
+        PrintLoadTime("OBJ load", objPath.c_str(), loadStart);
+
+        mesh.ComputeNormals();
+        meshCache.Build(mesh);
+        if (meshCache.Save(meshCachePath.c_str(), objPath.c_str()))
+            std::cout << "Mesh cache written: " << meshCachePath << std::endl;
+        else
+            std::cout << "Mesh cache could not be written: " << meshCachePath << std::endl;
     }
+    PrintMeshStats(meshCache);
+
+	// Get bound & xcenter & scale
+    cy::Vec3f bbMin = meshCache.GetBoundMin();
+	cy::Vec3f bbMax = meshCache.GetBoundMax();
 
     g_objCenter = (bbMin + bbMax) * 0.5f;
     cy::Vec3f extent = bbMax - bbMin;
@@ -1111,58 +1583,10 @@ int main(int argc, char** argv)
     float diag = sqrt(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z) * g_objScale;
     g_dist = max(2.0f, diag * 1.2f);
 
-	mesh.ComputeNormals();
-
-    std::vector<float> positions;
-    std::vector<float> normals;
-    std::vector<float> texcoords;
-    positions.reserve(mesh.NF() * 3 * 3);
-    normals.reserve(mesh.NF() * 3 * 3);
-    texcoords.reserve(mesh.NF() * 3 * 2);
-
-    bool hasUVs = mesh.NVT() > 0;
+    bool hasUVs = meshCache.HasTexCoords();
     if (!hasUVs)
         std::cout << "OBJ has no texture coordinates. Texture display will not work correctly." << std::endl;
 
-    for (unsigned int fi = 0; fi < mesh.NF(); ++fi)
-    {
-        auto f = mesh.F((int)fi);
-        auto fn = mesh.FN((int)fi);
-        auto ft = mesh.FT((int)fi);
-
-        for (int c = 0; c < 3; ++c)
-        {
-            int vi = f.v[c];
-            int ni = fn.v[c];
-            cy::Vec3f p = mesh.V(vi);
-            cy::Vec3f n = (mesh.NVN() > 0 && ni >= 0) ? mesh.VN(ni) : cy::Vec3f(0, 1, 0);
-
-            positions.push_back(p.x);
-            positions.push_back(p.y);
-            positions.push_back(p.z);
-
-            normals.push_back(n.x);
-            normals.push_back(n.y);
-            normals.push_back(n.z);
-
-            float u = 0.0f;
-            float v = 0.0f;
-            if (hasUVs)
-            {
-                int ti = ft.v[c];
-                if (ti >= 0)
-                {
-                    cy::Vec3f uvw = mesh.VT(ti);
-                    u = uvw.x;
-                    v = uvw.y;
-                }
-            }
-
-            texcoords.push_back(u);
-            texcoords.push_back(v);
-        }
-    }
-
     // GLFW
     if (!glfwInit())
     {
@@ -1200,11 +1624,44 @@ int main(int argc, char** argv)
         glfwTerminate();
         return -1;
     }
+    cy::GLSLProgram::EnableParallelCompile((GLADloadproc)glfwGetProcAddress);
+
+    // Sahder: all programs are submitted now and compiled by the driver while the textures,
+    // the mesh, and the render targets are created; they are finished before the first frame
+    LitShader litShader;
+    MotionBlurShader motionShader;
+    BrightExtractShader brightShader;
+    BlurShader blurShader;
+    CombineShader combineShader;
+    ToneMapShader toneMapShader;
+    ColorGradingShader gradingShader;
+    FXAAShader fxaaShader;
+    MotionVectorShader motionVectorShader;
+    DebugDisplayShader debugDisplayShader;
+    DepthPreviewShader depthShader;
 
+    cy::GLSLProgram::SetBinaryCacheDirectory(g_shaderCacheDir);
+    auto shaderStart = std::chrono::steady_clock::now();
+    SubmitShader(litShader);
+    SubmitShader(motionShader);
+    SubmitShader(brightShader);
+    SubmitShader(blurShader);
+    SubmitShader(combineShader);
+    SubmitShader(toneMapShader);
+    SubmitShader(gradingShader);
+    SubmitShader(fxaaShader);
+    SubmitShader(motionVectorShader);
+    SubmitShader(debugDisplayShader);
+    SubmitShader(depthShader);
+    double shaderSubmitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
+
+    cy::TextureManager textureManager;
+    textureManager.SetBudget(g_textureBudgetMB << 20);
     if (!material.mapKd.empty())
-        kdTex = LoadTexture2D(JoinPath(mtlDir, material.mapKd), true);
+        kdTex = LoadTexture2D(textureManager, JoinPath(mtlDir, material.mapKd), true, g_diffuseMapFormat);
     if (!material.mapKs.empty())
-        ksTex = LoadTexture2D(JoinPath(mtlDir, material.mapKs), false);
+        ksTex = LoadTexture2D(textureManager, JoinPath(mtlDir, material.mapKs), false, g_specularMapFormat);
+    PrintTextureSharing(textureManager);
 
     std::cout << "GL_VERSION: " << glGetString(GL_VERSION) << "\n";
     std::cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << "\n";
@@ -1224,64 +1681,96 @@ int main(int argc, char** argv)
     std::cout << "  [ / ]           : exposure - / +\n";
     std::cout << "  G               : toggle color grading\n";
     std::cout << "  P               : perspective / orthographic\n";
+    std::cout << "  C               : toggle backface culling\n";
+    std::cout << "  L               : toggle level of detail\n";
+    std::cout << "  R               : print texture residency\n";
+    std::cout << "  K               : start / stop capturing frames to " << g_capturePrefix << "*.png\n";
+    std::cout << "  J               : capture PNG effort (store / fast / small)\n";
     std::cout << "Debug view layout: top-right Scene, mid-right Bloom Bright, bottom-left Bloom Blur, bottom-right Motion Vector\n";
 
-    // Sahder
-    LitShader litShader;
-    MotionBlurShader motionShader;
-    BrightExtractShader brightShader;
-    BlurShader blurShader;
-    CombineShader combineShader;
-    ToneMapShader toneMapShader;
-    ColorGradingShader gradingShader;
-    FXAAShader fxaaShader;
-    MotionVectorShader motionVectorShader;
-    DebugDisplayShader debugDisplayShader;
-    DepthPreviewShader depthShader;
-
-    if (!BuildShader(litShader, "Failed to build lit shader.") ||
-        !BuildShader(motionShader, "Failed to build motion blur shader.") ||
-        !BuildShader(brightShader, "Failed to build bright extract shader.") ||
-        !BuildShader(blurShader, "Failed to build blur shader.") ||
-        !BuildShader(combineShader, "Failed to build combine shader.") ||
-        !BuildShader(toneMapShader, "Failed to build tone mapping shader.") ||
-        !BuildShader(gradingShader, "Failed to build color grading shader.") ||
-        !BuildShader(fxaaShader, "Failed to build FXAA shader.") ||
-        !BuildShader(motionVectorShader, "Failed to build motion vector shader.") ||
-        !BuildShader(debugDisplayShader, "Failed to build debug display shader.") ||
-        !BuildShader(depthShader, "Failed to build depth preview shader."))
+    // The material is uploaded once, the camera and the light each frame
+    cy::UniformBuffer<MaterialUniforms> materialUniforms;
+    materialUniforms.Create(kMaxMaterials);
     {
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return -1;
+        MaterialUniforms& u = materialUniforms[0];
+        u.Ka = material.Ka;
+        u.Kd = material.Kd;
+        u.Ks = material.Ks;
+        u.Ke = material.Ke;
+        u.Ns = material.Ns;
+        u.hasDiffuseTex = kdTex ? 1 : 0;
+        u.hasSpecularTex = ksTex ? 1 : 0;
     }
+    materialUniforms.Update();
+    materialUniforms.Bind(kMaterialBlockBinding);
+
+    cy::UniformBuffer<FrameUniforms> frameUniforms;
+    frameUniforms.Create(1);
+    frameUniforms.Bind(kFrameBlockBinding);
 
     // Mesh VAO
-    GLuint meshVAO = 0, posVBO = 0, normVBO = 0, uvVBO = 0;
+    GLuint meshVAO = 0, posVBO = 0, normVBO = 0, uvVBO = 0, meshEBO = 0;
     glCreateVertexArrays(1, &meshVAO);
-    glCreateBuffers(1, &posVBO);
-    glCreateBuffers(1, &normVBO);
-    glCreateBuffers(1, &uvVBO);
-
-    glNamedBufferData(posVBO, (GLsizeiptr)(positions.size() * sizeof(float)), positions.data(), GL_STATIC_DRAW);
-    glNamedBufferData(normVBO, (GLsizeiptr)(normals.size() * sizeof(float)), normals.data(), GL_STATIC_DRAW);
-    glNamedBufferData(uvVBO, (GLsizeiptr)(texcoords.size() * sizeof(float)), texcoords.data(), GL_STATIC_DRAW);
-
-    glVertexArrayVertexBuffer(meshVAO, 0, posVBO, 0, 3 * sizeof(float));
-    glVertexArrayVertexBuffer(meshVAO, 1, normVBO, 0, 3 * sizeof(float));
-    glVertexArrayVertexBuffer(meshVAO, 2, uvVBO, 0, 2 * sizeof(float));
-
-    glEnableVertexArrayAttrib(meshVAO, 0);
-    glVertexArrayAttribFormat(meshVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
-    glVertexArrayAttribBinding(meshVAO, 0, 0);
-
-    glEnableVertexArrayAttrib(meshVAO, 1);
-    glVertexArrayAttribFormat(meshVAO, 1, 3, GL_FLOAT, GL_FALSE, 0);
-    glVertexArrayAttribBinding(meshVAO, 1, 1);
+    glCreateBuffers(1, &meshEBO);
+    glNamedBufferStorage(meshEBO, (GLsizeiptr)meshCache.IndicesSize(), meshCache.Indices(), 0);
+    glVertexArrayElementBuffer(meshVAO, meshEBO);
+    const GLenum meshIndexType = (meshCache.IndexSize() == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
-    glEnableVertexArrayAttrib(meshVAO, 2);
-    glVertexArrayAttribFormat(meshVAO, 2, 2, GL_FLOAT, GL_FALSE, 0);
-    glVertexArrayAttribBinding(meshVAO, 2, 2);
+    MeshVertexFormat meshFormat;
+    if (g_quantizeMesh)
+    {
+        cy::QuantizedMesh quantized;
+        if (QuantizeMesh(meshCache, quantized))
+        {
+            // Interleaved: snorm16 position, snorm16 octahedral normal, half float UV
+            glCreateBuffers(1, &posVBO);
+            glNamedBufferStorage(posVBO, (GLsizeiptr)quantized.VerticesSize(), quantized.vertices.data(), 0);
+            glVertexArrayVertexBuffer(meshVAO, 0, posVBO, 0, sizeof(cy::QuantizedVertex));
+
+            glEnableVertexArrayAttrib(meshVAO, 0);
+            glVertexArrayAttribFormat(meshVAO, 0, 3, GL_SHORT, GL_TRUE, offsetof(cy::QuantizedVertex, position));
+            glVertexArrayAttribBinding(meshVAO, 0, 0);
+
+            glEnableVertexArrayAttrib(meshVAO, 1);
+            glVertexArrayAttribFormat(meshVAO, 1, 2, GL_SHORT, GL_TRUE, offsetof(cy::QuantizedVertex, normal));
+            glVertexArrayAttribBinding(meshVAO, 1, 0);
+
+            glEnableVertexArrayAttrib(meshVAO, 2);
+            glVertexArrayAttribFormat(meshVAO, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(cy::QuantizedVertex, texCoord));
+            glVertexArrayAttribBinding(meshVAO, 2, 0);
+
+            meshFormat.quantized = true;
+            meshFormat.posScale = quantized.positionScale;
+            meshFormat.posOffset = quantized.positionOffset;
+        }
+    }
+    if (!meshFormat.quantized)
+    {
+        glCreateBuffers(1, &posVBO);
+        glCreateBuffers(1, &normVBO);
+        glCreateBuffers(1, &uvVBO);
+
+        // Uploaded directly from the mapped cache file on warm starts
+        glNamedBufferStorage(posVBO, (GLsizeiptr)meshCache.PositionsSize(), meshCache.Positions(), 0);
+        glNamedBufferStorage(normVBO, (GLsizeiptr)meshCache.NormalsSize(), meshCache.Normals(), 0);
+        glNamedBufferStorage(uvVBO, (GLsizeiptr)meshCache.TexCoordsSize(), meshCache.TexCoords(), 0);
+
+        glVertexArrayVertexBuffer(meshVAO, 0, posVBO, 0, 3 * sizeof(float));
+        glVertexArrayVertexBuffer(meshVAO, 1, normVBO, 0, 3 * sizeof(float));
+        glVertexArrayVertexBuffer(meshVAO, 2, uvVBO, 0, 2 * sizeof(float));
+
+        glEnableVertexArrayAttrib(meshVAO, 0);
+        glVertexArrayAttribFormat(meshVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(meshVAO, 0, 0);
+
+        glEnableVertexArrayAttrib(meshVAO, 1);
+        glVertexArrayAttribFormat(meshVAO, 1, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(meshVAO, 1, 1);
+
+        glEnableVertexArrayAttrib(meshVAO, 2);
+        glVertexArrayAttribFormat(meshVAO, 2, 2, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(meshVAO, 2, 2);
+    }
 
 	// Fullscreen Quad
     GLuint fsQuadVAO = 0, fsQuadVBO = 0;
@@ -1339,10 +1828,72 @@ int main(int argc, char** argv)
         return -1;
     }
 
-	glEnable(GL_DEPTH_TEST);
+    // Wait for the shader programs that are not compiled yet
+    auto shaderWaitStart = std::chrono::steady_clock::now();
+    unsigned int shadersReady = 0;
+    if (!FinishShader(litShader, "Failed to build lit shader.", shadersReady) ||
+        !FinishShader(motionShader, "Failed to build motion blur shader.", shadersReady) ||
+        !FinishShader(brightShader, "Failed to build bright extract shader.", shadersReady) ||
+        !FinishShader(blurShader, "Failed to build blur shader.", shadersReady) ||
+        !FinishShader(combineShader, "Failed to build combine shader.", shadersReady) ||
+        !FinishShader(toneMapShader, "Failed to build tone mapping shader.", shadersReady) ||
+        !FinishShader(gradingShader, "Failed to build color grading shader.", shadersReady) ||
+        !FinishShader(fxaaShader, "Failed to build FXAA shader.", shadersReady) ||
+        !FinishShader(motionVectorShader, "Failed to build motion vector shader.", shadersReady) ||
+        !FinishShader(debugDisplayShader, "Failed to build debug display shader.", shadersReady) ||
+        !FinishShader(depthShader, "Failed to build depth preview shader.", shadersReady))
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    PrintShaderBuildTime(11, shadersReady, shaderSubmitMs, shaderWaitStart);
+    litShader.GetUniforms();
+    meshFormat.SetUniforms(litShader.prog);
+    motionShader.GetUniforms();
+    brightShader.GetUniforms();
+    blurShader.GetUniforms();
+    combineShader.GetUniforms();
+    toneMapShader.GetUniforms();
+    gradingShader.GetUniforms();
+    fxaaShader.GetUniforms();
+    motionVectorShader.GetUniforms();
+    debugDisplayShader.GetUniforms();
+
+	g_glState.Enable(GL_DEPTH_TEST);
+
+    // Frame capture: each finished readback is copied to the frame writer, which encodes it on its worker threads
+    cy::FrameWriter frameWriter;
+    cy::FramebufferReadback readback;
+    readback.Create(3, [&frameWriter](const cy::FramebufferReadback::Frame& frame)
+    {
+        std::vector<unsigned char> rgba(frame.pixels, frame.pixels + (size_t)frame.width * frame.height * 4);
+        frameWriter.Write(std::move(rgba), frame.width, frame.height, true);
+    });
+    bool capturing = false;
+    uint64_t frameIndex = 0;
 
+    int lastLod = -1;
     while (!glfwWindowShouldClose(window))
     {
+        // Deliver the readbacks that are finished, then start or stop the capture requested with K
+        readback.Poll();
+        if (g_captureFrames != capturing)
+        {
+            capturing = g_captureFrames;
+            if (capturing)
+            {
+                frameWriter.Start(g_capturePrefix, g_captureEffort);
+                std::cout << "Capturing frames to " << g_capturePrefix << "*.png (" << cy::PngEffortName(g_captureEffort) << ")\n";
+            }
+            else
+            {
+                readback.Poll(true);
+                PrintCaptureStats(readback, frameWriter);
+            }
+        }
+        ++frameIndex;
+
         glfwGetFramebufferSize(window, &fbW, &fbH);
         if (fbW != sceneRT.width || fbH != sceneRT.height)
         {
@@ -1359,6 +1910,7 @@ int main(int argc, char** argv)
                 std::cerr << "ERROR: failed to resize render targets\n";
                 break;
             }
+            g_glState.Reset();  // the names of the deleted targets can be reused
         }
 
         // Camera Moverment
@@ -1387,227 +1939,202 @@ int main(int argc, char** argv)
         S.SetScale(g_objScale);
         cy::Matrix4f M = S * Tcenter;
 
+        // Level of detail: the coarsest level whose error stays below a pixel at the distance of the object center
+        cy::Vec4f objCenter4 = M * cy::Vec4f(g_objCenter.x, g_objCenter.y, g_objCenter.z, 1.0f);
+        float objDist = (camPosW - cy::Vec3f(objCenter4.x, objCenter4.y, objCenter4.z)).Length();
+        int lod = g_useLod ? SelectLod(meshCache, P, fbH, g_objScale, objDist, 1.0f) : 0;
+        if (lod != lastLod)
+        {
+            std::cout << "LOD " << lod << ": " << meshCache.GetLod(lod).faceCount << " triangles\n";
+            lastLod = lod;
+        }
+
 		// Pass1: Scene Render to Scene Render Target
-        glBindFramebuffer(GL_FRAMEBUFFER, sceneRT.fbo);
-        glViewport(0, 0, fbW, fbH);
-        glEnable(GL_DEPTH_TEST);
-        glClearColor(0.05f, 0.05f, 0.06f, 1.0f);
+        g_glState.BindFramebuffer(sceneRT.fbo);
+        g_glState.Viewport(0, 0, fbW, fbH);
+        g_glState.Enable(GL_DEPTH_TEST);
+        g_glState.ClearColor(0.05f, 0.05f, 0.06f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        litShader.prog.Bind();
-        litShader.prog.SetUniformMatrix4("uM", M.cell);
-        litShader.prog.SetUniformMatrix4("uV", V.cell);
-        litShader.prog.SetUniformMatrix4("uP", P.cell);
-
-        litShader.prog.SetUniform("uCamPosW", camPosW.x, camPosW.y, camPosW.z);
-        litShader.prog.SetUniform("uLightPosW", lightPosW.x, lightPosW.y, lightPosW.z);
-
-        litShader.prog.SetUniform("uKa", material.Ka.x, material.Ka.y, material.Ka.z);
-        litShader.prog.SetUniform("uKd", material.Kd.x, material.Kd.y, material.Kd.z);
-        litShader.prog.SetUniform("uKs", material.Ks.x, material.Ks.y, material.Ks.z);
-        litShader.prog.SetUniform("uKe", material.Ke.x, material.Ke.y, material.Ke.z);
-        litShader.prog.SetUniform("uNs", material.Ns);
-        litShader.prog.SetUniform("uAmbientColor", 0.16f, 0.16f, 0.18f);
-        litShader.prog.SetUniform("uLightColor", 1.0f, 0.96f, 0.90f);
-        litShader.prog.SetUniform("uDiffuseTex", 0);
-        litShader.prog.SetUniform("uSpecularTex", 1);
-        litShader.prog.SetUniform("uHasDiffuseTex", kdTex ? 1 : 0);
-        litShader.prog.SetUniform("uHasSpecularTex", ksTex ? 1 : 0);
-
-        glBindTextureUnit(0, kdTex);
-        glBindTextureUnit(1, ksTex);
-
-        glBindVertexArray(meshVAO);
-        glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(mesh.NF() * 3));
-
+        FrameUniforms& frame = frameUniforms[0];
+        frame.V = V;
+        frame.P = P;
+        frame.camPosW = camPosW;
+        frame.lightPosW = lightPosW;
+        frame.ambientColor = cy::Vec3f(0.16f, 0.16f, 0.18f);
+        frame.lightColor = cy::Vec3f(1.0f, 0.96f, 0.90f);
+        frameUniforms.Update();
+
+        g_glState.UseProgram(litShader.prog);
+        litShader.uM.Set(M);
+        litShader.uMaterialID.Set(0);
+
+        g_glState.BindTextureUnit(0, kdTex);
+        g_glState.BindTextureUnit(1, ksTex);
+        textureManager.Use(kdTex);
+        textureManager.Use(ksTex);
+
+        // Meshlets outside the view frustum, or facing away with backface culling, are not drawn
+        cy::MeshletCuller culler;
+        culler.Set(P, V * M, g_backfaceCulling ? cy::MeshletCuller::CULL_BACK : cy::MeshletCuller::CULL_NONE);
+        g_glState.SetCapability(GL_CULL_FACE, g_backfaceCulling);
+
+        g_glState.BindVertexArray(meshVAO);
+        DrawLod(meshCache, culler, meshIndexType, lod, meshCache.GetLod(lod).firstFace, meshCache.GetLod(lod).faceCount);
+        g_glState.Disable(GL_CULL_FACE);
+
+        // The fullscreen passes below write every pixel without blending, so their targets are not cleared
         if (g_showDepth)
         {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            depthShader.prog.Bind();
-            depthShader.prog.SetUniform("uSceneDepth", 0);
-            glBindTextureUnit(0, sceneRT.depthTex);
+            g_glState.BindFramebuffer(0);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(depthShader.prog);
+            g_glState.BindTextureUnit(0, sceneRT.depthTex);
             DrawFullscreenQuad(fsQuadVAO);
         }
         else
         {
 			// Pass2: Motion Blur to Motion Render Target
-            glBindFramebuffer(GL_FRAMEBUFFER, motionRT.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            motionShader.prog.Bind();
-            motionShader.prog.SetUniform("uSceneColor", 0);
-            motionShader.prog.SetUniform("uSceneDepth", 1);
-            motionShader.prog.SetUniform("uEnableMotionBlur", (g_enableMotionBlur && g_hasPrevFrame) ? 1 : 0);
-            motionShader.prog.SetUniformMatrix4("uCurrInvVP", currentInvVP.cell);
-            motionShader.prog.SetUniformMatrix4("uPrevVP", g_prevVP.cell);
-            glBindTextureUnit(0, sceneRT.colorTex);
-            glBindTextureUnit(1, sceneRT.depthTex);
+            g_glState.BindFramebuffer(motionRT.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(motionShader.prog);
+            motionShader.uEnableMotionBlur.Set((g_enableMotionBlur && g_hasPrevFrame) ? 1 : 0);
+            motionShader.uCurrInvVP.Set(currentInvVP);
+            motionShader.uPrevVP.Set(g_prevVP);
+            g_glState.BindTextureUnit(0, sceneRT.colorTex);
+            g_glState.BindTextureUnit(1, sceneRT.depthTex);
             DrawFullscreenQuad(fsQuadVAO);
 
 			// Pass2.5: Motion Vector to Motion Vector Render Target (for debug display)
-            glBindFramebuffer(GL_FRAMEBUFFER, motionVectorRT.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            motionVectorShader.prog.Bind();
-            motionVectorShader.prog.SetUniform("uSceneDepth", 0);
-            motionVectorShader.prog.SetUniformMatrix4("uCurrInvVP", currentInvVP.cell);
-            motionVectorShader.prog.SetUniformMatrix4("uPrevVP", g_prevVP.cell);
-            glBindTextureUnit(0, sceneRT.depthTex);
+            g_glState.BindFramebuffer(motionVectorRT.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(motionVectorShader.prog);
+            motionVectorShader.uCurrInvVP.Set(currentInvVP);
+            motionVectorShader.uPrevVP.Set(g_prevVP);
+            g_glState.BindTextureUnit(0, sceneRT.depthTex);
             DrawFullscreenQuad(fsQuadVAO);
 
 			// Pass3: Bright Extract to Bloom Brightness Render Target
-            glBindFramebuffer(GL_FRAMEBUFFER, bloomBrightRT.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            brightShader.prog.Bind();
-            brightShader.prog.SetUniform("uInputTex", 0);
-            brightShader.prog.SetUniform("uThreshold", g_bloomThreshold);
-            brightShader.prog.SetUniform("uEnableBloom", g_enableBloom ? 1 : 0);
-            glBindTextureUnit(0, motionRT.colorTex);
+            g_glState.BindFramebuffer(bloomBrightRT.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(brightShader.prog);
+            brightShader.uThreshold.Set(g_bloomThreshold);
+            brightShader.uEnableBloom.Set(g_enableBloom ? 1 : 0);
+            g_glState.BindTextureUnit(0, motionRT.colorTex);
             DrawFullscreenQuad(fsQuadVAO);
 
 			// Pass4: Blur (Horizontal) to Bloom Blur Render Target 1
-            glBindFramebuffer(GL_FRAMEBUFFER, bloomBlurRT1.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            blurShader.prog.Bind();
-            blurShader.prog.SetUniform("uInputTex", 0);
-            blurShader.prog.SetUniform("uTexelSize", 1.0f / (float)fbW, 1.0f / (float)fbH);
-            blurShader.prog.SetUniform("uHorizontal", 1);
-            glBindTextureUnit(0, bloomBrightRT.colorTex);
+            g_glState.BindFramebuffer(bloomBlurRT1.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(blurShader.prog);
+            blurShader.uTexelSize.Set(cy::Vec2f(1.0f / (float)fbW, 1.0f / (float)fbH));
+            blurShader.uHorizontal.Set(1);
+            g_glState.BindTextureUnit(0, bloomBrightRT.colorTex);
             DrawFullscreenQuad(fsQuadVAO);
 
 			// Pass5: Blur (Vertical) to Bloom Blur Render Target 2
-            glBindFramebuffer(GL_FRAMEBUFFER, bloomBlurRT2.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            blurShader.prog.Bind();
-            blurShader.prog.SetUniform("uInputTex", 0);
-            blurShader.prog.SetUniform("uTexelSize", 1.0f / (float)fbW, 1.0f / (float)fbH);
-            blurShader.prog.SetUniform("uHorizontal", 0);
-            glBindTextureUnit(0, bloomBlurRT1.colorTex);
+            g_glState.BindFramebuffer(bloomBlurRT2.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(blurShader.prog);
+            blurShader.uTexelSize.Set(cy::Vec2f(1.0f / (float)fbW, 1.0f / (float)fbH));
+            blurShader.uHorizontal.Set(0);
+            g_glState.BindTextureUnit(0, bloomBlurRT1.colorTex);
             DrawFullscreenQuad(fsQuadVAO);
 
 			// Pass6: Combine Scene + Bloom to Combine Render Target
-            glBindFramebuffer(GL_FRAMEBUFFER, combineRT.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            combineShader.prog.Bind();
-            combineShader.prog.SetUniform("uSceneTex", 0);
-            combineShader.prog.SetUniform("uBloomTex", 1);
-            combineShader.prog.SetUniform("uEnableBloom", g_enableBloom ? 1 : 0);
-            combineShader.prog.SetUniform("uBloomStrength", g_bloomStrength);
-            glBindTextureUnit(0, motionRT.colorTex);
-            glBindTextureUnit(1, bloomBlurRT2.colorTex);
+            g_glState.BindFramebuffer(combineRT.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(combineShader.prog);
+            combineShader.uEnableBloom.Set(g_enableBloom ? 1 : 0);
+            combineShader.uBloomStrength.Set(g_bloomStrength);
+            g_glState.BindTextureUnit(0, motionRT.colorTex);
+            g_glState.BindTextureUnit(1, bloomBlurRT2.colorTex);
             DrawFullscreenQuad(fsQuadVAO);
 
 			// Pass7: Tone Mapping to ToneMap Render Target
-            glBindFramebuffer(GL_FRAMEBUFFER, toneMapRT.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            toneMapShader.prog.Bind();
-            toneMapShader.prog.SetUniform("uInputTex", 0);
-            toneMapShader.prog.SetUniform("uEnableToneMapping", g_enableToneMapping ? 1 : 0);
-            toneMapShader.prog.SetUniform("uExposure", g_exposure);
-            toneMapShader.prog.SetUniform("uToneMapMode", g_toneMapMode);
-            glBindTextureUnit(0, combineRT.colorTex);
+            g_glState.BindFramebuffer(toneMapRT.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(toneMapShader.prog);
+            toneMapShader.uEnableToneMapping.Set(g_enableToneMapping ? 1 : 0);
+            toneMapShader.uExposure.Set(g_exposure);
+            toneMapShader.uToneMapMode.Set(g_toneMapMode);
+            g_glState.BindTextureUnit(0, combineRT.colorTex);
             DrawFullscreenQuad(fsQuadVAO);
 
             // Pass8: Color Grading to Grade Render Target
-            glBindFramebuffer(GL_FRAMEBUFFER, gradeRT.fbo);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            gradingShader.prog.Bind();
-            gradingShader.prog.SetUniform("uInputTex", 0);
-            gradingShader.prog.SetUniform("uEnableColorGrading", g_enableColorGrading ? 1 : 0);
-            gradingShader.prog.SetUniform("uSaturation", g_gradeSaturation);
-            gradingShader.prog.SetUniform("uContrast", g_gradeContrast);
-            gradingShader.prog.SetUniform("uBrightness", g_gradeBrightness);
-            gradingShader.prog.SetUniform("uColorFilter", g_colorFilter.x, g_colorFilter.y, g_colorFilter.z);
-            glBindTextureUnit(0, toneMapRT.colorTex);
+            g_glState.BindFramebuffer(gradeRT.fbo);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(gradingShader.prog);
+            gradingShader.uEnableColorGrading.Set(g_enableColorGrading ? 1 : 0);
+            gradingShader.uSaturation.Set(g_gradeSaturation);
+            gradingShader.uContrast.Set(g_gradeContrast);
+            gradingShader.uBrightness.Set(g_gradeBrightness);
+            gradingShader.uColorFilter.Set(g_colorFilter);
+            g_glState.BindTextureUnit(0, toneMapRT.colorTex);
             DrawFullscreenQuad(fsQuadVAO);
 
 			// Pass9: FXAA to Screen
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
-            glViewport(0, 0, fbW, fbH);
-            glDisable(GL_DEPTH_TEST);
-            glClearColor(0.f, 0.f, 0.f, 1.f);
-            glClear(GL_COLOR_BUFFER_BIT);
-
-            fxaaShader.prog.Bind();
-            fxaaShader.prog.SetUniform("uInputTex", 0);
-            fxaaShader.prog.SetUniform("uEnableFXAA", g_enableFXAA ? 1 : 0);
-            fxaaShader.prog.SetUniform("uInvScreenSize", 1.0f / (float)fbW, 1.0f / (float)fbH);
-            glBindTextureUnit(0, gradeRT.colorTex);
+            g_glState.BindFramebuffer(0);
+            g_glState.Viewport(0, 0, fbW, fbH);
+            g_glState.Disable(GL_DEPTH_TEST);
+
+            g_glState.UseProgram(fxaaShader.prog);
+            fxaaShader.uEnableFXAA.Set(g_enableFXAA ? 1 : 0);
+            fxaaShader.uInvScreenSize.Set(cy::Vec2f(1.0f / (float)fbW, 1.0f / (float)fbH));
+            g_glState.BindTextureUnit(0, gradeRT.colorTex);
             DrawFullscreenQuad(fsQuadVAO);
 
+            // Capture the FXAA output before the debug views are drawn over it
+            if (capturing)
+                readback.Capture(0, 0, 0, (unsigned int)fbW, (unsigned int)fbH, frameIndex);
+
             if (g_showDebugViews)
             {
                 const int pad = 12;
 				const int debugW = fbW / 4;
 				const int debugH = fbH / 4;
 
-                debugDisplayShader.prog.Bind();
+                g_glState.UseProgram(debugDisplayShader.prog);
 
                 // Top-right: Scene
-                glViewport(fbW - debugW - pad, fbH - debugH - pad, debugW, debugH);
-                debugDisplayShader.prog.SetUniform("uInputTex", 0);
-                debugDisplayShader.prog.SetUniform("uApplyToneMap", 1);
-                glBindTextureUnit(0, sceneRT.colorTex);
+                g_glState.Viewport(fbW - debugW - pad, fbH - debugH - pad, debugW, debugH);
+                debugDisplayShader.uApplyToneMap.Set(1);
+                g_glState.BindTextureUnit(0, sceneRT.colorTex);
                 DrawFullscreenQuad(fsQuadVAO);
 
                 // Mid-right: Bloom Bright
-                glViewport(fbW - debugW - pad, fbH - 2 * debugH - 2 * pad, debugW, debugH);
-                debugDisplayShader.prog.SetUniform("uInputTex", 0);
-                debugDisplayShader.prog.SetUniform("uApplyToneMap", 1);
-                glBindTextureUnit(0, bloomBrightRT.colorTex);
+                g_glState.Viewport(fbW - debugW - pad, fbH - 2 * debugH - 2 * pad, debugW, debugH);
+                g_glState.BindTextureUnit(0, bloomBrightRT.colorTex);
                 DrawFullscreenQuad(fsQuadVAO);
 
                 // Bottom-left: Bloom Blur
-                glViewport(pad, pad, debugW, debugH);
-                debugDisplayShader.prog.SetUniform("uInputTex", 0);
-                debugDisplayShader.prog.SetUniform("uApplyToneMap", 1);
-                glBindTextureUnit(0, bloomBlurRT2.colorTex);
+                g_glState.Viewport(pad, pad, debugW, debugH);
+                g_glState.BindTextureUnit(0, bloomBlurRT2.colorTex);
                 DrawFullscreenQuad(fsQuadVAO);
 
                 // Bottom-right: Motion Vector
-                glViewport(fbW - debugW - pad, pad, debugW, debugH);
-                debugDisplayShader.prog.SetUniform("uInputTex", 0);
-                debugDisplayShader.prog.SetUniform("uApplyToneMap", 0);
-                glBindTextureUnit(0, motionVectorRT.colorTex);
+                g_glState.Viewport(fbW - debugW - pad, pad, debugW, debugH);
+                debugDisplayShader.uApplyToneMap.Set(0);
+                g_glState.BindTextureUnit(0, motionVectorRT.colorTex);
                 DrawFullscreenQuad(fsQuadVAO);
-
-                // Restore viewport for next frame safety
-                glViewport(0, 0, fbW, fbH);
             }
         }
 
@@ -1615,10 +2142,30 @@ int main(int argc, char** argv)
         g_prevVP = currentVP;
         g_hasPrevFrame = true;
 
+        // Keep the material textures within the budget, then report their residency if requested
+        textureManager.Update();
+        if (g_printTextureResidency)
+        {
+            g_printTextureResidency = false;
+            PrintTextureResidency(textureManager);
+        }
+
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
+    // Deliver the captures in flight and wait for their files
+    if (readback.NumCaptured() > 0)
+    {
+        readback.Poll(true);
+        frameWriter.Wait();
+        PrintCaptureStats(readback, frameWriter);
+    }
+    PrintGLStateStats(g_glState, frameIndex);
+    readback.Delete();
+    frameUniforms.Delete();
+    materialUniforms.Delete();
+
 	// Destroy Render Targets
     DestroyColorRenderTarget(motionVectorRT);
     DestroyColorRenderTarget(gradeRT);
@@ -1630,13 +2177,12 @@ int main(int argc, char** argv)
     DestroyColorRenderTarget(motionRT);
     DestroySceneRenderTarget(sceneRT);
 
-    if (kdTex) 
-        glDeleteTextures(1, &kdTex);
-    if (ksTex) 
-        glDeleteTextures(1, &ksTex);
+    textureManager.Clear();
 
     glDeleteBuffers(1, &fsQuadVBO);
     glDeleteVertexArrays(1, &fsQuadVAO);
+    glDeleteBuffers(1, &meshEBO);
+    glDeleteBuffers(1, &uvVBO);
     glDeleteBuffers(1, &normVBO);
     glDeleteBuffers(1, &posVBO);
     glDeleteVertexArrays(1, &meshVAO);
@@ -1,11 +1,25 @@
 ﻿#include <iostream>
 #include <array>
+#include <chrono>
+#include <filesystem>
+#include <cstddef>
+#include <unordered_set>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include "cyMatrix.h"
 #include "cyGL.h"
 #include "cyTriMesh.h"
-#include "cyMatrix.h"
+#include "cyMeshCache.h"
+#include "cyCookedTexture.h"
+#include "cyTextureManager.h"
+#include "cyQuantizedMesh.h"
+#include "cyImageLoader.h"
+#include "cyPixelUnpackRing.h"
+#include "cyFramebufferReadback.h"
+#include "cyFrameWriter.h"
+#include "cyUniformBuffer.h"
+#include "cyGLState.h"
 #include "lodepng.h"
 
 
@@ -42,6 +56,34 @@ static float g_lightYaw = 0.7f;
 static float g_lightPitch = 0.4f;
 static float g_lightRadius = 3.0f;
 
+// Mesh vertex format: 16 B quantized interleaved vertices instead of 32 B float streams
+static bool g_quantizeMesh = true;
+
+// Back-face culling of the mesh; meshlets whose normal cone faces away from the camera are skipped on the CPU
+static bool g_backfaceCulling = false;
+
+// Simplified levels of detail of the mesh, selected by their projected error
+static bool g_useLod = true;
+
+// Block compression of the material textures, applied when they are cooked
+static cy::BlockFormat g_diffuseMapFormat = cy::BLOCK_BC7;
+static cy::BlockFormat g_specularMapFormat = cy::BLOCK_BC1;
+
+// Memory budget of the material textures; the top levels of the least recently used ones are evicted above it
+static size_t g_textureBudgetMB = 256;
+static bool g_printTextureResidency = false;
+
+// Frame capture: the default framebuffer is read back a few frames late and written as a numbered PNG sequence
+static bool g_captureFrames = false;
+static cy::PngEffort g_captureEffort = cy::PNG_FAST;
+static const char* g_capturePrefix = "capture/frame_";
+
+// Linked shader programs are stored here and loaded back at the next start instead of compiling the shaders
+static const char* g_shaderCacheDir = "shader_cache";
+
+// The passes change the framebuffer, viewport, program, vertex array, texture and capability state through this cache
+static cy::GLStateCache g_glState;
+
 // Texture
 struct TexturePaths
 {
@@ -64,6 +106,57 @@ struct GPUMaterial
 	bool hasKd = false;
 	bool hasKs = false;
 };
+
+// Uniform blocks of the lit shaders (std140). FrameBlock holds the matrices and lights of a view and is
+// written once per frame: element 0 is the camera view and element 1 the mirrored view of the reflection.
+// The MaterialBuffer storage block (std430) holds all materials and the plane material after them, and the
+// draws select theirs with uMaterialID; unlike a uniform block, it has no limit on the number of materials.
+static const GLuint kFrameBlockBinding = 0;
+static const GLuint kMaterialBufferBinding = 1;
+static const GLuint kMirrorFrameBlockBinding = 2;
+
+struct FrameUniforms
+{
+    cy::Matrix4f V;
+    cy::Matrix4f P;
+    cy::Matrix4f lightVP;
+    cy::Vec3f camPosW;
+    float spotCosInner;
+    cy::Vec3f lightPosW;
+    float spotCosOuter;
+    cy::Vec3f lightDirW;
+    float pad;
+};
+static_assert(sizeof(FrameUniforms) == 240, "FrameUniforms must match the std140 layout of FrameBlock");
+
+struct MaterialUniforms
+{
+    cy::Vec3f Ka{ 0, 0, 0 };
+    float Ns = 0.0f;
+    cy::Vec3f Kd{ 1, 1, 1 };
+    float Ni = 1.0f;
+    cy::Vec3f Ks{ 0, 0, 0 };
+    int illum = 2;
+    cy::Vec3f Tf{ 0, 0, 0 };
+    int hasDiffuseTex = 0;
+    int hasSpecularTex = 0;
+    int pad[3] = {};
+};
+static_assert(sizeof(MaterialUniforms) == 80, "MaterialUniforms must match the std430 layout of MaterialData");
+
+// Destination of a decoded image: a face of the environment cubemap or a material texture
+// Size of the persistently mapped buffer that texture uploads go through
+static const size_t kUploadRingSize = 64 << 20;
+
+// Lets the image loader decode directly into the upload ring. The workers wait for free space,
+// which the main thread makes by retiring the finished uploads.
+struct UploadRingAllocator : public cy::ImageLoader::Allocator
+{
+    cy::PixelUnpackRing& ring;
+    explicit UploadRingAllocator(cy::PixelUnpackRing& r) : ring(r) {}
+    unsigned char* Allocate(cy::ImageLoader::Image& image) override { return ring.Allocate(size_t(image.width) * image.height * 4, image.offset); }
+    void Free(cy::ImageLoader::Image& image) override { ring.Cancel(image.offset); }
+};
 // ------------------------------
 
 
@@ -82,9 +175,11 @@ struct Shader
         #version 460 core
         layout(location=0) in vec3 aPos;
         uniform mat4 uMVP;
+        uniform vec3 uPosScale = vec3(1.0);
+        uniform vec3 uPosOffset = vec3(0.0);
         void main()
         {
-            gl_Position = uMVP * vec4(aPos, 1.0);
+            gl_Position = uMVP * vec4(aPos * uPosScale + uPosOffset, 1.0);
             gl_PointSize = 2.0;
         }
     )GLSL";
@@ -97,6 +192,28 @@ struct Shader
             FragColor = vec4(1.0, 1.0, 1.0, 1.0); // constant color white
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program.
+    // The camera, the light and the materials come from the uniform blocks.
+    cy::GLSLUniform<cy::Matrix4f> uM;
+    cy::GLSLUniform<int> uMaterialID;
+    cy::GLSLUniform<int> uVisMode;
+    cy::GLSLUniform<float> uReflectStrength;
+    cy::GLSLUniform<cy::Vec3f> uPosScale;
+    cy::GLSLUniform<cy::Vec3f> uPosOffset;
+    cy::GLSLUniform<int> uOctNormal;
+
+    // Gets the uniform handles; the program is rebuilt with F6, so this is called after every build
+    void GetUniforms()
+    {
+        uM = prog.GetUniform<cy::Matrix4f>("uM");
+        uMaterialID = prog.GetUniform<int>("uMaterialID");
+        uVisMode = prog.GetUniform<int>("uVisMode");
+        uReflectStrength = prog.GetUniform<float>("uReflectStrength");
+        uPosScale = prog.GetUniform<cy::Vec3f>("uPosScale");
+        uPosOffset = prog.GetUniform<cy::Vec3f>("uPosOffset");
+        uOctNormal = prog.GetUniform<int>("uOctNormal");
+    }
 };
 
 // Plane shader (render to a quad)
@@ -152,7 +269,7 @@ struct SkyboxShader
         #version 460 core
         in vec3 vDirW;
         out vec4 FragColor;
-        uniform samplerCube uEnv;
+        layout(binding = 0) uniform samplerCube uEnv;
         void main()
         {
             vec3 dir = normalize(vDirW);
@@ -160,6 +277,17 @@ struct SkyboxShader
             FragColor = vec4(c, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<cy::Matrix4f> uProj;
+    cy::GLSLUniform<cy::Matrix4f> uView;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uProj = prog.GetUniform<cy::Matrix4f>("uProj");
+        uView = prog.GetUniform<cy::Matrix4f>("uView");
+    }
 };
 
 struct ReflectShader
@@ -170,9 +298,18 @@ struct ReflectShader
         #version 460 core
         layout(location=0) in vec3 aPos;
         layout(location=2) in vec2 aUV;
+        layout(std140, binding = 0) uniform FrameBlock
+        {
+            mat4 uV;
+            mat4 uP;
+            mat4 uLightVP;
+            vec3 uCamPosW;
+            float uSpotCosInner;
+            vec3 uLightPosW;
+            float uSpotCosOuter;
+            vec3 uLightDirW;
+        };
         uniform mat4 uM;
-        uniform mat4 uV;
-        uniform mat4 uP;
         out vec4 vWorldPos;
         void main()
         {
@@ -184,16 +321,30 @@ struct ReflectShader
         #version 460 core
         in vec4 vWorldPos;
         out vec4 FragColor;
-        uniform mat4 uVref;
-        uniform mat4 uPref;
-        uniform sampler2D uReflectionTex;
-        uniform vec3 uCamPosW;
+        layout(std140, binding = 0) uniform FrameBlock
+        {
+            mat4 uV;
+            mat4 uP;
+            mat4 uLightVP;
+            vec3 uCamPosW;
+            float uSpotCosInner;
+            vec3 uLightPosW;
+            float uSpotCosOuter;
+            vec3 uLightDirW;
+        };
+        // The mirrored view that the reflection texture is rendered with
+        layout(std140, binding = 2) uniform MirrorFrameBlock
+        {
+            mat4 V;
+            mat4 P;
+        } uMirror;
+        layout(binding = 0) uniform sampler2D uReflectionTex;
         uniform vec3 uFadeCenterW;
         uniform float uFadeRadius;
         uniform float uReflectOpacity;
         void main()
         {
-            vec4 clip = uPref * uVref * vWorldPos;
+            vec4 clip = uMirror.P * uMirror.V * vWorldPos;
             vec2 uv = (clip.xy / clip.w) * 0.5 + 0.5;
             float inside = step(0.0, uv.x) * step(uv.x, 1.0) * step(0.0, uv.y) * step(uv.y, 1.0);
             vec3 planar = texture(uReflectionTex, clamp(uv, 0.0, 1.0)).rgb;
@@ -208,6 +359,19 @@ struct ReflectShader
             FragColor = vec4(planar, alpha);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<cy::Matrix4f> uM;
+    cy::GLSLUniform<float> uFadeRadius;
+    cy::GLSLUniform<float> uReflectOpacity;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uM = prog.GetUniform<cy::Matrix4f>("uM");
+        uFadeRadius = prog.GetUniform<float>("uFadeRadius");
+        uReflectOpacity = prog.GetUniform<float>("uReflectOpacity");
+    }
 };
 
 struct ShadowDepthShader
@@ -217,10 +381,23 @@ struct ShadowDepthShader
     const char* vs = R"GLSL(
         #version 460 core
         layout(location=0) in vec3 aPos;
-        uniform mat4 uLightMVP;
+        layout(std140, binding = 0) uniform FrameBlock
+        {
+            mat4 uV;
+            mat4 uP;
+            mat4 uLightVP;
+            vec3 uCamPosW;
+            float uSpotCosInner;
+            vec3 uLightPosW;
+            float uSpotCosOuter;
+            vec3 uLightDirW;
+        };
+        uniform mat4 uM;
+        uniform vec3 uPosScale = vec3(1.0);
+        uniform vec3 uPosOffset = vec3(0.0);
         void main()
         {
-            gl_Position = uLightMVP * vec4(aPos, 1.0);
+            gl_Position = uLightVP * uM * vec4(aPos * uPosScale + uPosOffset, 1.0);
         }
     )GLSL";
 
@@ -228,6 +405,21 @@ struct ShadowDepthShader
         #version 460 core
         void main() { }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<cy::Matrix4f> uM;
+    cy::GLSLUniform<cy::Vec3f> uPosScale;
+    cy::GLSLUniform<cy::Vec3f> uPosOffset;
+    cy::GLSLUniform<int> uOctNormal;     // not used by the depth pass, so the handle is not valid
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uM = prog.GetUniform<cy::Matrix4f>("uM");
+        uPosScale = prog.GetUniform<cy::Vec3f>("uPosScale");
+        uPosOffset = prog.GetUniform<cy::Vec3f>("uPosOffset");
+        uOctNormal = prog.GetUniform<int>("uOctNormal");
+    }
 };
 
 struct LightMarkerShader
@@ -237,9 +429,18 @@ struct LightMarkerShader
     const char* vs = R"GLSL(
         #version 460 core
         layout(location=0) in vec3 aPos;
+        layout(std140, binding = 0) uniform FrameBlock
+        {
+            mat4 uV;
+            mat4 uP;
+            mat4 uLightVP;
+            vec3 uCamPosW;
+            float uSpotCosInner;
+            vec3 uLightPosW;
+            float uSpotCosOuter;
+            vec3 uLightDirW;
+        };
         uniform mat4 uM;
-        uniform mat4 uV;
-        uniform mat4 uP;
         void main()
         {
             gl_Position = uP * uV * uM * vec4(aPos, 1.0);
@@ -255,10 +456,132 @@ struct LightMarkerShader
             FragColor = vec4(uColor, 1.0);
         }
     )GLSL";
+
+    // Uniform handles, set with glProgramUniform without binding the program
+    cy::GLSLUniform<cy::Matrix4f> uM;
+    cy::GLSLUniform<cy::Vec3f> uColor;
+
+    // Gets the uniform handles
+    void GetUniforms()
+    {
+        uM = prog.GetUniform<cy::Matrix4f>("uM");
+        uColor = prog.GetUniform<cy::Vec3f>("uColor");
+    }
 };
 // ------------------------------
 
 // Helping tools
+// Print file load time & throughput
+static void PrintLoadTime(const char* label, const char* path, std::chrono::steady_clock::time_point start)
+{
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::error_code ec;
+    double mb = (double)std::filesystem::file_size(path, ec) / (1024.0 * 1024.0);
+    if (ec)
+        mb = 0.0;
+    std::cout << label << ": " << mb << " MB in " << ms << " ms (" << (ms > 0.0 ? mb * 1000.0 / ms : 0.0) << " MB/s)\n";
+}
+
+// Print the vertex reduction of the indexed mesh compared to one vertex per face corner
+static void PrintMeshStats(const cy::MeshCache& meshCache)
+{
+    const double vertexSize = (3 + 3 + 2) * sizeof(float);
+    const double mb = 1.0 / (1024.0 * 1024.0);
+    double flatSize = meshCache.NumIndices() * vertexSize * mb;
+    double indexedSize = (meshCache.NumVertices() * vertexSize + meshCache.IndicesSize()) * mb;
+    std::cout << "Mesh: " << meshCache.NumIndices() << " corners -> " << meshCache.NumVertices() << " vertices, "
+              << meshCache.IndexSize() * 8 << "-bit indices, " << flatSize << " MB -> " << indexedSize << " MB\n";
+    const cy::VertexCacheStats& before = meshCache.GetOriginalCacheStats();
+    const cy::VertexCacheStats& after = meshCache.GetOptimizedCacheStats();
+    std::cout << "Vertex cache (" << after.cacheSize << " entries): ACMR " << before.acmr << " -> " << after.acmr
+              << ", ATVR " << before.atvr << " -> " << after.atvr << "\n";
+    unsigned int numCones = 0;
+    for (unsigned int i = 0; i < meshCache.NumMeshlets(); ++i)
+        numCones += meshCache.GetMeshlet((int)i).HasCone() ? 1 : 0;
+    if (meshCache.NumMeshlets() > 0)
+        std::cout << "Meshlets: " << meshCache.NumMeshlets() << ", " << (double)meshCache.NumFaces() / meshCache.NumMeshlets()
+                  << " triangles on average, " << 100.0 * numCones / meshCache.NumMeshlets() << "% with normal cones\n";
+    for (unsigned int i = 1; i < meshCache.NumLods(); ++i)
+        std::cout << "LOD " << i << ": " << meshCache.GetLod((int)i).faceCount << " triangles, error " << meshCache.GetLod((int)i).error << "\n";
+}
+
+// Draw the faces of the given range whose meshlets pass the culler; adjacent visible meshlets are merged into one draw
+static void DrawMeshlets(const cy::MeshCache& meshCache, const cy::MeshletCuller& culler, GLenum indexType, unsigned int firstFace, unsigned int faceCount)
+{
+    static std::vector<cy::FaceRange> visible;
+    static std::vector<GLsizei> counts;
+    static std::vector<const void*> offsets;
+    visible.clear();
+    cy::CullMeshlets(visible, meshCache.Meshlets(), meshCache.NumMeshlets(), culler, firstFace, faceCount);
+    counts.resize(visible.size());
+    offsets.resize(visible.size());
+    for (size_t i = 0; i < visible.size(); ++i)
+    {
+        counts[i] = (GLsizei)visible[i].faceCount * 3;
+        offsets[i] = (const void*)((size_t)visible[i].firstFace * 3 * meshCache.IndexSize());
+    }
+    if (!visible.empty())
+        glMultiDrawElements(GL_TRIANGLES, counts.data(), indexType, offsets.data(), (GLsizei)visible.size());
+}
+
+// Select the coarsest level of detail whose error projects to at most maxPixels at the given distance.
+// P(1,1) is cot(fovy/2) for a perspective projection and 1/halfHeight for an orthographic one.
+static int SelectLod(const cy::MeshCache& meshCache, const cy::Matrix4f& P, int fbH, float objScale, float distance, float maxPixels)
+{
+    bool perspective = P(3, 3) == 0.0f;
+    float pixelsPerUnit = P(1, 1) * 0.5f * (float)fbH;
+    if (perspective)
+        pixelsPerUnit /= (distance > 1e-4f) ? distance : 1e-4f;
+    int lod = 0;
+    for (unsigned int i = 1; i < meshCache.NumLods(); ++i)
+    {
+        if (meshCache.GetLod((int)i).error * objScale * pixelsPerUnit <= maxPixels)
+            lod = (int)i;
+    }
+    return lod;
+}
+
+// Draw a face range of the given level of detail; only the full mesh has meshlets to cull
+static void DrawLod(const cy::MeshCache& meshCache, const cy::MeshletCuller& culler, GLenum indexType, int lod, unsigned int firstFace, unsigned int faceCount)
+{
+    if (lod == 0)
+        DrawMeshlets(meshCache, culler, indexType, firstFace, faceCount);
+    else if (faceCount > 0)
+        glDrawElements(GL_TRIANGLES, (GLsizei)faceCount * 3, indexType, (const void*)((size_t)firstFace * 3 * meshCache.IndexSize()));
+}
+
+// Dequantization parameters of the mesh vertex format (identity for float vertices)
+struct MeshVertexFormat
+{
+    bool quantized = false;
+    cy::Vec3f posScale = cy::Vec3f(1.0f, 1.0f, 1.0f);
+    cy::Vec3f posOffset = cy::Vec3f(0.0f, 0.0f, 0.0f);
+
+    // Sets the uniforms through the handles of a shader that has uPosScale, uPosOffset, and uOctNormal
+    template <typename ShaderType>
+    void SetUniforms(const ShaderType& shader) const
+    {
+        shader.uPosScale.Set(posScale);
+        shader.uPosOffset.Set(posOffset);
+        shader.uOctNormal.Set(quantized ? 1 : 0);
+    }
+};
+
+// Quantize the cached vertex streams and check the round-trip error before using them
+static bool QuantizeMesh(const cy::MeshCache& meshCache, cy::QuantizedMesh& quantized)
+{
+    quantized.Build(meshCache.Positions(), meshCache.Normals(), meshCache.TexCoords(), meshCache.NumVertices(), meshCache.GetBoundMin(), meshCache.GetBoundMax());
+    cy::QuantizationError error = quantized.MeasureError(meshCache.Positions(), meshCache.Normals(), meshCache.TexCoords());
+    std::cout << "Quantized vertices: " << sizeof(cy::QuantizedVertex) << " B/vertex, max error position " << error.position
+              << ", normal " << error.normalAngle << " deg, uv " << error.texCoord << "\n";
+    if (!quantized.IsAccurate(error))
+    {
+        std::cout << "Quantization error is above the tolerance, using float vertices.\n";
+        return false;
+    }
+    return true;
+}
+
 static float DegToRad(float deg) 
 {
     return deg * 3.1415926535f / 180.0f; 
@@ -372,7 +695,8 @@ static bool ReadTextFile(const std::string& path, std::string& outText)
     return true;
 }
 
-static bool BuildShaders(Shader& shader)
+// Submits the shader files, or the embedded fallback shaders if they are missing, without waiting for the driver
+static void SubmitShaders(Shader& shader)
 {
     std::string vsText, fsText;
     const char* vs = shader.vsFallback;
@@ -392,9 +716,17 @@ static bool BuildShaders(Shader& shader)
         std::cout << "[F6] Shader file(s) not found. Using embedded fallback shaders.\n" << "  Expected:\n" << "    " << shader.vsPath << "\n" << "    " << shader.fsPath << "\n";
     }
 
-    // cyGL: rebuild program
-    // Build<files=false, parse=false> : source strings
-    if (!shader.prog.Build<false, false>(vs, fs))
+    // cyGL: rebuild program, the driver keeps a copy of the sources
+    // BuildAsync<files=false, parse=false> : source strings
+    shader.prog.BuildAsync<false, false>(vs, fs);
+}
+
+// Waits for the program submitted by SubmitShaders; numReady counts it if it was already compiled
+static bool FinishShaders(Shader& shader, unsigned int* numReady = nullptr)
+{
+    if (numReady && shader.prog.IsReady())
+        ++*numReady;
+    if (!shader.prog.Finish())
     {
         std::cerr << "[F6] Shader build failed. Keeping previous program (if any).\n";
         return false;
@@ -404,64 +736,40 @@ static bool BuildShaders(Shader& shader)
     return true;
 }
 
-static bool BuildPlaneShader(PlaneShader& shader)
+static bool BuildShaders(Shader& shader)
 {
-    if (!shader.prog.Build<false, false>(shader.vs, shader.fs))
-    {
-        std::cerr << "Plane shader build failed.\n";
-        return false;
-    }
-    shader.built = true;
-    std::cout << "Plane shader build OK.\n";
-    return true;
+    SubmitShaders(shader);
+    return FinishShaders(shader);
 }
 
-static bool BuildSkyboxShader(SkyboxShader& shader)
+// Submits the program of a shader without waiting for the driver to compile it
+template <typename ShaderType>
+static void SubmitShader(ShaderType& shader)
 {
-    if (!shader.prog.Build<false, false>(shader.vs, shader.fs))
-    {
-        std::cerr << "Skybox shader build failed.\n";
-        return false;
-    }
-    shader.built = true;
-    std::cout << "Skybox shader build OK.\n";
-    return true;
+    shader.prog.template BuildAsync<false, false>(shader.vs, shader.fs);
 }
 
-static bool BuildReflectShader(ReflectShader& shader)
+// Waits for the program submitted by SubmitShader; numReady counts it if it was already compiled
+template <typename ShaderType>
+static bool FinishShader(ShaderType& shader, const char* name, unsigned int* numReady = nullptr)
 {
-    if (!shader.prog.Build<false, false>(shader.vs, shader.fs))
+    if (numReady && shader.prog.IsReady())
+        ++*numReady;
+    if (!shader.prog.Finish())
     {
-        std::cerr << "Reflection shader build failed.\n";
+        std::cerr << name << " shader build failed.\n";
         return false;
     }
     shader.built = true;
-    std::cout << "Reflection shader build OK.\n";
+    std::cout << name << " shader build OK.\n";
     return true;
 }
 
-static bool BuildShadowDepthShader(ShadowDepthShader& shader)
+template <typename ShaderType>
+static bool BuildShader(ShaderType& shader, const char* name)
 {
-    if (!shader.prog.Build<false, false>(shader.vs, shader.fs))
-    {
-        std::cerr << "Shadow depth shader build failed.\n";
-        return false;
-    }
-    shader.built = true;
-    std::cout << "Shadow depth shader build OK.\n";
-    return true;
-}
-
-static bool BuildLightMarkerShader(LightMarkerShader& shader)
-{
-    if (!shader.prog.Build<false, false>(shader.vs, shader.fs))
-    {
-        std::cerr << "Light marker shader build failed.\n";
-        return false;
-    }
-    shader.built = true;
-    std::cout << "Light marker shader build OK.\n";
-    return true;
+    SubmitShader(shader);
+    return FinishShader(shader, name);
 }
 
 static cy::Vec3f ComputeLightPosViewSpace(float camYaw, float camPitch, float camDist, float lightYaw, float lightPitch, float lightRadius)
@@ -482,78 +790,139 @@ static cy::Vec3f ComputeLightPosViewSpace(float camYaw, float camPitch, float ca
     return cy::Vec3f(lpv4.x, lpv4.y, lpv4.z);
 }
 
-static bool LoadPNGTexture(const std::string& pngPath, std::vector<unsigned char>& outRGBA, unsigned& outW, unsigned& outH)
+// Prints the quality and the memory of a block compressed texture against uncompressed RGBA
+static void PrintTextureCompression(const std::string& path, const cy::CookedTexture& cooked)
+{
+    if (cooked.GetFormat() == cy::BLOCK_NONE)
+        return;
+    const double rgbaMB = (double)cooked.RGBASize() / (1024.0 * 1024.0);
+    const double dataMB = (double)cooked.DataSize() / (1024.0 * 1024.0);
+    std::cout << "Texture compression: " << path << " " << cy::BlockFormatName(cooked.GetFormat()) << " PSNR " << cooked.GetPSNR() << " dB, "
+        << rgbaMB << " MB -> " << dataMB << " MB (" << (rgbaMB - dataMB) << " MB saved)\n";
+}
+
+// Uses the cooked texture beside the PNG, or decodes the PNG and cooks its mipmaps if the cooked texture is missing or stale
+static bool LoadCookedTexture(const std::string& path, bool srgb, cy::BlockFormat format, cy::CookedTexture& cooked)
 {
-	outRGBA.clear();
-	outW = outH = 0;
-	unsigned err = lodepng::decode(outRGBA, outW, outH, pngPath);
-    if (err != 0)
+    const std::string cachePath = cy::CookedTexture::GetCacheFileName(path.c_str(), srgb, format);
+    auto loadStart = std::chrono::steady_clock::now();
+    if (cooked.Load(cachePath.c_str(), path.c_str(), srgb, format))
+    {
+        PrintLoadTime("Texture cache load", cachePath.c_str(), loadStart);
+        PrintTextureCompression(path, cooked);
+        return true;
+    }
+    std::vector<unsigned char> pixels;
+    unsigned w = 0, h = 0;
+    unsigned error = cy::DecodePNG(pixels, w, h, path);
+    if (error)
     {
-        std::cerr << "ERROR: lodepng decode failed: " << pngPath << " (" << err << ": " << lodepng_error_text(err) << ")\n";
-		return false;
+        std::cerr << "ERROR: lodepng decode failed: " << path << " (" << error << ": " << lodepng_error_text(error) << ")\n";
+        return false;
     }
+    cooked.Build(pixels.data(), w, h, srgb, format);
+    PrintLoadTime("Texture cook", path.c_str(), loadStart);
+    PrintTextureCompression(path, cooked);
+    if (cooked.Save(cachePath.c_str(), path.c_str()))
+        std::cout << "Texture cache written: " << cachePath << "\n";
+    else
+        std::cout << "Texture cache could not be written: " << cachePath << "\n";
     return true;
 }
 
-static GLuint CreateTexture2D(unsigned w, unsigned h, const unsigned char* rgba)
+// Prints the resident levels and the memory of each managed texture
+static void PrintTextureResidency(const cy::TextureManager& textureManager)
 {
-    if (!rgba || w == 0 || h == 0)
-        return 0;
+    std::cout << "Texture residency: " << (double)textureManager.ResidentBytes() / (1024.0 * 1024.0) << " of " << (double)textureManager.TotalBytes() / (1024.0 * 1024.0)
+        << " MB resident (budget " << (double)textureManager.GetBudget() / (1024.0 * 1024.0) << " MB)\n";
+    for (unsigned int i = 0; i < textureManager.NumTextures(); ++i)
+    {
+        const cy::TextureResidency& r = textureManager.GetResidency(i);
+        std::cout << "  " << r.cacheFile << ": " << r.width << "x" << r.height << ", levels " << r.baseLevel << "-" << (r.numLevels - 1) << " resident, "
+            << (double)r.residentBytes / (1024.0 * 1024.0) << " of " << (double)r.totalBytes / (1024.0 * 1024.0) << " MB, last used "
+            << (textureManager.Frame() - r.lastUsedFrame) << " frames ago, " << r.evictedLevels << " levels evicted, " << r.restoredLevels << " loaded back\n";
+    }
+}
 
-    GLuint tex = 0;
-	glCreateTextures(GL_TEXTURE_2D, 1, &tex);
-	glTextureStorage2D(tex, 1, GL_RGBA8, (GLsizei)w, (GLsizei)h);
-	glTextureSubImage2D(tex, 0, 0, 0, (GLsizei)w, (GLsizei)h, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+// Prints the time spent submitting the shader programs, how many were compiled in the background before they were
+// needed, the time spent waiting for the others, and how many were loaded from the program binary cache
+static void PrintShaderBuildTime(unsigned int numPrograms, unsigned int numReady, double submitMs, std::chrono::steady_clock::time_point waitStart)
+{
+    double waitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+    std::cout << "Shaders: " << numPrograms << " programs submitted in " << submitMs << " ms, waited " << waitMs << " ms";
+    if (cy::GLSLProgram::IsParallelCompileEnabled())
+        std::cout << " (" << numReady << " compiled in parallel before use)";
+    else
+        std::cout << " (parallel compile not supported)";
+    std::cout << ", binary cache " << g_shaderCacheDir << ": "
+        << cy::GLSLProgram::NumBinaryCacheHits() << " hits, " << cy::GLSLProgram::NumBinaryCacheMisses() << " misses, "
+        << cy::GLSLProgram::NumBinaryCacheRejected() << " rejected\n";
+}
+
+// Prints how many state changes the GL state cache issued and how many it dropped as redundant
+static void PrintGLStateStats(const cy::GLStateCache& state, uint64_t numFrames)
+{
+    const uint64_t issued = state.NumIssued();
+    const uint64_t filtered = state.NumFiltered();
+    std::cout << "GL state: " << issued << " calls issued, " << filtered << " filtered";
+    if (numFrames > 0)
+        std::cout << " (" << (double)issued / numFrames << " and " << (double)filtered / numFrames << " per frame)";
+    std::cout << "\n";
+    for (int i = 0; i < cy::GLStateCache::NUM_FUNCTIONS; ++i)
+    {
+        const cy::GLStateCache::Function f = (cy::GLStateCache::Function)i;
+        if (state.NumIssued(f) + state.NumFiltered(f) > 0)
+            std::cout << "  " << cy::GLStateCache::FunctionName(f) << ": " << state.NumIssued(f) << " issued, " << state.NumFiltered(f) << " filtered\n";
+    }
+}
+
+// Prints the readback latency and the PNG throughput of the frame capture
+static void PrintCaptureStats(const cy::FramebufferReadback& readback, const cy::FrameWriter& frameWriter)
+{
+    const cy::FrameWriterStats stats = frameWriter.GetStats();
+    std::cout << "Capture readback: " << readback.NumCaptured() << " frames, " << readback.NumSkipped() << " skipped, "
+        << readback.AverageDelay() << " frames late on average (" << readback.NumBuffers() << " buffers)\n";
+    std::cout << "Capture PNG (" << cy::PngEffortName(frameWriter.GetEffort()) << ", " << frameWriter.NumThreads() << " threads): "
+        << stats.framesWritten << " written, " << frameWriter.NumPending() << " pending, " << stats.framesDropped << " dropped, "
+        << stats.FramesPerSecond() << " frames/s, "
+        << (stats.framesWritten > 0 ? (double)stats.fileBytes / (1024.0 * 1024.0) / stats.framesWritten : 0.0) << " MB/frame\n";
+}
+
+// Prints how many material texture requests were served by a texture that already existed
+static void PrintTextureSharing(const cy::TextureManager& textureManager)
+{
+    const unsigned int requests = textureManager.NumHits() + textureManager.NumMisses();
+    std::cout << "Texture sharing: " << requests << " requests, " << textureManager.NumTextures() << " textures, hit rate "
+        << (requests > 0 ? 100.0 * textureManager.NumHits() / requests : 0.0) << "%\n";
+}
+
+// Creates the texture with all levels of the cooked texture, compressed or not. The texture manager owns it, evicts
+// its top levels when the textures exceed the budget, and loads them back from the cache file when it is used again.
+// Materials that use the same image with the same settings have the same cache file and share one texture.
+static GLuint CreateTexture2D(cy::TextureManager& textureManager, const cy::CookedTexture& cooked, const std::string& cachePath)
+{
+    if (cachePath.empty())
+        return 0;
+    GLuint tex = textureManager.Acquire(cachePath.c_str());
+    if (tex != 0)
+        return tex;
+    tex = textureManager.Create(cooked, cachePath.c_str());
+    if (tex == 0)
+        return 0;
 
     glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTextureParameteri(tex, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTextureParameteri(tex, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	glGenerateTextureMipmap(tex);
 	return tex;
 }
 
-// OpenGL faces order: +X, -X, +Y, -Y, +Z, -Z
-static GLuint CreateCubemapFromPNG(const std::array<std::string, 6>& faces)
+// Creates a cubemap with storage for six faces of the given size; the faces are uploaded separately
+static GLuint CreateCubemap(unsigned w, unsigned h)
 {
-    std::vector<unsigned char> rgba0;
-    unsigned w0 = 0, h0 = 0;
-    if (!LoadPNGTexture(faces[0], rgba0, w0, h0))
-    {
-        std::cerr << "Failed to load cubemap face: " << faces[0] << "\n";
-        return 0;
-    }
-
     GLuint tex = 0;
     glCreateTextures(GL_TEXTURE_CUBE_MAP, 1, &tex);
-    glTextureStorage2D(tex, 1, GL_RGBA8, (GLsizei)w0, (GLsizei)h0);
-
-    auto uploadFace = [&](int FaceIndex, const std::string& path) {
-        std::vector<unsigned char> rgba;
-        unsigned w = 0, h = 0;
-        if (!LoadPNGTexture(path, rgba, w, h))
-        {
-            std::cerr << "Failed to load cubemap face: " << path << "\n";
-            return false;
-        };
-        if (w != w0 || h != h0)
-        {
-            std::cerr << "Cubemap face size mismatch: " << path << " (expected " << w0 << "x" << h0 << ", got " << w << "x" << h << ")\n";
-            return false;
-        }
-        glTextureSubImage3D(tex, 0, 0, 0, FaceIndex, (GLsizei)w, (GLsizei)h, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
-        return true;
-        };
-
-    for (int i = 0; i < 6; ++i)
-    {
-        if (!uploadFace(i, faces[i]))
-        {
-            glDeleteTextures(1, &tex);
-			return 0;
-        }
-    }
+    glTextureStorage2D(tex, 1, GL_RGBA8, (GLsizei)w, (GLsizei)h);
 
 	glTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTextureParameteri(tex, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -598,7 +967,7 @@ static void SetupRTTextureFiltering(GLuint texId)
 // Event call back
 static void framebuffer_size_callback(GLFWwindow* /*window*/, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    g_glState.Viewport(0, 0, width, height);
 }
 
 static void mouse_button_callback(GLFWwindow* window, int button, int action, int /*mods*/)
@@ -683,6 +1052,34 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         g_usePerspective = !g_usePerspective;
         std::cout << "[P] Projection = " << (g_usePerspective ? "Perspective" : "Orthographic") << std::endl;
     }
+    // C to toggle backface culling of the object
+    if (key == GLFW_KEY_C && action == GLFW_PRESS)
+    {
+        g_backfaceCulling = !g_backfaceCulling;
+        std::cout << "[C] Backface Culling = " << (g_backfaceCulling ? "ON" : "OFF") << std::endl;
+    }
+    // L to toggle the level of detail selection
+    if (key == GLFW_KEY_L && action == GLFW_PRESS)
+    {
+        g_useLod = !g_useLod;
+        std::cout << "[L] Level of Detail = " << (g_useLod ? "ON" : "OFF") << std::endl;
+    }
+    // R to print the residency of the material textures
+    if (key == GLFW_KEY_R && action == GLFW_PRESS)
+    {
+        g_printTextureResidency = true;
+    }
+    // K to start or stop capturing frames, J to select the PNG effort of the next capture
+    if (key == GLFW_KEY_K && action == GLFW_PRESS)
+    {
+        g_captureFrames = !g_captureFrames;
+        std::cout << "[K] Capture = " << (g_captureFrames ? "ON" : "OFF") << std::endl;
+    }
+    if (key == GLFW_KEY_J && action == GLFW_PRESS)
+    {
+        g_captureEffort = (cy::PngEffort)((g_captureEffort + 1) % (cy::PNG_SMALL + 1));
+        std::cout << "[J] Capture PNG effort = " << cy::PngEffortName(g_captureEffort) << " (from the next capture)" << std::endl;
+    }
     // 1-3 to for Blinn components, 0 for full shading, N for normal visualization
     if (action == GLFW_PRESS)
     {
@@ -724,32 +1121,104 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         std::cerr << "Usage: " << argv[0] << " <mesh.obj>\n";
         return -1;
     }
-    cy::TriMesh mesh;
-    if (!mesh.LoadFromFileObj(argv[1], true, &std::cout))
+    auto startupStart = std::chrono::steady_clock::now();
+
+    // The cubemap faces are decoded on worker threads while the mesh, the material textures, and the window
+    // are set up, and the main thread uploads each face when it is decoded. The image id is the face index.
+    cy::ImageLoader imageLoader;
+
+    // OpenGL faces order: +X, -X, +Y, -Y, +Z, -Z
+    const std::array<std::string, 6> cubemapFaces = {
+        "assets/cubemap/cubemap_posx.png",
+        "assets/cubemap/cubemap_negx.png",
+        "assets/cubemap/cubemap_posy.png",
+        "assets/cubemap/cubemap_negy.png",
+        "assets/cubemap/cubemap_posz.png",
+        "assets/cubemap/cubemap_negz.png"
+    };
+    for (int i = 0; i < 6; ++i)
+        imageLoader.Load(cubemapFaces[i]);
+    // Mesh: use the binary cache beside the OBJ, rebuild it if it is missing or stale
+    const std::string meshCachePath = cy::MeshCache::GetCacheFileName(argv[1]);
+    cy::MeshCache meshCache;
+    auto loadStart = std::chrono::steady_clock::now();
+    if (meshCache.Load(meshCachePath.c_str(), argv[1]))
     {
-        std::cerr << "ERROR: failed to load obj: " << argv[1] << "\n";
-        return -1;
+        PrintLoadTime("Mesh cache load", meshCachePath.c_str(), loadStart);
+    }
+    else
+    {
+        cy::TriMesh mesh;
+        if (!mesh.LoadFromFileObjMapped(argv[1], true, &std::cout))
+        {
+            std::cerr << "ERROR: failed to load obj: " << argv[1] << "\n";
+            return -1;
+        }
+        PrintLoadTime("OBJ load", argv[1], loadStart);
+
+        mesh.ComputeNormals();
+        meshCache.Build(mesh);
+        if (meshCache.Save(meshCachePath.c_str(), argv[1]))
+            std::cout << "Mesh cache written: " << meshCachePath << "\n";
+        else
+            std::cout << "Mesh cache could not be written: " << meshCachePath << "\n";
     }
+    PrintMeshStats(meshCache);
 
-    // Get vertices & bounding box & center & scale
-    cy::Vec3f bbMin(1e30f, 1e30f, 1e30f);
-    cy::Vec3f bbMax(-1e30f, -1e30f, -1e30f);
-    for (unsigned int i = 0; i < mesh.NV(); ++i)
+    // GPU materials; their textures are loaded with their mipmaps from the cooked textures and uploaded after the window is created
+    std::vector<GPUMaterial> gpuMtls;
+    std::vector<cy::CookedTexture> cookedTextures;  // map_Kd and map_Ks of each material, empty if an earlier material loaded the same file
+    std::vector<std::string> cookedTextureFiles;    // their cache files, which evicted levels are loaded back from and textures are shared by
+    if (meshCache.NumMtls() > 0)
     {
-        cy::Vec3f p = mesh.V((int)i);
-        bbMin.x = min(bbMin.x, p.x);
-        bbMin.y = min(bbMin.y, p.y);
-        bbMin.z = min(bbMin.z, p.z);
-        bbMax.x = max(bbMax.x, p.x);
-        bbMax.y = max(bbMax.y, p.y);
-        bbMax.z = max(bbMax.z, p.z);
+        gpuMtls.resize(meshCache.NumMtls());
+        cookedTextures = std::vector<cy::CookedTexture>(meshCache.NumMtls() * 2);
+        cookedTextureFiles.resize(meshCache.NumMtls() * 2);
+        std::unordered_set<std::string> loadedTextureFiles;
+
+        for (unsigned int mi = 0; mi < meshCache.NumMtls(); ++mi)
+        {
+            const auto& mtl = meshCache.M((int)mi);
+            GPUMaterial& gpuMtl = gpuMtls[mi];
+            gpuMtl.Ka = cy::Vec3f(mtl.Ka[0], mtl.Ka[1], mtl.Ka[2]);
+            gpuMtl.Kd = cy::Vec3f(mtl.Kd[0], mtl.Kd[1], mtl.Kd[2]);
+            gpuMtl.Ks = cy::Vec3f(mtl.Ks[0], mtl.Ks[1], mtl.Ks[2]);
+            gpuMtl.Tf = cy::Vec3f(mtl.Tf[0], mtl.Tf[1], mtl.Tf[2]);
+            gpuMtl.Ns = mtl.Ns;
+            gpuMtl.Ni = mtl.Ni;
+            gpuMtl.illum = mtl.illum;
+
+            // map_Kd and map_Ks
+            for (int specular = 0; specular < 2; ++specular)
+            {
+                std::string path = ResolveTexPath(argv[1], specular ? mtl.map_Ks.data : mtl.map_Kd.data);
+                if (path.empty())
+                    continue;
+                const cy::BlockFormat format = specular ? g_specularMapFormat : g_diffuseMapFormat;
+                std::string& cachePath = cookedTextureFiles[mi * 2 + specular];
+                cachePath = cy::CookedTexture::GetCacheFileName(path.c_str(), false, format);
+                // The cache file name holds the resolved path and the decode settings, so it identifies the texture
+                if (!loadedTextureFiles.insert(cachePath).second)
+                    std::cout << "Material " << mi << (specular ? " map_Ks: " : " map_Kd: ") << path << " (shared)\n";
+                else if (LoadCookedTexture(path, false, format, cookedTextures[mi * 2 + specular]))
+                    std::cout << "Material " << mi << (specular ? " map_Ks: " : " map_Kd: ") << path << "\n";
+            }
+        }
+    }
+    else    // No materials in OBJ/MTL
+    {
+        gpuMtls.resize(1);
     }
+
+    // Get bounding box & center & scale
+    cy::Vec3f bbMin = meshCache.GetBoundMin();
+    cy::Vec3f bbMax = meshCache.GetBoundMax();
     g_objCenter = (bbMin + bbMax) * 0.5f;
     cy::Vec3f ext = bbMax - bbMin;
     float maxExtent = max(ext.x, max(ext.y, ext.z));
     const float targetSize = 2.0f;
     g_objScale = (maxExtent > 1e-8f) ? (targetSize / maxExtent) : 1.0f;         // Auto scale
-    std::cout << "NV=" << mesh.NV() << "  NF=" << mesh.NF() << "\n";
+    std::cout << "NV=" << meshCache.NumVertices() << "  NF=" << meshCache.NumFaces() << "\n";
     std::cout << "AABB Min: (" << bbMin.x << ", " << bbMin.y << ", " << bbMin.z << ")\n";
     std::cout << "AABB Max: (" << bbMax.x << ", " << bbMax.y << ", " << bbMax.z << ")\n";
     std::cout << "Center  : (" << g_objCenter.x << ", " << g_objCenter.y << ", " << g_objCenter.z << ")\n";
@@ -758,53 +1227,6 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
     g_dist = max(2.0f, diag * 0.1f);
     g_orthoScale = 1.5f;
 
-    mesh.ComputeNormals();
-    const bool hasUV = mesh.HasTextureVertices();
-
-    std::vector<float> positions;
-    positions.reserve(mesh.NF() * 3 * 3);
-    std::vector<float> normals;
-    normals.reserve(mesh.NF() * 3 * 3);
-    std::vector<float> uvs;
-    uvs.reserve(mesh.NF() * 3 * 2);
-
-    for (unsigned int fi = 0; fi < mesh.NF(); ++fi)
-    {
-        auto f = mesh.F((int)fi);
-        auto fn = mesh.FN((int)fi);
-        auto ft = hasUV ? mesh.FT((int)fi) : cy::TriMesh::TriFace();
-
-        for (int c = 0; c < 3; ++c)
-        {
-            int vi = f.v[c];
-            int ni = fn.v[c];
-            cy::Vec3f p = mesh.V(vi);
-            cy::Vec3f n = (mesh.NVN() > 0 && ni >= 0) ? mesh.VN(ni) : cy::Vec3f(0, 1, 0);
-
-            positions.push_back(p.x);
-            positions.push_back(p.y);
-            positions.push_back(p.z);
-
-            normals.push_back(n.x);
-            normals.push_back(n.y);
-            normals.push_back(n.z);
-
-            float u = 0.0f, v = 0.0f;
-            if (hasUV)
-            {
-                int ti = ft.v[c];
-                if (ti >= 0 && (unsigned)ti < mesh.NVT())
-                {
-                    cy::Vec3f t = mesh.VT(ti);
-                    u = t.x;
-                    v = t.y;
-                }
-            }
-            uvs.push_back(u);
-            uvs.push_back(v);
-        }
-    }
-
     //const GLsizei drawVertexCount = (GLsizei)(mesh.NF() * 3);
 
     // GLFW
@@ -845,64 +1267,38 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         glfwTerminate();
         return -1;
     }
+    cy::GLSLProgram::EnableParallelCompile((GLADloadproc)glfwGetProcAddress);
 
     std::cout << "GL_VERSION: " << glGetString(GL_VERSION) << "\n";        // Show OpenGL Version
     std::cout << "GLSL: " << glGetString(GL_SHADING_LANGUAGE_VERSION) << "\n";
 
+    // From here on, the images are decoded directly into the upload ring;
+    // the ones that are already decoded are uploaded from memory
+    cy::PixelUnpackRing uploadRing;
+    UploadRingAllocator uploadRingAllocator(uploadRing);
+    if (uploadRing.Create(kUploadRingSize))
+        imageLoader.SetAllocator(&uploadRingAllocator);
+    else
+        std::cerr << "WARNING: persistent upload buffer unavailable, textures are uploaded from memory\n";
+
+    // Shader programs: all of them are submitted now and compiled by the driver while the textures,
+    // the cubemap, and the meshes are loaded; they are finished before the first frame
+    cy::GLSLProgram::SetBinaryCacheDirectory(g_shaderCacheDir);
+    auto shaderStart = std::chrono::steady_clock::now();
     Shader shader;
     glfwSetWindowUserPointer(window, &shader);
-    if (!BuildShaders(shader))
-    {
-        std::cerr << "ERROR: shader build failed\n";
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return -1;
-    }
-
     PlaneShader planeShader;
-    if (!BuildPlaneShader(planeShader))
-    {
-        std::cerr << "ERROR: plane shader build failed\n";
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return -1;
-    }
-
     SkyboxShader skyboxShader;
-    if (!BuildSkyboxShader(skyboxShader))
-    {
-        std::cerr << "ERROR: skybox shader build failed\n";
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return -1;
-    }
-
     ReflectShader reflectShader;
-    if (!BuildReflectShader(reflectShader))
-    {
-        std::cerr << "ERROR: reflection shader build failed\n";
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return -1;
-    }
-
     ShadowDepthShader shadowDepthShader;
-    if (!BuildShadowDepthShader(shadowDepthShader))
-    {
-        std::cerr << "ERROR: shadow depth shader build failed\n";
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return -1;
-    }
-
     LightMarkerShader lightMarkerShader;
-    if (!BuildLightMarkerShader(lightMarkerShader))
-    {
-        std::cerr << "ERROR: light marker shader build failed\n";
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return -1;
-    }
+    SubmitShaders(shader);
+    SubmitShader(planeShader);
+    SubmitShader(skyboxShader);
+    SubmitShader(reflectShader);
+    SubmitShader(shadowDepthShader);
+    SubmitShader(lightMarkerShader);
+    double shaderSubmitMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - shaderStart).count();
 
     // Shadow map
     cy::GLRenderDepth<GL_TEXTURE_2D> shadowDepth;
@@ -927,18 +1323,107 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         glTextureParameteri(shadowTex, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
     }
 
-    // Cubemap Setup
-    std::array<std::string, 6> cubemapFaces = {
-        "assets/cubemap/cubemap_posx.png",
-        "assets/cubemap/cubemap_negx.png",
-        "assets/cubemap/cubemap_posy.png",
-        "assets/cubemap/cubemap_negy.png",
-        "assets/cubemap/cubemap_posz.png",
-        "assets/cubemap/cubemap_negz.png"
-    };
-    GLuint cubemapTex = CreateCubemapFromPNG(cubemapFaces);
-    if (!cubemapTex)
+    // Material textures: all levels are uploaded directly from the cooked textures, then the files are unmapped
+    cy::TextureManager textureManager;
+    textureManager.SetBudget(g_textureBudgetMB << 20);
+    for (size_t mi = 0; mi < gpuMtls.size() && !cookedTextures.empty(); ++mi)
+    {
+        GPUMaterial& gpuMtl = gpuMtls[mi];
+        gpuMtl.texKd = CreateTexture2D(textureManager, cookedTextures[mi * 2], cookedTextureFiles[mi * 2]);
+        gpuMtl.hasKd = (gpuMtl.texKd != 0);
+        gpuMtl.texKs = CreateTexture2D(textureManager, cookedTextures[mi * 2 + 1], cookedTextureFiles[mi * 2 + 1]);
+        gpuMtl.hasKs = (gpuMtl.texKs != 0);
+    }
+    cookedTextures.clear();
+
+    // Materials are uploaded once, one element each; the plane uses the one after them
+    const unsigned int planeMaterial = (unsigned int)gpuMtls.size();
+    cy::UniformBuffer<MaterialUniforms> materialBuffer;
+    materialBuffer.Create(planeMaterial + 1);
+    for (unsigned int mi = 0; mi < planeMaterial; ++mi)
+    {
+        const GPUMaterial& m = gpuMtls[mi];
+        MaterialUniforms& u = materialBuffer[mi];
+        u.Ka = m.Ka;
+        u.Kd = m.Kd;
+        u.Ks = m.Ks;
+        u.Tf = m.Tf;
+        u.Ns = m.Ns;
+        u.Ni = m.Ni;
+        u.illum = m.illum;
+        u.hasDiffuseTex = m.hasKd ? 1 : 0;
+        u.hasSpecularTex = m.hasKs ? 1 : 0;
+    }
+    {
+        MaterialUniforms& u = materialBuffer[planeMaterial];
+        u.Ka = cy::Vec3f(0.00f, 0.00f, 0.00f);
+        u.Kd = cy::Vec3f(0.04f, 0.04f, 0.04f);
+        u.Ks = cy::Vec3f(0.6f, 0.6f, 0.6f);
+        u.Ns = 512.0f;
+    }
+    materialBuffer.Update();
+    materialBuffer.BindStorage(kMaterialBufferBinding);
+
+    // Camera view and mirrored view, written each frame
+    cy::UniformBuffer<FrameUniforms> frameUniforms;
+    frameUniforms.Create(2, true);
+
+    std::cout << "Material textures: " << textureManager.NumTextures() << ", " << (double)textureManager.TotalBytes() / (1024.0 * 1024.0)
+        << " MB (budget " << g_textureBudgetMB << " MB)\n";
+    PrintTextureSharing(textureManager);
+
+    // Cubemap: upload the faces in the order they are decoded
+    GLuint cubemapTex = 0;
+    unsigned int cubemapW = 0, cubemapH = 0;
+    int cubemapFacesLoaded = 0;
+    cy::ImageLoader::Image image;
+    while (imageLoader.NumPending() > 0)
+    {
+        // Before waiting for an image, free the ring space of the finished uploads, since a worker may be waiting for it
+        if (imageLoader.TryNext(image))
+            uploadRing.Retire(false);
+        else
+        {
+            uploadRing.Retire(true);
+            if (!imageLoader.Next(image))
+                break;
+        }
+        if (image.error != 0)
+        {
+            std::cerr << "ERROR: lodepng decode failed: " << image.path << " (" << image.error << ": " << lodepng_error_text(image.error) << ")\n";
+            continue;
+        }
+        const bool inRing = image.memory != nullptr;
+        const void* pixels = inRing ? (const void*)(uintptr_t)image.offset : image.rgba.data();
+        if (inRing)
+            uploadRing.Bind();
+        if (!cubemapTex)
+        {
+            cubemapTex = CreateCubemap(image.width, image.height);
+            cubemapW = image.width;
+            cubemapH = image.height;
+        }
+        if (image.width != cubemapW || image.height != cubemapH)
+        {
+            std::cerr << "Cubemap face size mismatch: " << image.path << " (expected " << cubemapW << "x" << cubemapH << ", got " << image.width << "x" << image.height << ")\n";
+        }
+        else
+        {
+            glTextureSubImage3D(cubemapTex, 0, 0, 0, (GLint)image.id, (GLsizei)image.width, (GLsizei)image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            ++cubemapFacesLoaded;
+        }
+        if (inRing)
+        {
+            uploadRing.Unbind();
+            uploadRing.Fence(image.offset);
+        }
+    }
+    imageLoader.SetAllocator(nullptr);
+    uploadRing.Delete();    // waits for the uploads, the buffer is only used while loading
+    if (cubemapFacesLoaded < 6)
     {
+        if (cubemapTex)
+            glDeleteTextures(1, &cubemapTex);
         std::cerr << "ERROR: env cubemap creation failed\n";
         return -1;
     }
@@ -1062,90 +1547,158 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
     glVertexArrayAttribFormat(lightMarkerVAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
     glVertexArrayAttribBinding(lightMarkerVAO, 0, 0);
 
-    // Build GPU Materials
-    std::vector<GPUMaterial> gpuMtls;
-    if (mesh.NM() > 0)
-    {
-        gpuMtls.resize(mesh.NM());
+    GLuint vao = 0, vbo = 0, nbo = 0, tbo = 0, ebo = 0;
+    glCreateVertexArrays(1, &vao);
+    glCreateBuffers(1, &ebo);
+    glNamedBufferStorage(ebo, (GLsizeiptr)meshCache.IndicesSize(), meshCache.Indices(), 0);
+    glVertexArrayElementBuffer(vao, ebo);
+    const GLenum indexType = (meshCache.IndexSize() == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
-        for (unsigned int mi = 0; mi < mesh.NM(); ++mi)
+    MeshVertexFormat meshFormat;
+    if (g_quantizeMesh)
+    {
+        cy::QuantizedMesh quantized;
+        if (QuantizeMesh(meshCache, quantized))
         {
-            const auto& mtl = mesh.M((int)mi);
-            GPUMaterial gpuMtl;
-            gpuMtl.Ka = cy::Vec3f(mtl.Ka[0], mtl.Ka[1], mtl.Ka[2]);
-            gpuMtl.Kd = cy::Vec3f(mtl.Kd[0], mtl.Kd[1], mtl.Kd[2]);
-            gpuMtl.Ks = cy::Vec3f(mtl.Ks[0], mtl.Ks[1], mtl.Ks[2]);
-            gpuMtl.Tf = cy::Vec3f(mtl.Tf[0], mtl.Tf[1], mtl.Tf[2]);
-            gpuMtl.Ns = mtl.Ns;
-            gpuMtl.Ni = mtl.Ni;
-            gpuMtl.illum = mtl.illum;
-
-            // map_kd
-            std::string kdPath = ResolveTexPath(argv[1], mtl.map_Kd.data);
-            if (!kdPath.empty())
-            {
-                std::vector<unsigned char> rgba;
-                unsigned w = 0, h = 0;
-                if (LoadPNGTexture(kdPath, rgba, w, h))
-                {
-                    gpuMtl.texKd = CreateTexture2D(w, h, rgba.data());
-                    gpuMtl.hasKd = (gpuMtl.texKd != 0);
-                    std::cout << "Material " << mi << " map_Kd: " << kdPath << "\n";
-                }
-            }
-
-            // map_Ks
-            std::string ksPath = ResolveTexPath(argv[1], mtl.map_Ks.data);
-            if (!ksPath.empty())
-            {
-                std::vector<unsigned char> rgba;
-                unsigned w = 0, h = 0;
-                if (LoadPNGTexture(ksPath, rgba, w, h))
-                {
-                    gpuMtl.texKs = CreateTexture2D(w, h, rgba.data());
-                    gpuMtl.hasKs = (gpuMtl.texKs != 0);
-                    std::cout << "Material " << mi << " map_Ks: " << ksPath << "\n";
-                }
-            }
-
-            gpuMtls[mi] = gpuMtl;
+            // Interleaved: snorm16 position, snorm16 octahedral normal, half float UV
+            glCreateBuffers(1, &vbo);
+            glNamedBufferStorage(vbo, (GLsizeiptr)quantized.VerticesSize(), quantized.vertices.data(), 0);
+            glVertexArrayVertexBuffer(vao, 0, vbo, 0, sizeof(cy::QuantizedVertex));
+
+            glEnableVertexArrayAttrib(vao, 0);
+            glVertexArrayAttribFormat(vao, 0, 3, GL_SHORT, GL_TRUE, offsetof(cy::QuantizedVertex, position));
+            glVertexArrayAttribBinding(vao, 0, 0);
+
+            glEnableVertexArrayAttrib(vao, 1);
+            glVertexArrayAttribFormat(vao, 1, 2, GL_SHORT, GL_TRUE, offsetof(cy::QuantizedVertex, normal));
+            glVertexArrayAttribBinding(vao, 1, 0);
+
+            glEnableVertexArrayAttrib(vao, 2);
+            glVertexArrayAttribFormat(vao, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(cy::QuantizedVertex, texCoord));
+            glVertexArrayAttribBinding(vao, 2, 0);
+
+            meshFormat.quantized = true;
+            meshFormat.posScale = quantized.positionScale;
+            meshFormat.posOffset = quantized.positionOffset;
         }
     }
-    else    // No materials in OBJ/MTL
+    if (!meshFormat.quantized)
     {
-        gpuMtls.resize(1);
+        glCreateBuffers(1, &vbo);
+        glCreateBuffers(1, &nbo);
+        glCreateBuffers(1, &tbo);
+
+        // Uploaded directly from the mapped cache file on warm starts
+        glNamedBufferStorage(vbo, (GLsizeiptr)meshCache.PositionsSize(), meshCache.Positions(), 0);
+        glNamedBufferStorage(nbo, (GLsizeiptr)meshCache.NormalsSize(), meshCache.Normals(), 0);
+        glNamedBufferStorage(tbo, (GLsizeiptr)meshCache.TexCoordsSize(), meshCache.TexCoords(), 0);
+        glVertexArrayVertexBuffer(vao, 0, vbo, 0, 3 * sizeof(float));
+        // Normal buffer at binding=1
+        glVertexArrayVertexBuffer(vao, 1, nbo, 0, 3 * sizeof(float));
+        glVertexArrayVertexBuffer(vao, 2, tbo, 0, 2 * sizeof(float));
+
+        glEnableVertexArrayAttrib(vao, 0);
+        glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vao, 0, 0);
+
+        glEnableVertexArrayAttrib(vao, 1);
+        glVertexArrayAttribFormat(vao, 1, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vao, 1, 1);
+
+        glEnableVertexArrayAttrib(vao, 2);
+        glVertexArrayAttribFormat(vao, 2, 2, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(vao, 2, 2);
     }
 
-    GLuint vao = 0, vbo = 0, nbo = 0, tbo = 0;
-    glCreateVertexArrays(1, &vao);
-    glCreateBuffers(1, &vbo);
-    glCreateBuffers(1, &nbo);
-    glCreateBuffers(1, &tbo);
-
-    glNamedBufferData(vbo, (GLsizeiptr)(positions.size() * sizeof(float)), positions.data(), GL_STATIC_DRAW);
-    glNamedBufferData(nbo, (GLsizeiptr)(normals.size() * sizeof(float)), normals.data(), GL_STATIC_DRAW);
-    glNamedBufferData(tbo, (GLsizeiptr)(uvs.size() * sizeof(float)), uvs.data(), GL_STATIC_DRAW);
-    glVertexArrayVertexBuffer(vao, 0, vbo, 0, 3 * sizeof(float));
-    // Normal buffer at binding=1
-    glVertexArrayVertexBuffer(vao, 1, nbo, 0, 3 * sizeof(float));
-    glVertexArrayVertexBuffer(vao, 2, tbo, 0, 2 * sizeof(float));
-
-    glEnableVertexArrayAttrib(vao, 0);
-    glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, 0);
-    glVertexArrayAttribBinding(vao, 0, 0);
-
-    glEnableVertexArrayAttrib(vao, 1);
-    glVertexArrayAttribFormat(vao, 1, 3, GL_FLOAT, GL_FALSE, 0);
-    glVertexArrayAttribBinding(vao, 1, 1);
-
-    glEnableVertexArrayAttrib(vao, 2);
-    glVertexArrayAttribFormat(vao, 2, 2, GL_FLOAT, GL_FALSE, 0);
-    glVertexArrayAttribBinding(vao, 2, 2);
-
-    glEnable(GL_DEPTH_TEST);
+    // Wait for the shader programs that are not compiled yet
+    auto shaderWaitStart = std::chrono::steady_clock::now();
+    unsigned int shadersReady = 0;
+    if (!FinishShaders(shader, &shadersReady))
+    {
+        std::cerr << "ERROR: shader build failed\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    if (!FinishShader(planeShader, "Plane", &shadersReady))
+    {
+        std::cerr << "ERROR: plane shader build failed\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    if (!FinishShader(skyboxShader, "Skybox", &shadersReady))
+    {
+        std::cerr << "ERROR: skybox shader build failed\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    if (!FinishShader(reflectShader, "Reflection", &shadersReady))
+    {
+        std::cerr << "ERROR: reflection shader build failed\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    if (!FinishShader(shadowDepthShader, "Shadow depth", &shadersReady))
+    {
+        std::cerr << "ERROR: shadow depth shader build failed\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    if (!FinishShader(lightMarkerShader, "Light marker", &shadersReady))
+    {
+        std::cerr << "ERROR: light marker shader build failed\n";
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    PrintShaderBuildTime(6, shadersReady, shaderSubmitMs, shaderWaitStart);
+    shader.GetUniforms();
+    skyboxShader.GetUniforms();
+    reflectShader.GetUniforms();
+    shadowDepthShader.GetUniforms();
+    lightMarkerShader.GetUniforms();
+
+    g_glState.Enable(GL_DEPTH_TEST);
+
+    double startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+    std::cout << "Startup: " << startupMs << " ms\n";
+
+    // Frame capture: each finished readback is copied to the frame writer, which encodes it on its worker threads
+    cy::FrameWriter frameWriter;
+    cy::FramebufferReadback readback;
+    readback.Create(3, [&frameWriter](const cy::FramebufferReadback::Frame& frame)
+    {
+        std::vector<unsigned char> rgba(frame.pixels, frame.pixels + (size_t)frame.width * frame.height * 4);
+        frameWriter.Write(std::move(rgba), frame.width, frame.height, true);
+    });
+    bool capturing = false;
+    uint64_t frameIndex = 0;
 
+    int lastLod = -1;
     while (!glfwWindowShouldClose(window))
     {
+        // Deliver the readbacks that are finished, then start or stop the capture requested with K
+        readback.Poll();
+        if (g_captureFrames != capturing)
+        {
+            capturing = g_captureFrames;
+            if (capturing)
+            {
+                frameWriter.Start(g_capturePrefix, g_captureEffort);
+                std::cout << "Capturing frames to " << g_capturePrefix << "*.png (" << cy::PngEffortName(g_captureEffort) << ")\n";
+            }
+            else
+            {
+                readback.Poll(true);
+                PrintCaptureStats(readback, frameWriter);
+            }
+        }
+        ++frameIndex;
+
         // Automatically animate the background color
         //const float t = static_cast<float>(glfwGetTime());      // Get seconds
         //const float r = 0.5f + 0.5f * std::sin(t * 1.0f);
@@ -1163,8 +1716,12 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         {
             shader.reloadShaders = false;
             BuildShaders(shader);
-            BuildSkyboxShader(skyboxShader);
-            BuildReflectShader(reflectShader);
+            BuildShader(skyboxShader, "Skybox");
+            BuildShader(reflectShader, "Reflection");
+            shader.GetUniforms();
+            skyboxShader.GetUniforms();
+            reflectShader.GetUniforms();
+            g_glState.Reset();    // the rebuilt programs may reuse the names of the deleted ones
         }
 
         int fbW = 0, fbH = 0;
@@ -1177,6 +1734,7 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
             lastRTH = fbH;
             renderTex.Resize(4, (GLsizei)fbW, (GLsizei)fbH, cy::GL::TYPE_UBYTE);
             SetupRTTextureFiltering(renderTex.GetTextureID());
+            g_glState.Reset();    // the resized render target has new framebuffer and texture names
         }
 
         // Matrices
@@ -1204,6 +1762,16 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         S.SetScale(g_objScale);
         cy::Matrix4f M = Tup * S * Tcenter;
 
+        // Level of detail: the coarsest level whose error stays below a pixel at the distance of the object center
+        cy::Vec4f objCenter4 = M * cy::Vec4f(g_objCenter.x, g_objCenter.y, g_objCenter.z, 1.0f);
+        float objDist = (camPosW - cy::Vec3f(objCenter4.x, objCenter4.y, objCenter4.z)).Length();
+        int lod = g_useLod ? SelectLod(meshCache, P, fbH, g_objScale, objDist, 1.0f) : 0;
+        if (lod != lastLod)
+        {
+            std::cout << "LOD " << lod << ": " << meshCache.GetLod(lod).faceCount << " triangles\n";
+            lastLod = lod;
+        }
+
         // Mirror Matrix
         cy::Matrix4f MirrorY;
         MirrorY.SetIdentity();
@@ -1217,334 +1785,295 @@ static void key_callback(GLFWwindow* window, int key, int /*scancode*/, int acti
         cy::Matrix4f Vlight = MakeLookAt(lightPosW, lightTargetW, cy::Vec3f(0.0f, 1.0f, 0.0f));
         cy::Matrix4f Plight = cy::Matrix4f::Perspective(DegToRad(40.0f), 1.0f, 0.1f, 20.0f);
         cy::Matrix4f LightVP = Plight * Vlight;
-        cy::Matrix4f LightMVP = LightVP * M;
 
-        shadowDepth.Bind();
-        glEnable(GL_DEPTH_TEST);
+        const float spotCosInner = cosf(DegToRad(15.0f));
+        const float spotCosOuter = cosf(DegToRad(22.0f));
+        cy::Matrix4f Vref = MakeView(g_yaw, -g_pitch, g_dist);
+
+        // Per-frame uniforms of the camera view and of the mirrored view, uploaded together
+        for (unsigned int view = 0; view < 2; ++view)
+        {
+            FrameUniforms& f = frameUniforms[view];
+            f.V = view == 0 ? V : Vref;
+            f.P = P;
+            f.lightVP = LightVP;
+            f.camPosW = camPosW;
+            f.spotCosInner = spotCosInner;
+            f.lightPosW = lightPosW;
+            f.spotCosOuter = spotCosOuter;
+            f.lightDirW = lightDirW;
+            f.pad = 0.0f;
+        }
+        frameUniforms.Update();
+        frameUniforms.Bind(kFrameBlockBinding, 0);
+        frameUniforms.Bind(kMirrorFrameBlockBinding, 1);
+
+        g_glState.BindFramebuffer(shadowDepth.GetID());
+        g_glState.Viewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+        g_glState.Enable(GL_DEPTH_TEST);
         glClear(GL_DEPTH_BUFFER_BIT);
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_FRONT);
+        g_glState.Enable(GL_CULL_FACE);
+        g_glState.CullFace(GL_FRONT);
+
+        // Front faces are culled, so meshlets that face the light entirely are skipped as well
+        cy::MeshletCuller culler;
+        culler.Set(Plight, Vlight * M, cy::MeshletCuller::CULL_FRONT);
 
-        shadowDepthShader.prog.Bind();
-        shadowDepthShader.prog.SetUniformMatrix4("uLightMVP", LightMVP.cell);
+        g_glState.UseProgram(shadowDepthShader.prog);
+        shadowDepthShader.uM.Set(M);
+        meshFormat.SetUniforms(shadowDepthShader);
 
-        glBindVertexArray(vao);
+        g_glState.BindVertexArray(vao);
 
         // Draw Only the Object into the Shadow Map
-        if (mesh.NM() > 0)
+        if (meshCache.NumMtls() > 0)
         {
-            for (unsigned int mi = 0; mi < mesh.NM(); ++mi)
+            for (unsigned int mi = 0; mi < meshCache.NumMtls(); ++mi)
             {
-                int firstFace = mesh.GetMaterialFirstFace((int)mi);
-                int faceCount = mesh.GetMaterialFaceCount((int)mi);
+                int firstFace = (int)meshCache.GetMtlRange((int)mi, lod).firstFace;
+                int faceCount = (int)meshCache.GetMtlRange((int)mi, lod).faceCount;
                 if (faceCount <= 0)
                     continue;
-                glDrawArrays(GL_TRIANGLES, firstFace * 3, faceCount * 3);
+                DrawLod(meshCache, culler, indexType, lod, (unsigned int)firstFace, (unsigned int)faceCount);
             }
         }
         else
         {
-            glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(mesh.NF() * 3));
+            DrawLod(meshCache, culler, indexType, lod, meshCache.GetLod(lod).firstFace, meshCache.GetLod(lod).faceCount);
         }
 
-        shadowDepth.Unbind();
-        glCullFace(GL_BACK);
-        glDisable(GL_CULL_FACE);
-
-        const float spotCosInner = cosf(DegToRad(15.0f));
-        const float spotCosOuter = cosf(DegToRad(22.0f));
+        g_glState.CullFace(GL_BACK);
+        g_glState.Disable(GL_CULL_FACE);
 
         // Pass 1: render teapot (mirrored) -> render texture
-        renderTex.Bind();
+        g_glState.BindFramebuffer(renderTex.GetID());
         //glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, fbW, fbH);
-        glEnable(GL_DEPTH_TEST);
-        glClearColor(0, 0, 0, 0);
+        g_glState.Viewport(0, 0, fbW, fbH);
+        g_glState.Enable(GL_DEPTH_TEST);
+        g_glState.ClearColor(0, 0, 0, 0);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glDisable(GL_CULL_FACE);
-
-        cy::Matrix4f Vref = MakeView(g_yaw, -g_pitch, g_dist);
-
-        shader.prog.Bind();
-        shader.prog.SetUniformMatrix4("uM", M.cell);
-        shader.prog.SetUniformMatrix4("uV", Vref.cell);
-        shader.prog.SetUniformMatrix4("uP", P.cell);
-        shader.prog.SetUniform("uCamPosW", camPosW.x, camPosW.y, camPosW.z);
-        shader.prog.SetUniform("uLightPosW", lightPosW.x, lightPosW.y, lightPosW.z);
+        g_glState.Disable(GL_CULL_FACE);
 
-        // Shadow / spotlight uniforms
-        shader.prog.SetUniformMatrix4("uLightVP", LightVP.cell);
-        shader.prog.SetUniform("uLightDirW", lightDirW.x, lightDirW.y, lightDirW.z);
-        shader.prog.SetUniform("uSpotCosInner", spotCosInner);
-        shader.prog.SetUniform("uSpotCosOuter", spotCosOuter);
-        shader.prog.SetUniform("uShadowMap", 3);
-        glBindTextureUnit(3, shadowDepth.GetTextureID());
+        frameUniforms.Bind(kFrameBlockBinding, 1);
+        culler.Set(P, Vref * M, g_backfaceCulling ? cy::MeshletCuller::CULL_BACK : cy::MeshletCuller::CULL_NONE);
+        g_glState.SetCapability(GL_CULL_FACE, g_backfaceCulling);
 
-        shader.prog.SetUniform("uEnvMap", 2);
-        glBindTextureUnit(2, cubemapTex);
+        // The camera, lights and materials come from the uniform blocks, and the samplers have fixed units
+        g_glState.UseProgram(shader.prog);
+        shader.uM.Set(M);
+        meshFormat.SetUniforms(shader);
+        g_glState.BindTextureUnit(3, shadowDepth.GetTextureID());
+        g_glState.BindTextureUnit(2, cubemapTex);
 
-        shader.prog.SetUniform("uReflectStrength", 0.2f);
-        shader.prog.SetUniform("uRefractStrength", 0.0f);
-        shader.prog.SetUniform("uVisMode", 0);
-        shader.prog.SetUniform("uDiffuseTex", 0);
-        shader.prog.SetUniform("uSpecularTex", 1);
+        shader.uReflectStrength.Set(0.2f);
+        shader.uVisMode.Set(0);
 
-        glBindVertexArray(vao);
+        g_glState.BindVertexArray(vao);
 
         // Multiuple materials
-        if (mesh.NM() > 0)
+        if (meshCache.NumMtls() > 0)
         {
-            for (unsigned int mi = 0; mi < mesh.NM(); ++mi)
+            for (unsigned int mi = 0; mi < meshCache.NumMtls(); ++mi)
             {
-                int firstFace = mesh.GetMaterialFirstFace((int)mi);
-                int faceCount = mesh.GetMaterialFaceCount((int)mi);
+                int firstFace = (int)meshCache.GetMtlRange((int)mi, lod).firstFace;
+                int faceCount = (int)meshCache.GetMtlRange((int)mi, lod).faceCount;
                 if (faceCount <= 0)
                     continue;
 
                 const GPUMaterial& m = gpuMtls[mi];
+                assert(mi < planeMaterial);
+                shader.uMaterialID.Set((int)mi);
 
-                shader.prog.SetUniform("uKa", m.Ka.x, m.Ka.y, m.Ka.z);
-                shader.prog.SetUniform("uKd", m.Kd.x, m.Kd.y, m.Kd.z);
-                shader.prog.SetUniform("uKs", m.Ks.x, m.Ks.y, m.Ks.z);
-                shader.prog.SetUniform("uTf", m.Tf.x, m.Tf.y, m.Tf.z);
-                shader.prog.SetUniform("uNs", m.Ns);
-                shader.prog.SetUniform("uNi", m.Ni);
-                shader.prog.SetUniform("uIllum", m.illum);
+                g_glState.BindTextureUnit(0, m.texKd);
+                g_glState.BindTextureUnit(1, m.texKs);
+                textureManager.Use(m.texKd);
+                textureManager.Use(m.texKs);
 
-                glBindTextureUnit(0, m.texKd);
-                glBindTextureUnit(1, m.texKs);
-                shader.prog.SetUniform("uHasDiffuseTex", m.hasKd);
-                shader.prog.SetUniform("uHasSpecularTex", m.hasKs);
-
-                glDrawArrays(GL_TRIANGLES, firstFace * 3, faceCount * 3);
+                DrawLod(meshCache, culler, indexType, lod, (unsigned int)firstFace, (unsigned int)faceCount);
             }
         }
         else
         {
-            const GPUMaterial& m = gpuMtls[0];
-            shader.prog.SetUniform("uKa", m.Ka.x, m.Ka.y, m.Ka.z);
-            shader.prog.SetUniform("uKd", m.Kd.x, m.Kd.y, m.Kd.z);
-            shader.prog.SetUniform("uKs", m.Ks.x, m.Ks.y, m.Ks.z);
-            shader.prog.SetUniform("uTf", m.Tf.x, m.Tf.y, m.Tf.z);
-            shader.prog.SetUniform("uNs", m.Ns);
-            shader.prog.SetUniform("uNi", m.Ni);
-            shader.prog.SetUniform("uIllum", m.illum);
-
-            glBindTextureUnit(0, 0);
-            glBindTextureUnit(1, 0);
-            shader.prog.SetUniform("uHasDiffuseTex", false);
-            shader.prog.SetUniform("uHasSpecularTex", false);
-
-            glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(mesh.NF() * 3));
+            shader.uMaterialID.Set(0);
+            g_glState.BindTextureUnit(0, 0);
+            g_glState.BindTextureUnit(1, 0);
+
+            DrawLod(meshCache, culler, indexType, lod, meshCache.GetLod(lod).firstFace, meshCache.GetLod(lod).faceCount);
         }
 
+        g_glState.Disable(GL_CULL_FACE);
+
         // Pass 2: Render scene (skybox + object)
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glViewport(0, 0, fbW, fbH);
-        glEnable(GL_DEPTH_TEST);
-        glClearColor(0.08f, 0.08f, 0.10f, 1.0f);
+        g_glState.BindFramebuffer(0);
+        g_glState.Viewport(0, 0, fbW, fbH);
+        g_glState.Enable(GL_DEPTH_TEST);
+        g_glState.ClearColor(0.08f, 0.08f, 0.10f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         //Draw skybox
-        glDepthFunc(GL_LEQUAL);
-        glDepthMask(GL_FALSE);
+        g_glState.DepthFunc(GL_LEQUAL);
+        g_glState.DepthMask(false);
 
         cy::Matrix4f VnoT = V;
         VnoT(0, 3) = 0;
         VnoT(1, 3) = 0;
         VnoT(2, 3) = 0;
 
-        skyboxShader.prog.Bind();
-        skyboxShader.prog.SetUniformMatrix4("uProj", P.cell);
-        skyboxShader.prog.SetUniformMatrix4("uView", VnoT.cell);
-        skyboxShader.prog.SetUniform("uEnv", 0);
-        glBindTextureUnit(0, cubemapTex);
-        glBindVertexArray(skyboxVAO);
+        frameUniforms.Bind(kFrameBlockBinding, 0);
+        g_glState.UseProgram(skyboxShader.prog);
+        skyboxShader.uProj.Set(P);
+        skyboxShader.uView.Set(VnoT);
+        g_glState.BindTextureUnit(0, cubemapTex);
+        g_glState.BindVertexArray(skyboxVAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
 
-        glDepthMask(GL_TRUE);
-        glDepthFunc(GL_LESS);
+        g_glState.DepthMask(true);
+        g_glState.DepthFunc(GL_LESS);
 
         // Object
-        shader.prog.Bind();
-        shader.prog.SetUniformMatrix4("uM", M.cell);
-        shader.prog.SetUniformMatrix4("uV", V.cell);
-        shader.prog.SetUniformMatrix4("uP", P.cell);
-        shader.prog.SetUniform("uCamPosW", camPosW.x, camPosW.y, camPosW.z);
-        shader.prog.SetUniform("uLightPosW", lightPosW.x, lightPosW.y, lightPosW.z);
-
-        // Shadow / spotlight uniforms
-        shader.prog.SetUniformMatrix4("uLightVP", LightVP.cell);
-        shader.prog.SetUniform("uLightDirW", lightDirW.x, lightDirW.y, lightDirW.z);
-        shader.prog.SetUniform("uSpotCosInner", spotCosInner);
-        shader.prog.SetUniform("uSpotCosOuter", spotCosOuter);
-        shader.prog.SetUniform("uShadowMap", 3);
-        glBindTextureUnit(3, shadowDepth.GetTextureID());
-
-        shader.prog.SetUniform("uEnvMap", 2);
-        glBindTextureUnit(2, cubemapTex);
-        shader.prog.SetUniform("uReflectStrength", 1.0f);
-        shader.prog.SetUniform("uRefractStrength", 0.0f);
-        shader.prog.SetUniform("uVisMode", g_visMode);
-
-        // Texture units
-        shader.prog.SetUniform("uDiffuseTex", 0);
-        shader.prog.SetUniform("uSpecularTex", 1);
-        glBindVertexArray(vao);
+        g_glState.UseProgram(shader.prog);
+        shader.uM.Set(M);
+        meshFormat.SetUniforms(shader);
+        g_glState.BindTextureUnit(3, shadowDepth.GetTextureID());
+        g_glState.BindTextureUnit(2, cubemapTex);
+        shader.uReflectStrength.Set(1.0f);
+        shader.uVisMode.Set(g_visMode);
+        g_glState.BindVertexArray(vao);
+
+        culler.Set(P, V * M, g_backfaceCulling ? cy::MeshletCuller::CULL_BACK : cy::MeshletCuller::CULL_NONE);
+        g_glState.SetCapability(GL_CULL_FACE, g_backfaceCulling);
 
         // Support multiple materials
-        if (mesh.NM() > 0)
+        if (meshCache.NumMtls() > 0)
         {
-            for (unsigned int mi = 0; mi < mesh.NM(); ++mi)
+            for (unsigned int mi = 0; mi < meshCache.NumMtls(); ++mi)
             {
-                int firstFace = mesh.GetMaterialFirstFace((int)mi);
-                int faceCount = mesh.GetMaterialFaceCount((int)mi);
+                int firstFace = (int)meshCache.GetMtlRange((int)mi, lod).firstFace;
+                int faceCount = (int)meshCache.GetMtlRange((int)mi, lod).faceCount;
                 if (faceCount <= 0)
                     continue;
 
                 const GPUMaterial& m = gpuMtls[mi];
 
-                // Set material properties
-                shader.prog.SetUniform("uKa", m.Ka.x, m.Ka.y, m.Ka.z);
-                shader.prog.SetUniform("uKd", m.Kd.x, m.Kd.y, m.Kd.z);
-                shader.prog.SetUniform("uKs", m.Ks.x, m.Ks.y, m.Ks.z);
-                shader.prog.SetUniform("uTf", m.Tf.x, m.Tf.y, m.Tf.z);
-                shader.prog.SetUniform("uNs", m.Ns);
-                shader.prog.SetUniform("uNi", m.Ni);
-                shader.prog.SetUniform("uIllum", m.illum);
+                // Select the material properties
+                assert(mi < planeMaterial);
+                shader.uMaterialID.Set((int)mi);
 
                 // Binding Texture (unit0 = kd, unit1 = ks)
-                glBindTextureUnit(0, m.texKd);
-                glBindTextureUnit(1, m.texKs);
-                shader.prog.SetUniform("uHasDiffuseTex", m.hasKd);
-                shader.prog.SetUniform("uHasSpecularTex", m.hasKs);
+                g_glState.BindTextureUnit(0, m.texKd);
+                g_glState.BindTextureUnit(1, m.texKs);
+                textureManager.Use(m.texKd);
+                textureManager.Use(m.texKs);
 
-                glDrawArrays(GL_TRIANGLES, firstFace * 3, faceCount * 3);
+                DrawLod(meshCache, culler, indexType, lod, (unsigned int)firstFace, (unsigned int)faceCount);
             }
         }
         else    // If no material
         {
-            const GPUMaterial& m = gpuMtls[0];
-            shader.prog.SetUniform("uKa", m.Ka.x, m.Ka.y, m.Ka.z);
-            shader.prog.SetUniform("uKd", m.Kd.x, m.Kd.y, m.Kd.z);
-            shader.prog.SetUniform("uKs", m.Ks.x, m.Ks.y, m.Ks.z);
-            shader.prog.SetUniform("uTf", m.Tf.x, m.Tf.y, m.Tf.z);
-            shader.prog.SetUniform("uNs", m.Ns);
-            shader.prog.SetUniform("uNi", m.Ni);
-            shader.prog.SetUniform("uIllum", m.illum);
-
-            glBindTextureUnit(0, 0);
-            glBindTextureUnit(1, 0);
-            shader.prog.SetUniform("uHasDiffuseTex", false);
-            shader.prog.SetUniform("uHasSpecularTex", false);
-
-            glDrawArrays(GL_TRIANGLES, 0, (GLsizei)(mesh.NF() * 3));
+            shader.uMaterialID.Set(0);
+            g_glState.BindTextureUnit(0, 0);
+            g_glState.BindTextureUnit(1, 0);
+
+            DrawLod(meshCache, culler, indexType, lod, meshCache.GetLod(lod).firstFace, meshCache.GetLod(lod).faceCount);
         }
 
         // Light Marker
-        glDisable(GL_CULL_FACE);
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
+        g_glState.Disable(GL_CULL_FACE);
+        g_glState.Enable(GL_DEPTH_TEST);
+        g_glState.Disable(GL_BLEND);
 
         cy::Matrix4f MLight = cy::Matrix4f::Translation(lightPosW);
 
-        lightMarkerShader.prog.Bind();
-        lightMarkerShader.prog.SetUniformMatrix4("uM", MLight.cell);
-        lightMarkerShader.prog.SetUniformMatrix4("uV", V.cell);
-        lightMarkerShader.prog.SetUniformMatrix4("uP", P.cell);
-        lightMarkerShader.prog.SetUniform("uColor", 1.0f, 0.9f, 0.2f);
+        g_glState.UseProgram(lightMarkerShader.prog);
+        lightMarkerShader.uM.Set(MLight);
+        lightMarkerShader.uColor.Set(cy::Vec3f(1.0f, 0.9f, 0.2f));
 
-        glBindVertexArray(lightMarkerVAO);
+        g_glState.BindVertexArray(lightMarkerVAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
     
         // Pass 3: Draw Plane with reflection
         // Plane
-        glEnable(GL_DEPTH_TEST);
-        glDisable(GL_BLEND);
-        glEnable(GL_POLYGON_OFFSET_FILL);
+        g_glState.Enable(GL_DEPTH_TEST);
+        g_glState.Disable(GL_BLEND);
+        g_glState.Enable(GL_POLYGON_OFFSET_FILL);
         glPolygonOffset(1.0f, 1.0f);
-        glDisable(GL_POLYGON_OFFSET_FILL);
+        g_glState.Disable(GL_POLYGON_OFFSET_FILL);
 
         cy::Matrix4f Mplane;
         Mplane.SetIdentity();
-        shader.prog.Bind();
-        shader.prog.SetUniformMatrix4("uM", Mplane.cell);
-        shader.prog.SetUniformMatrix4("uV", V.cell);
-        shader.prog.SetUniformMatrix4("uP", P.cell);
-        shader.prog.SetUniform("uCamPosW", camPosW.x, camPosW.y, camPosW.z);
-        shader.prog.SetUniform("uLightPosW", lightPosW.x, lightPosW.y, lightPosW.z);
-
-        // Shadow / spotlight uniforms
-        shader.prog.SetUniformMatrix4("uLightVP", LightVP.cell);
-        shader.prog.SetUniform("uLightDirW", lightDirW.x, lightDirW.y, lightDirW.z);
-        shader.prog.SetUniform("uSpotCosInner", spotCosInner);
-        shader.prog.SetUniform("uSpotCosOuter", spotCosOuter);
-        shader.prog.SetUniform("uShadowMap", 3);
-        glBindTextureUnit(3, shadowDepth.GetTextureID());
-
-        shader.prog.SetUniform("uEnvMap", 2);
-        glBindTextureUnit(2, cubemapTex);
-
-        shader.prog.SetUniform("uReflectStrength", 1.0f);
-        shader.prog.SetUniform("uRefractStrength", 0.0f);
-        shader.prog.SetUniform("uHasDiffuseTex", false);
-        shader.prog.SetUniform("uHasSpecularTex", false);
-        shader.prog.SetUniform("uKa", 0.00f, 0.00f, 0.00f);
-        shader.prog.SetUniform("uKd", 0.04f, 0.04f, 0.04f);
-        shader.prog.SetUniform("uKs", 0.6f, 0.6f, 0.6f);
-        shader.prog.SetUniform("uNs", 512.0f);
-        shader.prog.SetUniform("uReflectStrength", 0.8f);
-
-        glBindVertexArray(reflPlaneVAO);
+        g_glState.UseProgram(shader.prog);
+        shader.uM.Set(Mplane);
+        MeshVertexFormat().SetUniforms(shader);    // the plane uses float vertices
+        g_glState.BindTextureUnit(3, shadowDepth.GetTextureID());
+        g_glState.BindTextureUnit(2, cubemapTex);
+        shader.uMaterialID.Set((int)planeMaterial);
+        shader.uReflectStrength.Set(0.8f);
+
+        g_glState.BindVertexArray(reflPlaneVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
         // Reflection
-        glEnable(GL_DEPTH_TEST);
-		glDepthFunc(GL_LEQUAL);
-        glDepthMask(GL_FALSE);
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
-        glEnable(GL_CULL_FACE);
-        glCullFace(GL_BACK);
-        glFrontFace(GL_CW);
+        g_glState.Enable(GL_DEPTH_TEST);
+		g_glState.DepthFunc(GL_LEQUAL);
+        g_glState.DepthMask(false);
+        g_glState.Enable(GL_BLEND);
+        g_glState.BlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        g_glState.Enable(GL_CULL_FACE);
+        g_glState.CullFace(GL_BACK);
+        g_glState.FrontFace(GL_CW);
 
         // Draw reflective plane
-        reflectShader.prog.Bind();
-        reflectShader.prog.SetUniformMatrix4("uM", Mplane.cell);
-        reflectShader.prog.SetUniformMatrix4("uV", V.cell);
-        reflectShader.prog.SetUniformMatrix4("uP", P.cell);
-        reflectShader.prog.SetUniformMatrix4("uVref", Vref.cell);
-        reflectShader.prog.SetUniformMatrix4("uPref", P.cell);
-
-        reflectShader.prog.SetUniform("uCamPosW", camPosW.x, camPosW.y, camPosW.z);
+        g_glState.UseProgram(reflectShader.prog);
+        reflectShader.uM.Set(Mplane);
+
         //cy::Vec3f fadeCenterW(0.0f, 0.0f, 0.0f);
         //reflectShader.prog.SetUniform("uFadeCenterW", fadeCenterW.x, fadeCenterW.y, fadeCenterW.z);
-        reflectShader.prog.SetUniform("uFadeRadius", 2.0f);
-        reflectShader.prog.SetUniform("uReflectOpacity", 0.6f);
-        reflectShader.prog.SetUniform("uReflectionTex", 0);
+        reflectShader.uFadeRadius.Set(2.0f);
+        reflectShader.uReflectOpacity.Set(0.6f);
 
-        glBindTextureUnit(0, renderTex.GetTextureID());
-        glBindVertexArray(reflPlaneVAO);
+        g_glState.BindTextureUnit(0, renderTex.GetTextureID());
+        g_glState.BindVertexArray(reflPlaneVAO);
         glDrawArrays(GL_TRIANGLES, 0, 6);
 
-        glDepthMask(GL_TRUE);
-		glDepthFunc(GL_LESS);
-        glDisable(GL_BLEND);
-        glDisable(GL_CULL_FACE);
+        g_glState.DepthMask(true);
+		g_glState.DepthFunc(GL_LESS);
+        g_glState.Disable(GL_BLEND);
+        g_glState.Disable(GL_CULL_FACE);
+
+        // Capture the finished frame from the default framebuffer
+        if (capturing)
+            readback.Capture(0, 0, 0, (unsigned int)fbW, (unsigned int)fbH, frameIndex);
+
+        // Keep the material textures within the budget, then report their residency if requested
+        textureManager.Update();
+        if (g_printTextureResidency)
+        {
+            g_printTextureResidency = false;
+            PrintTextureResidency(textureManager);
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
 
-    // Clean up materials
-    for (auto& m : gpuMtls)
+    // Deliver the captures in flight and wait for their files
+    if (readback.NumCaptured() > 0)
     {
-        if (m.texKd) glDeleteTextures(1, &m.texKd);
-        if (m.texKs) glDeleteTextures(1, &m.texKs);
+        readback.Poll(true);
+        frameWriter.Wait();
+        PrintCaptureStats(readback, frameWriter);
     }
+    PrintGLStateStats(g_glState, frameIndex);
+    readback.Delete();
+    frameUniforms.Delete();
+    materialBuffer.Delete();
+
+    // Clean up materials
+    textureManager.Clear();
     glDeleteBuffers(1, &planeVBO);
     glDeleteVertexArrays(1, &planeVAO);
+    glDeleteBuffers(1, &ebo);
     glDeleteBuffers(1, &tbo);
     glDeleteBuffers(1, &nbo);
     glDeleteBuffers(1, &vbo);
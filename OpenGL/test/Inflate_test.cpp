@@ -0,0 +1,295 @@
+// Tests of the table-driven inflate (cyInflate.h) against lodepng's own inflate. The output must be byte
+// identical on the zlib streams of the PNG files in the assets directory and on generated streams, and on
+// truncated and corrupted streams both decoders must agree on success or failure. Incomplete Huffman codes
+// must be rejected, except the empty code and the single one-bit code.
+// With the argument "bench", the inflate throughput on the cubemap PNGs is printed as well.
+// lodepng is compiled in, so this test is built with ../source/lodepng.cpp.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cyInflate.h"
+#include "TestCommon.h"
+
+typedef unsigned (*InflateFunc)(unsigned char**, size_t*, const unsigned char*, size_t, const LodePNGDecompressSettings*);
+
+// Decodes with the given function and returns the lodepng error code
+static unsigned Decode(InflateFunc func, const std::vector<unsigned char>& in, std::vector<unsigned char>& out)
+{
+    LodePNGDecompressSettings settings;
+    lodepng_decompress_settings_init(&settings);
+    unsigned char* data = nullptr;
+    size_t size = 0;
+    const unsigned error = func(&data, &size, in.data(), in.size(), &settings);
+    out.assign(data, data + (error ? 0 : size));
+    free(data);
+    return error;
+}
+
+// Decodes the stream with both decoders and returns false if they disagree on success or on the output
+static bool SameResult(const std::vector<unsigned char>& in, bool zlib, bool* succeeded = nullptr)
+{
+    std::vector<unsigned char> expected, actual;
+    const unsigned expectedError = Decode(zlib ? lodepng_zlib_decompress : lodepng_inflate, in, expected);
+    const unsigned actualError = Decode(zlib ? cy::ZlibDecompress : cy::Inflate, in, actual);
+    if (succeeded)
+        *succeeded = actualError == 0;
+    return (expectedError == 0) == (actualError == 0) && expected == actual;
+}
+
+// Returns the concatenated IDAT chunks of a PNG file, which form one zlib stream
+static std::vector<unsigned char> ReadIdat(const std::filesystem::path& file)
+{
+    std::ifstream stream(file, std::ios::binary);
+    const std::vector<unsigned char> png((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+    std::vector<unsigned char> idat;
+    for (size_t pos = 8; pos + 12 <= png.size();)
+    {
+        const size_t length = (size_t(png[pos]) << 24) | (png[pos + 1] << 16) | (png[pos + 2] << 8) | png[pos + 3];
+        if (pos + 12 + length > png.size())
+            break;
+        if (memcmp(&png[pos + 4], "IDAT", 4) == 0)
+            idat.insert(idat.end(), png.begin() + pos + 8, png.begin() + pos + 8 + length);
+        pos += 12 + length;
+    }
+    return idat;
+}
+
+static std::vector<std::filesystem::path> FindPngs(const std::filesystem::path& dir)
+{
+    std::vector<std::filesystem::path> files;
+    std::error_code ec;
+    for (std::filesystem::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec))
+        if (it->path().extension() == ".png")
+            files.push_back(it->path());
+    return files;
+}
+
+static void TestPngCorpus(const std::vector<std::filesystem::path>& pngs)
+{
+    unsigned int numSame = 0;
+    for (const std::filesystem::path& file : pngs)
+    {
+        bool succeeded = false;
+        const bool same = SameResult(ReadIdat(file), true, &succeeded);
+        if (!same || !succeeded)
+            std::cerr << file.string() << " differs or fails\n";
+        numSame += same && succeeded;
+    }
+    std::cout << numSame << " of " << pngs.size() << " PNG streams are identical\n";
+    CHECK(!pngs.empty());
+    CHECK(numSame == pngs.size());
+}
+
+// Data that compresses to stored, fixed, and dynamic blocks with short and long matches
+static std::vector<unsigned char> MakeData(unsigned int kind, size_t size, std::mt19937& rng)
+{
+    std::vector<unsigned char> data(size);
+    static const char text[] = "the quick brown fox jumps over the lazy dog, ";
+    for (size_t i = 0; i < size; ++i)
+    {
+        switch (kind % 5)
+        {
+            case 0: data[i] = (unsigned char)rng(); break;                                  // incompressible
+            case 1: data[i] = (unsigned char)text[i % (sizeof(text) - 1)]; break;           // long matches
+            case 2: data[i] = 0; break;                                                     // distance 1 runs
+            case 3: data[i] = (unsigned char)(rng() % 4 + (i / 1000) * 3); break;           // few symbols
+            case 4: data[i] = i > 300 && rng() % 8 ? data[i - 1 - rng() % 300] : (unsigned char)rng(); break;  // random matches
+        }
+    }
+    return data;
+}
+
+// Compresses the data to a zlib stream with the given block type and window
+static std::vector<unsigned char> Compress(const std::vector<unsigned char>& data, unsigned int btype, unsigned int windowSize)
+{
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init(&settings);
+    settings.btype = btype;
+    settings.windowsize = windowSize;
+    unsigned char* out = nullptr;
+    size_t size = 0;
+    std::vector<unsigned char> stream;
+    if (lodepng_zlib_compress(&out, &size, data.data(), data.size(), &settings) == 0)
+        stream.assign(out, out + size);
+    free(out);
+    return stream;
+}
+
+static void TestGeneratedStreams()
+{
+    std::mt19937 rng(11);
+    unsigned int numStreams = 0, numSame = 0, numMutated = 0, numMutatedSame = 0, numMutatedDecoded = 0;
+    for (unsigned int kind = 0; kind < 5; ++kind)
+    {
+        for (size_t size : { 1, 100, 5000, 70000, 300000 })
+        {
+            for (unsigned int btype = 0; btype < 3; ++btype)
+            {
+                const std::vector<unsigned char> zlib = Compress(MakeData(kind, size, rng), btype, btype == 2 && size > 5000 ? 32768 : 2048);
+                if (zlib.size() < 7)
+                    continue;
+                ++numStreams;
+                numSame += SameResult(zlib, true);
+
+                // Truncated streams, with and without the zlib trailer
+                for (size_t cut : { size_t(2), zlib.size() / 3, zlib.size() / 2, zlib.size() - 5, zlib.size() - 4, zlib.size() - 1 })
+                {
+                    ++numMutated;
+                    numMutatedSame += SameResult(std::vector<unsigned char>(zlib.begin(), zlib.begin() + cut), true);
+                }
+
+                // Corrupted raw deflate data, where no checksum hides the errors of the decoder
+                const std::vector<unsigned char> deflate(zlib.begin() + 2, zlib.end() - 4);
+                for (int trial = 0; trial < 60; ++trial)
+                {
+                    std::vector<unsigned char> corrupted = deflate;
+                    const size_t region = trial < 30 ? cy::Min(corrupted.size(), size_t(64)) : corrupted.size();  // half in the block headers
+                    for (int flips = 1 + trial % 3; flips > 0; --flips)
+                        corrupted[rng() % region] ^= (unsigned char)(1 << (rng() % 8));
+                    bool decoded = false;
+                    ++numMutated;
+                    numMutatedSame += SameResult(corrupted, false, &decoded);
+                    numMutatedDecoded += decoded;
+                }
+            }
+        }
+    }
+    std::cout << numSame << " of " << numStreams << " generated streams are identical, "
+        << numMutatedSame << " of " << numMutated << " truncated or corrupted streams agree ("
+        << numMutatedDecoded << " corrupted streams decode)\n";
+    CHECK(numSame == numStreams);
+    CHECK(numMutatedSame == numMutated);
+}
+
+// Writes the bits of a dynamic block by hand, to test the checks of the code lengths
+class BitWriter
+{
+public:
+    void Write(unsigned int value, unsigned int numBits)   // LSB first, as the header fields and extra bits
+    {
+        for (unsigned int i = 0; i < numBits; ++i)
+            Bit((value >> i) & 1);
+    }
+    void WriteCode(unsigned int code, unsigned int length)   // MSB first, as the Huffman codes
+    {
+        for (unsigned int i = length; i-- > 0;)
+            Bit((code >> i) & 1);
+    }
+    const std::vector<unsigned char>& Data() const { return data; }
+
+private:
+    std::vector<unsigned char> data;
+    unsigned int numBits = 0;
+    void Bit(unsigned int b)
+    {
+        if (numBits % 8 == 0)
+            data.push_back(0);
+        data.back() |= (unsigned char)(b << (numBits % 8));
+        ++numBits;
+    }
+};
+
+// A dynamic block with 257 literal/length codes and one distance code that encodes the literal 0 and the end code.
+// The literal 0 has a one-bit code and the end code a two-bit code. If completeLiterals is set, the literal 1
+// also has a two-bit code, which makes the literal/length code complete.
+static std::vector<unsigned char> MakeDynamicBlock(bool completeLiterals, unsigned int distLength)
+{
+    BitWriter w;
+    w.Write(1, 1);    // final block
+    w.Write(2, 2);    // dynamic Huffman codes
+    w.Write(0, 5);    // 257 literal/length codes
+    w.Write(0, 5);    // 1 distance code
+    w.Write(14, 4);   // 18 code length codes, up to the one of length 1
+
+    // The code length symbols 0, 1, 2, and 18 have two-bit codes 00, 01, 10, and 11
+    static const unsigned int order[18] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1 };
+    for (unsigned int symbol : order)
+        w.Write(symbol == 0 || symbol == 1 || symbol == 2 || symbol == 18 ? 2 : 0, 3);
+    auto length = [&w](unsigned int len) { w.WriteCode(len, 2); };
+    auto zeros = [&w](unsigned int n) { w.WriteCode(3, 2); w.Write(n - 11, 7); };
+
+    length(1);                  // literal 0
+    if (completeLiterals)
+    {
+        length(2);              // literal 1
+        zeros(138);
+        zeros(116);             // literals 2 to 255
+    }
+    else
+    {
+        zeros(138);
+        zeros(117);             // literals 1 to 255
+    }
+    length(2);                  // end code
+    length(distLength);         // distance code 0
+
+    // Codes: literal 0 is 0, and the end code is 11 after the literal 1 at 10, or 10 without it
+    w.WriteCode(0, 1);
+    w.WriteCode(completeLiterals ? 3 : 2, 2);
+    return w.Data();
+}
+
+static void TestIncompleteCodes()
+{
+    std::vector<unsigned char> out;
+    CHECK(Decode(cy::Inflate, MakeDynamicBlock(true, 1), out) == 0 && out == std::vector<unsigned char>(1, 0));
+    CHECK(Decode(cy::Inflate, MakeDynamicBlock(true, 0), out) == 0 && out == std::vector<unsigned char>(1, 0));     // no distance code
+    CHECK(Decode(cy::Inflate, MakeDynamicBlock(true, 2), out) != 0);     // a single two-bit distance code
+    CHECK(Decode(cy::Inflate, MakeDynamicBlock(false, 1), out) != 0);    // incomplete literal/length code
+    CHECK(Decode(lodepng_inflate, MakeDynamicBlock(true, 1), out) == 0);
+    CHECK(Decode(lodepng_inflate, MakeDynamicBlock(false, 1), out) != 0);
+}
+
+// Prints the inflate throughput of both decoders on the zlib streams of the given PNG files
+static void Benchmark(const std::vector<std::filesystem::path>& pngs)
+{
+    std::vector<std::vector<unsigned char>> streams;
+    size_t inSize = 0, outSize = 0;
+    for (const std::filesystem::path& file : pngs)
+    {
+        if (file.string().find("cubemap") == std::string::npos)
+            continue;
+        streams.push_back(ReadIdat(file));
+        inSize += streams.back().size();
+        std::vector<unsigned char> out;
+        Decode(cy::ZlibDecompress, streams.back(), out);
+        outSize += out.size();
+    }
+    if (streams.empty())
+        return;
+    const struct { const char* name; InflateFunc func; } decoders[] = { { "lodepng", lodepng_zlib_decompress }, { "cy", cy::ZlibDecompress } };
+    for (const auto& decoder : decoders)
+    {
+        double best = 1e30;
+        for (int run = 0; run < 3; ++run)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            std::vector<unsigned char> out;
+            for (const std::vector<unsigned char>& stream : streams)
+                Decode(decoder.func, stream, out);
+            best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+        std::cout << decoder.name << " inflate of " << streams.size() << " cubemap streams: "
+            << (int)(inSize / best / (1024 * 1024)) << " MB/s in, " << (int)(outSize / best / (1024 * 1024)) << " MB/s out\n";
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const bool bench = argc > 1 && std::string(argv[1]) == "bench";
+    const std::vector<std::filesystem::path> pngs = FindPngs("../assets");
+    TestPngCorpus(pngs);
+    TestGeneratedStreams();
+    TestIncompleteCodes();
+    if (bench)
+        Benchmark(pngs);
+    return TestResult("Inflate_test");
+}
@@ -0,0 +1,201 @@
+// Tests of the post-transform vertex cache simulator and the triangle order optimization
+// (cyMeshOptimizer.h and IndexedMesh::Optimize). No GPU is needed.
+
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "cyIndexedMesh.h"
+#include "TestCommon.h"
+
+// Reference FIFO cache simulator that keeps the cached vertices in a queue
+static unsigned int SimulateFifo(const std::vector<uint32_t>& indices, unsigned int cacheSize)
+{
+    std::deque<uint32_t> cache;
+    unsigned int transforms = 0;
+    for (uint32_t v : indices)
+    {
+        if (std::find(cache.begin(), cache.end(), v) != cache.end())
+            continue;
+        ++transforms;
+        cache.push_back(v);
+        if (cache.size() > cacheSize)
+            cache.pop_front();
+    }
+    return transforms;
+}
+
+// Triangles of a grid of w x h quads with (w+1) x (h+1) vertices, row by row
+static std::vector<uint32_t> MakeGrid(unsigned int w, unsigned int h)
+{
+    std::vector<uint32_t> indices;
+    for (unsigned int y = 0; y < h; ++y)
+    {
+        for (unsigned int x = 0; x < w; ++x)
+        {
+            const uint32_t v = y * (w + 1) + x;
+            indices.insert(indices.end(), { v, v + 1, v + w + 2 });
+            indices.insert(indices.end(), { v, v + w + 2, v + w + 1 });
+        }
+    }
+    return indices;
+}
+
+// Shuffles the triangles of the index buffer, keeping the vertex order of each triangle
+static void ShuffleTriangles(std::vector<uint32_t>& indices, unsigned int seed)
+{
+    std::vector<std::array<uint32_t, 3>> tris(indices.size() / 3);
+    for (size_t t = 0; t < tris.size(); ++t)
+        tris[t] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+    std::shuffle(tris.begin(), tris.end(), std::mt19937(seed));
+    for (size_t t = 0; t < tris.size(); ++t)
+        for (int c = 0; c < 3; ++c)
+            indices[t * 3 + c] = tris[t][c];
+}
+
+static void TestKnownAcmr()
+{
+    // Disjoint triangles transform every corner
+    std::vector<uint32_t> disjoint(300);
+    for (uint32_t i = 0; i < 300; ++i)
+        disjoint[i] = i;
+    cy::VertexCacheStats s = cy::AnalyzeVertexCache(disjoint.data(), disjoint.size(), 300);
+    CHECK(s.transforms == 300);
+    CHECK(s.acmr == 3.0f);
+    CHECK(s.atvr == 1.0f);
+
+    // A strip transforms one vertex per triangle after the first one
+    const unsigned int numTris = 200;
+    std::vector<uint32_t> strip;
+    for (uint32_t t = 0; t < numTris; ++t)
+    {
+        if (t % 2 == 0) strip.insert(strip.end(), { t, t + 1, t + 2 });
+        else            strip.insert(strip.end(), { t + 1, t, t + 2 });
+    }
+    s = cy::AnalyzeVertexCache(strip.data(), strip.size(), numTris + 2);
+    CHECK(s.transforms == numTris + 2);
+    CHECK(s.acmr >= 0.5f && s.acmr <= 1.0f + 2.0f / numTris);
+    CHECK(s.atvr == 1.0f);
+
+    // An empty index buffer has no misses
+    s = cy::AnalyzeVertexCache(nullptr, 0, 0);
+    CHECK(s.transforms == 0 && s.acmr == 0.0f && s.atvr == 0.0f);
+}
+
+static void TestAgainstReferenceSimulator()
+{
+    std::mt19937 rng(1);
+    for (unsigned int cacheSize : { 1u, 3u, 8u, 16u, 32u })
+    {
+        for (unsigned int numVertices : { 3u, 20u, 500u })
+        {
+            std::vector<uint32_t> indices(3 * 400);
+            for (uint32_t& i : indices)
+                i = rng() % numVertices;
+            const cy::VertexCacheStats s = cy::AnalyzeVertexCache(indices.data(), indices.size(), numVertices, cacheSize);
+            CHECK(s.transforms == SimulateFifo(indices, cacheSize));
+        }
+    }
+}
+
+static void TestOptimizeVertexCache()
+{
+    const unsigned int w = 32, h = 32, nv = (w + 1) * (h + 1);
+    std::vector<uint32_t> indices = MakeGrid(w, h);
+    ShuffleTriangles(indices, 2);
+    std::vector<uint32_t> sorted = indices;
+    const cy::VertexCacheStats before = cy::AnalyzeVertexCache(indices.data(), indices.size(), nv);
+    cy::OptimizeVertexCache(indices.data(), indices.size(), nv);
+    const cy::VertexCacheStats after = cy::AnalyzeVertexCache(indices.data(), indices.size(), nv);
+    std::cout << "Shuffled grid ACMR " << before.acmr << " ATVR " << before.atvr
+        << ", optimized ACMR " << after.acmr << " ATVR " << after.atvr << "\n";
+    CHECK(after.acmr < before.acmr);
+    CHECK(after.acmr < 0.9f);
+    CHECK(after.transforms == SimulateFifo(indices, cy::defaultVertexCacheSize));
+
+    // The triangles and their windings are kept
+    auto triangles = [](const std::vector<uint32_t>& ix)
+    {
+        std::vector<std::array<uint32_t, 3>> tris(ix.size() / 3);
+        for (size_t t = 0; t < tris.size(); ++t)
+            tris[t] = { ix[t * 3], ix[t * 3 + 1], ix[t * 3 + 2] };
+        std::sort(tris.begin(), tris.end());
+        return tris;
+    };
+    CHECK(triangles(indices) == triangles(sorted));
+}
+
+static void TestIndexedMeshOptimize()
+{
+    // A grid whose triangles are shuffled within three material ranges of different sizes
+    const unsigned int w = 24, h = 24, nv = (w + 1) * (h + 1);
+    cy::IndexedMesh mesh;
+    mesh.indices = MakeGrid(w, h);
+    for (unsigned int v = 0; v < nv; ++v)
+    {
+        mesh.positions.insert(mesh.positions.end(), { float(v % (w + 1)), float(v / (w + 1)), 0.0f });
+        mesh.normals.insert(mesh.normals.end(), { 0.0f, 0.0f, 1.0f });
+        mesh.texCoords.insert(mesh.texCoords.end(), { float(v), 0.0f });
+    }
+    const unsigned int nf = mesh.NumFaces();
+    mesh.mtlRanges = { { 0, 100 }, { 100, 700 }, { 800, nf - 800 } };
+    for (const cy::IndexedMesh::MtlRange& r : mesh.mtlRanges)
+    {
+        std::vector<uint32_t> part(mesh.indices.begin() + r.firstFace * 3, mesh.indices.begin() + (r.firstFace + r.faceCount) * 3);
+        ShuffleTriangles(part, r.firstFace);
+        std::copy(part.begin(), part.end(), mesh.indices.begin() + r.firstFace * 3);
+    }
+
+    // Triangles of a material range as sorted position triples, which do not depend on the vertex order
+    typedef std::array<float, 9> Triangle;
+    auto rangeTriangles = [&mesh](const cy::IndexedMesh::MtlRange& r)
+    {
+        std::vector<Triangle> tris;
+        for (unsigned int f = r.firstFace; f < r.firstFace + r.faceCount; ++f)
+        {
+            Triangle t;
+            for (int c = 0; c < 3; ++c)
+                for (int j = 0; j < 3; ++j)
+                    t[c * 3 + j] = mesh.positions[size_t(mesh.indices[f * 3 + c]) * 3 + j];
+            tris.push_back(t);
+        }
+        std::sort(tris.begin(), tris.end());
+        return tris;
+    };
+    std::vector<std::vector<Triangle>> before;
+    for (const cy::IndexedMesh::MtlRange& r : mesh.mtlRanges)
+        before.push_back(rangeTriangles(r));
+    const cy::VertexCacheStats statsBefore = mesh.AnalyzeVertexCache();
+
+    mesh.Optimize();
+
+    const cy::VertexCacheStats statsAfter = mesh.AnalyzeVertexCache();
+    std::cout << "Material ranges ACMR " << statsBefore.acmr << " -> " << statsAfter.acmr
+        << ", ATVR " << statsBefore.atvr << " -> " << statsAfter.atvr << "\n";
+    CHECK(statsAfter.acmr < statsBefore.acmr);
+    CHECK(mesh.NumVertices() == nv);
+    CHECK(mesh.NumFaces() == nf);
+    for (size_t m = 0; m < mesh.mtlRanges.size(); ++m)
+        CHECK(rangeTriangles(mesh.mtlRanges[m]) == before[m]);
+
+    // The vertices are renumbered in the order they are first used
+    uint32_t next = 0;
+    bool firstUseOrder = true;
+    for (uint32_t i : mesh.indices)
+    {
+        if (i > next) firstUseOrder = false;
+        if (i == next) ++next;
+    }
+    CHECK(firstUseOrder);
+}
+
+int main()
+{
+    TestKnownAcmr();
+    TestAgainstReferenceSimulator();
+    TestOptimizeVertexCache();
+    TestIndexedMeshOptimize();
+    return TestResult("MeshOptimizer_test");
+}
@@ -0,0 +1,207 @@
+// Tests of the meshlet builder and of the meshlet bounds and culling (cyMeshlet.h). No GPU is needed.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "cyMeshlet.h"
+#include "TestCommon.h"
+
+// A closed sphere with a noisy radius, so that the face normals vary within the meshlets
+static void MakeBumpySphere(std::vector<float>& positions, std::vector<uint32_t>& indices, unsigned int rings, unsigned int segments)
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> bump(0.9f, 1.1f);
+    const float pi = 3.14159265f;
+    for (unsigned int r = 0; r <= rings; ++r)
+    {
+        for (unsigned int s = 0; s < segments; ++s)
+        {
+            const float theta = pi * r / rings, phi = 2 * pi * s / segments;
+            const float radius = (r == 0 || r == rings) ? 1.0f : bump(rng);
+            positions.insert(positions.end(), { radius * std::sin(theta) * std::cos(phi), radius * std::cos(theta), radius * std::sin(theta) * std::sin(phi) });
+        }
+    }
+    for (unsigned int r = 0; r < rings; ++r)
+    {
+        for (unsigned int s = 0; s < segments; ++s)
+        {
+            const uint32_t a = r * segments + s, b = r * segments + (s + 1) % segments;
+            const uint32_t c = a + segments, d = b + segments;
+            if (r > 0) indices.insert(indices.end(), { a, b, c });
+            if (r + 1 < rings) indices.insert(indices.end(), { b, d, c });
+        }
+    }
+}
+
+static cy::Vec3f Position(const std::vector<float>& positions, uint32_t v)
+{
+    return cy::Vec3f(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+}
+
+static cy::Vec3f FaceNormal(const std::vector<float>& positions, const uint32_t* face)
+{
+    const cy::Vec3f p0 = Position(positions, face[0]);
+    return (Position(positions, face[1]) - p0).Cross(Position(positions, face[2]) - p0);
+}
+
+// Returns the triangles of the face range, sorted, to compare them regardless of their order
+static std::vector<std::array<uint32_t, 3>> RangeTriangles(const std::vector<uint32_t>& indices, const cy::FaceRange& r)
+{
+    std::vector<std::array<uint32_t, 3>> tris;
+    for (unsigned int f = r.firstFace; f < r.firstFace + r.faceCount; ++f)
+        tris.push_back({ indices[f * 3], indices[f * 3 + 1], indices[f * 3 + 2] });
+    std::sort(tris.begin(), tris.end());
+    return tris;
+}
+
+static void TestBuildAndBounds(const std::vector<float>& positions, std::vector<uint32_t>& indices, std::vector<cy::Meshlet>& meshlets, unsigned int maxVertices, unsigned int maxTriangles)
+{
+    // Two face ranges, as with two materials
+    const unsigned int nf = (unsigned int)indices.size() / 3;
+    const cy::FaceRange ranges[2] = { { 0, nf / 3 }, { nf / 3, nf - nf / 3 } };
+    const std::vector<std::array<uint32_t, 3>> before[2] = { RangeTriangles(indices, ranges[0]), RangeTriangles(indices, ranges[1]) };
+
+    meshlets.clear();
+    cy::BuildMeshlets(meshlets, indices.data(), positions.data(), (unsigned int)positions.size() / 3, ranges, 2, maxVertices, maxTriangles);
+    std::cout << nf << " faces in " << meshlets.size() << " meshlets of at most " << maxVertices << " vertices and " << maxTriangles << " triangles\n";
+
+    // The triangles stay within their ranges and the meshlets cover each face once, in order
+    for (int r = 0; r < 2; ++r)
+        CHECK(RangeTriangles(indices, ranges[r]) == before[r]);
+    unsigned int nextFace = 0;
+    bool contiguous = true, withinLimits = true, crossesRange = false, sphereContains = true, coneContains = true;
+    std::vector<uint32_t> vertices;
+    for (const cy::Meshlet& m : meshlets)
+    {
+        contiguous = contiguous && m.firstFace == nextFace && m.faceCount > 0;
+        nextFace = m.firstFace + m.faceCount;
+        crossesRange = crossesRange || (m.firstFace < ranges[1].firstFace && nextFace > ranges[1].firstFace);
+
+        vertices.assign(indices.begin() + m.firstFace * 3, indices.begin() + nextFace * 3);
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+        withinLimits = withinLimits && m.faceCount <= maxTriangles && m.vertexCount <= maxVertices && m.vertexCount == vertices.size();
+
+        // Every vertex is in the bounding sphere
+        for (uint32_t v : vertices)
+        {
+            if ((Position(positions, v) - m.GetCenter()).Length() > m.radius * (1 + 1e-6f))
+                sphereContains = false;
+        }
+
+        // Every face normal is in the normal cone: its angle to the axis is at most the half angle,
+        // up to the rounding of the cutoff, which is close to 1 for wide cones. The angle is computed
+        // with atan2, since acos of a cosine close to 1 is not accurate for small angles.
+        if (m.HasCone())
+        {
+            const float halfAngle = std::asin(m.coneCutoff);
+            for (unsigned int f = m.firstFace; f < nextFace; ++f)
+            {
+                const cy::Vec3f n = FaceNormal(positions, &indices[f * 3]);
+                if (n.Length() > 0 && std::atan2(m.GetConeAxis().Cross(n).Length(), m.GetConeAxis().Dot(n)) > halfAngle + 1e-4f)
+                    coneContains = false;
+            }
+        }
+    }
+    CHECK(contiguous);
+    CHECK(nextFace == nf);
+    CHECK(!crossesRange);
+    CHECK(withinLimits);
+    CHECK(sphereContains);
+    CHECK(coneContains);
+}
+
+// Checks that the culler never rejects a meshlet with a face that is rendered with the cull mode.
+// The whole mesh is in the frustum, so only the cone test can reject meshlets.
+static void TestConeCulling(const std::vector<float>& positions, const std::vector<uint32_t>& indices, const std::vector<cy::Meshlet>& meshlets)
+{
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    unsigned int numCulled = 0, numWrong = 0;
+    for (int view = 0; view < 200; ++view)
+    {
+        cy::Vec3f dir(uniform(rng), uniform(rng), uniform(rng));
+        if (dir.Length() < 0.1f) continue;
+        dir.Normalize();
+        const bool perspective = view % 2 == 0;
+        const cy::Vec3f eye = dir * (perspective ? 3.0f + 3.0f * std::abs(uniform(rng)) : 10.0f);
+        const cy::Vec3f up = std::abs(dir.y) < 0.9f ? cy::Vec3f(0, 1, 0) : cy::Vec3f(1, 0, 0);
+        const cy::Matrix4f modelView = cy::Matrix4f::View(eye, cy::Vec3f(0, 0, 0), up);
+        cy::Matrix4f proj;
+        if (perspective)
+        {
+            proj = cy::Matrix4f::Perspective(1.6f, 1.0f, 0.1f, 100.0f);
+        }
+        else
+        {
+            proj.SetIdentity();
+            proj(0, 0) = proj(1, 1) = 1 / 1.5f;
+            proj(2, 2) = -2 / 99.9f;
+            proj(2, 3) = -100.1f / 99.9f;
+        }
+        const cy::MeshletCuller::CullMode mode = view % 4 < 2 ? cy::MeshletCuller::CULL_BACK : cy::MeshletCuller::CULL_FRONT;
+        cy::MeshletCuller culler;
+        culler.Set(proj, modelView, mode);
+
+        for (const cy::Meshlet& m : meshlets)
+        {
+            if (culler.IsVisible(m))
+                continue;
+            ++numCulled;
+            for (unsigned int f = m.firstFace; f < m.firstFace + m.faceCount; ++f)
+            {
+                const uint32_t* face = &indices[f * 3];
+                const cy::Vec3f toEye = perspective ? eye - Position(positions, face[0]) : dir;
+                const float facing = FaceNormal(positions, face).Dot(toEye);
+                if (mode == cy::MeshletCuller::CULL_BACK ? facing > 0 : facing < 0)
+                {
+                    ++numWrong;
+                    break;
+                }
+            }
+        }
+    }
+    std::cout << numCulled << " meshlets culled by the normal cones\n";
+    CHECK(numCulled > 0);
+    CHECK(numWrong == 0);
+}
+
+// Checks the bounds of a flat square and of two opposite faces
+static void TestSimpleBounds()
+{
+    const std::vector<float> positions = { 0, 0, 0, 2, 0, 0, 0, 2, 0, 2, 2, 0 };
+    const std::vector<uint32_t> indices = { 0, 1, 2, 1, 3, 2 };
+    cy::Meshlet m = {};
+    m.firstFace = 0;
+    m.faceCount = 2;
+    cy::ComputeMeshletBounds(m, indices.data(), positions.data());
+    // The sphere of Ritter's method is not the smallest one, which has the radius sqrt(2)
+    CHECK(m.radius >= std::sqrt(2.0f) - 1e-5f);
+    for (int v = 0; v < 4; ++v)
+        CHECK((Position(positions, v) - m.GetCenter()).Length() <= m.radius);
+    CHECK(m.HasCone());
+    CHECK((m.GetConeAxis() - cy::Vec3f(0, 0, 1)).Length() < 1e-5f);
+    CHECK(m.coneCutoff < 1e-3f);
+
+    // Opposite faces give a cone that cannot cull
+    const std::vector<uint32_t> folded = { 0, 1, 2, 1, 2, 3 };
+    cy::ComputeMeshletBounds(m, folded.data(), positions.data());
+    CHECK(!m.HasCone());
+}
+
+int main()
+{
+    std::vector<float> positions;
+    std::vector<uint32_t> indices;
+    MakeBumpySphere(positions, indices, 40, 64);
+    std::vector<cy::Meshlet> meshlets;
+    TestBuildAndBounds(positions, indices, meshlets, cy::meshletMaxVertices, cy::meshletMaxTriangles);
+    TestConeCulling(positions, indices, meshlets);
+    TestBuildAndBounds(positions, indices, meshlets, 16, 10);
+    TestConeCulling(positions, indices, meshlets);
+    TestSimpleBounds();
+    return TestResult("Meshlet_test");
+}
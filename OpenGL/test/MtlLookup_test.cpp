@@ -0,0 +1,144 @@
+// Synthetic benchmark of the material lookup and the face sort by material (cyTriMesh.h). It writes an OBJ file
+// with 200k faces that switch between 10k materials on every face, and a .mtl file that defines them in a
+// different order. Both OBJ loaders are timed, and their faces, material ranges, and material data must match
+// a serial reference computed from the generated file.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cyTriMesh.h"
+#include "TestCommon.h"
+
+static const unsigned int kNumFaces = 200000;
+static const unsigned int kNumMaterials = 10000;
+static const unsigned int kNumFacesWithoutMtl = 100;    // faces before the first usemtl, which go last
+
+static std::string MtlName(unsigned int k) { return "mtl_" + std::to_string(k); }
+
+// Writes the OBJ and .mtl files and returns the material of each face in file order, -1 for no material.
+// Face i uses the vertices i+1, i+2, and i+3, so every face can be identified by its first vertex.
+static std::vector<int> WriteScene(const std::string& objFile, const std::string& mtlFile)
+{
+    std::mt19937 rng(10);
+    std::vector<int> faceMtl(kNumFaces, -1);
+    std::vector<unsigned int> order(kNumMaterials);
+    std::iota(order.begin(), order.end(), 0u);
+    std::shuffle(order.begin(), order.end(), rng);
+    for (unsigned int i = kNumFacesWithoutMtl; i < kNumFaces; ++i)
+    {
+        // Every material is used, first in a shuffled order and then at random
+        const unsigned int j = i - kNumFacesWithoutMtl;
+        faceMtl[i] = (int)(j < kNumMaterials ? order[j] : rng() % kNumMaterials);
+    }
+
+    FILE* fp = fopen(objFile.c_str(), "w");
+    if (!fp)
+        return {};
+    fprintf(fp, "mtllib %s\n", std::filesystem::path(mtlFile).filename().string().c_str());
+    for (unsigned int i = 0; i < kNumFaces + 2; ++i)
+        fprintf(fp, "v %u %u 0\n", i % 1000, i / 1000);
+    for (unsigned int i = 0; i < kNumFaces; ++i)
+    {
+        if (faceMtl[i] >= 0)
+            fprintf(fp, "usemtl %s\n", MtlName(faceMtl[i]).c_str());
+        fprintf(fp, "f %u %u %u\n", i + 1, i + 2, i + 3);
+    }
+    fclose(fp);
+
+    // The materials are defined in reverse order, and their diffuse color identifies them
+    fp = fopen(mtlFile.c_str(), "w");
+    if (!fp)
+        return {};
+    for (unsigned int k = kNumMaterials; k-- > 0;)
+        fprintf(fp, "newmtl %s\nKd %u %u 0.5\nNs %u\n", MtlName(k).c_str(), k % 100, k / 100, k);
+    fclose(fp);
+    return faceMtl;
+}
+
+// Checks the loaded mesh against the serial reference: materials are numbered in the order of their first
+// usemtl, faces are sorted by material keeping the file order, and faces without a material go last
+static void CheckMesh(const cy::TriMesh& mesh, const std::vector<int>& faceMtl)
+{
+    std::vector<int> mtlIndex(kNumMaterials, -1), mtlOfIndex;
+    for (int k : faceMtl)
+    {
+        if (k >= 0 && mtlIndex[k] < 0)
+        {
+            mtlIndex[k] = (int)mtlOfIndex.size();
+            mtlOfIndex.push_back(k);
+        }
+    }
+    std::vector<unsigned int> faces(kNumFaces);
+    std::iota(faces.begin(), faces.end(), 0u);
+    auto key = [&](unsigned int i) { return faceMtl[i] < 0 ? (int)kNumMaterials : mtlIndex[faceMtl[i]]; };
+    std::stable_sort(faces.begin(), faces.end(), [&](unsigned int a, unsigned int b) { return key(a) < key(b); });
+
+    CHECK(mesh.NF() == kNumFaces);
+    CHECK(mesh.NM() == kNumMaterials);
+    if (mesh.NF() != kNumFaces || mesh.NM() != kNumMaterials)
+        return;
+    bool faceOrder = true;
+    for (unsigned int i = 0; i < kNumFaces; ++i)
+    {
+        const unsigned int f = faces[i];
+        faceOrder = faceOrder && mesh.F(i).v[0] == f && mesh.F(i).v[1] == f + 1 && mesh.F(i).v[2] == f + 2;
+    }
+    CHECK(faceOrder);
+
+    bool ranges = true, materials = true;
+    unsigned int first = 0;
+    for (unsigned int m = 0; m < kNumMaterials; ++m)
+    {
+        const unsigned int k = mtlOfIndex[m];
+        const unsigned int count = (unsigned int)std::count(faceMtl.begin(), faceMtl.end(), (int)k);
+        ranges = ranges && mesh.GetMaterialFirstFace(m) == (int)first && mesh.GetMaterialFaceCount(m) == (int)count;
+        first += count;
+        const cy::TriMesh::Mtl& mtl = mesh.M(m);
+        materials = materials && mtl.name.data && MtlName(k) == mtl.name.data
+            && mtl.Kd[0] == float(k % 100) && mtl.Kd[1] == float(k / 100) && mtl.Ns == float(k);
+    }
+    CHECK(ranges);
+    CHECK(materials);
+    CHECK(first == kNumFaces - kNumFacesWithoutMtl);
+}
+
+int main()
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "cy_mtl_lookup_test";
+    std::filesystem::create_directories(dir);
+    const std::string objFile = (dir / "materials.obj").string(), mtlFile = (dir / "materials.mtl").string();
+    const std::vector<int> faceMtl = WriteScene(objFile, mtlFile);
+    CHECK(faceMtl.size() == kNumFaces);
+
+    typedef bool (*LoadFunc)(cy::TriMesh&, const char*);
+    const struct { const char* name; LoadFunc load; } loaders[] = {
+        { "LoadFromFileObj", [](cy::TriMesh& mesh, const char* file) { return mesh.LoadFromFileObj(file, true, nullptr); } },
+        { "LoadFromFileObjMapped", [](cy::TriMesh& mesh, const char* file) { return mesh.LoadFromFileObjMapped(file, true, nullptr); } },
+    };
+    std::cout << kNumFaces << " faces with " << kNumMaterials << " materials, best of 3 runs:\n";
+    for (const auto& loader : loaders)
+    {
+        double bestMs = 1e30;
+        for (int run = 0; run < 3; ++run)
+        {
+            cy::TriMesh mesh;
+            const auto start = std::chrono::steady_clock::now();
+            const bool loaded = loader.load(mesh, objFile.c_str());
+            bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+            CHECK(loaded);
+            if (run == 0)
+                CheckMesh(mesh, faceMtl);
+        }
+        std::cout << "  " << loader.name << " " << bestMs << " ms\n";
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+    return TestResult("MtlLookup_test");
+}
@@ -0,0 +1,205 @@
+// Tests of the PNG scanline kernels (cyPngDecoder.h): the kernels of every instruction set that the CPU
+// supports must match a byte by byte reference for all filter types, 1 to 4 bytes per pixel, and row
+// lengths from 0 to 256 bytes, and they must not write outside of the row.
+// With the argument "bench", the throughput of each kernel is printed as well.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cyPngDecoder.h"
+#include "TestCommon.h"
+
+static const char* const g_isaNames[] = { "scalar", "SSE2", "SSSE3", "AVX2" };
+static const char* const g_filterNames[] = { "None", "Sub", "Up", "Avg", "Paeth" };
+
+// Reference unfilter, written after the PNG specification
+static void ReferenceUnfilter(int filter, unsigned char* row, const unsigned char* prev, size_t rowBytes, int bpp)
+{
+    for (size_t i = 0; i < rowBytes; ++i)
+    {
+        const int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+        const int b = prev[i];
+        const int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+        int predictor = 0;
+        switch (filter)
+        {
+            case 1: predictor = a; break;
+            case 2: predictor = b; break;
+            case 3: predictor = (a + b) / 2; break;
+            case 4:
+            {
+                const int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+                predictor = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+                break;
+            }
+        }
+        row[i] = (unsigned char)(row[i] + predictor);
+    }
+}
+
+// Reference conversion of grey, grey-alpha, RGB and RGBA pixels to RGBA
+static void ReferenceToRGBA(unsigned char* rgba, const unsigned char* src, size_t numPixels, int channels)
+{
+    for (size_t i = 0; i < numPixels; ++i)
+    {
+        const unsigned char* s = src + i * channels;
+        unsigned char* d = rgba + i * 4;
+        d[0] = s[0];
+        d[1] = channels >= 3 ? s[1] : s[0];
+        d[2] = channels >= 3 ? s[2] : s[0];
+        d[3] = channels == 2 ? s[1] : (channels == 4 ? s[3] : 255);
+    }
+}
+
+static const size_t kGuard = 64;   // bytes after the output that must not change
+static const unsigned char kGuardValue = 0xA5;
+
+static bool GuardIntact(const std::vector<unsigned char>& buffer, size_t end)
+{
+    for (size_t i = end; i < end + kGuard; ++i)
+        if (buffer[i] != kGuardValue)
+            return false;
+    return true;
+}
+
+static void TestUnfilter(const cy::PngKernels& kernels, std::mt19937& rng)
+{
+    bool matches = true, inBounds = true;
+    std::vector<unsigned char> row, prev, expected;
+    for (int filter = 1; filter <= 4; ++filter)
+    {
+        for (int bpp = 1; bpp <= 4; ++bpp)
+        {
+            const cy::PngKernels::Unfilter unfilter = kernels.unfilter[filter][bpp - 1];
+            if (!unfilter)
+            {
+                matches = false;
+                continue;
+            }
+            for (size_t rowBytes = 0; rowBytes <= 256; rowBytes += bpp)
+            {
+                // Unaligned rows, and a zero previous row as for the first scanline
+                for (size_t offset = 0; offset < 4; ++offset)
+                {
+                    for (int zeroPrev = 0; zeroPrev < 2; ++zeroPrev)
+                    {
+                        row.assign(offset + rowBytes + kGuard, kGuardValue);
+                        prev.assign(offset + rowBytes + kGuard, 0);
+                        for (size_t i = 0; i < rowBytes; ++i)
+                        {
+                            row[offset + i] = (unsigned char)rng();
+                            prev[offset + i] = zeroPrev ? 0 : (unsigned char)rng();
+                        }
+                        expected.assign(row.begin() + offset, row.begin() + offset + rowBytes);
+                        ReferenceUnfilter(filter, expected.data(), prev.data() + offset, rowBytes, bpp);
+                        unfilter(row.data() + offset, prev.data() + offset, rowBytes);
+                        if (rowBytes > 0 && memcmp(row.data() + offset, expected.data(), rowBytes) != 0)
+                        {
+                            if (matches)
+                                std::cerr << g_isaNames[kernels.isa] << " " << g_filterNames[filter] << " bpp " << bpp << " row " << rowBytes << " bytes differs\n";
+                            matches = false;
+                        }
+                        inBounds = inBounds && GuardIntact(row, offset + rowBytes);
+                    }
+                }
+            }
+        }
+    }
+    CHECK(matches);
+    CHECK(inBounds);
+}
+
+static void TestToRGBA(const cy::PngKernels& kernels, std::mt19937& rng)
+{
+    bool matches = true, inBounds = true;
+    std::vector<unsigned char> src, rgba, expected;
+    for (int channels = 1; channels <= 4; ++channels)
+    {
+        for (size_t numPixels = 0; numPixels <= 200; ++numPixels)
+        {
+            for (size_t offset = 0; offset < 4; ++offset)
+            {
+                src.resize(offset + numPixels * channels);
+                for (unsigned char& c : src)
+                    c = (unsigned char)rng();
+                rgba.assign(offset + numPixels * 4 + kGuard, kGuardValue);
+                expected.resize(numPixels * 4);
+                ReferenceToRGBA(expected.data(), src.data() + offset, numPixels, channels);
+                kernels.toRGBA[channels - 1](rgba.data() + offset, src.data() + offset, numPixels);
+                if (numPixels > 0 && memcmp(rgba.data() + offset, expected.data(), numPixels * 4) != 0)
+                {
+                    if (matches)
+                        std::cerr << g_isaNames[kernels.isa] << " " << channels << " channels, " << numPixels << " pixels differ\n";
+                    matches = false;
+                }
+                inBounds = inBounds && GuardIntact(rgba, offset + numPixels * 4);
+            }
+        }
+    }
+    CHECK(matches);
+    CHECK(inBounds);
+}
+
+// Prints the throughput of the kernels on rows of a typical texture width
+static void Benchmark(const cy::PngKernels& kernels)
+{
+    const size_t width = 2048, numRows = 2048;
+    std::vector<unsigned char> rows(width * 4 * 2), src(width * 4), rgba(width * 4);
+    std::mt19937 rng(5);
+    for (unsigned char& c : rows)
+        c = (unsigned char)rng();
+    for (unsigned char& c : src)
+        c = (unsigned char)rng();
+    auto megabytesPerSecond = [](size_t bytes, std::chrono::steady_clock::time_point start)
+    {
+        return bytes / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / (1024.0 * 1024.0);
+    };
+
+    std::cout << g_isaNames[kernels.isa] << " unfilter MB/s (bpp 1 2 3 4):\n";
+    for (int filter = 1; filter <= 4; ++filter)
+    {
+        std::cout << "  " << g_filterNames[filter];
+        for (int bpp = 1; bpp <= 4; ++bpp)
+        {
+            const size_t rowBytes = width * bpp;
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < numRows; ++r)
+                kernels.unfilter[filter][bpp - 1](rows.data() + (r % 2) * rowBytes, rows.data() + ((r + 1) % 2) * rowBytes, rowBytes);
+            std::cout << " " << (int)megabytesPerSecond(rowBytes * numRows, start);
+        }
+        std::cout << "\n";
+    }
+    std::cout << g_isaNames[kernels.isa] << " to RGBA MB/s of output (channels 1 2 3 4):\n ";
+    for (int channels = 1; channels <= 4; ++channels)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < numRows; ++r)
+            kernels.toRGBA[channels - 1](rgba.data(), src.data(), width);
+        std::cout << " " << (int)megabytesPerSecond(width * 4 * numRows, start);
+    }
+    std::cout << "\n";
+    volatile unsigned char sink = rows[0] ^ rgba[0];
+    (void)sink;
+}
+
+int main(int argc, char** argv)
+{
+    const bool bench = argc > 1 && std::string(argv[1]) == "bench";
+    const cy::PngIsa best = cy::DetectPngIsa();
+    std::cout << "CPU instruction set: " << g_isaNames[best] << "\n";
+    std::mt19937 rng(6);
+    for (int isa = cy::PNG_ISA_SCALAR; isa <= best; ++isa)
+    {
+        const cy::PngKernels kernels = cy::PngKernels::Make((cy::PngIsa)isa);
+        CHECK(kernels.isa == isa);
+        TestUnfilter(kernels, rng);
+        TestToRGBA(kernels, rng);
+        if (bench)
+            Benchmark(kernels);
+    }
+    return TestResult("PngKernels_test");
+}
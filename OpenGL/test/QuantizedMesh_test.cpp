@@ -0,0 +1,197 @@
+// Round-trip tests of the quantized vertex format (cyQuantizedMesh.h): positions must be within half a
+// quantization step, normals within 0.01 degrees, and texture coordinates within the half float precision,
+// on random data and on the edge cases. The half float conversion is checked for every half value.
+
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "cyQuantizedMesh.h"
+#include "TestCommon.h"
+
+static bool IsNaN(float f) { return f != f; }
+
+// Vertex data with separate arrays, as given to QuantizedMesh::Build
+struct VertexData
+{
+    std::vector<float> positions, normals, texCoords;
+
+    unsigned int NumVertices() const { return (unsigned int)positions.size() / 3; }
+    void Add(const cy::Vec3f& p, const cy::Vec3f& n, const cy::Vec2f& t)
+    {
+        positions.insert(positions.end(), { p.x, p.y, p.z });
+        normals.insert(normals.end(), { n.x, n.y, n.z });
+        texCoords.insert(texCoords.end(), { t.x, t.y });
+    }
+};
+
+// Bounding box of the positions
+static void GetBounds(const VertexData& data, cy::Vec3f& boundMin, cy::Vec3f& boundMax)
+{
+    boundMin = cy::Vec3f(data.positions.data());
+    boundMax = boundMin;
+    for (unsigned int i = 1; i < data.NumVertices(); ++i)
+    {
+        const cy::Vec3f p(data.positions.data() + i * 3);
+        for (int j = 0; j < 3; ++j)
+        {
+            boundMin[j] = cy::Min(boundMin[j], p[j]);
+            boundMax[j] = cy::Max(boundMax[j], p[j]);
+        }
+    }
+}
+
+// Quantizes the data and checks every vertex against the bounds of the format, independently of IsAccurate()
+static cy::QuantizedMesh CheckRoundTrip(const VertexData& data)
+{
+    cy::Vec3f boundMin, boundMax;
+    GetBounds(data, boundMin, boundMax);
+    cy::QuantizedMesh mesh;
+    mesh.Build(data.positions.data(), data.normals.data(), data.texCoords.data(), data.NumVertices(), boundMin, boundMax);
+    CHECK(mesh.NumVertices() == data.NumVertices());
+
+    bool positionsOk = true, normalsOk = true, texCoordsOk = true;
+    for (unsigned int i = 0; i < mesh.NumVertices(); ++i)
+    {
+        // Half a step of each axis, with some room for the rounding of the dequantization
+        const cy::Vec3f p(data.positions.data() + i * 3), q = mesh.GetPosition(i);
+        for (int j = 0; j < 3; ++j)
+        {
+            const float halfStep = 0.5f * mesh.positionScale[j] / 32767.0f;
+            if (!(std::abs(q[j] - p[j]) <= halfStep * 1.01f + 1e-6f * std::abs(p[j])))
+                positionsOk = false;
+        }
+
+        const cy::Vec3f n(data.normals.data() + i * 3), d = mesh.GetNormal(i);
+        if (!(std::abs(d.Length() - 1) < 1e-5f))
+            normalsOk = false;
+        if (n.LengthSquared() > 0)
+        {
+            const float angle = std::atan2(d.Cross(n).Length(), d.Dot(n)) * 180.0f / cy::Pi<float>();
+            if (!(angle <= 0.01f))
+                normalsOk = false;
+        }
+
+        // Half a unit in the last place of the 11-bit significand of a half float
+        const cy::Vec2f t = mesh.GetTexCoord(i);
+        for (int j = 0; j < 2; ++j)
+        {
+            const float s = data.texCoords[i * 2 + j];
+            if (!(std::abs(t[j] - s) <= cy::Max(std::abs(s), 1.0f / 16384.0f) / 2048.0f))
+                texCoordsOk = false;
+        }
+    }
+    CHECK(positionsOk);
+    CHECK(normalsOk);
+    CHECK(texCoordsOk);
+
+    const cy::QuantizationError error = mesh.MeasureError(data.positions.data(), data.normals.data(), data.texCoords.data());
+    CHECK(mesh.IsAccurate(error));
+    return mesh;
+}
+
+static void TestRandom()
+{
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::normal_distribution<float> gaussian;
+    VertexData data;
+    for (int i = 0; i < 100000; ++i)
+    {
+        cy::Vec3f n(gaussian(rng), gaussian(rng), gaussian(rng));
+        n.Normalize();
+        data.Add(cy::Vec3f(uniform(rng) * 50.0f + 10.0f, uniform(rng) * 0.5f, uniform(rng) * 2000.0f), n,
+            cy::Vec2f(uniform(rng) * 4.0f, uniform(rng) * 0.01f));
+    }
+    CheckRoundTrip(data);
+}
+
+static void TestEdgeCases()
+{
+    // Zero normals decode to +z, flat boxes keep their constant coordinate, and the poles are exact
+    VertexData data;
+    data.Add(cy::Vec3f(0, 1, 3), cy::Vec3f(0, 0, 0), cy::Vec2f(0, 0));
+    data.Add(cy::Vec3f(1, 1, 3), cy::Vec3f(0, 0, 1), cy::Vec2f(1, 1));
+    data.Add(cy::Vec3f(1, 1, 3), cy::Vec3f(0, 0, -1), cy::Vec2f(-1, 0.5f));
+    data.Add(cy::Vec3f(0.5f, 1, 3), cy::Vec3f(1, 0, 0), cy::Vec2f(65504, -65504));
+    data.Add(cy::Vec3f(0.25f, 1, 3), cy::Vec3f(0, -1, 0), cy::Vec2f(1e-6f, -1e-7f));
+    data.Add(cy::Vec3f(0.75f, 1, 3), cy::Vec3f(0, 1e-3f, -1), cy::Vec2f(0.1f, 0.2f));
+    data.Add(cy::Vec3f(0.75f, 1, 3), cy::Vec3f(-1, -1, -1), cy::Vec2f(0.3f, 0.7f));
+    const cy::QuantizedMesh mesh = CheckRoundTrip(data);
+    CHECK(mesh.GetNormal(0) == cy::Vec3f(0, 0, 1));
+    CHECK(mesh.GetNormal(1) == cy::Vec3f(0, 0, 1));
+    CHECK(mesh.GetNormal(2) == cy::Vec3f(0, 0, -1));
+    for (unsigned int i = 0; i < mesh.NumVertices(); ++i)
+    {
+        CHECK(mesh.GetPosition(i).y == 1 && mesh.GetPosition(i).z == 3);
+        CHECK(!IsNaN(mesh.GetNormal(i).x) && !IsNaN(mesh.GetNormal(i).y) && !IsNaN(mesh.GetNormal(i).z));
+    }
+
+    // The ends of the bounding box map to the ends of the snorm range
+    CHECK(cy::FloatToSnorm16(-1.0f) == -32767 && cy::FloatToSnorm16(1.0f) == 32767 && cy::FloatToSnorm16(2.0f) == 32767);
+    CHECK(cy::Snorm16ToFloat(-32768) == -1.0f && cy::Snorm16ToFloat(-32767) == -1.0f && cy::Snorm16ToFloat(32767) == 1.0f);
+
+    // Normals close to the poles and the seams of the octahedron
+    VertexData seams;
+    std::mt19937 rng(8);
+    std::uniform_real_distribution<float> tiny(-1e-4f, 1e-4f);
+    for (int i = 0; i < 10000; ++i)
+    {
+        const float s = (i & 1) ? 1.0f : -1.0f;
+        cy::Vec3f n;
+        switch (i % 3)
+        {
+            case 0: n = cy::Vec3f(tiny(rng), tiny(rng), s); break;                          // near a pole
+            case 1: n = cy::Vec3f(s, tiny(rng), tiny(rng)); break;                          // on the z = 0 seam
+            case 2: n = cy::Vec3f(tiny(rng) + 0.5f, s * 0.5f, tiny(rng) - 0.70710678f); break;  // lower hemisphere
+        }
+        seams.Add(cy::Vec3f(float(i), 0, 0), n.GetNormalized(), cy::Vec2f(0, 0));
+    }
+    CheckRoundTrip(seams);
+}
+
+// Every half float converts to a float and back to itself, and floats round to the nearest half, ties to even
+static void TestHalfFloat()
+{
+    bool roundTrip = true, nanKept = true, ties = true, ordered = true;
+    for (unsigned int h = 0; h < 0x10000; ++h)
+    {
+        const float f = cy::HalfToFloat((uint16_t)h);
+        const bool isNaN = (h & 0x7C00) == 0x7C00 && (h & 0x3FF) != 0;
+        if (isNaN)
+        {
+            nanKept = nanKept && IsNaN(f) && IsNaN(cy::HalfToFloat(cy::FloatToHalf(f)));
+            continue;
+        }
+        roundTrip = roundTrip && cy::FloatToHalf(f) == h;
+
+        // The midpoint to the next half of larger magnitude rounds to the even one of the two
+        if ((h & 0x7FFF) < 0x7BFF)
+        {
+            const float next = cy::HalfToFloat((uint16_t)(h + 1));
+            const float mid = (f + next) * 0.5f;
+            const uint16_t even = (h & 1) ? (uint16_t)(h + 1) : (uint16_t)h;
+            ties = ties && cy::FloatToHalf(mid) == even;
+            ordered = ordered && cy::FloatToHalf(std::nextafter(mid, f)) == h && cy::FloatToHalf(std::nextafter(mid, next)) == (uint16_t)(h + 1);
+        }
+    }
+    CHECK(roundTrip);
+    CHECK(nanKept);
+    CHECK(ties);
+    CHECK(ordered);
+
+    // Overflow goes to infinity, and values below half the smallest subnormal go to zero
+    CHECK(cy::FloatToHalf(65520.0f) == 0x7C00 && cy::FloatToHalf(-1e10f) == 0xFC00);
+    CHECK(cy::FloatToHalf(65519.0f) == 0x7BFF);
+    CHECK(cy::FloatToHalf(std::ldexp(1.0f, -25)) == 0 && cy::FloatToHalf(std::ldexp(1.5f, -25)) == 1);
+    CHECK(cy::FloatToHalf(-0.0f) == 0x8000);
+}
+
+int main()
+{
+    TestRandom();
+    TestEdgeCases();
+    TestHalfFloat();
+    return TestResult("QuantizedMesh_test");
+}
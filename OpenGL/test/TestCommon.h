@@ -0,0 +1,34 @@
+//-------------------------------------------------------------------------------
+// Checks shared by the standalone tests of the cy headers.
+//
+// Each test is a single source file with its own main() that does not need OpenGL. It is built from this
+// directory, for example with "cl /std:c++17 /O2 /EHsc /I..\header MeshOptimizer_test.cpp", and returns a
+// nonzero exit code if a check fails.
+//-------------------------------------------------------------------------------
+
+#ifndef _TEST_COMMON_H_INCLUDED_
+#define _TEST_COMMON_H_INCLUDED_
+
+#include <iostream>
+
+static int g_numChecks = 0;
+static int g_numFailures = 0;
+
+// Counts the check and prints the expression and its location if it fails
+#define CHECK(expr) \
+    do { \
+        ++g_numChecks; \
+        if (!(expr)) { \
+            ++g_numFailures; \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " << #expr << "\n"; \
+        } \
+    } while (0)
+
+// Prints the number of checks and failures and returns the exit code of the test
+static int TestResult(const char* name)
+{
+    std::cout << name << ": " << g_numChecks << " checks, " << g_numFailures << " failed\n";
+    return g_numFailures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,161 @@
+// Tests of TriMesh::ComputeNormals (cyTriMesh.h): the result with one thread must match a serial reference
+// exactly, the result with 2 to 16 parts must match it within rounding, and angle weighting must give the
+// exact corner normals of a cube regardless of its triangulation.
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "cyTriMesh.h"
+#include "TestCommon.h"
+
+// The largest difference of a normal component between the parallel and the serial sums
+static const float kPartTolerance = 3.2e-7f;
+
+// A grid of w x h quads with random heights
+static void MakeBumpyGrid(cy::TriMesh& mesh, unsigned int w, unsigned int h)
+{
+    std::mt19937 rng(9);
+    std::uniform_real_distribution<float> height(-0.5f, 0.5f);
+    mesh.SetNumVertex((w + 1) * (h + 1));
+    for (unsigned int y = 0; y <= h; ++y)
+        for (unsigned int x = 0; x <= w; ++x)
+            mesh.V(y * (w + 1) + x).Set(float(x), float(y), height(rng));
+    mesh.SetNumFaces(w * h * 2);
+    for (unsigned int y = 0; y < h; ++y)
+    {
+        for (unsigned int x = 0; x < w; ++x)
+        {
+            const unsigned int v = y * (w + 1) + x, f = (y * w + x) * 2;
+            cy::TriMesh::TriFace& f0 = mesh.F(f);
+            cy::TriMesh::TriFace& f1 = mesh.F(f + 1);
+            f0.v[0] = v; f0.v[1] = v + 1; f0.v[2] = v + w + 2;
+            f1.v[0] = v; f1.v[1] = v + w + 2; f1.v[2] = v + w + 1;
+        }
+    }
+}
+
+// Area weighted normals summed in face order, as the serial code did
+static std::vector<cy::Vec3f> ReferenceNormals(const cy::TriMesh& mesh)
+{
+    std::vector<cy::Vec3f> normals(mesh.NV(), cy::Vec3f(0, 0, 0));
+    for (unsigned int i = 0; i < mesh.NF(); ++i)
+    {
+        const cy::TriMesh::TriFace& face = mesh.F(i);
+        const cy::Vec3f& p0 = mesh.V(face.v[0]);
+        const cy::Vec3f N = (mesh.V(face.v[1]) - p0) ^ (mesh.V(face.v[2]) - p0);
+        for (int c = 0; c < 3; ++c)
+            normals[face.v[c]] += N;
+    }
+    for (cy::Vec3f& n : normals)
+        n.Normalize();
+    return normals;
+}
+
+// The largest component difference of the computed normals from the given ones
+static float MaxDifference(const cy::TriMesh& mesh, const std::vector<cy::Vec3f>& normals)
+{
+    float maxDiff = 0;
+    for (unsigned int i = 0; i < mesh.NV(); ++i)
+        for (int j = 0; j < 3; ++j)
+            maxDiff = cy::Max(maxDiff, std::abs(mesh.VN(i)[j] - normals[i][j]));
+    return maxDiff;
+}
+
+static void TestParallelMatchesSerial()
+{
+    // 1.05M faces, so that up to 16 parts of at least 64K faces are used
+    cy::TriMesh mesh;
+    MakeBumpyGrid(mesh, 725, 725);
+    const std::vector<cy::Vec3f> reference = ReferenceNormals(mesh);
+
+    mesh.ComputeNormals(false, false, 1);
+    CHECK(mesh.NVN() == mesh.NV());
+    CHECK(MaxDifference(mesh, reference) == 0);
+    bool normalFaces = true;
+    for (unsigned int i = 0; i < mesh.NF(); ++i)
+        for (int c = 0; c < 3; ++c)
+            normalFaces = normalFaces && mesh.FN(i).v[c] == mesh.F(i).v[c];
+    CHECK(normalFaces);
+
+    float maxDiff = 0;
+    for (unsigned int numThreads = 2; numThreads <= 16; ++numThreads)
+    {
+        mesh.ComputeNormals(false, false, numThreads);
+        maxDiff = cy::Max(maxDiff, MaxDifference(mesh, reference));
+    }
+    std::cout << "Largest difference of 2 to 16 parts from the serial normals: " << maxDiff << "\n";
+    CHECK(maxDiff <= kPartTolerance);
+
+    // Angle weighting splits the faces in the same way
+    mesh.ComputeNormals(false, true, 1);
+    std::vector<cy::Vec3f> serialAngle(mesh.NV());
+    for (unsigned int i = 0; i < mesh.NV(); ++i)
+        serialAngle[i] = mesh.VN(i);
+    maxDiff = 0;
+    for (unsigned int numThreads : { 2u, 7u, 16u })
+    {
+        mesh.ComputeNormals(false, true, numThreads);
+        maxDiff = cy::Max(maxDiff, MaxDifference(mesh, serialAngle));
+    }
+    CHECK(maxDiff <= kPartTolerance);
+}
+
+// A unit cube whose first face is split along the other diagonal than the rest, so that the corners have
+// one triangle of some faces and two of others
+static void MakeCube(cy::TriMesh& mesh, bool clockwise)
+{
+    mesh.SetNumVertex(8);
+    for (unsigned int i = 0; i < 8; ++i)
+        mesh.V(i).Set(float(i & 1), float((i >> 1) & 1), float((i >> 2) & 1));
+    // The corners of each face in counter-clockwise order seen from outside
+    const unsigned int quads[6][4] = { { 0, 4, 6, 2 }, { 1, 3, 7, 5 }, { 0, 1, 5, 4 }, { 2, 6, 7, 3 }, { 0, 2, 3, 1 }, { 4, 5, 7, 6 } };
+    mesh.SetNumFaces(12);
+    for (unsigned int q = 0; q < 6; ++q)
+    {
+        const unsigned int* c = quads[q];
+        const unsigned int s = q == 0 ? 1 : 0;   // the diagonal is c[s] to c[s+2]
+        const unsigned int tris[2][3] = { { c[s], c[s + 1], c[s + 2] }, { c[s], c[s + 2], c[(s + 3) % 4] } };
+        for (unsigned int t = 0; t < 2; ++t)
+        {
+            cy::TriMesh::TriFace& face = mesh.F(q * 2 + t);
+            for (int k = 0; k < 3; ++k)
+                face.v[k] = tris[t][clockwise ? 2 - k : k];
+        }
+    }
+}
+
+static void TestAngleWeightedCube()
+{
+    for (int clockwise = 0; clockwise < 2; ++clockwise)
+    {
+        cy::TriMesh mesh;
+        MakeCube(mesh, clockwise != 0);
+
+        mesh.ComputeNormals(clockwise != 0, true);
+        float maxError = 0;
+        for (unsigned int i = 0; i < 8; ++i)
+        {
+            const cy::Vec3f expected = (mesh.V(i) * 2.0f - cy::Vec3f(1, 1, 1)) / std::sqrt(3.0f);
+            maxError = cy::Max(maxError, (mesh.VN(i) - expected).Length());
+        }
+        CHECK(maxError < 1e-6f);
+
+        // Area weighting favors the faces whose diagonal ends at the corner
+        mesh.ComputeNormals(clockwise != 0, false);
+        float maxSkew = 0;
+        for (unsigned int i = 0; i < 8; ++i)
+        {
+            const cy::Vec3f expected = (mesh.V(i) * 2.0f - cy::Vec3f(1, 1, 1)) / std::sqrt(3.0f);
+            maxSkew = cy::Max(maxSkew, (mesh.VN(i) - expected).Length());
+        }
+        CHECK(maxSkew > 0.1f);
+    }
+}
+
+int main()
+{
+    TestParallelMatchesSerial();
+    TestAngleWeightedCube();
+    return TestResult("TriMeshNormals_test");
+}